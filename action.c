@@ -50,6 +50,7 @@
 #include "error.h"
 #include "dprint.h"
 #include "route.h"
+#include "route_optimize.h"
 #include "parser/msg_parser.h"
 #include "ut.h"
 #include "sr_module.h"
@@ -902,9 +903,17 @@ int do_action(struct action* a, struct sip_msg* msg)
 			}
 
 			return_code=1;
-			adefault = NULL;
-			aitem = (struct action*)a->elem[1].u.data;
-			cmatch=0;
+			if (a->elem[2].type==SWITCH_IDX_ST) {
+				/* jump straight to the matching case */
+				adefault = ((struct switch_idx*)a->elem[2].u.data)->deflt;
+				aitem = switch_idx_lookup(
+					(struct switch_idx*)a->elem[2].u.data, &val);
+				cmatch = aitem ? 1 : 0;
+			} else {
+				adefault = NULL;
+				aitem = (struct action*)a->elem[1].u.data;
+				cmatch=0;
+			}
 			while(aitem)
 			{
 				if((unsigned char)aitem->type==DEFAULT_T)
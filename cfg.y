@@ -91,6 +91,7 @@
 #include "route_struct.h"
 #include "globals.h"
 #include "route.h"
+#include "route_optimize.h"
 #include "dprint.h"
 #include "cfg_pp.h"
 #include "sr_module.h"
@@ -277,6 +278,7 @@ extern int cfg_parse_only_routes;
 %token XLOG_PRINT_LEVEL
 %token XLOG_LEVEL
 %token PV_PRINT_BUF_SIZE
+%token SCRIPT_OPTIMIZE
 
 /* config vars. */
 %token DEBUG_MODE
@@ -309,6 +311,8 @@ extern int cfg_parse_only_routes;
 %token MEM_WARMING_ENABLED
 %token MEM_WARMING_PATTERN_FILE
 %token MEM_WARMING_PERCENTAGE
+%token SHM_CACHE_SIZE
+%token SHM_CACHE_BATCH
 %token RPM_MEM_FILE
 %token RPM_MEM_SIZE
 %token MEMLOG
@@ -427,6 +431,8 @@ extern int cfg_parse_only_routes;
 %token COLON
 %token ANY
 %token ANYCAST
+%token REUSE_PORT
+%token PIN_WORKERS
 %token SCRIPTVARERR
 %token SCALE_UP_TO
 %token SCALE_DOWN_TO
@@ -633,6 +639,12 @@ listen_id_def:	listen_id					{ IFOR();
 socket_def_param: ANYCAST { IFOR();
 					p_tmp.flags |= SI_IS_ANYCAST;
 					}
+				| REUSE_PORT { IFOR();
+					p_tmp.flags |= SI_REUSE_PORT;
+					}
+				| PIN_WORKERS { IFOR();
+					p_tmp.flags |= SI_PIN_WORKERS;
+					}
 				| USE_WORKERS NUMBER { IFOR();
 					p_tmp.workers=$2;
 					}
@@ -870,6 +882,18 @@ assign_stm: LOGLEVEL EQUAL snumber { IFOR();
 				"for HP_MALLOC\n");
 			#endif
 			}
+		| SHM_CACHE_SIZE EQUAL NUMBER { IFOR();
+			if ($3 < 0)
+				yyerror("shm_cache_size has to be a positive number (KB)");
+			shm_cache_size=$3;
+			}
+		| SHM_CACHE_SIZE EQUAL error { yyerror("number expected"); }
+		| SHM_CACHE_BATCH EQUAL NUMBER { IFOR();
+			if ($3 < 1 || $3 > 1024)
+				yyerror("shm_cache_batch has to be between 1 and 1024");
+			shm_cache_batch=$3;
+			}
+		| SHM_CACHE_BATCH EQUAL error { yyerror("number expected"); }
 		| RPM_MEM_FILE EQUAL STRING { IFOR();
 			rpm_mem_file = $3;
 			}
@@ -1058,6 +1082,9 @@ assign_stm: LOGLEVEL EQUAL snumber { IFOR();
 		| XLOG_LEVEL EQUAL NUMBER { IFOR();
 							*xlog_level = $3; }
 		| XLOG_LEVEL EQUAL error { yyerror("number expected"); }
+		| SCRIPT_OPTIMIZE EQUAL NUMBER { IFOR();
+							script_optimize = $3; }
+		| SCRIPT_OPTIMIZE EQUAL error { yyerror("boolean value expected"); }
 		| SOCKET EQUAL socket_def { IFOR();
 							if (add_listening_socket($3)!=0){
 								LM_CRIT("cfg. parser: failed"
@@ -29,6 +29,7 @@
 #include "daemonize.h"
 #include "pt.h"
 #include "route.h"
+#include "route_optimize.h"
 #include "reactor_defs.h"
 #include "cfg_pp.h"
 #include "cfg_reload.h"
@@ -376,6 +377,11 @@ static void routes_reload_per_proc(int sender, void *param)
 		goto error;
 	}
 
+	if (optimize_rls()<0) {
+		LM_ERR("optimizing routes failed, abording\n");
+		goto error;
+	}
+
 	sroutes = sr_bk;
 
 	/* keep the parsed routes, waiting for the confirmation to switch */
@@ -511,6 +517,11 @@ int reload_routing_script(void)
 		goto error;
 	}
 
+	if (optimize_rls()<0) {
+		LM_ERR("optimizing routes failed, abording\n");
+		goto error;
+	}
+
 	/* trigger module's validation functions to check if the reload of this 
 	 * new route set is "approved" */
 	if (!modules_validate_reload()) {
@@ -58,22 +58,25 @@ stat_var* bad_URIs;
 stat_var* unsupported_methods;
 stat_var* bad_msg_hdr;
 stat_var* slow_msgs;
+stat_var* ipc_enq_fails;
 
 
 stat_export_t core_stats[] = {
-	{"rcv_requests" ,         0,  &rcv_reqs              },
-	{"rcv_replies" ,          0,  &rcv_rpls              },
-	{"fwd_requests" ,         0,  &fwd_reqs              },
-	{"fwd_replies" ,          0,  &fwd_rpls              },
-	{"drop_requests" ,        0,  &drp_reqs              },
-	{"drop_replies" ,         0,  &drp_rpls              },
-	{"err_requests" ,         0,  &err_reqs              },
-	{"err_replies" ,          0,  &err_rpls              },
+	{"rcv_requests" ,         STAT_PER_PROC,  &rcv_reqs  },
+	{"rcv_replies" ,          STAT_PER_PROC,  &rcv_rpls  },
+	{"fwd_requests" ,         STAT_PER_PROC,  &fwd_reqs  },
+	{"fwd_replies" ,          STAT_PER_PROC,  &fwd_rpls  },
+	{"drop_requests" ,        STAT_PER_PROC,  &drp_reqs  },
+	{"drop_replies" ,         STAT_PER_PROC,  &drp_rpls  },
+	{"err_requests" ,         STAT_PER_PROC,  &err_reqs  },
+	{"err_replies" ,          STAT_PER_PROC,  &err_rpls  },
 	{"bad_URIs_rcvd",         0,  &bad_URIs              },
 	{"unsupported_methods",   0,  &unsupported_methods   },
 	{"bad_msg_hdr",           0,  &bad_msg_hdr           },
 	{"slow_messages" ,        0,  &slow_msgs             },
 	{"timestamp",  STAT_IS_FUNC, (stat_var**)get_ticks   },
+	{"ipc_queued_jobs", STAT_IS_FUNC, (stat_var**)ipc_get_queued_jobs},
+	{"ipc_enqueue_failures",  0,  &ipc_enq_fails         },
 	{0,0,0}
 };
 
@@ -77,6 +77,9 @@ extern stat_var* bad_msg_hdr;
 /*! \brief SIP message processing which exceeded 'threshold' duration */
 extern stat_var* slow_msgs;
 
+/*! \brief IPC jobs dropped because of a full destination queue */
+extern stat_var* ipc_enq_fails;
+
 #ifdef PKG_MALLOC
 int init_pkg_stats(int no_procs);
 #endif
@@ -277,6 +277,22 @@ typedef int (*db_last_inserted_id_f) (const db_con_t* _h);
 typedef int (*db_insert_update_f) (const db_con_t* _h, const db_key_t* _k,
 				const db_val_t* _v, const int _n);
 
+/**
+ * \brief Insert several rows into specified table, update on duplicate key.
+ *
+ * The multi-row form of db_insert_update_f: the rows are written with as few
+ * INSERT ... ON DUPLICATE KEY UPDATE statements as the query buffer allows.
+ * \param _h structure representing database connection
+ * \param _k key names, the same for all the rows
+ * \param _v values of the keys, _n for each row, one row after the other
+ * \param _n number of key=value pairs of a row
+ * \param _r number of rows
+ * \return returns the number of statements used if everything is OK,
+ * otherwise returns value < 0
+ */
+typedef int (*db_insert_update_multi_f) (const db_con_t* _h, const db_key_t* _k,
+				const db_val_t* _v, const int _n, const int _r);
+
 /**
  * \brief Asynchronous raw SQL query on a separate DB connection.
  *		  Returns immediately.
@@ -356,6 +372,7 @@ typedef struct db_func {
 	db_replace_f      replace;       /* Replace row in a table */
 	db_last_inserted_id_f  last_inserted_id;  /* Retrieve the last inserted ID in a table */
 	db_insert_update_f     insert_update;     /* Insert into table, update on duplicate key */
+	db_insert_update_multi_f insert_update_multi; /* Same as insert_update, for several rows */
 	db_async_raw_query_f   async_raw_query;   /* Starts an asynchronous raw query */
 	db_async_resume_f      async_resume;      /* Called on progress or completed query */
 	db_async_free_result_f async_free_result; /* Clean up after an async query */
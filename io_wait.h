@@ -57,8 +57,12 @@
 #include <errno.h>
 #include <string.h>
 #ifdef HAVE_SIGIO_RT
+#ifndef __USE_GNU
 #define __USE_GNU /* or else F_SETSIG won't be included */
+#endif
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE /* define this as well */
+#endif
 #include <sys/types.h> /* recv */
 #include <sys/socket.h> /* recv */
 #include <signal.h> /* sigprocmask, sigwait a.s.o */
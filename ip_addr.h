@@ -88,7 +88,7 @@ union sockaddr_union{
 
 
 enum si_flags { SI_NONE=0, SI_IS_IP=1, SI_IS_LO=2, SI_IS_MCAST=4,
-	SI_IS_ANYCAST=8 };
+	SI_IS_ANYCAST=8, SI_REUSE_PORT=16, SI_PIN_WORKERS=32 };
 
 struct receive_info {
 	struct ip_addr src_ip;
@@ -165,6 +165,7 @@ struct socket_id {
 
 /* check if a socket_info is marked as anycast */
 #define is_anycast(_si) (_si->flags & SI_IS_ANYCAST)
+#define is_reuse_port(_si) (_si->flags & SI_REUSE_PORT)
 
 
 struct net* mk_net(struct ip_addr* ip, struct ip_addr* mask);
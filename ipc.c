@@ -21,15 +21,23 @@
 
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
 #include "ipc.h"
 #include "dprint.h"
 #include "mem/mem.h"
+#include "mem/shm_mem.h"
+#include "core_stats.h"
 
 #include <fcntl.h>
 
+#ifdef __OS_linux
+#include <sys/eventfd.h>
+#define IPC_USE_EVENTFD
+#endif
+
 #define IPC_HANDLER_NAME_MAX  32
 typedef struct _ipc_handler {
 	/* handler function */
@@ -48,6 +56,34 @@ typedef struct _ipc_job {
 	void *payload2;
 } ipc_job;
 
+/* per-process queue of jobs - a bounded MPSC ring (any process may push,
+ * only the owner process pops), based on D. Vyukov's sequenced cells */
+#define IPC_QUEUE_SIZE   2048  /* must be a power of 2 */
+#define IPC_QUEUE_MASK   (IPC_QUEUE_SIZE - 1)
+
+/* max number of jobs handled at once by ipc_handle_job() */
+#define IPC_QUEUE_BATCH  64
+
+/* how long (~usecs) to wait for a full queue to be drained */
+#define IPC_QUEUE_FULL_RETRIES  1000
+#define IPC_QUEUE_FULL_WAIT     100
+
+struct ipc_queue_cell {
+	unsigned int seq;
+	ipc_job job;
+};
+
+struct ipc_queue {
+	/* producers side */
+	unsigned int enq_pos __attribute__((aligned(64)));
+	/* consumer side */
+	unsigned int deq_pos __attribute__((aligned(64)));
+	/* set by the consumer when it has nothing more to do; the first
+	 * producer to reset it has to ring the doorbell */
+	int idle;
+	struct ipc_queue_cell cells[IPC_QUEUE_SIZE] __attribute__((aligned(64)));
+};
+
 static ipc_handler *ipc_handlers = NULL;
 static unsigned int ipc_handlers_no = 0;
 
@@ -96,17 +132,151 @@ int init_ipc(void)
 }
 
 
+static struct ipc_queue *ipc_new_queue(void)
+{
+	struct ipc_queue *q;
+	int i;
+
+	q = shm_malloc(sizeof *q);
+	if (!q)
+		return NULL;
+
+	memset(q, 0, sizeof *q);
+	for (i = 0; i < IPC_QUEUE_SIZE; i++)
+		q->cells[i].seq = i;
+	q->idle = 1;
+
+	return q;
+}
+
+
+static int ipc_new_doorbell(int *fds)
+{
+#ifdef IPC_USE_EVENTFD
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK);
+	return fds[0] < 0 ? -1 : 0;
+#else
+	if (pipe(fds) < 0)
+		return -1;
+
+	/* a full doorbell pipe is as good as a rang one */
+	if (fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL)|O_NONBLOCK) == -1 ||
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL)|O_NONBLOCK) == -1)
+		return -1;
+
+	return 0;
+#endif
+}
+
+
+static inline void ipc_ring_doorbell(int fd)
+{
+#ifdef IPC_USE_EVENTFD
+	uint64_t one = 1;
+#else
+	char one = 1;
+#endif
+
+again:
+	if (write(fd, &one, sizeof one) < 0) {
+		if (errno == EINTR)
+			goto again;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			LM_ERR("failed to ring IPC doorbell on %d: %s\n",
+				fd, strerror(errno));
+	}
+}
+
+
+static inline void ipc_clear_doorbell(int fd)
+{
+#ifdef IPC_USE_EVENTFD
+	uint64_t cnt;
+
+	while (read(fd, &cnt, sizeof cnt) < 0 && errno == EINTR) ;
+#else
+	char buf[64];
+
+	while (read(fd, buf, sizeof buf) > 0) ;
+#endif
+}
+
+
+static inline int ipc_queue_push(struct ipc_queue *q, ipc_job *job)
+{
+	struct ipc_queue_cell *cell;
+	unsigned int pos, seq;
+	int diff;
+
+	pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &q->cells[pos & IPC_QUEUE_MASK];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (int)(seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* full */
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->job = *job;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+static inline int ipc_queue_pop(struct ipc_queue *q, ipc_job *job)
+{
+	struct ipc_queue_cell *cell;
+	unsigned int pos = q->deq_pos;
+
+	cell = &q->cells[pos & IPC_QUEUE_MASK];
+	if ((int)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1)) < 0)
+		return 0;
+
+	*job = cell->job;
+	__atomic_store_n(&cell->seq, pos + IPC_QUEUE_SIZE, __ATOMIC_RELEASE);
+	__atomic_store_n(&q->deq_pos, pos + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+/* consumer side only - checks if the next job is published */
+static inline int ipc_queue_empty(struct ipc_queue *q)
+{
+	unsigned int pos = q->deq_pos;
+
+	return (int)(__atomic_load_n(&q->cells[pos & IPC_QUEUE_MASK].seq,
+		__ATOMIC_SEQ_CST) - (pos + 1)) < 0;
+}
+
+
 int create_ipc_pipes( int proc_no )
 {
 	int i;
 
 	for( i=0 ; i<proc_no ; i++ ) {
-		if (pipe(pt[i].ipc_pipe_holder)<0) {
+		if (ipc_new_doorbell(pt[i].ipc_pipe_holder)<0) {
 			LM_ERR("failed to create IPC pipe for process %d, err %d/%s\n",
 				i, errno, strerror(errno));
 			return -1;
 		}
 
+		pt[i].ipc_queue = ipc_new_queue();
+		if (!pt[i].ipc_queue) {
+			LM_ERR("failed to create IPC queue for process %d\n", i);
+			return -1;
+		}
+
 		if (pipe(pt[i].ipc_sync_pipe_holder)<0) {
 			LM_ERR("failed to create IPC sync pipe for process %d, err %d/%s\n",
 				i, errno, strerror(errno));
@@ -179,9 +349,48 @@ again:
 	return 0;
 }
 
+static int __ipc_queue_job(int dst_proc, ipc_handler_type type,
+												void *payload1, void *payload2)
+{
+	struct ipc_queue *q = pt[dst_proc].ipc_queue;
+	int fd = IPC_FD_WRITE(dst_proc);
+	ipc_job job;
+	int i;
+
+	if (fd < 0) {
+		LM_ERR("sending job type %d[%s] failed: process %d has no IPC\n",
+			type, ipc_handlers[type].name, dst_proc);
+		return -1;
+	}
+
+	job.snd_proc = (short)process_no;
+	job.handler_type = type;
+	job.payload1 = payload1;
+	job.payload2 = payload2;
+
+	for (i = 0; ipc_queue_push(q, &job) < 0; i++) {
+		if (i == IPC_QUEUE_FULL_RETRIES) {
+			update_stat(ipc_enq_fails, 1);
+			LM_ERR("sending job type %d[%s] failed: IPC queue of process "
+				"%d is full\n", type, ipc_handlers[type].name, dst_proc);
+			return -1;
+		}
+		/* make sure the consumer is awake while waiting for it */
+		if (i == 0)
+			ipc_ring_doorbell(fd);
+		usleep(IPC_QUEUE_FULL_WAIT);
+	}
+
+	/* only ring if the consumer went idle in the meantime */
+	if (__atomic_exchange_n(&q->idle, 0, __ATOMIC_SEQ_CST))
+		ipc_ring_doorbell(fd);
+
+	return 0;
+}
+
 int ipc_send_job(int dst_proc, ipc_handler_type type, void *payload)
 {
-	return __ipc_send_job(IPC_FD_WRITE(dst_proc), type, payload, NULL);
+	return __ipc_queue_job(dst_proc, type, payload, NULL);
 }
 
 int ipc_dispatch_job(ipc_handler_type type, void *payload)
@@ -191,7 +400,7 @@ int ipc_dispatch_job(ipc_handler_type type, void *payload)
 
 int ipc_send_rpc(int dst_proc, ipc_rpc_f *rpc, void *param)
 {
-	return __ipc_send_job(IPC_FD_WRITE(dst_proc), ipc_rpc_type, rpc, param);
+	return __ipc_queue_job(dst_proc, ipc_rpc_type, rpc, param);
 }
 
 int ipc_dispatch_rpc( ipc_rpc_f *rpc, void *param)
@@ -233,11 +442,96 @@ again:
 	return 0;
 }
 
+static inline void ipc_run_job(ipc_job *job)
+{
+	LM_DBG("received job type %d[%s] from process %d\n",
+		job->handler_type, ipc_handlers[job->handler_type].name,
+		job->snd_proc);
+
+	/* custom handling for RPC type */
+	if (job->handler_type==ipc_rpc_type) {
+		((ipc_rpc_f*)job->payload1)( job->snd_proc, job->payload2);
+	} else {
+		/* generic registered type */
+		ipc_handlers[job->handler_type].func( job->snd_proc, job->payload1);
+	}
+}
+
+
+/* runs up to @max jobs (0 - no limit) from the queue of the current process;
+ * if jobs are left behind, the doorbell is rang again so that the reactor
+ * gets back here on its next iteration */
+static void ipc_handle_queued_jobs(int fd, int max)
+{
+	struct ipc_queue *q = pt[process_no].ipc_queue;
+	ipc_job job;
+	int n = 0;
+
+	ipc_clear_doorbell(fd);
+
+	for (;;) {
+		while (ipc_queue_pop(q, &job)) {
+			ipc_run_job(&job);
+			if (++n == max) {
+				ipc_ring_doorbell(fd);
+				return;
+			}
+		}
+
+		__atomic_store_n(&q->idle, 1, __ATOMIC_SEQ_CST);
+		if (ipc_queue_empty(q))
+			return;
+
+		/* a job sneaked in; if its producer saw us idle, it rang the
+		 * doorbell already and we will get back here anyhow */
+		if (!__atomic_exchange_n(&q->idle, 0, __ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+
+void ipc_reset_queue(int proc_no)
+{
+	struct ipc_queue *q = pt[proc_no].ipc_queue;
+
+	/* jobs left behind by a previous owner of the slot should not wait
+	 * for a doorbell which may never come */
+	if (__atomic_load_n(&q->enq_pos, __ATOMIC_SEQ_CST) == q->deq_pos) {
+		__atomic_store_n(&q->idle, 1, __ATOMIC_SEQ_CST);
+	} else {
+		__atomic_store_n(&q->idle, 0, __ATOMIC_SEQ_CST);
+		ipc_ring_doorbell(pt[proc_no].ipc_pipe_holder[1]);
+	}
+}
+
+
+unsigned long ipc_get_queued_jobs(void *foo)
+{
+	unsigned long n = 0;
+	struct ipc_queue *q;
+	int i;
+
+	for (i = 0; i < counted_max_processes; i++) {
+		if (pt[i].pid == -1 || !(q = pt[i].ipc_queue))
+			continue;
+		n += __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED) -
+			__atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+	}
+
+	return n;
+}
+
+
 void ipc_handle_job(int fd)
 {
 	ipc_job job;
 	int n;
 
+	if (fd == IPC_FD_READ_SELF) {
+		ipc_handle_queued_jobs(fd, IPC_QUEUE_BATCH);
+		return;
+	}
+
 	/* read one IPC job from the pipe; even if the read is blocking,
 	 * we are here triggered from the reactor, on a READ event, so 
 	 * we shouldn;t ever block */
@@ -249,16 +543,7 @@ void ipc_handle_job(int fd)
 		return;
 	}
 
-	LM_DBG("received job type %d[%s] from process %d\n",
-		job.handler_type, ipc_handlers[job.handler_type].name, job.snd_proc);
-
-	/* custom handling for RPC type */
-	if (job.handler_type==ipc_rpc_type) {
-		((ipc_rpc_f*)job.payload1)( job.snd_proc, job.payload2);
-	} else {
-		/* generic registered type */
-		ipc_handlers[job.handler_type].func( job.snd_proc, job.payload1);
-	}
+	ipc_run_job(&job);
 
 	return;
 }
@@ -268,6 +553,11 @@ void ipc_handle_all_pending_jobs(int fd)
 {
 	char buf;
 
+	if (fd == IPC_FD_READ_SELF) {
+		ipc_handle_queued_jobs(fd, 0);
+		return;
+	}
+
 	while ( recv(fd, &buf, 1, MSG_DONTWAIT|MSG_PEEK)==1 )
 		ipc_handle_job(fd);
 }
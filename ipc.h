@@ -127,6 +127,14 @@ int init_ipc(void);
 int create_ipc_pipes(int proc_no);
 
 
+/* to be called when a new process takes over the "proc_no" slot */
+void ipc_reset_queue(int proc_no);
+
+
+/* number of IPC jobs queued and not yet handled, across all processes */
+unsigned long ipc_get_queued_jobs(void *foo);
+
+
 /* required by the IPC PIPE macros */
 #include "pt.h"
 
@@ -105,6 +105,7 @@
 #include "dprint.h"
 #include "daemonize.h"
 #include "route.h"
+#include "route_optimize.h"
 #include "bin_interface.h"
 #include "globals.h"
 #include "mem/mem.h"
@@ -1220,6 +1221,11 @@ try_again:
 	/* shm statistics, module stat groups, memory warming */
 	init_shm_post_yyparse();
 
+	if (shm_cache_init() < 0) {
+		LM_ERR("failed to initialize the shm cache\n");
+		goto error;
+	}
+
 	if (config_check>1 && check_rls()!=0) {
 		LM_ERR("bad function call in config file\n");
 		return ret;
@@ -1468,6 +1474,11 @@ try_again:
 		goto error;
 	}
 
+	if (optimize_rls()!=0) {
+		LM_ERR("failed to optimize the routing script\n");
+		goto error;
+	}
+
 	if (init_log_level() != 0) {
 		LM_ERR("failed to init logging levels\n");
 		goto error;
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "../dprint.h"
+#include "msg_arena.h"
+
+#define MSG_ARENA_ALIGN  (sizeof(long long))
+#define msg_arena_round(_s) \
+	(((_s) + MSG_ARENA_ALIGN - 1) & ~(MSG_ARENA_ALIGN - 1))
+
+struct msg_arena msg_arena;
+
+
+static struct msg_arena_block *msg_arena_new_block(unsigned long size)
+{
+	struct msg_arena_block *b;
+
+	if (size < MSG_ARENA_BLOCK_SIZE)
+		size = MSG_ARENA_BLOCK_SIZE;
+
+	b = pkg_malloc(sizeof *b + size);
+	if (!b) {
+		LM_ERR("oom for a %lu bytes msg arena block\n", size);
+		return NULL;
+	}
+
+	b->pos = b->data;
+	b->end = b->data + size;
+	b->next = msg_arena.blocks;
+	msg_arena.blocks = b;
+
+	return b;
+}
+
+
+int msg_arena_bind(struct sip_msg *msg)
+{
+	if (msg_arena.owner)
+		return -1;
+
+	msg_arena.owner = msg;
+	msg_arena.active = 0;
+	return 0;
+}
+
+
+void msg_arena_release(struct sip_msg *msg)
+{
+	struct msg_arena_block *b;
+
+	if (!msg || msg != msg_arena.owner)
+		return;
+
+	/* keep a single regular block around for the next message */
+	while ((b = msg_arena.blocks) && (b->next ||
+	(unsigned long)(b->end - b->data) != MSG_ARENA_BLOCK_SIZE)) {
+		msg_arena.blocks = b->next;
+		pkg_free(b);
+	}
+
+	if (b)
+		b->pos = b->data;
+
+	msg_arena.owner = NULL;
+	msg_arena.active = 0;
+}
+
+
+void *msg_arena_get(unsigned long size)
+{
+	struct msg_arena_block *b;
+	void *p;
+
+	if (!msg_arena.owner)
+		return pkg_malloc(size);
+
+	size = msg_arena_round(size);
+
+	b = msg_arena.blocks;
+	if (!b || b->pos + size > b->end) {
+		b = msg_arena_new_block(size);
+		if (!b)
+			return NULL;
+	}
+
+	p = b->pos;
+	b->pos += size;
+
+	return p;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Per-process bump allocator for the structures living exactly as long as
+ * the SIP message currently being processed by receive_msg() (header
+ * fields, the Via/To/CSeq bodies parsed along with them and the lumps
+ * anchored on the message).
+ *
+ * The arena is bound to a single message at a time. Allocations are only
+ * carved from it while parsing that message (see msg_arena_enter()) or when
+ * the caller explicitly asks for it; everything else keeps using pkg. Any
+ * object which may have come from the arena must be released with
+ * msg_arena_free(), which is a no-op for arena chunks and a pkg_free() for
+ * everything else. The whole arena is reset in one go once the message is
+ * destroyed.
+ */
+
+#ifndef _MEM_MSG_ARENA_H
+#define _MEM_MSG_ARENA_H
+
+#include "mem.h"
+
+/* size of a regular arena block; the first block is kept between messages,
+ * any additional one goes back to pkg when the arena is reset */
+#define MSG_ARENA_BLOCK_SIZE  (16*1024)
+
+struct sip_msg;
+
+struct msg_arena_block {
+	struct msg_arena_block *next;
+	char *pos;
+	char *end;
+	char data[0];
+};
+
+struct msg_arena {
+	struct sip_msg *owner;   /* message the arena is bound to */
+	int active;              /* allocations go to the arena */
+	struct msg_arena_block *blocks;  /* current block first */
+};
+
+extern struct msg_arena msg_arena;
+
+/* binds the arena to @msg; returns -1 if it is already in use */
+int msg_arena_bind(struct sip_msg *msg);
+
+/* releases everything allocated for @msg and unbinds the arena */
+void msg_arena_release(struct sip_msg *msg);
+
+/* carves @size bytes from the arena (plain pkg chunk if the arena is not
+ * bound); returns NULL if no more pkg memory is available */
+void *msg_arena_get(unsigned long size);
+
+/* routes the allocations done until msg_arena_leave() to the arena,
+ * if @msg is its owner; returns the previous state */
+static inline int msg_arena_enter(struct sip_msg *msg)
+{
+	int prev = msg_arena.active;
+
+	msg_arena.active = (msg && msg == msg_arena.owner);
+	return prev;
+}
+
+static inline void msg_arena_leave(int prev)
+{
+	msg_arena.active = prev;
+}
+
+static inline int msg_arena_owns(void *p)
+{
+	struct msg_arena_block *b;
+
+	if (!msg_arena.owner)
+		return 0;
+
+	for (b = msg_arena.blocks; b; b = b->next)
+		if ((char *)p >= b->data && (char *)p < b->end)
+			return 1;
+
+	return 0;
+}
+
+/* arena chunk if a message scope is active, pkg chunk otherwise */
+#define msg_arena_malloc(_size) \
+	(msg_arena.active ? msg_arena_get(_size) : pkg_malloc(_size))
+
+/* arena chunk if @_msg owns the arena, pkg chunk otherwise */
+#define msg_arena_alloc(_msg, _size) \
+	((_msg) && (_msg) == msg_arena.owner ? \
+		msg_arena_get(_size) : pkg_malloc(_size))
+
+/* arena chunk if @_ptr lives in the arena, pkg chunk otherwise */
+#define msg_arena_alloc_near(_ptr, _size) \
+	(msg_arena_owns(_ptr) ? msg_arena_get(_size) : pkg_malloc(_size))
+
+#define msg_arena_free(_p) \
+	do { \
+		if (!msg_arena_owns(_p)) \
+			pkg_free(_p); \
+	} while (0)
+
+#endif /* _MEM_MSG_ARENA_H */
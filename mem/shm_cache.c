@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "shm_mem.h"
+#include "shm_cache.h"
+
+int shm_cache_size = 0;
+int shm_cache_batch = 16;
+int shm_cache_on;
+
+#ifdef DBG_MALLOC
+#define CACHE_DBG_ARGS , const char *file, const char *func, unsigned int line
+#define CACHE_DBG_PASS , file, func, line
+#define CACHE_DBG_HERE , __FILE__, __FUNCTION__, __LINE__
+#else
+#define CACHE_DBG_ARGS
+#define CACHE_DBG_PASS
+#define CACHE_DBG_HERE
+#endif
+
+/* the free chunks are linked through their first bytes */
+#define chunk_next(_p) (*(void **)(_p))
+
+struct shm_cache_class {
+	void *chunks;
+	unsigned int no;
+};
+
+/* shared by all the processes, only updated under the allocator lock */
+struct shm_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long flushes;
+	unsigned long size;
+};
+
+static struct shm_cache_stats *cache_stats;
+
+static unsigned int class_size[SHM_CACHE_CLASSES];
+static unsigned long (*frag_size)(void *p);
+static unsigned long cache_limit;
+
+/* per process */
+static struct shm_cache_class cache[SHM_CACHE_CLASSES];
+static unsigned long cached;      /* bytes currently cached */
+static unsigned long published;   /* "cached" as last added to the stats */
+static unsigned long hits;        /* not yet added to the stats */
+
+
+/* the class of a request, i.e. the smallest one holding @size bytes */
+static inline int size_class(unsigned long size)
+{
+	int b;
+
+	if (size <= 64)
+		return size ? (size - 1) >> 4 : 0;
+
+	b = sizeof(long) * 8 - 1 - __builtin_clzl(size - 1);
+	return 4 + (b - 6) * 4 + (((size - 1) >> (b - 2)) & 3);
+}
+
+
+/* both must be called under the allocator lock */
+static inline void publish_stats(void)
+{
+	cache_stats->hits += hits;
+	cache_stats->size += cached - published;
+	hits = 0;
+	published = cached;
+}
+
+static void drain_class(struct shm_cache_class *c, unsigned int keep
+		CACHE_DBG_ARGS)
+{
+	void *p;
+
+	while (c->no > keep) {
+		p = c->chunks;
+		c->chunks = chunk_next(p);
+		c->no--;
+		cached -= frag_size(p);
+		SHM_FREE(shm_block, p CACHE_DBG_PASS);
+	}
+}
+
+
+int shm_cache_init(void)
+{
+	int i, b;
+
+	if (shm_cache_size <= 0)
+		return 0;
+
+#ifdef INLINE_ALLOC
+#if defined F_MALLOC
+	frag_size = fm_frag_size;
+#elif defined Q_MALLOC
+	frag_size = qm_frag_size;
+#endif
+#else
+	switch (mem_allocator_shm) {
+#ifdef F_MALLOC
+	case MM_F_MALLOC:
+	case MM_F_MALLOC_DBG:
+		frag_size = fm_frag_size;
+		break;
+#endif
+#ifdef Q_MALLOC
+	case MM_Q_MALLOC:
+	case MM_Q_MALLOC_DBG:
+		frag_size = qm_frag_size;
+		break;
+#endif
+	default:
+		break;
+	}
+#endif
+
+	if (!frag_size) {
+		LM_WARN("shm_cache_size is only supported by the F_MALLOC and "
+		        "Q_MALLOC shm allocators, disabling the shm cache\n");
+		return 0;
+	}
+
+	if (shm_cache_batch < 1 || shm_cache_batch > 1024) {
+		LM_ERR("bad shm_cache_batch %d (1 - 1024)\n", shm_cache_batch);
+		return -1;
+	}
+
+	cache_stats = shm_malloc(sizeof *cache_stats);
+	if (!cache_stats) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+	memset(cache_stats, 0, sizeof *cache_stats);
+
+	for (i = 0; i < SHM_CACHE_CLASSES; i++) {
+		if (i < 4) {
+			class_size[i] = (i + 1) * 16;
+		} else {
+			b = 6 + (i - 4) / 4;
+			class_size[i] = (1 << b) + ((i - 4) % 4 + 1) * (1 << (b - 2));
+		}
+	}
+
+	cache_limit = (unsigned long)shm_cache_size * 1024;
+
+	LM_DBG("caching up to %luK of shm chunks per process, in batches "
+	       "of %d\n", cache_limit >> 10, shm_cache_batch);
+	return 0;
+}
+
+
+void shm_cache_enable(void)
+{
+	if (!cache_stats)
+		return;
+
+	/* anything inherited from the parent is still owned by it */
+	memset(cache, 0, sizeof cache);
+	cached = published = hits = 0;
+
+	shm_cache_on = 1;
+}
+
+
+void shm_cache_flush(void)
+{
+	int i;
+
+	if (!shm_cache_on)
+		return;
+
+	shm_lock();
+
+	for (i = 0; i < SHM_CACHE_CLASSES; i++)
+		drain_class(&cache[i], 0 CACHE_DBG_HERE);
+	cache_stats->flushes++;
+	publish_stats();
+	shm_threshold_check();
+
+	shm_unlock();
+}
+
+
+void *shm_cache_malloc(unsigned long size CACHE_DBG_ARGS)
+{
+	struct shm_cache_class *c;
+	void *p, *chunk;
+	int i, n;
+
+	c = &cache[size_class(size)];
+
+	if (c->chunks) {
+		p = c->chunks;
+		c->chunks = chunk_next(p);
+		c->no--;
+		cached -= frag_size(p);
+		hits++;
+		return p;
+	}
+
+	/* refill the class, unless we already cache too much */
+	n = cached < cache_limit ? shm_cache_batch : 1;
+	size = class_size[c - cache];
+
+	shm_lock();
+
+	p = SHM_MALLOC(shm_block, size CACHE_DBG_PASS);
+	if (!p && cached) {
+		/* the memory we keep may be enough to satisfy it */
+		for (i = 0; i < SHM_CACHE_CLASSES; i++)
+			drain_class(&cache[i], 0 CACHE_DBG_PASS);
+		cache_stats->flushes++;
+		p = SHM_MALLOC(shm_block, size CACHE_DBG_PASS);
+	}
+
+	for (i = 1; p && i < n; i++) {
+		chunk = SHM_MALLOC(shm_block, size CACHE_DBG_PASS);
+		if (!chunk)
+			break;
+
+		chunk_next(chunk) = c->chunks;
+		c->chunks = chunk;
+		c->no++;
+		cached += frag_size(chunk);
+	}
+
+	cache_stats->misses++;
+	publish_stats();
+	shm_threshold_check();
+
+	shm_unlock();
+
+	return p;
+}
+
+
+void shm_cache_free(void *p CACHE_DBG_ARGS)
+{
+	struct shm_cache_class *c;
+	unsigned long size;
+	int cls, i;
+
+	size = frag_size(p);
+	if (size < class_size[0] || size > SHM_CACHE_MAX_SIZE)
+		goto heap;
+
+	/* the largest class it can serve */
+	cls = size_class(size);
+	if (class_size[cls] > size)
+		cls--;
+	c = &cache[cls];
+
+	chunk_next(p) = c->chunks;
+	c->chunks = p;
+	c->no++;
+	cached += size;
+
+	if (c->no <= 2 * shm_cache_batch && cached <= cache_limit)
+		return;
+
+	shm_lock();
+
+	if (cached <= cache_limit) {
+		drain_class(c, c->no - shm_cache_batch CACHE_DBG_PASS);
+	} else {
+		/* over the limit, give back half of each class */
+		for (i = 0; i < SHM_CACHE_CLASSES; i++)
+			drain_class(&cache[i], cache[i].no / 2 CACHE_DBG_PASS);
+	}
+
+	cache_stats->flushes++;
+	publish_stats();
+	shm_threshold_check();
+
+	shm_unlock();
+	return;
+
+heap:
+	shm_lock();
+	SHM_FREE(shm_block, p CACHE_DBG_PASS);
+	shm_threshold_check();
+	shm_unlock();
+}
+
+
+unsigned long shm_cache_get_hits(unsigned short foo)
+{
+	return cache_stats ? cache_stats->hits : 0;
+}
+
+unsigned long shm_cache_get_misses(unsigned short foo)
+{
+	return cache_stats ? cache_stats->misses : 0;
+}
+
+unsigned long shm_cache_get_flushes(unsigned short foo)
+{
+	return cache_stats ? cache_stats->flushes : 0;
+}
+
+unsigned long shm_cache_get_size(unsigned short foo)
+{
+	return cache_stats ? cache_stats->size : 0;
+}
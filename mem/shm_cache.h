@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Per-process cache of small shm chunks, in front of the F_MALLOC and
+ * Q_MALLOC shm allocators (which are serialized by the global mem_lock).
+ *
+ * Each process keeps a free list ("magazine") for each size class. A
+ * shm_malloc() of up to SHM_CACHE_MAX_SIZE bytes is served from the list of
+ * its class, which is refilled with shm_cache_batch chunks at once when
+ * empty. A shm_free() of such a chunk puts it back on the list of the
+ * process doing the free; whenever a list grows past two batches or the
+ * process caches more than shm_cache_size KB, chunks are given back to the
+ * allocator, in batches as well. So the global lock is taken once every
+ * shm_cache_batch operations instead of on each of them.
+ *
+ * The cached chunks are still "used" from the allocator's point of view;
+ * the "shmem:cached_size" statistic reports how much memory that is. The
+ * _unsafe and _bulk flavors (called with the lock already held) bypass
+ * the cache, as do the processes forked before the cache is enabled.
+ */
+
+#ifndef _MEM_SHM_CACHE_H
+#define _MEM_SHM_CACHE_H
+
+/* largest request (bytes) served by the cache */
+#define SHM_CACHE_MAX_SIZE  4096
+
+/* 16 byte steps up to 64, then 4 classes for each power of 2 */
+#define SHM_CACHE_CLASSES   28
+
+extern int shm_cache_size;   /* KB, per process; 0 disables the cache */
+extern int shm_cache_batch;  /* chunks moved at once to / from the heap */
+
+/* set in the processes using the cache */
+extern int shm_cache_on;
+
+#define shm_cache_fits(_size) \
+	(shm_cache_on && (_size) <= SHM_CACHE_MAX_SIZE)
+
+/* run once the config is parsed, allocates the shared statistics */
+int shm_cache_init(void);
+
+/* enables the cache of the current process, called right after fork */
+void shm_cache_enable(void);
+
+/* gives all the cached chunks back to the allocator (e.g. on exit) */
+void shm_cache_flush(void);
+
+/* shm_malloc() of up to SHM_CACHE_MAX_SIZE bytes, in a caching process;
+ * shm_cache_free() takes any chunk (cacheable or not) of such a process */
+#ifdef DBG_MALLOC
+void *shm_cache_malloc(unsigned long size,
+		const char *file, const char *func, unsigned int line);
+void shm_cache_free(void *p,
+		const char *file, const char *func, unsigned int line);
+#else
+void *shm_cache_malloc(unsigned long size);
+void shm_cache_free(void *p);
+#endif
+
+/* the "shmem:" cache statistics */
+unsigned long shm_cache_get_hits(unsigned short foo);
+unsigned long shm_cache_get_misses(unsigned short foo);
+unsigned long shm_cache_get_flushes(unsigned short foo);
+unsigned long shm_cache_get_size(unsigned short foo);
+
+#endif
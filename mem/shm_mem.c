@@ -87,6 +87,10 @@ stat_export_t shm_stats[] = {
 	{"real_used_size" , STAT_IS_FUNC,    (stat_var**)shm_get_rused },
 	{"fragments" ,      STAT_IS_FUNC,    (stat_var**)shm_get_frags },
 #endif
+	{"cache_hits" ,     STAT_IS_FUNC,    (stat_var**)shm_cache_get_hits    },
+	{"cache_misses" ,   STAT_IS_FUNC,    (stat_var**)shm_cache_get_misses  },
+	{"cache_flushes" ,  STAT_IS_FUNC,    (stat_var**)shm_cache_get_flushes },
+	{"cached_size" ,    STAT_IS_FUNC,    (stat_var**)shm_cache_get_size    },
 	{0,0,0}
 };
 #endif
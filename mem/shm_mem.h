@@ -50,6 +50,7 @@
 #include "../lock_ops.h" /* we don't include locking.h on purpose */
 #include "mem_funcs.h"
 #include "common.h"
+#include "shm_cache.h"
 
 #include "../mi/mi.h"
 
@@ -307,12 +308,16 @@ inline static void* _shm_malloc(unsigned long size,
 {
 	void *p;
 
-	shm_lock();
+	if (shm_cache_fits(size)) {
+		p = shm_cache_malloc(size, file, function, line);
+	} else {
+		shm_lock();
 
-	p = SHM_MALLOC(shm_block, size, file, function, line);
-	shm_threshold_check();
+		p = SHM_MALLOC(shm_block, size, file, function, line);
+		shm_threshold_check();
 
-	shm_unlock();
+		shm_unlock();
+	}
 
 	#ifdef SHM_EXTRA_STATS
 	if (p) {
@@ -432,8 +437,6 @@ inline static void* _shm_realloc_unsafe(void *ptr, unsigned int size,
 inline static void _shm_free(void *ptr,
 		const char* file, const char* function, unsigned int line)
 {
-	shm_lock();
-
 	#ifdef SHM_EXTRA_STATS
 		if (shm_stats_get_index(ptr) !=  VAR_STAT(MOD_NAME)) {
 				update_module_stats(-shm_frag_size(ptr), -(shm_frag_size(ptr) + shm_frag_overhead), -1, shm_stats_get_index(ptr));
@@ -445,6 +448,13 @@ inline static void _shm_free(void *ptr,
 		}
 	#endif
 
+	if (shm_cache_on) {
+		shm_cache_free(ptr, file, function, line);
+		return;
+	}
+
+	shm_lock();
+
 	SHM_FREE(shm_block, ptr, file, function, line);
 	shm_threshold_check();
 
@@ -532,12 +542,16 @@ inline static void* shm_malloc(unsigned long size)
 {
 	void *p;
 
-	shm_lock();
+	if (shm_cache_fits(size)) {
+		p = shm_cache_malloc(size);
+	} else {
+		shm_lock();
 
-	p = SHM_MALLOC(shm_block, size);
-	shm_threshold_check();
+		p = SHM_MALLOC(shm_block, size);
+		shm_threshold_check();
 
-	shm_unlock();
+		shm_unlock();
+	}
 
 #ifdef SHM_EXTRA_STATS
 	if (p) {
@@ -656,8 +670,6 @@ inline static void* shm_realloc_unsafe(void *ptr, unsigned int size)
 #define shm_free_func shm_free
 inline static void shm_free(void *_p)
 {
-	shm_lock();
-
 	#ifdef SHM_EXTRA_STATS
 		if (shm_stats_get_index(_p) !=  VAR_STAT(MOD_NAME)) {
 				update_module_stats(-shm_frag_size(_p), -(shm_frag_size(_p) + shm_frag_overhead), -1, shm_stats_get_index(_p));
@@ -669,6 +681,13 @@ inline static void shm_free(void *_p)
 		}
 	#endif
 
+	if (shm_cache_on) {
+		shm_cache_free(_p);
+		return;
+	}
+
+	shm_lock();
+
 	SHM_FREE(shm_block, _p);
 	shm_threshold_check();
 
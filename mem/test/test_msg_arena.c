@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2020 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,USA
+ */
+
+#include <tap.h>
+
+#include "../../str.h"
+#include "../../ut.h"
+#include "../../data_lump.h"
+#include "../../parser/msg_parser.h"
+#include "../../parser/parse_via.h"
+#include "../../parser/parse_from.h"
+#include "../msg_arena.h"
+
+#include "test_msg_arena.h"
+
+static str arena_msg = str_init(
+	"INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP p1.example.com;branch=z9hG4bK1;rport\r\n"
+	"Via: SIP/2.0/UDP p2.example.com;branch=z9hG4bK2, "
+		"SIP/2.0/UDP p3.example.com;branch=z9hG4bK3\r\n"
+	"To: Bob <sip:bob@biloxi.example.com>;x=y\r\n"
+	"From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n");
+
+static void init_msg(struct sip_msg *msg)
+{
+	memset(msg, 0, sizeof *msg);
+	msg->buf = arena_msg.s;
+	msg->len = arena_msg.len;
+}
+
+void test_msg_arena(void)
+{
+	struct sip_msg msg, other;
+	struct lump *anchor, *l;
+	struct via_body *vb;
+	void *big;
+
+	init_msg(&msg);
+	init_msg(&other);
+
+	ok(msg_arena_bind(&msg) == 0, "arena-1");
+	ok(msg_arena_bind(&other) != 0, "arena-2");
+
+	ok(parse_msg(msg.buf, msg.len, &msg) == 0, "arena-3");
+	ok(parse_headers(&msg, HDR_EOH_F, 0) == 0, "arena-4");
+	ok(msg_arena_owns(msg.headers) && msg_arena_owns(msg.last_header),
+		"arena-5");
+
+	vb = msg.h_via1->sibling->parsed;
+	ok(vb && vb->next && msg_arena_owns(vb) && msg_arena_owns(vb->next),
+		"arena-6");
+	ok(msg_arena_owns(msg.via1->param_lst), "arena-7");
+	ok(msg_arena_owns(msg.to->parsed) &&
+		msg_arena_owns(get_to(&msg)->param_lst), "arena-8");
+	ok(msg_arena_owns(msg.cseq->parsed), "arena-9");
+
+	/* allocations outside the parser scope stay in pkg */
+	ok(!msg_arena.active, "arena-10");
+
+	anchor = anchor_lump(&msg, msg.to->name.s - msg.buf, 0);
+	ok(anchor && msg_arena_owns(anchor), "arena-11");
+	l = insert_new_lump_after(anchor, pkg_malloc(1), 1, 0);
+	ok(l && msg_arena_owns(l) && !msg_arena_owns(l->u.value), "arena-12");
+
+	l = anchor_lump(&other, 0, 0);
+	ok(l && !msg_arena_owns(l), "arena-13");
+	free_lump_list(other.add_rm);
+
+	/* larger than a block */
+	big = msg_arena_get(2 * MSG_ARENA_BLOCK_SIZE);
+	ok(big && msg_arena_owns(big) &&
+		msg_arena_owns((char *)big + 2 * MSG_ARENA_BLOCK_SIZE - 1), "arena-14");
+
+	/* mixed arena / pkg parsed data is released by the same helpers */
+	ok(parse_from_header(&msg) == 0 && !msg_arena_owns(msg.from->parsed),
+		"arena-15");
+
+	free_sip_msg(&msg);
+	msg_arena_release(&msg);
+	ok(!msg_arena.owner && msg_arena.blocks && !msg_arena.blocks->next,
+		"arena-16");
+
+	/* not bound -> plain pkg */
+	ok(parse_msg(other.buf, other.len, &other) == 0, "arena-17");
+	ok(!msg_arena_owns(other.headers), "arena-18");
+	free_sip_msg(&other);
+
+	/* the arena is reusable once released */
+	init_msg(&msg);
+	ok(msg_arena_bind(&msg) == 0, "arena-19");
+	ok(parse_msg(msg.buf, msg.len, &msg) == 0 &&
+		msg_arena_owns(msg.headers), "arena-20");
+	free_sip_msg(&msg);
+	msg_arena_release(&msg);
+}
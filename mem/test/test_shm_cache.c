@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,USA
+ */
+
+#include <tap.h>
+
+#include "../shm_mem.h"
+#include "../shm_cache.h"
+
+#include "test_shm_cache.h"
+
+#define SHM_CACHE_TEST_CHUNKS 200
+
+void test_shm_cache(void)
+{
+	void *p, *q, *chunks[SHM_CACHE_TEST_CHUNKS];
+	unsigned long misses, flushes;
+	int i;
+
+	shm_cache_size = 16;
+	shm_cache_batch = 8;
+	ok(shm_cache_init() == 0, "shm-cache-1");
+	shm_cache_enable();
+	ok(shm_cache_on, "shm-cache-2");
+
+	misses = shm_cache_get_misses(0);
+	p = shm_malloc(100);
+	ok(p && shm_cache_get_misses(0) == misses + 1, "shm-cache-3");
+	ok(shm_cache_get_size(0) >= 7 * 100, "shm-cache-4");
+
+	/* served from the magazine, last freed first */
+	shm_free(p);
+	q = shm_malloc(97);
+	ok(q == p && shm_cache_get_misses(0) == misses + 1, "shm-cache-5");
+	shm_free(q);
+
+	/* too large to be cached */
+	p = shm_malloc(SHM_CACHE_MAX_SIZE + 1);
+	ok(p && shm_cache_get_misses(0) == misses + 1, "shm-cache-6");
+	shm_free(p);
+
+	/* more than 2 batches of a class are given back */
+	flushes = shm_cache_get_flushes(0);
+	for (i = 0; i < SHM_CACHE_TEST_CHUNKS; i++)
+		chunks[i] = shm_malloc(300);
+	for (i = 0; i < SHM_CACHE_TEST_CHUNKS; i++)
+		shm_free(chunks[i]);
+	ok(shm_cache_get_flushes(0) > flushes, "shm-cache-7");
+	ok(shm_cache_get_size(0) <= 16 * 1024, "shm-cache-8");
+
+	shm_cache_flush();
+	ok(shm_cache_get_size(0) == 0, "shm-cache-9");
+
+	shm_cache_on = 0;
+	shm_cache_size = 0;
+}
@@ -35,6 +35,7 @@
 #include "../../ut.h"
 
 #include "benchmark.h"
+#include "bm_tm_lookup.h"
 
 #include "../../mem/shm_mem.h"
 
@@ -159,6 +160,12 @@ static mi_export_t mi_cmds[] = {
 		{mi_bm_poll_results, {0}},
 		{EMPTY_MI_RECIPE}}
 	},
+	{ "bm_tm_lookup", 0,0,0, {
+		{mi_bm_tm_lookup, {0}},
+		{mi_bm_tm_lookup_1, {"loops", 0}},
+		{mi_bm_tm_lookup_2, {"loops", "buckets", 0}},
+		{EMPTY_MI_RECIPE}}
+	},
 	{EMPTY_MI_EXPORT}
 };
 
@@ -171,6 +178,16 @@ static pv_export_t mod_items[] = {
 	{ {0, 0}, 0, 0, 0, 0, 0, 0, 0 }
 };
 
+static dep_export_t deps = {
+	{ /* OpenSIPS module dependencies */
+		{ MOD_TYPE_DEFAULT, "tm", DEP_SILENT },
+		{ MOD_TYPE_NULL, NULL, 0 },
+	},
+	{ /* modparam dependencies */
+		{ NULL, NULL },
+	},
+};
+
 /*
  * Module interface
  */
@@ -180,7 +197,7 @@ struct module_exports exports = {
 	MODULE_VERSION,
 	DEFAULT_DLFLAGS,
 	0,          /* load function */
-	NULL,       /* OpenSIPS module dependencies */
+	&deps,      /* OpenSIPS module dependencies */
 	cmds,       /* Exported functions */
 	0,          /* Exported async functions */
 	params,     /* Exported parameters */
@@ -221,6 +238,10 @@ static int mod_init(void) {
 	bm_mycfg->granularity   = bm_granularity;
 	bm_mycfg->loglevel      = bm_loglevel;
 
+	/* the TM lookup benchmark is optional */
+	if (bm_tm_lookup_init() < 0)
+		return -1;
+
 	return ret;
 }
 
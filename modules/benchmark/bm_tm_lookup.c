@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../../dprint.h"
+#include "../../ipc.h"
+#include "../../pt.h"
+#include "../../mem/shm_mem.h"
+#include "../tm/tm_load.h"
+
+#include "bm_tm_lookup.h"
+
+#define BM_TM_LOOKUP_LOOPS     100000
+#define BM_TM_LOOKUP_BUCKETS   16
+#define BM_TM_LOOKUP_TIMEOUT   60 /* seconds */
+
+typedef struct bm_tm_lookup {
+	int busy;
+	int procs;
+	int loops;
+	unsigned int buckets;
+	int done;
+	unsigned long long lookups;
+} bm_tm_lookup_t;
+
+static struct tm_binds bm_tmb;
+static bm_tm_lookup_t *bm_tm_lookup;
+
+
+int bm_tm_lookup_init(void)
+{
+	if (load_tm_api(&bm_tmb) != 0) {
+		LM_DBG("tm not loaded, bm_tm_lookup disabled\n");
+		return 0;
+	}
+
+	bm_tm_lookup = shm_malloc(sizeof *bm_tm_lookup);
+	if (!bm_tm_lookup) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(bm_tm_lookup, 0, sizeof *bm_tm_lookup);
+
+	return 0;
+}
+
+
+/* runs in each worker - walks the hot buckets over and over, with labels
+ * which never match, so each lookup scans the whole bucket */
+static void bm_rpc_tm_lookup(int sender, void *param)
+{
+	struct cell *t;
+	unsigned int hash, label;
+	int i;
+
+	label = (unsigned int)(unsigned long)param;
+
+	for (i = 0; i < bm_tm_lookup->loops; i++) {
+		hash = i % bm_tm_lookup->buckets;
+		if (bm_tmb.t_lookup_ident(&t, hash, label) > 0)
+			bm_tmb.unref_cell(t);
+	}
+
+	__atomic_add_fetch(&bm_tm_lookup->lookups, bm_tm_lookup->loops,
+		__ATOMIC_RELAXED);
+	__atomic_add_fetch(&bm_tm_lookup->done, 1, __ATOMIC_RELEASE);
+}
+
+
+static mi_response_t *bm_run_tm_lookup(int loops, int buckets)
+{
+	mi_response_t *resp;
+	mi_item_t *resp_obj;
+	struct timeval start, stop;
+	long long usecs;
+	int i, sent, waited;
+
+	if (!bm_tm_lookup)
+		return init_mi_error(400, MI_SSTR("TM module not loaded"));
+
+	if (loops <= 0 || buckets <= 0 || buckets > TM_TABLE_ENTRIES)
+		return init_mi_error(400, MI_SSTR("Bad parameter value"));
+
+	/* a run which timed out stays busy until its workers are done */
+	if (__atomic_exchange_n(&bm_tm_lookup->busy, 1, __ATOMIC_ACQUIRE) &&
+	__atomic_load_n(&bm_tm_lookup->done, __ATOMIC_ACQUIRE) <
+	bm_tm_lookup->procs)
+		return init_mi_error(400, MI_SSTR("Benchmark already running"));
+
+	bm_tm_lookup->procs = counted_max_processes;
+	bm_tm_lookup->loops = loops;
+	bm_tm_lookup->buckets = buckets;
+	bm_tm_lookup->done = 0;
+	bm_tm_lookup->lookups = 0;
+
+	gettimeofday(&start, NULL);
+
+	/* keep all the other IPC-capable processes busy at once */
+	for (i = 1, sent = 0; i < counted_max_processes; i++) {
+		if (i == process_no || (pt[i].flags & OSS_PROC_NO_IPC) ||
+		!(pt[i].flags & OSS_PROC_IS_RUNNING))
+			continue;
+
+		if (ipc_send_rpc(i, bm_rpc_tm_lookup, (void *)(unsigned long)
+		(0xffff0000 | i)) < 0)
+			LM_ERR("failed to send the benchmark job to process %d\n", i);
+		else
+			sent++;
+	}
+	bm_tm_lookup->procs = sent;
+
+	for (waited = 0; __atomic_load_n(&bm_tm_lookup->done, __ATOMIC_ACQUIRE)
+	< sent; waited++) {
+		if (waited == BM_TM_LOOKUP_TIMEOUT * 1000)
+			return init_mi_error(500, MI_SSTR("Timeout waiting for the workers"));
+		usleep(1000);
+	}
+
+	gettimeofday(&stop, NULL);
+
+	usecs = (stop.tv_sec - start.tv_sec) * 1000000LL +
+		(stop.tv_usec - start.tv_usec);
+	if (usecs <= 0)
+		usecs = 1;
+
+	resp = init_mi_result_object(&resp_obj);
+	if (!resp)
+		goto out;
+
+	if (add_mi_number(resp_obj, MI_SSTR("processes"), sent) < 0 ||
+	add_mi_number(resp_obj, MI_SSTR("lookups"), bm_tm_lookup->lookups) < 0 ||
+	add_mi_number(resp_obj, MI_SSTR("usecs"), usecs) < 0 ||
+	add_mi_number(resp_obj, MI_SSTR("lookups_per_sec"),
+		(double)bm_tm_lookup->lookups * 1000000 / usecs) < 0) {
+		free_mi_response(resp);
+		resp = NULL;
+	}
+
+out:
+	__atomic_store_n(&bm_tm_lookup->busy, 0, __ATOMIC_RELEASE);
+	return resp;
+}
+
+mi_response_t *mi_bm_tm_lookup(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	return bm_run_tm_lookup(BM_TM_LOOKUP_LOOPS, BM_TM_LOOKUP_BUCKETS);
+}
+
+mi_response_t *mi_bm_tm_lookup_1(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	int loops;
+
+	if (get_mi_int_param(params, "loops", &loops) < 0)
+		return init_mi_param_error();
+
+	return bm_run_tm_lookup(loops, BM_TM_LOOKUP_BUCKETS);
+}
+
+mi_response_t *mi_bm_tm_lookup_2(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	int loops, buckets;
+
+	if (get_mi_int_param(params, "loops", &loops) < 0)
+		return init_mi_param_error();
+	if (get_mi_int_param(params, "buckets", &buckets) < 0)
+		return init_mi_param_error();
+
+	return bm_run_tm_lookup(loops, buckets);
+}
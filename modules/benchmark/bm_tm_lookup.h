@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Concurrent TM lookups, for comparing the tm hash entry locking modes:
+ * all the IPC-capable processes walk the same few hash buckets at once.
+ */
+
+#ifndef _BM_TM_LOOKUP_H_
+#define _BM_TM_LOOKUP_H_
+
+#include "../../mi/mi.h"
+
+/* loads the TM API, if available; returns -1 only on internal errors */
+int bm_tm_lookup_init(void);
+
+mi_response_t *mi_bm_tm_lookup(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+mi_response_t *mi_bm_tm_lookup_1(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+mi_response_t *mi_bm_tm_lookup_2(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+
+#endif /* _BM_TM_LOOKUP_H_ */
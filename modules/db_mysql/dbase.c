@@ -1475,6 +1475,112 @@ error:
 }
 
 
+/**
+  * Insert several rows into a specified table, update on duplicate key.
+  * The rows are packed into as few statements as the query buffer allows.
+  * \param _h structure representing database connection
+  * \param _k key names
+  * \param _v values of the keys, _n for each row
+  * \param _n number of key=value pairs of a row
+  * \param _r number of rows
+  * \return the number of submitted statements or < 0 on error
+ */
+int db_insert_update_multi(const db_con_t* _h, const db_key_t* _k,
+	const db_val_t* _v, const int _n, const int _r)
+{
+	int off, start, row_off, upd_len, ret, i, rows, stmts;
+	static str  sql_str;
+	static char sql_buf[SQL_BUF_LEN];
+	static char upd_buf[SQL_BUF_LEN];
+
+	if ((!_h) || (!_k) || (!_v) || (!_n) || (_r < 0)) {
+		LM_ERR("invalid parameter value\n");
+		return -1;
+	}
+
+	CON_RESET_CURR_PS(_h); /* no prepared statements support */
+
+	/* the update part is the same for all the statements */
+	ret = snprintf(upd_buf, SQL_BUF_LEN, " on duplicate key update ");
+	if (ret < 0 || ret >= SQL_BUF_LEN) goto error;
+	upd_len = ret;
+
+	for (i = 0; i < _n; i++) {
+		ret = snprintf(upd_buf + upd_len, SQL_BUF_LEN - upd_len,
+			"%.*s=values(%.*s)%s", _k[i]->len, _k[i]->s, _k[i]->len, _k[i]->s,
+			i == _n - 1 ? "" : ",");
+		if (ret < 0 || ret >= SQL_BUF_LEN - upd_len) goto error;
+		upd_len += ret;
+	}
+
+	ret = snprintf(sql_buf, SQL_BUF_LEN, "insert into %.*s (",
+		CON_TABLE(_h)->len, CON_TABLE(_h)->s);
+	if (ret < 0 || ret >= SQL_BUF_LEN) goto error;
+	start = ret;
+
+	ret = db_print_columns(sql_buf + start, SQL_BUF_LEN - start, _k, _n);
+	if (ret < 0) return -1;
+	start += ret;
+
+	ret = snprintf(sql_buf + start, SQL_BUF_LEN - start, ") values ");
+	if (ret < 0 || ret >= (SQL_BUF_LEN - start)) goto error;
+	start += ret;
+
+	off = start;
+	for (i = 0, rows = 0, stmts = 0; i < _r; ) {
+		row_off = off;
+
+		/* "(values)", plus room for the "," or the update part */
+		ret = -1;
+		if (off + 2 + upd_len < SQL_BUF_LEN) {
+			if (rows)
+				sql_buf[off++] = ',';
+			sql_buf[off++] = '(';
+			ret = db_print_values(_h, sql_buf + off,
+				SQL_BUF_LEN - off - 1 - upd_len, _v + i * _n, _n,
+				db_mysql_val2str);
+		}
+
+		if (ret >= 0) {
+			off += ret;
+			sql_buf[off++] = ')';
+			rows++;
+			i++;
+			if (i < _r)
+				continue;
+		} else {
+			if (!rows) {
+				LM_ERR("row %d does not fit the query buffer\n", i);
+				goto error;
+			}
+			off = row_off;
+		}
+
+		/* the buffer is full or this is the last row */
+		memcpy(sql_buf + off, upd_buf, upd_len);
+		off += upd_len;
+
+		sql_str.s = sql_buf;
+		sql_str.len = off;
+
+		if (db_mysql_submit_query(_h, &sql_str) < 0) {
+			LM_ERR("error while submitting query\n");
+			return -2;
+		}
+
+		stmts++;
+		rows = 0;
+		off = start;
+	}
+
+	return stmts;
+
+error:
+	LM_ERR("error while preparing insert_update_multi operation\n");
+	return -1;
+}
+
+
 /**
  * Store the name of table that will be used by subsequent database functions
  * \param _h database handle
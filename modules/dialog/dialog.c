@@ -53,6 +53,7 @@
 #include "dlg_db_handler.h"
 #include "dlg_req_within.h"
 #include "dlg_profile.h"
+#include "dlg_prof_counters.h"
 #include "dlg_vals.h"
 #include "dlg_replication.h"
 #include "dlg_repl_profile.h"
@@ -281,6 +282,8 @@ static param_export_t mod_params[]={
 	{ "enable_stats",          INT_PARAM, &dlg_enable_stats         },
 	{ "hash_size",             INT_PARAM, &dlg_hash_size            },
 	{ "log_profile_hash_size", INT_PARAM, &log_profile_hash_size    },
+	{ "atomic_profiles",       INT_PARAM, &atomic_profiles          },
+	{ "atomic_profiles_hash_size", INT_PARAM, &atomic_profiles_hash_size },
 	{ "rr_param",              STR_PARAM, &rr_param.s               },
 	{ "default_timeout",       INT_PARAM, &default_timeout          },
 	{ "options_ping_interval", INT_PARAM, &options_ping_interval    },
@@ -331,6 +334,8 @@ static param_export_t mod_params[]={
 	{ "replicate_profiles_check", INT_PARAM, &repl_prof_timer_check },
 	{ "replicate_profiles_buffer",INT_PARAM, &repl_prof_buffer_th   },
 	{ "replicate_profiles_expire",INT_PARAM, &repl_prof_timer_expire},
+	{ "replicate_dialogs_timer",  INT_PARAM, &repl_dlg_batch_utimer },
+	{ "replicate_dialogs_batch",  INT_PARAM, &repl_dlg_batch_size   },
 	{ 0,0,0 }
 };
 
@@ -347,6 +352,12 @@ static stat_export_t mod_stats[] = {
 	{"create_recv",         0,              &create_recv       },
 	{"update_recv",         0,              &update_recv       },
 	{"delete_recv",         0,              &delete_recv       },
+	{"timer_lag",           STAT_IS_FUNC,
+		(stat_var**)dlg_get_timer_lag },
+	{"repl_batch_size",     STAT_IS_FUNC,
+		(stat_var**)dlg_get_repl_batch_size },
+	{"repl_lag",            STAT_IS_FUNC,
+		(stat_var**)dlg_get_repl_lag },
 	{0,0,0}
 };
 
@@ -725,6 +736,12 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (atomic_profiles_hash_size <= 0 || atomic_profiles_hash_size > 24) {
+		LM_ERR("invalid value for atomic_profiles_hash_size:%d (1-24)!!\n",
+			atomic_profiles_hash_size);
+		return -1;
+	}
+
 	if (rr_param.s==0 || rr_param.s[0]==0) {
 		LM_ERR("empty rr_param!!\n");
 		return -1;
@@ -863,6 +880,11 @@ static int mod_init(void)
 			LM_ERR("Sync request failed\n");
 	}
 
+	if (repl_dlg_batch_init() < 0) {
+		LM_ERR("cannot initialize dialog replication batches\n");
+		return -1;
+	}
+
 	if ( register_timer( "dlg-timer", dlg_timer_routine, NULL, 1,
 	TIMER_FLAG_DELAY_ON_DELAY)<0 ) {
 		LM_ERR("failed to register timer\n");
@@ -881,6 +903,13 @@ static int mod_init(void)
 		return -1;
 	}
 
+	if (atomic_profiles && register_timer("dlg-profile-cleaner",
+	prof_counters_clean_routine, NULL, PROF_CNT_CLEAN_INTERVAL,
+	TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+		LM_ERR("failed to register the profile cleaner timer\n");
+		return -1;
+	}
+
 	/* init handlers */
 	init_dlg_handlers(default_timeout);
 
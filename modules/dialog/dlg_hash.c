@@ -1302,6 +1302,9 @@ void next_state_dlg(struct dlg_cell *dlg, int event, int dir, int *old_state,
 		raise_state_changed_event(dlg, (unsigned int)(*old_state),
 			(unsigned int)(*new_state));
 
+	if (*old_state!=DLG_STATE_DELETED && *new_state==DLG_STATE_DELETED)
+		dlg_ping_timers_due_now(dlg);
+
 	 if (dialog_repl_cluster && replicate_events &&
 	(*old_state==DLG_STATE_CONFIRMED_NA || *old_state==DLG_STATE_CONFIRMED) &&
 	*new_state==DLG_STATE_DELETED )
@@ -24,6 +24,7 @@
 #define _DIALOG_DLG_HASH_H_
 
 #include "../../locking.h"
+#include "../../timer.h"
 #include "../../context.h"
 #include "../../mi/mi.h"
 #include "../../lib/dbg/struct_hist.h"
@@ -141,6 +142,10 @@ struct dlg_cell
 	unsigned int         initial_t_hash_index;
 	unsigned int         initial_t_label;
 	unsigned int         replicated; /* indicates if the dialog is replicated */
+	unsigned int         repl_pending; /* DLG_REPL_EV_* events waiting in a
+	                                    * replication queue, if any */
+	utime_t              repl_ts;     /* when it was queued for replication */
+	struct dlg_cell      *repl_next;
 	struct dlg_tl        tl;
 	struct dlg_ping_list *pl;
 	struct dlg_ping_list *reinvite_pl;
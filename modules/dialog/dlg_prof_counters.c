@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "../../mem/shm_mem.h"
+#include "../../hash_func.h"
+#include "../../dprint.h"
+#include "../../pt.h"
+#include "dlg_profile.h"
+#include "dlg_prof_counters.h"
+
+#define PROF_CNT_DEAD    LONG_MIN
+#define PROF_CNT_STRIDE  (PROF_CNT_LINE / sizeof(long))
+
+int atomic_profiles = 0;
+int atomic_profiles_hash_size = 10;
+
+
+/* shm memory starting on a cache line; free it through *chunk */
+static void *shm_malloc_aligned(unsigned long size, void **chunk)
+{
+	*chunk = shm_malloc(size + PROF_CNT_LINE - 1);
+	if (!*chunk)
+		return NULL;
+
+	return (void *)(((unsigned long)*chunk + PROF_CNT_LINE - 1) &
+		~(unsigned long)(PROF_CNT_LINE - 1));
+}
+
+
+struct prof_counters *new_prof_counters(unsigned int size)
+{
+	struct prof_counters *pc;
+	unsigned long len;
+	void *chunk;
+
+	len = sizeof *pc + size * sizeof *pc->buckets;
+	pc = shm_malloc_aligned(len, &chunk);
+	if (!pc) {
+		LM_ERR("no more shm mem\n");
+		return NULL;
+	}
+	memset(pc, 0, len);
+
+	pc->size = size;
+	pc->chunk = chunk;
+
+	return pc;
+}
+
+
+void destroy_prof_counters(struct prof_counters *pc)
+{
+	struct prof_val_counter *c, *next;
+	unsigned int i;
+
+	for (i = 0; i < pc->size; i++)
+		for (c = pc->buckets[i]; c; c = next) {
+			next = c->next;
+			shm_free(c->chunk);
+		}
+
+	for (c = pc->dead; c; c = next) {
+		next = c->next_dead;
+		shm_free(c->chunk);
+	}
+
+	if (pc->proc_chunk)
+		shm_free(pc->proc_chunk);
+	shm_free(pc->chunk);
+}
+
+
+static struct prof_val_counter *new_val_counter(str *value, unsigned int hash)
+{
+	struct prof_val_counter *c;
+	unsigned long len;
+	void *chunk;
+
+	/* nothing else may share the cache line of the counter */
+	len = sizeof *c + value->len;
+	if (len < PROF_CNT_LINE)
+		len = PROF_CNT_LINE;
+
+	c = shm_malloc_aligned(len, &chunk);
+	if (!c) {
+		LM_ERR("no more shm mem\n");
+		return NULL;
+	}
+	memset(c, 0, sizeof *c);
+
+	c->n = 1;
+	c->hash = hash;
+	c->value.s = (char *)(c + 1);
+	c->value.len = value->len;
+	memcpy(c->value.s, value->s, value->len);
+	c->chunk = chunk;
+
+	return c;
+}
+
+
+struct prof_val_counter *prof_val_inc(struct prof_counters *pc, str *value)
+{
+	struct prof_val_counter **bucket, *head, *c, *new = NULL;
+	unsigned int hash;
+	long n;
+
+	hash = core_hash(value, NULL, 0);
+	bucket = &pc->buckets[hash & (pc->size - 1)];
+
+	head = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+	for (;;) {
+		for (c = head; c; c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+			if (c->hash != hash || c->value.len != value->len ||
+					memcmp(c->value.s, value->s, value->len))
+				continue;
+
+			/* a dead counter is being unlinked, look for a newer one */
+			n = __atomic_load_n(&c->n, __ATOMIC_RELAXED);
+			while (n != PROF_CNT_DEAD)
+				if (__atomic_compare_exchange_n(&c->n, &n, n + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					if (new)
+						shm_free(new->chunk);
+					return c;
+				}
+		}
+
+		if (!new) {
+			new = new_val_counter(value, hash);
+			if (!new)
+				return NULL;
+		}
+
+		/* on failure, the value may have been added meanwhile: rescan */
+		new->next = head;
+		if (__atomic_compare_exchange_n(bucket, &head, new, 0,
+				__ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			return new;
+	}
+}
+
+
+/* the deltas of the processes, allocated once they are known */
+static long *get_proc_counters(struct prof_counters *pc)
+{
+	long *proc_n, *old = NULL;
+	unsigned long len;
+	void *chunk;
+
+	proc_n = __atomic_load_n(&pc->proc_n, __ATOMIC_ACQUIRE);
+	if (proc_n || !counted_max_processes)
+		return proc_n;
+
+	len = counted_max_processes * PROF_CNT_LINE;
+	proc_n = shm_malloc_aligned(len, &chunk);
+	if (!proc_n) {
+		LM_ERR("no more shm mem\n");
+		return NULL;
+	}
+	memset(proc_n, 0, len);
+
+	if (!__atomic_compare_exchange_n(&pc->proc_n, &old, proc_n, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		shm_free(chunk);
+		return old;
+	}
+
+	pc->proc_chunk = chunk;
+	return proc_n;
+}
+
+
+void prof_noval_add(struct prof_counters *pc, int delta)
+{
+	long *proc_n;
+
+	proc_n = get_proc_counters(pc);
+	if (!proc_n || process_no >= counted_max_processes) {
+		__atomic_fetch_add(&pc->n, delta, __ATOMIC_RELAXED);
+		return;
+	}
+
+	/* only written by this process */
+	proc_n += process_no * PROF_CNT_STRIDE;
+	__atomic_store_n(proc_n,
+		__atomic_load_n(proc_n, __ATOMIC_RELAXED) + delta, __ATOMIC_RELAXED);
+}
+
+
+unsigned int prof_noval_get(struct prof_counters *pc)
+{
+	long *proc_n, n;
+	unsigned int i;
+
+	n = __atomic_load_n(&pc->n, __ATOMIC_RELAXED);
+
+	proc_n = __atomic_load_n(&pc->proc_n, __ATOMIC_ACQUIRE);
+	if (proc_n)
+		for (i = 0; i < counted_max_processes; i++)
+			n += __atomic_load_n(&proc_n[i * PROF_CNT_STRIDE],
+				__ATOMIC_RELAXED);
+
+	return n > 0 ? n : 0;
+}
+
+
+unsigned int prof_counters_get(struct prof_counters *pc, str *value)
+{
+	struct prof_val_counter *c;
+	unsigned int hash, i;
+	long n, sum;
+
+	if (!value) {
+		for (sum = 0, i = 0; i < pc->size; i++)
+			for (c = __atomic_load_n(&pc->buckets[i], __ATOMIC_ACQUIRE); c;
+					c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+				n = __atomic_load_n(&c->n, __ATOMIC_RELAXED);
+				if (n > 0)
+					sum += n;
+			}
+
+		return sum;
+	}
+
+	hash = core_hash(value, NULL, 0);
+
+	for (c = __atomic_load_n(&pc->buckets[hash & (pc->size - 1)],
+			__ATOMIC_ACQUIRE); c;
+			c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+		if (c->hash != hash || c->value.len != value->len ||
+				memcmp(c->value.s, value->s, value->len))
+			continue;
+
+		n = __atomic_load_n(&c->n, __ATOMIC_RELAXED);
+		if (n != PROF_CNT_DEAD)
+			return n > 0 ? n : 0;
+	}
+
+	return 0;
+}
+
+
+int prof_counters_for_each(struct prof_counters *pc,
+		int (*f)(void *param, str *value, unsigned int n), void *param)
+{
+	struct prof_val_counter *c;
+	unsigned int i;
+	long n;
+
+	for (i = 0; i < pc->size; i++)
+		for (c = __atomic_load_n(&pc->buckets[i], __ATOMIC_ACQUIRE); c;
+				c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+			n = __atomic_load_n(&c->n, __ATOMIC_RELAXED);
+			if (n > 0 && f(param, &c->value, n) < 0)
+				return -1;
+		}
+
+	return 0;
+}
+
+
+/*
+ * Unlinks @c, following @prev (NULL if it was the head of the bucket when
+ * reached); returns its actual predecessor. Only the cleaner changes the
+ * links past the head, the others only prepend to the bucket.
+ */
+static struct prof_val_counter *unlink_val_counter(
+		struct prof_val_counter **bucket, struct prof_val_counter *prev,
+		struct prof_val_counter *c)
+{
+	struct prof_val_counter *head = c;
+
+	if (!prev) {
+		if (__atomic_compare_exchange_n(bucket, &head, c->next, 0,
+				__ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			return NULL;
+
+		/* new counters were added in front of it */
+		for (prev = head; prev->next != c; prev = prev->next) ;
+	}
+
+	__atomic_store_n(&prev->next, c->next, __ATOMIC_RELEASE);
+	return prev;
+}
+
+
+static void clean_prof_counters(struct prof_counters *pc)
+{
+	struct prof_val_counter *c, *prev, *next;
+	unsigned int i;
+	long n;
+
+	/* unlinked one run ago, nobody may still be walking them */
+	for (c = pc->dead; c; c = next) {
+		next = c->next_dead;
+		shm_free(c->chunk);
+	}
+	pc->dead = NULL;
+
+	for (i = 0; i < pc->size; i++) {
+		prev = NULL;
+		for (c = __atomic_load_n(&pc->buckets[i], __ATOMIC_ACQUIRE); c;
+				c = next) {
+			next = c->next;
+
+			n = 0;
+			if (!__atomic_compare_exchange_n(&c->n, &n, PROF_CNT_DEAD, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				prev = c;
+				continue;
+			}
+
+			prev = unlink_val_counter(&pc->buckets[i], prev, c);
+			c->next_dead = pc->dead;
+			pc->dead = c;
+		}
+	}
+}
+
+
+void prof_counters_clean_routine(unsigned int ticks, void *param)
+{
+	struct dlg_profile_table *profile;
+
+	for (profile = profiles; profile; profile = profile->next)
+		if (profile->counters && profile->has_value)
+			clean_prof_counters(profile->counters);
+}
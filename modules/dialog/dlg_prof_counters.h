@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Lock-free counters of the local (neither shared nor replicated) dialog
+ * profiles, enabled by the "atomic_profiles" module parameter.
+ *
+ * A profile with values keeps a hash of per-value counters, each alone in
+ * its cache line. The hash buckets are lists only ever prepended to (with
+ * a CAS on the bucket head) by set_dlg_profile(), so looking up a value
+ * takes no lock, while the dialog linker keeps a pointer to its counter
+ * for unset_dlg_profile(). The counters dropped to zero are unlinked by a
+ * timer, which marks them as dead first (so they cannot be taken again)
+ * and frees them on its next run only, once no lookup may still walk them.
+ *
+ * A profile without value keeps a delta for each process, again in its
+ * own cache line, the size of the profile being their sum.
+ */
+
+#ifndef _DIALOG_DLG_PROF_COUNTERS_H_
+#define _DIALOG_DLG_PROF_COUNTERS_H_
+
+#include "../../str.h"
+
+#define PROF_CNT_LINE            64
+#define PROF_CNT_CLEAN_INTERVAL  10  /* s */
+
+struct prof_val_counter {
+	long n;                            /* dialogs, PROF_CNT_DEAD if unlinked */
+	unsigned int hash;
+	str value;
+	struct prof_val_counter *next;
+	struct prof_val_counter *next_dead;
+	void *chunk;                       /* the allocated (unaligned) memory */
+};
+
+struct prof_counters {
+	long n;                            /* no value, before the procs fork */
+	long *proc_n;                      /* no value, PROF_CNT_LINE apart */
+	void *proc_chunk;
+	unsigned int size;
+	struct prof_val_counter *dead;     /* freed on the next clean-up */
+	void *chunk;
+	struct prof_val_counter *buckets[0];
+};
+
+extern int atomic_profiles;
+/* log2 of the value counter buckets of each profile */
+extern int atomic_profiles_hash_size;
+
+struct prof_counters *new_prof_counters(unsigned int size);
+void destroy_prof_counters(struct prof_counters *pc);
+
+/* adds a dialog to the counter of @value, returned for prof_val_dec() */
+struct prof_val_counter *prof_val_inc(struct prof_counters *pc, str *value);
+
+static inline void prof_val_dec(struct prof_val_counter *c)
+{
+	__atomic_fetch_sub(&c->n, 1, __ATOMIC_RELAXED);
+}
+
+void prof_noval_add(struct prof_counters *pc, int delta);
+
+/* the dialogs with @value, or with any value if NULL */
+unsigned int prof_counters_get(struct prof_counters *pc, str *value);
+
+/* the dialogs of a profile without value */
+unsigned int prof_noval_get(struct prof_counters *pc);
+
+/* calls @f for each value currently in use */
+int prof_counters_for_each(struct prof_counters *pc,
+		int (*f)(void *param, str *value, unsigned int n), void *param);
+
+void prof_counters_clean_routine(unsigned int ticks, void *param);
+
+#endif
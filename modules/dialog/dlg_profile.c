@@ -29,6 +29,7 @@
 #include "../../pt.h"
 #include "dlg_hash.h"
 #include "dlg_profile.h"
+#include "dlg_prof_counters.h"
 #include "dlg_repl_profile.h"
 #include "dlg_req_within.h"
 
@@ -457,8 +458,8 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
 	}
 
 	len = sizeof(struct dlg_profile_table) + name->len + 1;
-	/* anything else than only CACHEDB */
-	if (repl_type !=  REPL_CACHEDB)
+	/* anything else than only CACHEDB or atomic counters */
+	if (repl_type != REPL_CACHEDB && !(repl_type == REPL_NONE && atomic_profiles))
 		len += size * ((has_value==0) ? sizeof(struct prof_local_count*):sizeof(map_t));
 
 	profile = (struct dlg_profile_table *)shm_malloc(len);
@@ -469,7 +470,15 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
 	}
 	memset( profile , 0 , len);
 
-	if (!has_value)
+	if (repl_type == REPL_NONE && atomic_profiles) {
+		/* the value counters have their own, larger, hash */
+		profile->counters = new_prof_counters(has_value ?
+			1U << atomic_profiles_hash_size : 1);
+		if (!profile->counters) {
+			shm_free(profile);
+			return NULL;
+		}
+	} else if (!has_value)
 		profile->noval_rcv_counters = repl_prof_allocate();
 
 	profile->size = size;
@@ -477,7 +486,7 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
 	profile->repl_type = repl_type;
 
 	/* init locks */
-	if (repl_type != REPL_CACHEDB) {
+	if (repl_type != REPL_CACHEDB && !profile->counters) {
 		profile->locks = get_a_lock_set(size) ;
 
 		if( !profile->locks )
@@ -488,7 +497,7 @@ static struct dlg_profile_table* new_dlg_profile( str *name, unsigned int size,
 		}
 	}
 
-	if( repl_type == REPL_CACHEDB ) {
+	if( repl_type == REPL_CACHEDB || profile->counters ) {
 
 		profile->name.s = (char *)(profile + 1);
 
@@ -532,7 +541,9 @@ static void destroy_dlg_profile(struct dlg_profile_table *profile)
 
 	if (profile==NULL)
 		return;
-	if( profile->has_value && !(profile->repl_type==REPL_CACHEDB) )
+	if (profile->counters)
+		destroy_prof_counters(profile->counters);
+	else if( profile->has_value && !(profile->repl_type==REPL_CACHEDB) )
 	{
 		for( i= 0; i < profile->size; i++)
 			map_destroy( profile->entries[i], free_profile_val);
@@ -642,7 +653,12 @@ static void destroy_linker(struct dlg_profile_link *l, struct dlg_cell *dlg,
 	void ** dest;
 	int repl_remove = 0;
 
-	if (!(l->profile->repl_type==REPL_CACHEDB)) {
+	if (l->profile->counters) {
+		if (l->profile->has_value)
+			prof_val_dec(l->counter);
+		else
+			prof_noval_add(l->profile->counters, -1);
+	} else if (!(l->profile->repl_type==REPL_CACHEDB)) {
 		lock_set_get( l->profile->locks, l->hash_idx);
 
 		if( l->profile->has_value)
@@ -761,7 +777,15 @@ static int link_dlg_profile(struct dlg_profile_link *linker,
 	struct dlg_profile_table *profile = linker->profile;
 
 	/* insert into profile hash table */
-	if (profile->repl_type != REPL_CACHEDB) {
+	if (profile->counters) {
+		if (profile->has_value) {
+			linker->counter = prof_val_inc(profile->counters, &linker->value);
+			if (!linker->counter)
+				return -1;
+		} else {
+			prof_noval_add(profile->counters, 1);
+		}
+	} else if (profile->repl_type != REPL_CACHEDB) {
 		/* calculate the hash position */
 		hash = calc_hash_profile(&linker->value, dlg, profile);
 		linker->hash_idx = hash;
@@ -996,6 +1020,13 @@ unsigned int get_profile_size(struct dlg_profile_table *profile, str *value)
 	int ret;
 	map_iterator_t it;
 
+	if (profile->counters) {
+		if (profile->has_value)
+			return prof_counters_get(profile->counters, value);
+		else
+			return prof_noval_get(profile->counters);
+	}
+
 	if (profile->has_value==0)
 	{
 		/* iterate through the hash and count all records */
@@ -1109,6 +1140,9 @@ int noval_get_local_count(struct dlg_profile_table *profile)
 	struct prof_local_count *cnt;
 	int rc;
 
+	if (profile->counters)
+		return prof_noval_get(profile->counters);
+
 	for (i = 0; i < profile->size; i++) {
 		lock_set_get(profile->locks, i);
 
@@ -1256,6 +1290,22 @@ static inline int add_val_to_rpl_r(void * param, str key, void * val)
 	return 0;
 }
 
+static int add_counter_to_rpl(void *param, str *value, unsigned int n)
+{
+	mi_item_t *val_item;
+
+	val_item = add_mi_object((mi_item_t *)param, NULL, 0);
+	if (!val_item)
+		return -1;
+
+	if (add_mi_string(val_item, MI_SSTR("value"), value->s, value->len) < 0)
+		return -1;
+	if (add_mi_number(val_item, MI_SSTR("count"), n) < 0)
+		return -1;
+
+	return 0;
+}
+
 static inline int add_counter_no_val_to_rpl(void * param, int counter)
 {
 	mi_item_t *val_item;
@@ -1298,7 +1348,12 @@ mi_response_t *mi_get_profile_values(const mi_params_t *params,
 
 	/* gather dialog count for all values in this profile */
 	ret = 0;
-	if( profile->has_value )
+	if (profile->counters && profile->has_value)
+	{
+		ret = prof_counters_for_each(profile->counters, add_counter_to_rpl,
+			resp_arr);
+	}
+	else if( profile->has_value )
 	{
 		for( i=0; i<profile->size; i++ )
 		{
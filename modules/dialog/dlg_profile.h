@@ -41,11 +41,14 @@ struct dlg_profile_link {
 	str value;
 	int hash_idx;
 	int it_marker;
+	struct prof_val_counter *counter;  /* with "atomic_profiles" */
 	struct dlg_profile_link  *next;
 	struct dlg_profile_table *profile;
 };
 
 struct prof_rcv_count;
+struct prof_val_counter;
+struct prof_counters;
 
 struct prof_local_count {
 	int n;
@@ -73,6 +76,11 @@ struct dlg_profile_table {
 	struct prof_local_count **noval_local_counters;
 	struct prof_rcv_count *noval_rcv_counters;
 
+	/*
+	 * lock-free counters of the local profiles, see dlg_prof_counters.h
+	 */
+	struct prof_counters *counters;
+
 	struct dlg_profile_table *next;
 };
 
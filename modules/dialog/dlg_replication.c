@@ -629,8 +629,29 @@ void bin_push_dlg(bin_packet_t *packet, struct dlg_cell *dlg)
 	DLG_BIN_PUSH_ROUTE( packet, dlg, on_hangup);
 }
 
+static inline void bin_push_dlg_deleted(bin_packet_t *packet,
+		struct dlg_cell *dlg)
+{
+	bin_push_str(packet, &dlg->callid);
+	bin_push_str(packet, &dlg->legs[DLG_CALLER_LEG].tag);
+	bin_push_str(packet, &dlg->legs[callee_idx(dlg)].tag);
+}
+
+static inline void bin_push_dlg_cseq(bin_packet_t *packet,
+		struct dlg_cell *dlg, int leg)
+{
+	bin_push_str(packet, &dlg->callid);
+	bin_push_str(packet,
+			&dlg->legs[leg == DLG_CALLER_LEG?callee_idx(dlg):DLG_CALLER_LEG].tag);
+	bin_push_str(packet, &dlg->legs[leg].tag);
+	bin_push_int(packet, dlg->legs[leg].last_gen_cseq);
+}
+
 /*  Binary Packet sending functions   */
 
+static int queue_dlg_repl(struct dlg_cell *dlg, unsigned int ev);
+static void flush_own_dlg_repl(void);
+
 
 /**
  * replicates a locally created dialog to all the destinations
@@ -657,12 +678,21 @@ void replicate_dialog_created(struct dlg_cell *dlg)
 		goto no_send;
 	}
 
-	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_CREATED, BIN_VERSION, 0) != 0)
-		goto init_error;
-
 	if (dlg_has_reinvite_pinging(dlg) && persist_reinvite_pinging(dlg))
 		LM_ERR("failed to persist Re-INVITE pinging info\n");
 
+	if (repl_dlg_batch_utimer &&
+	        (rc = queue_dlg_repl(dlg, DLG_REPL_EV_CREATED)) >= 0) {
+		dlg->replicated = 1;
+		dlg_unlock_dlg(dlg);
+		if (rc)
+			flush_own_dlg_repl();
+		return;
+	}
+
+	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_CREATED, BIN_VERSION, 0) != 0)
+		goto init_error;
+
 	bin_push_dlg(&packet, dlg);
 
 	dlg->replicated = 1;
@@ -721,12 +751,21 @@ void replicate_dialog_updated(struct dlg_cell *dlg)
 		goto end;
 	}
 
-	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_UPDATED, BIN_VERSION, 0) != 0)
-		goto init_error;
-
 	if (dlg_has_reinvite_pinging(dlg) && persist_reinvite_pinging(dlg))
 		LM_ERR("failed to persist Re-INVITE pinging info\n");
 
+	if (repl_dlg_batch_utimer &&
+	        (rc = queue_dlg_repl(dlg, DLG_REPL_EV_UPDATED)) >= 0) {
+		dlg->replicated = 1;
+		dlg_unlock_dlg(dlg);
+		if (rc)
+			flush_own_dlg_repl();
+		return;
+	}
+
+	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_UPDATED, BIN_VERSION, 0) != 0)
+		goto init_error;
+
 	bin_push_dlg(&packet, dlg);
 
 	dlg->replicated = 1;
@@ -768,15 +807,28 @@ end:
  */
 void replicate_dialog_deleted(struct dlg_cell *dlg)
 {
-	int rc;
+	int rc, locked;
 	bin_packet_t packet;
 
+	if (repl_dlg_batch_utimer) {
+		locked = dlg->locked_by == process_no;
+		if (!locked)
+			dlg_lock_dlg(dlg);
+		rc = queue_dlg_repl(dlg, DLG_REPL_EV_DELETED);
+		if (!locked)
+			dlg_unlock_dlg(dlg);
+
+		/* a full queue is left to the timer if we hold a dialog lock */
+		if (rc > 0 && !locked)
+			flush_own_dlg_repl();
+		if (rc >= 0)
+			return;
+	}
+
 	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_DELETED, BIN_VERSION, 1024) != 0)
 		goto error;
 
-	bin_push_str(&packet, &dlg->callid);
-	bin_push_str(&packet, &dlg->legs[DLG_CALLER_LEG].tag);
-	bin_push_str(&packet, &dlg->legs[callee_idx(dlg)].tag);
+	bin_push_dlg_deleted(&packet, dlg);
 
 	rc = clusterer_api.send_all(&packet, dialog_repl_cluster);
 	switch (rc) {
@@ -807,18 +859,31 @@ error:
  */
 void replicate_dialog_cseq_updated(struct dlg_cell *dlg, int leg)
 {
-	int rc;
+	int rc, locked;
 	bin_packet_t packet;
 
+	/* only the cseqs of the caller and of the answered callee are queued */
+	if (repl_dlg_batch_utimer &&
+	        (leg == DLG_CALLER_LEG || leg == callee_idx(dlg))) {
+		locked = dlg->locked_by == process_no;
+		if (!locked)
+			dlg_lock_dlg(dlg);
+		rc = queue_dlg_repl(dlg, leg == DLG_CALLER_LEG ?
+			DLG_REPL_EV_CSEQ_CALLER : DLG_REPL_EV_CSEQ_CALLEE);
+		if (!locked)
+			dlg_unlock_dlg(dlg);
+
+		if (rc > 0 && !locked)
+			flush_own_dlg_repl();
+		if (rc >= 0)
+			return;
+	}
+
 	if (bin_init(&packet, &dlg_repl_cap, REPLICATION_DLG_CSEQ,
 			BIN_VERSION, 512) != 0)
 		goto error;
 
-	bin_push_str(&packet, &dlg->callid);
-	bin_push_str(&packet,
-			&dlg->legs[leg == DLG_CALLER_LEG?callee_idx(dlg):DLG_CALLER_LEG].tag);
-	bin_push_str(&packet, &dlg->legs[leg].tag);
-	bin_push_int(&packet, dlg->legs[leg].last_gen_cseq);
+	bin_push_dlg_cseq(&packet, dlg, leg);
 
 	rc = clusterer_api.send_all(&packet, dialog_repl_cluster);
 	switch (rc) {
@@ -842,6 +907,406 @@ error:
 	LM_ERR("Failed to replicate dialog cseq update\n");
 }
 
+/* batched replication of the dialog events */
+
+int repl_dlg_batch_utimer = 0;
+int repl_dlg_batch_size = DLG_REPL_BATCH_SIZE;
+
+/* the dialogs with events to replicate, queued by a process */
+struct repl_dlg_queue {
+	gen_lock_t lock;
+	struct dlg_cell *first;
+	struct dlg_cell *last;
+	unsigned int no;
+};
+
+struct repl_dlg_batches {
+	struct repl_dlg_queue *queues;  /* per process, once they are known */
+	unsigned long packets;          /* batches sent */
+	unsigned long events;           /* records sent in them */
+	unsigned long lag;              /* ms, see dlg_get_repl_lag() */
+};
+
+/* a batch being built */
+struct repl_dlg_batch {
+	bin_packet_t packet;
+	int events;
+	int sent[REPLICATION_DLG_BATCH];  /* records of each type */
+	utime_t oldest;                   /* when its oldest event was queued */
+};
+
+static struct repl_dlg_batches *repl_batches;
+
+static void flush_dlg_repl_routine(utime_t ticks, void *param);
+
+int repl_dlg_batch_init(void)
+{
+	if (!dialog_repl_cluster)
+		return 0;
+
+	if (repl_dlg_batch_utimer < 0) {
+		LM_ERR("negative replicate timer for dialogs %d\n",
+			repl_dlg_batch_utimer);
+		return -1;
+	}
+
+	if (!repl_dlg_batch_utimer)
+		return 0;
+
+	if (repl_dlg_batch_size <= 0) {
+		LM_ERR("bad replicate batch size for dialogs %d\n",
+			repl_dlg_batch_size);
+		return -1;
+	}
+
+	repl_batches = shm_malloc(sizeof *repl_batches);
+	if (!repl_batches) {
+		LM_ERR("no more shm mem\n");
+		return -1;
+	}
+	memset(repl_batches, 0, sizeof *repl_batches);
+
+	if (register_utimer("dialog-repl-dialogs-utimer", flush_dlg_repl_routine,
+		NULL, repl_dlg_batch_utimer * 1000, TIMER_FLAG_DELAY_ON_DELAY) < 0) {
+		LM_ERR("failed to register dialogs utimer\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the queue of the current process, the queues being allocated once the
+ * number of processes is known */
+static struct repl_dlg_queue *get_repl_queue(void)
+{
+	struct repl_dlg_queue *queues, *old = NULL;
+	unsigned int i;
+
+	queues = __atomic_load_n(&repl_batches->queues, __ATOMIC_ACQUIRE);
+	if (!queues && counted_max_processes) {
+		queues = shm_malloc(counted_max_processes * sizeof *queues);
+		if (!queues) {
+			LM_ERR("no more shm mem\n");
+			return NULL;
+		}
+		memset(queues, 0, counted_max_processes * sizeof *queues);
+
+		for (i = 0; i < counted_max_processes; i++)
+			lock_init(&queues[i].lock);
+
+		if (!__atomic_compare_exchange_n(&repl_batches->queues, &old, queues,
+				0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			for (i = 0; i < counted_max_processes; i++)
+				lock_destroy(&queues[i].lock);
+			shm_free(queues);
+			queues = old;
+		}
+	}
+
+	if (!queues || process_no >= counted_max_processes)
+		return NULL;
+
+	return &queues[process_no];
+}
+
+/*
+ * Queues the @ev event of @dlg (locked) for the next batch. A dialog sits in
+ * one queue at most, its later events (from any process) only being added
+ * to its pending ones; the batch replicates its state as of the flush.
+ *
+ * Returns 0 if queued, 1 if the queue of the process is full as well and
+ * -1 if the event has to be replicated right away.
+ */
+static int queue_dlg_repl(struct dlg_cell *dlg, unsigned int ev)
+{
+	struct repl_dlg_queue *q;
+	unsigned int no;
+
+	if (dlg->repl_pending) {
+		dlg->repl_pending |= ev;
+		return 0;
+	}
+
+	q = get_repl_queue();
+	if (!q)
+		return -1;
+
+	/* released once flushed */
+	ref_dlg_unsafe(dlg, 1);
+	dlg->repl_pending = ev;
+	dlg->repl_ts = get_uticks();
+	dlg->repl_next = NULL;
+
+	lock_get(&q->lock);
+	if (q->last)
+		q->last->repl_next = dlg;
+	else
+		q->first = dlg;
+	q->last = dlg;
+	no = ++q->no;
+	lock_release(&q->lock);
+
+	return no >= repl_dlg_batch_size ? 1 : 0;
+}
+
+/* each record is preceded by its length, see dlg_replicated_batch() */
+static void push_dlg_repl_record(struct repl_dlg_batch *b, int type,
+		struct dlg_cell *dlg, int leg)
+{
+	str buf;
+	int pos, len;
+
+	bin_get_buffer(&b->packet, &buf);
+	pos = buf.len;
+	bin_push_int(&b->packet, 0);
+	bin_push_int(&b->packet, type);
+
+	switch (type) {
+	case REPLICATION_DLG_CREATED:
+	case REPLICATION_DLG_UPDATED:
+		bin_push_dlg(&b->packet, dlg);
+		break;
+	case REPLICATION_DLG_DELETED:
+		bin_push_dlg_deleted(&b->packet, dlg);
+		break;
+	case REPLICATION_DLG_CSEQ:
+		bin_push_dlg_cseq(&b->packet, dlg, leg);
+		break;
+	}
+
+	/* the buffer may have been moved meanwhile */
+	bin_get_buffer(&b->packet, &buf);
+	len = buf.len - pos - sizeof len;
+	memcpy(buf.s + pos, &len, sizeof len);
+
+	b->events++;
+	b->sent[type]++;
+}
+
+/* adds the records of the pending @ev events of @dlg (locked) */
+static void push_dlg_repl_events(struct repl_dlg_batch *b,
+		struct dlg_cell *dlg, unsigned int ev)
+{
+	if (ev & DLG_REPL_EV_DELETED) {
+		/* nothing to delete if its creation was not replicated yet */
+		if (!(ev & DLG_REPL_EV_CREATED))
+			push_dlg_repl_record(b, REPLICATION_DLG_DELETED, dlg, 0);
+		return;
+	}
+
+	/* ended meanwhile, without a delete to replicate */
+	if (dlg->state == DLG_STATE_DELETED)
+		return;
+
+	/* the full state, including the cseqs */
+	if (ev & DLG_REPL_EV_CREATED) {
+		push_dlg_repl_record(b, REPLICATION_DLG_CREATED, dlg, 0);
+		return;
+	}
+
+	if (ev & DLG_REPL_EV_UPDATED)
+		push_dlg_repl_record(b, REPLICATION_DLG_UPDATED, dlg, 0);
+
+	/* an update does not carry the cseqs */
+	if (ev & DLG_REPL_EV_CSEQ_CALLER)
+		push_dlg_repl_record(b, REPLICATION_DLG_CSEQ, dlg, DLG_CALLER_LEG);
+	if (ev & DLG_REPL_EV_CSEQ_CALLEE)
+		push_dlg_repl_record(b, REPLICATION_DLG_CSEQ, dlg, callee_idx(dlg));
+}
+
+static void send_dlg_repl_batch(struct repl_dlg_batch *b)
+{
+	int rc;
+
+	rc = clusterer_api.send_all(&b->packet, dialog_repl_cluster);
+	switch (rc) {
+	case CLUSTERER_CURR_DISABLED:
+		LM_INFO("Current node is disabled in cluster: %d\n", dialog_repl_cluster);
+		goto error;
+	case CLUSTERER_DEST_DOWN:
+		LM_ERR("All destinations in cluster: %d are down or probing\n",
+			dialog_repl_cluster);
+		goto error;
+	case CLUSTERER_SEND_ERR:
+		LM_ERR("Error sending in cluster: %d\n", dialog_repl_cluster);
+		goto error;
+	}
+
+	if_update_stat(dlg_enable_stats, create_sent,
+		b->sent[REPLICATION_DLG_CREATED]);
+	if_update_stat(dlg_enable_stats, update_sent,
+		b->sent[REPLICATION_DLG_UPDATED]);
+	if_update_stat(dlg_enable_stats, delete_sent,
+		b->sent[REPLICATION_DLG_DELETED]);
+
+	__atomic_fetch_add(&repl_batches->packets, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&repl_batches->events, b->events, __ATOMIC_RELAXED);
+	__atomic_store_n(&repl_batches->lag, (get_uticks() - b->oldest) / 1000,
+		__ATOMIC_RELAXED);
+	goto reset;
+
+error:
+	LM_ERR("Failed to replicate %d dialog events\n", b->events);
+reset:
+	bin_reset_back_pointer(&b->packet);
+	b->events = 0;
+	memset(b->sent, 0, sizeof b->sent);
+}
+
+static void flush_dlg_repl_queue(struct repl_dlg_queue *q)
+{
+	struct repl_dlg_batch b;
+	struct dlg_cell *dlg, *next;
+	unsigned int ev;
+	int drop = 0;
+	str buf;
+
+	lock_get(&q->lock);
+	dlg = q->first;
+	q->first = q->last = NULL;
+	q->no = 0;
+	lock_release(&q->lock);
+
+	if (!dlg)
+		return;
+
+	memset(&b, 0, sizeof b);
+	if (bin_init(&b.packet, &dlg_repl_cap, REPLICATION_DLG_BATCH,
+			BIN_VERSION, 0) != 0) {
+		LM_ERR("Failed to replicate the queued dialog events\n");
+		drop = 1;
+	}
+
+	for (; dlg; dlg = next) {
+		dlg_lock_dlg(dlg);
+
+		/* it may be queued again as soon as nothing is pending */
+		next = dlg->repl_next;
+		ev = dlg->repl_pending;
+		dlg->repl_pending = 0;
+
+		if (!drop) {
+			if (!b.events || dlg->repl_ts < b.oldest)
+				b.oldest = dlg->repl_ts;
+			push_dlg_repl_events(&b, dlg, ev);
+		}
+
+		dlg_unlock_dlg(dlg);
+		unref_dlg(dlg, 1);
+
+		if (drop)
+			continue;
+
+		bin_get_buffer(&b.packet, &buf);
+		if (buf.len > DLG_REPL_BATCH_BUF_THRESHOLD)
+			send_dlg_repl_batch(&b);
+	}
+
+	if (drop)
+		return;
+
+	if (b.events)
+		send_dlg_repl_batch(&b);
+	bin_free_packet(&b.packet);
+}
+
+static void flush_own_dlg_repl(void)
+{
+	struct repl_dlg_queue *q;
+
+	q = get_repl_queue();
+	if (q)
+		flush_dlg_repl_queue(q);
+}
+
+static void flush_dlg_repl_routine(utime_t ticks, void *param)
+{
+	struct repl_dlg_queue *queues;
+	unsigned int i;
+
+	queues = __atomic_load_n(&repl_batches->queues, __ATOMIC_ACQUIRE);
+	if (!queues)
+		return;
+
+	for (i = 0; i < counted_max_processes; i++)
+		if (__atomic_load_n(&queues[i].no, __ATOMIC_RELAXED))
+			flush_dlg_repl_queue(&queues[i]);
+}
+
+/* the average number of events in a batch */
+unsigned long dlg_get_repl_batch_size(unsigned short foo)
+{
+	unsigned long packets;
+
+	if (!repl_batches)
+		return 0;
+
+	packets = __atomic_load_n(&repl_batches->packets, __ATOMIC_RELAXED);
+	return packets ?
+		__atomic_load_n(&repl_batches->events, __ATOMIC_RELAXED) / packets : 0;
+}
+
+/* how long the oldest event of the last batch sent was queued, in ms */
+unsigned long dlg_get_repl_lag(unsigned short foo)
+{
+	return repl_batches ?
+		__atomic_load_n(&repl_batches->lag, __ATOMIC_RELAXED) : 0;
+}
+
+/**
+ * replicates locally a batch of dialog events, each record being preceded
+ * by its length, so that a record only partially read (e.g. for an unknown
+ * dialog) does not break the next ones
+ */
+static int dlg_replicated_batch(bin_packet_t *packet)
+{
+	str buf;
+	char *end;
+	int len, type, rc = 0;
+
+	bin_get_buffer(packet, &buf);
+
+	while (bin_pop_int(packet, &len) == 0) {
+		end = packet->front_pointer + len;
+		if (len < (int)sizeof type || end > buf.s + buf.len) {
+			LM_ERR("malformed dialog batch from node: %d\n", packet->src_id);
+			return -1;
+		}
+
+		bin_pop_int(packet, &type);
+
+		switch (type) {
+		case REPLICATION_DLG_CREATED:
+			if (dlg_replicated_create(packet, NULL, NULL, NULL, 1) < 0)
+				rc = -1;
+			if_update_stat(dlg_enable_stats, create_recv, 1);
+			break;
+		case REPLICATION_DLG_UPDATED:
+			if (dlg_replicated_update(packet) < 0)
+				rc = -1;
+			if_update_stat(dlg_enable_stats, update_recv, 1);
+			break;
+		case REPLICATION_DLG_DELETED:
+			if (dlg_replicated_delete(packet) < 0)
+				rc = -1;
+			if_update_stat(dlg_enable_stats, delete_recv, 1);
+			break;
+		case REPLICATION_DLG_CSEQ:
+			if (dlg_replicated_cseq_updated(packet) < 0)
+				rc = -1;
+			break;
+		default:
+			rc = -1;
+			LM_WARN("Invalid dialog event %d in batch from node: %d\n",
+				type, packet->src_id);
+		}
+
+		packet->front_pointer = end;
+	}
+
+	return rc;
+}
+
 void receive_dlg_repl(bin_packet_t *packet)
 {
 	int rc = 0;
@@ -870,6 +1335,11 @@ void receive_dlg_repl(bin_packet_t *packet)
 		case REPLICATION_DLG_CSEQ:
 			rc = dlg_replicated_cseq_updated(pkt);
 			break;
+		case REPLICATION_DLG_BATCH:
+			ensure_bin_version(pkt, BIN_VERSION);
+
+			rc = dlg_replicated_batch(pkt);
+			break;
 		case SYNC_PACKET_TYPE:
 			ensure_bin_version(pkt, BIN_VERSION);
 
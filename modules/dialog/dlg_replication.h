@@ -32,9 +32,20 @@
 #define REPLICATION_DLG_UPDATED		2
 #define REPLICATION_DLG_DELETED		3
 #define REPLICATION_DLG_CSEQ		4
+#define REPLICATION_DLG_BATCH		5
 
 #define BIN_VERSION 2
 
+/* the events of a dialog waiting in a replication queue (repl_pending) */
+#define DLG_REPL_EV_CREATED		(1<<0)
+#define DLG_REPL_EV_UPDATED		(1<<1)
+#define DLG_REPL_EV_DELETED		(1<<2)
+#define DLG_REPL_EV_CSEQ_CALLER	(1<<3)
+#define DLG_REPL_EV_CSEQ_CALLEE	(1<<4)
+
+#define DLG_REPL_BATCH_SIZE				64
+#define DLG_REPL_BATCH_BUF_THRESHOLD	32768
+
 extern int dialog_repl_cluster;
 extern int profile_repl_cluster;
 
@@ -45,6 +56,9 @@ extern struct clusterer_binds clusterer_api;
 
 extern str shtag_dlg_val;
 
+extern int repl_dlg_batch_utimer;
+extern int repl_dlg_batch_size;
+
 void replicate_dialog_created(struct dlg_cell *dlg);
 void replicate_dialog_updated(struct dlg_cell *dlg);
 void replicate_dialog_deleted(struct dlg_cell *dlg);
@@ -56,6 +70,7 @@ int dlg_replicated_update(bin_packet_t *packet);
 int dlg_replicated_delete(bin_packet_t *packet);
 
 void receive_dlg_repl(bin_packet_t *packet);
+int repl_dlg_batch_init(void);
 void rcv_cluster_event(enum clusterer_event ev, int node_id);
 
 mi_response_t *mi_sync_cl_dlg(const mi_params_t *params,
@@ -64,5 +79,8 @@ mi_response_t *mi_sync_cl_dlg(const mi_params_t *params,
 int get_shtag_state(struct dlg_cell *dlg);
 int set_dlg_shtag(struct dlg_cell *dlg, str *tag_name);
 
+unsigned long dlg_get_repl_batch_size(unsigned short foo);
+unsigned long dlg_get_repl_lag(unsigned short foo);
+
 #endif /* _DIALOG_DLG_REPLICATION_H_ */
 
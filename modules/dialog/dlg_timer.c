@@ -30,8 +30,8 @@
 struct dlg_timer *d_timer = 0;
 dlg_timer_handler timer_hdl = 0;
 
-struct dlg_ping_timer *ping_timer=0;
-struct dlg_reinvite_ping_timer *reinvite_ping_timer=0;
+struct dlg_timer *ping_timer=0;
+struct dlg_timer *reinvite_ping_timer=0;
 str options_str=str_init("OPTIONS");
 str invite_str=str_init("INVITE");
 
@@ -45,36 +45,68 @@ extern int options_ping_interval;
  */
 #define FAKE_DIALOG_TL ((struct dlg_tl*)-1)
 
-int init_dlg_timer( dlg_timer_handler hdl )
+#define DLG_WHEEL_MASK  (DLG_WHEEL_SIZE - 1)
+
+/* the shard of an entry, by its (shm) address */
+#define tl_shard(_tl_) \
+	((((unsigned long)(_tl_) >> 4) ^ ((unsigned long)(_tl_) >> 12)) & \
+		(DLG_TIMER_SHARDS - 1))
+
+static struct dlg_timer *new_dlg_timer(void)
 {
-	d_timer = (struct dlg_timer*)shm_malloc(sizeof(struct dlg_timer));
-	if (d_timer==0) {
+	struct dlg_timer *t;
+	struct dlg_timer_shard *s;
+	unsigned int now, i, j;
+
+	t = (struct dlg_timer*)shm_malloc(sizeof(struct dlg_timer));
+	if (t==0) {
 		LM_ERR("no more shm mem\n");
-		return -1;
+		return 0;
 	}
-	memset( d_timer, 0, sizeof(struct dlg_timer) );
+	memset(t, 0, sizeof(struct dlg_timer));
 
-	d_timer->first.next = d_timer->first.prev = &(d_timer->first);
+	now = get_ticks();
+	for (i = 0; i < DLG_TIMER_SHARDS; i++) {
+		s = &t->shards[i];
+		s->clk = now;
+		for (j = 0; j < DLG_WHEEL_SIZE; j++)
+			s->slots[j].next = s->slots[j].prev = &s->slots[j];
+	}
 
-	d_timer->lock = lock_alloc();
-	if (d_timer->lock==0) {
-		LM_ERR("failed to alloc lock\n");
+	t->locks = lock_set_alloc(DLG_TIMER_SHARDS);
+	if (t->locks==0) {
+		LM_ERR("failed to alloc locks\n");
 		goto error0;
 	}
 
-	if (lock_init(d_timer->lock)==0) {
-		LM_ERR("failed to init lock\n");
+	if (lock_set_init(t->locks)==0) {
+		LM_ERR("failed to init locks\n");
 		goto error1;
 	}
 
-	timer_hdl = hdl;
-	return 0;
+	return t;
 error1:
-	lock_dealloc(d_timer->lock);
+	lock_set_dealloc(t->locks);
 error0:
-	shm_free(d_timer);
-	d_timer = 0;
-	return -1;
+	shm_free(t);
+	return 0;
+}
+
+static void free_dlg_timer(struct dlg_timer *t)
+{
+	lock_set_destroy(t->locks);
+	lock_set_dealloc(t->locks);
+	shm_free(t);
+}
+
+int init_dlg_timer( dlg_timer_handler hdl )
+{
+	d_timer = new_dlg_timer();
+	if (d_timer==0)
+		return -1;
+
+	timer_hdl = hdl;
+	return 0;
 }
 
 #ifdef EXTRA_DEBUG
@@ -100,16 +132,16 @@ void debug_detached_timer_list(struct dlg_tl *detached)
 
 }
 
-/* assumed to be always called under timer lock */
-void debug_main_timer_list(void)
+/* assumed to be always called under the lock of the slot's shard */
+void debug_slot_list(struct dlg_tl *slot)
 {
 	struct dlg_tl *start,*finish;
 	int visited=1;
 
-	start = finish = &(d_timer->first);
+	start = finish = slot;
 	LM_DBG("testing forward loop with visited = %d\n",visited);
 
-	/* check the main list is circular in both directions from start to end,
+	/* check the slot list is circular in both directions from start to end,
 	 * with no loops in the middle */
 	while (start) {
 		start->visited=visited;
@@ -119,13 +151,13 @@ void debug_main_timer_list(void)
 			break;
 
 		if (start == NULL || start->visited == visited) {
-			LM_ERR("Detected something wrong with main timer list on forward linking for entry %p \n",start);
+			LM_ERR("Detected something wrong with timer slot list on forward linking for entry %p \n",start);
 			abort();
 		}
 	}
 
 	visited++;
-	start = &(d_timer->first);
+	start = slot;
 
 	LM_DBG("testing backward loop with visited = %d\n",visited);
 
@@ -137,7 +169,7 @@ void debug_main_timer_list(void)
 			break;
 
 		if (start == NULL || start->visited == visited) {
-			LM_ERR("Detected something wrong with main timer list on backward linking for entry %p \n",start);
+			LM_ERR("Detected something wrong with timer slot list on backward linking for entry %p \n",start);
 			abort();
 		}
 	}
@@ -147,74 +179,27 @@ void debug_main_timer_list(void)
 
 int init_dlg_ping_timer(void)
 {
-	ping_timer = (struct dlg_ping_timer*)shm_malloc(sizeof(struct dlg_timer));
-	if (ping_timer==0) {
-		LM_ERR("no more shm mem\n");
-		return -1;
-	}
-
-	memset(ping_timer,0,sizeof(struct dlg_ping_timer));
-	ping_timer->lock = lock_alloc();
-	if (ping_timer->lock == 0) {
-		LM_ERR("failed to alloc lock\n");
-		goto error0;
-	}
-
-	if (lock_init(ping_timer->lock) == 0) {
-		LM_ERR("failed to init lock\n");
-		goto error1;
-	}
-
-	return 0;
-
-error1:
-	lock_dealloc(ping_timer->lock);
-error0:
-	shm_free(ping_timer);
-	ping_timer=0;
-	return -1;
+	ping_timer = new_dlg_timer();
+	return ping_timer ? 0 : -1;
 }
 
 int init_dlg_reinvite_ping_timer(void)
 {
-	reinvite_ping_timer = (struct dlg_reinvite_ping_timer*)shm_malloc(sizeof(struct dlg_timer));
-	if (reinvite_ping_timer==0) {
-		LM_ERR("no more shm mem\n");
-		return -1;
-	}
-
-	memset(reinvite_ping_timer,0,sizeof(struct dlg_reinvite_ping_timer));
-	reinvite_ping_timer->lock = lock_alloc();
-	if (reinvite_ping_timer->lock == 0) {
-		LM_ERR("failed to alloc lock\n");
-		goto error0;
-	}
-
-	if (lock_init(reinvite_ping_timer->lock) == 0) {
-		LM_ERR("failed to init lock\n");
-		goto error1;
-	}
-
-	return 0;
-
-error1:
-	lock_dealloc(reinvite_ping_timer->lock);
-error0:
-	shm_free(reinvite_ping_timer);
-	reinvite_ping_timer=0;
-	return -1;
+	reinvite_ping_timer = new_dlg_timer();
+	return reinvite_ping_timer ? 0 : -1;
 }
 
 void destroy_ping_timer(void)
 {
-	if (ping_timer ==0)
-		return;
-
-	lock_destroy(ping_timer->lock);
-	lock_dealloc(ping_timer->lock);
+	if (ping_timer) {
+		free_dlg_timer(ping_timer);
+		ping_timer=0;
+	}
 
-	shm_free(ping_timer);
-	ping_timer=0;
+	if (reinvite_ping_timer) {
+		free_dlg_timer(reinvite_ping_timer);
+		reinvite_ping_timer=0;
+	}
 }
 
 
@@ -223,97 +208,66 @@ void destroy_dlg_timer(void)
 	if (d_timer==0)
 		return;
 
-	lock_destroy(d_timer->lock);
-	lock_dealloc(d_timer->lock);
-
-	shm_free(d_timer);
+	free_dlg_timer(d_timer);
 	d_timer = 0;
 }
 
 
 
-static inline void insert_dlg_timer_unsafe(struct dlg_tl *tl)
+/* links @tl in the slot of its timeout; the ones already due (the shard
+ * was run past their timeout) go in the slot of the next run */
+static inline void insert_dlg_timer_unsafe(struct dlg_timer_shard *s,
+		struct dlg_tl *tl)
 {
-	struct dlg_tl* ptr;
+	struct dlg_tl *slot;
+	unsigned int tick;
 
-#ifdef EXTRA_DEBUG
-	debug_main_timer_list();
-#endif
-
-	for(ptr = d_timer->first.prev; ptr != &d_timer->first ; ptr = ptr->prev) {
-		if ( ptr->timeout <= tl->timeout )
-			break;
-	}
+	tick = (int)(tl->timeout - s->clk) > 0 ? tl->timeout : s->clk + 1;
+	slot = &s->slots[tick & DLG_WHEEL_MASK];
 
 	LM_DBG("inserting %p for %d\n", tl,tl->timeout);
-	tl->prev = ptr;
-	tl->next = ptr->next;
+	tl->prev = slot;
+	tl->next = slot->next;
 	tl->prev->next = tl;
 	tl->next->prev = tl;
 
 #ifdef EXTRA_DEBUG
-	debug_main_timer_list();
+	debug_slot_list(slot);
 #endif
 }
 
 int insert_dlg_timer(struct dlg_tl *tl, int interval)
 {
-	lock_get( d_timer->lock);
+	unsigned int i = tl_shard(tl);
+
+	lock_set_get( d_timer->locks, i);
 
 	if (tl->next!=0 || tl->prev!=0) {
-		lock_release( d_timer->lock);
+		lock_set_release( d_timer->locks, i);
 		LM_CRIT("Trying to insert a bogus dlg tl=%p tl->next=%p tl->prev=%p\n",
 			tl, tl->next, tl->prev);
 		return -1;
 	}
 	tl->timeout = get_ticks()+interval;
 
-	insert_dlg_timer_unsafe( tl );
+	insert_dlg_timer_unsafe( &d_timer->shards[i], tl );
 
-	lock_release( d_timer->lock);
+	lock_set_release( d_timer->locks, i);
 
 	return 0;
 }
 
-void unsafe_insert_ping_timer(struct dlg_ping_list *node,int new_timeout)
+/* (re)schedules a ping entry which is not in its timer */
+static void insert_ping_node(struct dlg_timer *t, struct dlg_ping_list *node,
+		unsigned int timeout)
 {
-	struct dlg_ping_list *it;
-
-	node->timeout = get_ticks() + new_timeout;
+	unsigned int i = tl_shard(node);
 
-	if (ping_timer->first == 0) {
-		ping_timer->first = node;
-		ping_timer->last = node;
-	} else {
-		/* quick optimisation, always check if our timeout is bigger than last
-		if not, lookup our position, might be useful in the future if we want
-		to set different ping intervals per dialog */
-		if (node->timeout >= ping_timer->last->timeout) {
-			node->prev = ping_timer->last;
-			ping_timer->last->next = node;
-			ping_timer->last = node;
-		} else {
-			for (it=ping_timer->first;it;it=it->next) {
-				if (it->timeout >= node->timeout)
-					break;
-			}
+	node->tl.timeout = timeout;
 
-			/* we need to insert ourselves before the found node */
-			if (it == NULL) {
-				/* we're going to be the last node 
-				should never get here due to the above optimisation ... paranoia */
-				node->prev = ping_timer->last;
-				ping_timer->last->next = node;
-				ping_timer->last = node;
-			} else {
-				it->prev->next=node;
-				node->prev = it->prev;
-				node->next = it;
-				it->prev = node;
-			}
-
-		}
-	}
+	lock_set_get( t->locks, i);
+	insert_dlg_timer_unsafe( &t->shards[i], &node->tl);
+	lock_set_release( t->locks, i);
 }
 
 int insert_ping_timer(struct dlg_cell* dlg)
@@ -325,65 +279,19 @@ int insert_ping_timer(struct dlg_cell* dlg)
 		LM_ERR("no more shm mem\n");
 		return -1;
 	}
-
+	memset(node, 0, sizeof(struct dlg_ping_list));
 	node->dlg = dlg;
-	node->next = 0;
-	node->prev = 0;
-
-	lock_get( ping_timer->lock );
-
-	unsafe_insert_ping_timer(node,options_ping_interval);
-	dlg->pl = node;
 
 	dlg->legs[DLG_CALLER_LEG].reply_received = DLG_PING_SUCCESS;
 	dlg->legs[callee_idx(dlg)].reply_received = DLG_PING_SUCCESS;
+	dlg->pl = node;
 
-	lock_release( ping_timer->lock);
+	insert_ping_node(ping_timer, node, get_ticks() + options_ping_interval);
 	LM_DBG("Inserted dlg [%p] in ping timer list\n",dlg);
 
 	return 0;
 }
 
-void unsafe_insert_reinvite_ping_timer(struct dlg_ping_list *node,int new_timeout)
-{
-	struct dlg_ping_list *it;
-
-	node->timeout = get_ticks() + new_timeout;
-
-	if (reinvite_ping_timer->first == 0) {
-		reinvite_ping_timer->first = node;
-		reinvite_ping_timer->last = node;
-	} else {
-		/* quick optimisation, always check if our timeout is bigger than last
-		if not, lookup our position, might be useful in the future if we want
-		to set different ping intervals per dialog */
-		if (node->timeout >= reinvite_ping_timer->last->timeout) {
-			node->prev = reinvite_ping_timer->last;
-			reinvite_ping_timer->last->next = node;
-			reinvite_ping_timer->last = node;
-		} else {
-			for (it=reinvite_ping_timer->first;it;it=it->next) {
-				if (it->timeout >= node->timeout)
-					break;
-			}
-
-			/* we need to insert ourselves before the found node */
-			if (it == NULL) {
-				/* we're going to be the last node 
-				should never get here due to the above optimisation ... paranoia */
-				node->prev = reinvite_ping_timer->last;
-				reinvite_ping_timer->last->next = node;
-				reinvite_ping_timer->last = node;
-			} else {
-				it->prev->next=node;
-				node->prev = it->prev;
-				node->next = it;
-				it->prev = node;
-			}
-		}
-	}
-}
-
 int insert_reinvite_ping_timer(struct dlg_cell* dlg)
 {
 	struct dlg_ping_list *node;
@@ -393,20 +301,15 @@ int insert_reinvite_ping_timer(struct dlg_cell* dlg)
 		LM_ERR("no more shm mem\n");
 		return -1;
 	}
-
+	memset(node, 0, sizeof(struct dlg_ping_list));
 	node->dlg = dlg;
-	node->next = 0;
-	node->prev = 0;
-
-	lock_get( reinvite_ping_timer->lock );
-
-	unsafe_insert_reinvite_ping_timer(node,reinvite_ping_interval);
-	dlg->reinvite_pl = node;
 
 	dlg->legs[DLG_CALLER_LEG].reinvite_confirmed = DLG_PING_SUCCESS;
 	dlg->legs[callee_idx(dlg)].reinvite_confirmed = DLG_PING_SUCCESS;
+	dlg->reinvite_pl = node;
 
-	lock_release( reinvite_ping_timer->lock);
+	insert_ping_node(reinvite_ping_timer, node,
+		get_ticks() + reinvite_ping_interval);
 	LM_DBG("Inserted dlg [%p] in reinvite ping timer list\n",dlg);
 
 	return 0;
@@ -414,16 +317,8 @@ int insert_reinvite_ping_timer(struct dlg_cell* dlg)
 
 static inline void remove_dlg_timer_unsafe(struct dlg_tl *tl)
 {
-#ifdef EXTRA_DEBUG
-	debug_main_timer_list();
-#endif
-
 	tl->prev->next = tl->next;
 	tl->next->prev = tl->prev;
-
-#ifdef EXTRA_DEBUG
-	debug_main_timer_list();
-#endif
 }
 
 
@@ -435,20 +330,22 @@ static inline void remove_dlg_timer_unsafe(struct dlg_tl *tl)
  */
 int remove_dlg_timer(struct dlg_tl *tl)
 {
-	lock_get( d_timer->lock);
+	unsigned int i = tl_shard(tl);
+
+	lock_set_get( d_timer->locks, i);
 
 	if (tl->prev==NULL && tl->timeout==0) {
 		/* dialog is not in timer list; either it is completly removed
 		   (prev=next=timeout=0), either is in process by timeout routine
 		   (prev=timeout=0;next!=0) */
-		lock_release( d_timer->lock);
+		lock_set_release( d_timer->locks, i);
 		return 1;
 	}
 
 	if (tl->prev==NULL || tl->next==NULL || tl->next == FAKE_DIALOG_TL) {
 		LM_CRIT("bogus tl=%p tl->prev=%p tl->next=%p\n",
 			tl, tl->prev, tl->next);
-		lock_release( d_timer->lock);
+		lock_set_release( d_timer->locks, i);
 		return -1;
 	}
 
@@ -458,60 +355,30 @@ int remove_dlg_timer(struct dlg_tl *tl)
 	tl->prev = NULL;
 	tl->timeout = 0;
 
-	lock_release( d_timer->lock);
+	lock_set_release( d_timer->locks, i);
 	return 0;
 }
 
-static inline void detach_ping_node_unsafe(struct dlg_ping_list *it,int reinvite)
-{
-	if (it->next && it->prev) {
-		it->prev->next = it->next;
-		it->next->prev = it->prev;
-	}
-	else if (it->next) {
-		it->next->prev = 0;
-		if (reinvite)
-			reinvite_ping_timer->first = it->next;
-		else
-			ping_timer->first = it->next;
-	} else if (it->prev) {
-		it->prev->next = 0;
-		if (reinvite)
-			reinvite_ping_timer->last = it->prev;
-		else
-			ping_timer->last = it->prev;
-	} else {
-		if (reinvite) {
-			reinvite_ping_timer->first = 0;
-			reinvite_ping_timer->last = 0;
-		} else {
-			ping_timer->first = 0;
-			ping_timer->last = 0;
-		}
-	}
-
-	it->next = it->prev = 0;
-}
-
 /* returns :
      0 - dialog was inserted in timer list with the new timeout
      1 - dialog was inserted in timer list with the new timeout 
     -1 - failure (dialog is expired, so it cannot be added again) */
 int update_dlg_timer( struct dlg_tl *tl, int timeout )
 {
+	unsigned int i = tl_shard(tl);
 	int ret;
 
-	lock_get( d_timer->lock);
+	lock_set_get( d_timer->locks, i);
 
 	if ( tl->next == FAKE_DIALOG_TL ) {
 		/* previously removed from timer list - we will not add it again */
-		lock_release( d_timer->lock);
+		lock_set_release( d_timer->locks, i);
 		return 0;
 	}
 
 	if ( tl->next ) {
 		if (tl->prev==0) {
-			lock_release( d_timer->lock);
+			lock_set_release( d_timer->locks, i);
 			return -1;
 		}
 		remove_dlg_timer_unsafe(tl);
@@ -521,60 +388,59 @@ int update_dlg_timer( struct dlg_tl *tl, int timeout )
 	}
 
 	tl->timeout = get_ticks()+timeout;
-	insert_dlg_timer_unsafe( tl );
+	insert_dlg_timer_unsafe( &d_timer->shards[i], tl );
 
-	lock_release( d_timer->lock);
+	lock_set_release( d_timer->locks, i);
 	return ret;
 }
 
-static inline struct dlg_tl* get_expired_dlgs(unsigned int time)
+/* detaches all the entries of @t expired by @time in a list ended by
+ * FAKE_DIALOG_TL, with prev=timeout=0 for each of them */
+static struct dlg_tl* get_expired_dlgs(struct dlg_timer *t, unsigned int time)
 {
-	struct dlg_tl *tl , *end, *ret;
+	struct dlg_timer_shard *s;
+	struct dlg_tl *slot, *tl, *next, *ret = FAKE_DIALOG_TL;
+	unsigned int i, n, lag = 0;
 
-	lock_get( d_timer->lock);
+	for (i = 0; i < DLG_TIMER_SHARDS; i++) {
+		s = &t->shards[i];
 
-	if (d_timer->first.next==&(d_timer->first)
-	|| d_timer->first.next->timeout > time ) {
-		lock_release( d_timer->lock);
-		return FAKE_DIALOG_TL;
-	}
+		lock_set_get( t->locks, i);
 
-#ifdef EXTRA_DEBUG
-	debug_main_timer_list();
-#endif
+		/* each slot is walked once, even if we are late by a full turn */
+		n = (int)(time - s->clk) > 0 ? time - s->clk : 0;
+		if (n > DLG_WHEEL_SIZE)
+			n = DLG_WHEEL_SIZE;
 
-	end = &d_timer->first;
-	tl = d_timer->first.next;
-	LM_DBG("start with tl=%p tl->prev=%p tl->next=%p (%d) at %d "
-		"and end with end=%p end->prev=%p end->next=%p\n",
-		tl,tl->prev,tl->next,tl->timeout,time,
-		end,end->prev,end->next);
-	while( tl!=end && tl->timeout <= time) {
-		LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d\n",
-			tl,tl->prev,tl->next,tl->timeout);
-		tl->prev = 0;
-		tl->timeout = 0;
-		tl=tl->next;
-	}
-	LM_DBG("end with tl=%p tl->prev=%p tl->next=%p and "
-		"d_timer->first.next->prev=%p\n",
-		tl,tl->prev,tl->next,d_timer->first.next->prev);
+		for (; n > 0; n--) {
+			slot = &s->slots[(time - n + 1) & DLG_WHEEL_MASK];
 
-	if (tl==end && d_timer->first.next->prev) {
-		LM_DBG("no dialog to return\n");
-		ret = FAKE_DIALOG_TL;
-	} else {
-		ret = d_timer->first.next;
-		tl->prev->next = FAKE_DIALOG_TL;
-		d_timer->first.next = tl;
-		tl->prev = &d_timer->first;
-	}
+			for (tl = slot->next; tl != slot; tl = next) {
+				next = tl->next;
+				/* due on a later turn */
+				if ((int)(tl->timeout - time) > 0)
+					continue;
 
-#ifdef EXTRA_DEBUG
-	debug_main_timer_list();
-#endif
+				LM_DBG("getting tl=%p tl->prev=%p tl->next=%p with %d\n",
+					tl,tl->prev,tl->next,tl->timeout);
+				if (time - tl->timeout > lag)
+					lag = time - tl->timeout;
 
-	lock_release( d_timer->lock);
+				remove_dlg_timer_unsafe(tl);
+				tl->prev = 0;
+				tl->timeout = 0;
+				tl->next = ret;
+				ret = tl;
+			}
+		}
+
+		if ((int)(time - s->clk) > 0)
+			s->clk = time;
+
+		lock_set_release( t->locks, i);
+	}
+
+	t->lag = lag * 1000;
 
 #ifdef EXTRA_DEBUG
 	debug_detached_timer_list(ret);
@@ -586,7 +452,7 @@ void dlg_timer_routine(unsigned int ticks , void * attr)
 {
 	struct dlg_tl *tl, *ctl;
 
-	tl = get_expired_dlgs( ticks );
+	tl = get_expired_dlgs( d_timer, ticks );
 
 	while (tl != FAKE_DIALOG_TL) {
 		ctl = tl;
@@ -598,98 +464,85 @@ void dlg_timer_routine(unsigned int ticks , void * attr)
 	}
 }
 
-/* removes expired dlgs from main ping_timer list
- * and links them back into a new list */
-void get_timeout_dlgs(struct dlg_ping_list **expired,
-		struct dlg_ping_list **to_be_deleted,int reinvite)
+unsigned long dlg_get_timer_lag(unsigned short foo)
 {
-	struct dlg_ping_list *exp = NULL,*del=NULL,*it=NULL,*next=NULL;
-	struct dlg_cell *current;
-	int detached;
-
-	if (reinvite)
-		lock_get(reinvite_ping_timer->lock);
-	else
-		lock_get(ping_timer->lock);
-
-	for (it=reinvite?reinvite_ping_timer->first:ping_timer->first;it;it=next) {
-		/* FIXME - optimisation needed here : only iterate on the nodes that we need to
-		eg. where pinging is in progress */
-
-		current = it->dlg;
-		next = it->next;
-		detached = 0;
-
-		if (current->state == DLG_STATE_DELETED) {
-			/* the dialog has terminated - we remove it as well
-			 * since we also have a ref */
-			detach_ping_node_unsafe(it,reinvite);
-			if (reinvite)
-				it->dlg->reinvite_pl = 0;
-			else
-				it->dlg->pl = 0;
-
-			if (del == NULL)
-				del = it;
-			else {
-				it->next = del;
-				del = it;
-			}
+	unsigned long lag = 0;
 
-			continue;
-		}
+	if (d_timer && d_timer->lag > lag)
+		lag = d_timer->lag;
+	if (ping_timer && ping_timer->lag > lag)
+		lag = ping_timer->lag;
+	if (reinvite_ping_timer && reinvite_ping_timer->lag > lag)
+		lag = reinvite_ping_timer->lag;
 
-		if (reinvite?(current->flags & DLG_FLAG_REINVITE_PING_CALLER):
-		(current->flags & DLG_FLAG_PING_CALLER)) {
-			if (reinvite?(current->legs[DLG_CALLER_LEG].reinvite_confirmed == DLG_PING_FAIL):
-			(current->legs[DLG_CALLER_LEG].reply_received == DLG_PING_FAIL)) {
-				detach_ping_node_unsafe(it,reinvite);
-				detached=1;
-
-				if (reinvite)
-					it->dlg->reinvite_pl = 0;
-				else
-					it->dlg->pl = 0;
-
-				if (exp == NULL)
-					exp = it;
-				else {
-					it->next = exp;
-					exp = it;
-				}
-			}
-		}
+	return lag;
+}
 
-		if (detached == 0) {
-			if (reinvite?(current->flags & DLG_FLAG_REINVITE_PING_CALLEE):
-			(current->flags & DLG_FLAG_PING_CALLEE)) {
-				if (reinvite?(current->legs[callee_idx(current)].reinvite_confirmed == DLG_PING_FAIL):
-				current->legs[callee_idx(current)].reply_received == DLG_PING_FAIL) {
-					detach_ping_node_unsafe(it,reinvite);
-					if (reinvite)
-						it->dlg->reinvite_pl = 0;
-					else
-						it->dlg->pl = 0;
-
-
-					if (exp == NULL)
-						exp = it;
-					else {
-						it->next = exp;
-						exp = it;
-					}
-				}
-			}
-		}
+/* the ping entry of a dialog is only touched by the ping routine, out of
+ * its timer, and by ping_timer_due_now() - which needs to know (under the
+ * shard lock) whether it is still linked to the dialog */
+static void unlink_ping_node(struct dlg_timer *t, struct dlg_ping_list *node,
+		struct dlg_ping_list **pl)
+{
+	unsigned int i = tl_shard(node);
+
+	lock_set_get( t->locks, i);
+	*pl = 0;
+	lock_set_release( t->locks, i);
+}
+
+/* makes the ping of @dlg due on the next run of its timer, so a failed
+ * ping terminates the dialog right away and not after a full interval */
+static void ping_timer_due_now(struct dlg_cell *dlg, int reinvite)
+{
+	struct dlg_timer *t = reinvite ? reinvite_ping_timer : ping_timer;
+	struct dlg_ping_list *node, **pl = reinvite ? &dlg->reinvite_pl : &dlg->pl;
+	unsigned int i;
+
+	node = *(struct dlg_ping_list * volatile *)pl;
+	if (!node || !t)
+		return;
+
+	i = tl_shard(node);
+	lock_set_get( t->locks, i);
+
+	/* not being processed by the ping routine right now */
+	if (*pl == node && node->tl.prev) {
+		remove_dlg_timer_unsafe(&node->tl);
+		node->tl.timeout = t->shards[i].clk + 1;
+		insert_dlg_timer_unsafe(&t->shards[i], &node->tl);
 	}
 
-	if (reinvite)
-		lock_release(reinvite_ping_timer->lock);
-	else
-		lock_release(ping_timer->lock);
+	lock_set_release( t->locks, i);
+}
 
-	*to_be_deleted = del;
-	*expired = exp;
+/* the dialog ended - its ping entries are released on the next run of
+ * their timers, without waiting for their next ping */
+void dlg_ping_timers_due_now(struct dlg_cell *dlg)
+{
+	ping_timer_due_now(dlg, 0);
+	ping_timer_due_now(dlg, 1);
+}
+
+/* the dialog of a ping entry ended or one of its pings failed */
+static inline int ping_node_done(struct dlg_ping_list *node, int reinvite)
+{
+	struct dlg_cell *dlg = node->dlg;
+
+	if (dlg->state == DLG_STATE_DELETED)
+		return 1;
+
+	if (reinvite) {
+		return ((dlg->flags & DLG_FLAG_REINVITE_PING_CALLER) &&
+			dlg->legs[DLG_CALLER_LEG].reinvite_confirmed == DLG_PING_FAIL) ||
+			((dlg->flags & DLG_FLAG_REINVITE_PING_CALLEE) &&
+			dlg->legs[callee_idx(dlg)].reinvite_confirmed == DLG_PING_FAIL);
+	}
+
+	return ((dlg->flags & DLG_FLAG_PING_CALLER) &&
+		dlg->legs[DLG_CALLER_LEG].reply_received == DLG_PING_FAIL) ||
+		((dlg->flags & DLG_FLAG_PING_CALLEE) &&
+		dlg->legs[callee_idx(dlg)].reply_received == DLG_PING_FAIL);
 }
 
 int dlg_handle_seq_reply(struct dlg_cell *dlg, struct sip_msg* rpl,
@@ -709,6 +562,7 @@ int dlg_handle_seq_reply(struct dlg_cell *dlg, struct sip_msg* rpl,
 		        "ci: [%.*s]\n", leg == DLG_CALLER_LEG ? "caller" : "callee",
 		        dlg->callid.len, dlg->callid.s);
 		*ping_status = DLG_PING_FAIL;
+		ping_timer_due_now(dlg, is_reinvite_rpl);
 		return -1;
 	}
 
@@ -721,6 +575,7 @@ int dlg_handle_seq_reply(struct dlg_cell *dlg, struct sip_msg* rpl,
 		        dlg->callid.len, dlg->callid.s);
 
 		*ping_status = DLG_PING_FAIL;
+		ping_timer_due_now(dlg, is_reinvite_rpl);
 		return -1;
 	}
 
@@ -839,65 +694,45 @@ void unref_dlg_cb(void *dlg)
 
 void dlg_options_routine(unsigned int ticks , void * attr)
 {
-	struct dlg_ping_list *expired,*to_be_deleted,*it,*curr,*next;
+	struct dlg_ping_list *it;
+	struct dlg_tl *tl;
 	struct dlg_cell *dlg;
-	int current_ticks;
 
-	get_timeout_dlgs(&expired,&to_be_deleted,0);
+	tl = get_expired_dlgs(ping_timer, ticks);
 
-	it = expired;
-	while (it) {
+	while (tl != FAKE_DIALOG_TL) {
+		it = (struct dlg_ping_list *)tl;
+		tl = tl->next;
+		it->tl.next = 0;
 		dlg = it->dlg;
-		LM_DBG("dialog %p-%.*s has expired\n",dlg,dlg->callid.len,dlg->callid.s);
-		curr = it->next;
-		shm_free(it);
-		it = curr;
-
-		init_dlg_term_reason(dlg,"Ping Timeout",sizeof("Ping Timeout")-1);
-		/* FIXME - maybe better not to send BYE both ways as we know for
-		 * sure one end in down . */
-		dlg_end_dlg(dlg,0,1);
-
-		/* no longer reffed in list */
-		unref_dlg(dlg,1);
-	}
 
-	it = to_be_deleted;
-	while (it) {
-		dlg = it->dlg;
-		LM_DBG("dialog %p-%.*s has terminated\n",dlg,dlg->callid.len,dlg->callid.s);
-		curr = it->next;
-		/* if marked as to be deleted, we let it go
-		 * for the ping timer list as well */
-		unref_dlg(dlg,1);
-		shm_free(it);
-		it = curr;
-	}
+		if (ping_node_done(it, 0)) {
+			unlink_ping_node(ping_timer, it, &dlg->pl);
+			shm_free(it);
 
-	tcp_no_new_conn = 1;
-
-	current_ticks = get_ticks();
-	/* ping_timer->first now contains all active dialogs
-	ping all dialogs with a lower timeout than now */
-	lock_get(ping_timer->lock);
-	it = ping_timer->first;
-	while (it) {
-		/* iterated across all the nodes that need pinging now */
-		if (it->timeout > current_ticks)
-			break;
-
-		dlg = it->dlg;
-		next=it->next;
+			if (dlg->state == DLG_STATE_DELETED) {
+				/* if marked as to be deleted, we let it go
+				 * for the ping timer list as well */
+				LM_DBG("dialog %p-%.*s has terminated\n",
+					dlg,dlg->callid.len,dlg->callid.s);
+			} else {
+				LM_DBG("dialog %p-%.*s has expired\n",
+					dlg,dlg->callid.len,dlg->callid.s);
+				init_dlg_term_reason(dlg,"Ping Timeout",
+					sizeof("Ping Timeout")-1);
+				/* FIXME - maybe better not to send BYE both ways as we know
+				 * for sure one end in down . */
+				dlg_end_dlg(dlg,0,1);
+			}
 
-		if (dialog_repl_cluster && get_shtag_state(dlg) == SHTAG_STATE_BACKUP) {
-			it = next;
+			/* no longer reffed in list */
+			unref_dlg(dlg,1);
 			continue;
 		}
 
-		/* do not ping ended dialogs - we might have missed them earlier or
-		 * might have terminated in the mean time - we'll clean them up on
-		 * our next iteration */
-		if (dlg->state != DLG_STATE_DELETED && it->timeout <= current_ticks) {
+		if (!dialog_repl_cluster || get_shtag_state(dlg) != SHTAG_STATE_BACKUP) {
+			tcp_no_new_conn = 1;
+
 			if (dlg->flags & DLG_FLAG_PING_CALLER) {
 				ref_dlg(dlg,1);
 				if (send_leg_msg(dlg,&options_str,callee_idx(dlg),
@@ -918,135 +753,115 @@ void dlg_options_routine(unsigned int ticks , void * attr)
 				}
 			}
 
-			/* we've pinged, now update the timeout & move the entry further down the list */
-			detach_ping_node_unsafe(it,0);
-			unsafe_insert_ping_timer(it,options_ping_interval);
+			tcp_no_new_conn = 0;
 		}
-		it = next;
-	}
 
-	lock_release(ping_timer->lock);
-	tcp_no_new_conn = 0;
+		/* we've pinged (or we are a backup), schedule the next ping */
+		insert_ping_node(ping_timer, it, get_ticks() + options_ping_interval);
+
+		/* a ping which failed in the meantime could not be made due yet */
+		if (ping_node_done(it, 0))
+			ping_timer_due_now(dlg, 0);
+	}
 }
 
 void dlg_reinvite_routine(unsigned int ticks , void * attr)
 {
 	static str content_type = str_init("application/sdp");
-	struct dlg_ping_list *expired,*to_be_deleted,*it,*curr,*next;
+	struct dlg_ping_list *it;
+	struct dlg_tl *tl;
 	struct dlg_cell *dlg;
 	str extra_headers;
 	str *sdp;
-	int current_ticks;
-
-	get_timeout_dlgs(&expired,&to_be_deleted,1);
 
-	it = expired;
-	while (it) {
-		dlg = it->dlg;
-		LM_DBG("dialog %p-%.*s has expired\n",dlg,dlg->callid.len,dlg->callid.s);
-		curr = it->next;
-		shm_free(it);
-		it = curr;
-
-		init_dlg_term_reason(dlg,"ReINVITE Ping Timeout",sizeof("ReINVITE Ping Timeout")-1);
-		/* FIXME - maybe better not to send BYE both ways as we know for
-		 * sure one end in down . */
-		dlg_end_dlg(dlg,0,1);
-
-		/* no longer reffed in list */
-		unref_dlg(dlg,1);
-	}
+	tl = get_expired_dlgs(reinvite_ping_timer, ticks);
 
-	it = to_be_deleted;
-	while (it) {
+	while (tl != FAKE_DIALOG_TL) {
+		it = (struct dlg_ping_list *)tl;
+		tl = tl->next;
+		it->tl.next = 0;
 		dlg = it->dlg;
-		LM_DBG("dialog %p-%.*s has terminated\n",dlg,dlg->callid.len,dlg->callid.s);
-		curr = it->next;
-		/* if marked as to be deleted, we let it go
-		 * for the ping timer list as well */
-		unref_dlg(dlg,1);
-		shm_free(it);
-		it = curr;
-	}
-
-	tcp_no_new_conn = 1;
 
-	current_ticks = get_ticks();
-	/* reinvite_ping_timer->first now contains all active dialogs
-	ping all dialogs with a lower timeout than now */
-	lock_get(reinvite_ping_timer->lock);
-	it = reinvite_ping_timer->first;
-	while (it) {
-		/* iterated across all the nodes that need pinging now */
-		if (it->timeout > current_ticks)
-			break;
+		if (ping_node_done(it, 1)) {
+			unlink_ping_node(reinvite_ping_timer, it, &dlg->reinvite_pl);
+			shm_free(it);
 
-		dlg = it->dlg;
-		next=it->next;
+			if (dlg->state == DLG_STATE_DELETED) {
+				/* if marked as to be deleted, we let it go
+				 * for the ping timer list as well */
+				LM_DBG("dialog %p-%.*s has terminated\n",
+					dlg,dlg->callid.len,dlg->callid.s);
+			} else {
+				LM_DBG("dialog %p-%.*s has expired\n",
+					dlg,dlg->callid.len,dlg->callid.s);
+				init_dlg_term_reason(dlg,"ReINVITE Ping Timeout",
+					sizeof("ReINVITE Ping Timeout")-1);
+				/* FIXME - maybe better not to send BYE both ways as we know
+				 * for sure one end in down . */
+				dlg_end_dlg(dlg,0,1);
+			}
 
-		if (dialog_repl_cluster && get_shtag_state(dlg) == SHTAG_STATE_BACKUP) {
-			it = next;
+			/* no longer reffed in list */
+			unref_dlg(dlg,1);
 			continue;
 		}
 
-		/* do not ping ended dialogs - we might have missed them earlier or
-		 * might have terminated in the mean time - we'll clean them up on
-		 * our next iteration */
-		if (dlg->state != DLG_STATE_DELETED && it->timeout <= current_ticks) {
-			if (dlg->flags & DLG_FLAG_REINVITE_PING_CALLER) {
+		if (!dialog_repl_cluster || get_shtag_state(dlg) != SHTAG_STATE_BACKUP) {
+			tcp_no_new_conn = 1;
 
+			if (dlg->flags & DLG_FLAG_REINVITE_PING_CALLER) {
 				if (!dlg_get_leg_hdrs(dlg, callee_idx(dlg),
 						DLG_CALLER_LEG, &content_type, NULL, &extra_headers)) {
 					LM_ERR("No more pkg for extra headers \n");
-					it = it->next;
-					continue;
-				}
-				sdp = (dlg->legs[DLG_CALLER_LEG].out_sdp.s?
-						&dlg->legs[DLG_CALLER_LEG].out_sdp:
-						&dlg->legs[callee_idx(dlg)].in_sdp);
-				
-				ref_dlg(dlg,1);
-				if (send_leg_msg(dlg,&invite_str,callee_idx(dlg),
-				DLG_CALLER_LEG,&extra_headers,sdp,
-				reinvite_reply_from_caller,dlg,unref_dlg_cb,
-				&dlg->legs[DLG_CALLER_LEG].reinvite_confirmed) < 0) {
-					LM_ERR("failed to ping caller\n");
-					unref_dlg(dlg,1);
-				}
+				} else {
+					sdp = (dlg->legs[DLG_CALLER_LEG].out_sdp.s?
+							&dlg->legs[DLG_CALLER_LEG].out_sdp:
+							&dlg->legs[callee_idx(dlg)].in_sdp);
+
+					ref_dlg(dlg,1);
+					if (send_leg_msg(dlg,&invite_str,callee_idx(dlg),
+					DLG_CALLER_LEG,&extra_headers,sdp,
+					reinvite_reply_from_caller,dlg,unref_dlg_cb,
+					&dlg->legs[DLG_CALLER_LEG].reinvite_confirmed) < 0) {
+						LM_ERR("failed to ping caller\n");
+						unref_dlg(dlg,1);
+					}
 
-				pkg_free(extra_headers.s);
+					pkg_free(extra_headers.s);
+				}
 			}
 
 			if (dlg->flags & DLG_FLAG_REINVITE_PING_CALLEE) {
-
 				if (!dlg_get_leg_hdrs(dlg, DLG_CALLER_LEG,
 						callee_idx(dlg), &content_type, NULL, &extra_headers)) {
 					LM_ERR("No more pkg for extra headers \n");
-					it = it->next;
-					continue;
-				}
-				sdp = (dlg->legs[callee_idx(dlg)].out_sdp.s?
-						&dlg->legs[callee_idx(dlg)].out_sdp:
-						&dlg->legs[DLG_CALLER_LEG].in_sdp);
+				} else {
+					sdp = (dlg->legs[callee_idx(dlg)].out_sdp.s?
+							&dlg->legs[callee_idx(dlg)].out_sdp:
+							&dlg->legs[DLG_CALLER_LEG].in_sdp);
+
+					ref_dlg(dlg,1);
+					if (send_leg_msg(dlg,&invite_str,DLG_CALLER_LEG,
+					callee_idx(dlg),&extra_headers,sdp,
+					reinvite_reply_from_callee,dlg,unref_dlg_cb,
+					&dlg->legs[callee_idx(dlg)].reinvite_confirmed) < 0) {
+						LM_ERR("failed to ping callee\n");
+						unref_dlg(dlg,1);
+					}
 
-				ref_dlg(dlg,1);
-				if (send_leg_msg(dlg,&invite_str,DLG_CALLER_LEG, callee_idx(dlg),
-				&extra_headers,sdp,reinvite_reply_from_callee, dlg,unref_dlg_cb,
-				&dlg->legs[callee_idx(dlg)].reinvite_confirmed) < 0) {
-					LM_ERR("failed to ping callee\n");
-					unref_dlg(dlg,1);
+					pkg_free(extra_headers.s);
 				}
-
-				pkg_free(extra_headers.s);
 			}
 
-			/* we've pinged, now update the timeout & move the entry further down the list */
-			detach_ping_node_unsafe(it,1);
-			unsafe_insert_reinvite_ping_timer(it,reinvite_ping_interval);
+			tcp_no_new_conn = 0;
 		}
-		it = next;
-	}
 
-	lock_release(reinvite_ping_timer->lock);
-	tcp_no_new_conn = 0;
+		/* we've pinged (or we are a backup), schedule the next ping */
+		insert_ping_node(reinvite_ping_timer, it,
+			get_ticks() + reinvite_ping_interval);
+
+		/* a ping which failed in the meantime could not be made due yet */
+		if (ping_node_done(it, 1))
+			ping_timer_due_now(dlg, 1);
+	}
 }
@@ -38,32 +38,36 @@ struct dlg_tl
 };
 
 
-struct  dlg_timer
-{
-	struct dlg_tl   first;
-	gen_lock_t      *lock;
-};
+/*
+ * The dialog timers are hashed timing wheels: each shard has a slot for
+ * every tick of a DLG_WHEEL_SIZE ticks turn, holding an unordered circular
+ * list of the entries expiring at that tick (modulo the turn). Inserting,
+ * removing or updating an entry is O(1); each run of the timer only walks
+ * the slots of the ticks elapsed since the previous one, skipping the
+ * entries due on a later turn. The entries are spread over the shards by
+ * their address, each shard having its own lock.
+ */
+#define DLG_TIMER_SHARDS  16  /* power of 2 */
+#define DLG_WHEEL_BITS    10
+#define DLG_WHEEL_SIZE    (1 << DLG_WHEEL_BITS)
 
-struct dlg_ping_list
+struct dlg_timer_shard
 {
-	struct dlg_cell* dlg;
-	volatile unsigned int timeout;
-	struct dlg_ping_list *next;
-	struct dlg_ping_list *prev;
+	unsigned int    clk;     /* last tick the shard was run for */
+	struct dlg_tl   slots[DLG_WHEEL_SIZE];
 };
 
-struct dlg_ping_timer
+struct dlg_timer
 {
-	struct dlg_ping_list *first;
-	struct dlg_ping_list *last;
-	gen_lock_t *lock;
+	gen_lock_set_t  *locks;  /* one for each shard */
+	unsigned int    lag;     /* ms, largest delay of the last run */
+	struct dlg_timer_shard shards[DLG_TIMER_SHARDS];
 };
 
-struct dlg_reinvite_ping_timer
+struct dlg_ping_list
 {
-	struct dlg_ping_list *first;
-	struct dlg_ping_list *last;
-	gen_lock_t *lock;
+	struct dlg_tl tl;        /* must be first */
+	struct dlg_cell* dlg;
 };
 
 typedef void (*dlg_timer_handler)(struct dlg_tl *);
@@ -84,9 +88,9 @@ int insert_ping_timer(struct dlg_cell *dlg);
 
 int insert_reinvite_ping_timer(struct dlg_cell *dlg);
 
-int remove_dlg_timer(struct dlg_tl *tl);
+void dlg_ping_timers_due_now(struct dlg_cell *dlg);
 
-int remove_ping_timer(struct dlg_cell *dlg);
+int remove_dlg_timer(struct dlg_tl *tl);
 
 int update_dlg_timer( struct dlg_tl *tl, int timeout );
 
@@ -96,4 +100,6 @@ void dlg_options_routine(unsigned int ticks , void * attr);
 
 void dlg_reinvite_routine(unsigned int ticks , void * attr);
 
+unsigned long dlg_get_timer_lag(unsigned short foo);
+
 #endif
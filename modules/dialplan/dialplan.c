@@ -84,6 +84,7 @@ static str default_param_s = str_init(DEFAULT_PARAM);
 str dp_df_part = str_init(DEFAULT_PARTITION);
 dp_param_p default_par2 = NULL;
 static str database_url = {NULL, 0};
+int dp_regex_prefilter = 1;
 
 
 static param_export_t mod_params[]={
@@ -101,6 +102,7 @@ static param_export_t mod_params[]={
 	{ "attrs_col",		STR_PARAM,	&attrs_column.s },
 	{ "timerec_col",        STR_PARAM,      &timerec_column.s },
 	{ "disabled_col",	STR_PARAM,	&disabled_column.s},
+	{ "regex_prefilter",	INT_PARAM,	&dp_regex_prefilter},
 	{0,0,0}
 };
 
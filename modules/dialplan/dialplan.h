@@ -39,6 +39,9 @@
 #define DP_CASE_INSENSITIVE		1
 #define DP_INDEX_HASH_SIZE		16
 
+/* longest literal prefix indexed for a regexp rule */
+#define DP_PREFIX_MAX_LEN		32
+
 typedef struct dpl_node{
 	int dpid;
 	int table_id; /*choose between matching regexp/strings with same priority*/
@@ -51,6 +54,7 @@ typedef struct dpl_node{
 	str attrs;
 	str timerec;
 	tmrec_expr *parsed_timerec;
+	int re_pos; /*position in the regexp bucket*/
 
 	struct dpl_node * next; /*next rule*/
 }dpl_node_t, *dpl_node_p;
@@ -63,10 +67,23 @@ typedef struct dpl_index{
 
 }dpl_index_t, *dpl_index_p;
 
+/* prefilter for the regexp rules: a (lowercase) trie of the literal
+   prefixes the anchored expressions start with; every rule hangs off the
+   node of its prefix, the ones without a prefix off the root */
+typedef struct dpl_prefix_node{
+	unsigned char c;
+	int rules_no;
+	int rules_size;
+	dpl_node_t ** rules; /*sorted by re_pos*/
+	struct dpl_prefix_node * kids;
+	struct dpl_prefix_node * next; /*next sibling*/
+}dpl_prefix_node_t, *dpl_prefix_node_p;
+
 /*For every DPID*/
 typedef struct dpl_id{
 	int dp_id;
 	dpl_index_t* rule_hash;/*fast access :string rules are hashed*/
+	dpl_prefix_node_t* re_prefix;/*regexp prefilter, if enabled*/
 	struct dpl_id * next;
 }dpl_id_t,*dpl_id_p;
 
@@ -135,5 +152,6 @@ void wrap_pcre_free( pcre*);
 
 extern rw_lock_t *ref_lock;
 extern str dp_df_part;
+extern int dp_regex_prefilter;
 
 #endif
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "../../dprint.h"
 #include "../../ut.h"
@@ -68,6 +69,9 @@ str timerec_column       =   str_init(TIMEREC_COL);
 void destroy_rule(dpl_node_t * rule);
 void destroy_hash(dpl_id_t **rules_hash);
 
+int build_prefix_index(dpl_id_t * idp);
+void destroy_prefix_node(dpl_prefix_node_t * node);
+
 dpl_node_t * build_rule(db_val_t * values);
 int add_rule2hash(dpl_node_t * rule, dp_connection_list_t *table, int index);
 
@@ -262,6 +266,7 @@ int dp_load_db(dp_connection_list_p dp_conn)
 	db_val_t cond_val[1];
 
 	dpl_node_t *rule;
+	dpl_id_p idp;
 	int no_rows = 10;
 
 
@@ -359,7 +364,12 @@ int dp_load_db(dp_connection_list_p dp_conn)
 
 
 end:
-
+	if (dp_regex_prefilter) {
+		for (idp = dp_conn->hash[dp_conn->next_index]; idp; idp = idp->next)
+			if (build_prefix_index(idp) != 0)
+				LM_WARN("failed to build the regexp prefilter of dpid %d, "
+					"its rules will be tested one by one\n", idp->dp_id);
+	}
 
 	/*update data*/
 	lock_start_write( dp_conn->ref_lock );
@@ -671,6 +681,7 @@ void destroy_hash(dpl_id_t **rules_hash)
 		}
 		*rules_hash = crt_idp->next;
 
+		destroy_prefix_node(crt_idp->re_prefix);
 		shm_free(crt_idp);
 		crt_idp = NULL;
 	}
@@ -717,6 +728,146 @@ void destroy_rule(dpl_node_t * rule){
 }
 
 
+/* gets the literal prefix any input matched by the anchored expression @exp
+ * must start with, lowercased; returns its length (0 if unanchored) */
+static int regex_literal_prefix(str *exp, char *prefix)
+{
+	char *p, *end;
+	unsigned char c;
+	int len = 0;
+
+	if (exp->len < 1 || exp->s[0] != '^')
+		return 0;
+
+	/* an alternative may start with anything */
+	if (memchr(exp->s, '|', exp->len))
+		return 0;
+
+	end = exp->s + exp->len;
+	for (p = exp->s + 1; p < end && len < DP_PREFIX_MAX_LEN; p++) {
+		c = *p;
+		if (c == '\\') {
+			/* escaped metacharacter; classes, backrefs, \Q etc. end it */
+			if (p + 1 == end || isalnum((int)(unsigned char)p[1]))
+				break;
+			c = *++p;
+		} else if (strchr(".[]()*+?{}^$", c)) {
+			break;
+		}
+
+		/* the char may also be optional */
+		if (p + 1 < end && (p[1] == '*' || p[1] == '?' || p[1] == '{'))
+			break;
+
+		prefix[len++] = tolower(c);
+	}
+
+	return len;
+}
+
+static dpl_prefix_node_p prefix_node_child(dpl_prefix_node_p node,
+																unsigned char c)
+{
+	dpl_prefix_node_p kid;
+
+	for (kid = node->kids; kid; kid = kid->next)
+		if (kid->c == c)
+			return kid;
+
+	kid = shm_malloc(sizeof *kid);
+	if (!kid) {
+		LM_ERR("out of shm memory (prefix node)\n");
+		return NULL;
+	}
+	memset(kid, 0, sizeof *kid);
+	kid->c = c;
+
+	kid->next = node->kids;
+	node->kids = kid;
+
+	return kid;
+}
+
+static int prefix_node_add_rule(dpl_prefix_node_p node, dpl_node_p rule)
+{
+	dpl_node_t **rules;
+
+	if (node->rules_no == node->rules_size) {
+		rules = shm_realloc(node->rules, (node->rules_size ?
+			2 * node->rules_size : 4) * sizeof *rules);
+		if (!rules) {
+			LM_ERR("out of shm memory (prefix rules)\n");
+			return -1;
+		}
+		node->rules = rules;
+		node->rules_size = node->rules_size ? 2 * node->rules_size : 4;
+	}
+
+	node->rules[node->rules_no++] = rule;
+	return 0;
+}
+
+/* indexes the regexp rules of @idp by their literal prefix, so translate()
+ * only runs the expressions which may actually match the input */
+int build_prefix_index(dpl_id_t * idp)
+{
+	dpl_prefix_node_p root, node;
+	dpl_node_p rule;
+	char prefix[DP_PREFIX_MAX_LEN];
+	int i, len, pos = 0, indexed = 0;
+
+	if (!idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule)
+		return 0;
+
+	root = shm_malloc(sizeof *root);
+	if (!root) {
+		LM_ERR("out of shm memory (prefix root)\n");
+		return -1;
+	}
+	memset(root, 0, sizeof *root);
+
+	for (rule = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rule;
+	rule = rule->next) {
+		rule->re_pos = pos++;
+
+		len = regex_literal_prefix(&rule->match_exp, prefix);
+		for (node = root, i = 0; node && i < len; i++)
+			node = prefix_node_child(node, (unsigned char)prefix[i]);
+
+		if (!node || prefix_node_add_rule(node, rule) != 0) {
+			destroy_prefix_node(root);
+			return -1;
+		}
+
+		if (len)
+			indexed++;
+	}
+
+	LM_DBG("dpid %d: %d out of %d regexp rules indexed by prefix\n",
+		idp->dp_id, indexed, pos);
+
+	idp->re_prefix = root;
+	return 0;
+}
+
+void destroy_prefix_node(dpl_prefix_node_t * node)
+{
+	dpl_prefix_node_p kid;
+
+	if (!node)
+		return;
+
+	while ((kid = node->kids)) {
+		node->kids = kid->next;
+		destroy_prefix_node(kid);
+	}
+
+	if (node->rules)
+		shm_free(node->rules);
+	shm_free(node);
+}
+
+
 dpl_id_p select_dpid(dp_connection_list_p conn, int id, int index)
 {
 	dpl_id_p idp;
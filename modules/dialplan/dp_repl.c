@@ -22,6 +22,8 @@
  *  2007-08-01 initial version (ancuta onofrei)
  */
 
+#include <ctype.h>
+
 #include "../../re.h"
 #include "../../time_rec.h"
 #include "dialplan.h"
@@ -274,6 +276,70 @@ error:
 	return -1;
 }
 
+static inline int match_regex_rule(str input, dpl_node_p rrulep)
+{
+	int regexp_res;
+
+	// Check for Time Period if Set
+	if(rrulep->parsed_timerec) {
+		LM_DBG("Timerec exists for rule checking: %.*s\n", rrulep->timerec.len, rrulep->timerec.s);
+		// Doesn't matches time period continue with next rule
+		if(!tmrec_expr_check(rrulep->parsed_timerec)) {
+			LM_DBG("Time rule doesn't match: skip next!\n");
+			return -1;
+		}
+	}
+
+	regexp_res = (test_match(input, rrulep->match_comp, matches, MAX_MATCHES)
+				>= 0 ? 0 : -1);
+
+	LM_DBG("Regex operator testing. Got result: %d\n", regexp_res);
+
+	return regexp_res;
+}
+
+/* tests, in bucket order, only the regexp rules whose literal prefix is
+ * found at the start of the input; returns the first matching one */
+static dpl_node_p match_prefix_index(str input, dpl_prefix_node_p root)
+{
+	dpl_prefix_node_p lists[DP_PREFIX_MAX_LEN + 1], node;
+	int pos[DP_PREFIX_MAX_LEN + 1];
+	int n = 0, i, best;
+	unsigned char c;
+
+	/* collect the rule lists along the input's path in the trie */
+	for (node = root, i = 0; node; i++) {
+		if (node->rules_no) {
+			lists[n] = node;
+			pos[n++] = 0;
+		}
+
+		if (i == input.len || i == DP_PREFIX_MAX_LEN)
+			break;
+
+		c = tolower((unsigned char)input.s[i]);
+		for (node = node->kids; node && node->c != c; node = node->next) ;
+	}
+
+	/* merge the (sorted) lists, so the priorities are kept */
+	for (;;) {
+		best = -1;
+		for (i = 0; i < n; i++) {
+			if (pos[i] == lists[i]->rules_no)
+				continue;
+			if (best < 0 || lists[i]->rules[pos[i]]->re_pos <
+			lists[best]->rules[pos[best]]->re_pos)
+				best = i;
+		}
+
+		if (best < 0)
+			return NULL;
+
+		if (match_regex_rule(input, lists[best]->rules[pos[best]++]) == 0)
+			return lists[best]->rules[pos[best] - 1];
+	}
+}
+
 #define DP_MAX_ATTRS_LEN	256
 static char dp_attrs_buf[DP_MAX_ATTRS_LEN+1];
 int translate(struct sip_msg *msg, str input, str * output, dpl_id_p idp, str * attrs) {
@@ -322,27 +388,14 @@ int translate(struct sip_msg *msg, str input, str * output, dpl_id_p idp, str *
 	}
 
 	/* try to match the input in the regexp bucket */
-	for (rrulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rrulep; rrulep=rrulep->next) {
-
-		// Check for Time Period if Set
-		if(rrulep->parsed_timerec) {
-			LM_DBG("Timerec exists for rule checking: %.*s\n", rrulep->timerec.len, rrulep->timerec.s);
-			// Doesn't matches time period continue with next rule
-			if(!tmrec_expr_check(rrulep->parsed_timerec)) {
-				LM_DBG("Time rule doesn't match: skip next!\n");
-				continue;
-			}
-		}
-
-		regexp_res = (test_match(input, rrulep->match_comp, matches, MAX_MATCHES)
-					>= 0 ? 0 : -1);
-
-		LM_DBG("Regex operator testing. Got result: %d\n", regexp_res);
-
-		if (regexp_res == 0) {
-			break;
-		}
+	if (idp->re_prefix) {
+		rrulep = match_prefix_index(input, idp->re_prefix);
+	} else {
+		for (rrulep = idp->rule_hash[DP_INDEX_HASH_SIZE].first_rule; rrulep; rrulep=rrulep->next)
+			if (match_regex_rule(input, rrulep) == 0)
+				break;
 	}
+	regexp_res = rrulep ? 0 : -1;
 
 	if (string_res != 0 && regexp_res != 0) {
 		LM_DBG("No matching rule for input %.*s\n", input.len, input.s);
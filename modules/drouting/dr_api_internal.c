@@ -68,13 +68,18 @@ static inline void * get_qr_rule_handle(rt_info_t *rule) {
 
 
 /* Warning this function assumes the lock is already taken */
-rt_info_t* find_rule_by_prefix_unsafe(ptree_t *pt, ptree_node_t *noprefix,
-		str prefix, unsigned int grp_id, unsigned int *matched_len)
+rt_info_t* find_rule_by_prefix_unsafe(ptree_t *pt, ptree_compact_t *cpt,
+		ptree_node_t *noprefix, str prefix, unsigned int grp_id,
+		unsigned int *matched_len)
 {
 	unsigned int rule_idx = 0;
 	rt_info_t *rt_info;
 
-	rt_info = get_prefix(pt, &prefix, grp_id,matched_len, &rule_idx);
+	if (cpt)
+		rt_info = get_prefix_compact(cpt, pt, &prefix, grp_id, matched_len,
+			&rule_idx);
+	else
+		rt_info = get_prefix(pt, &prefix, grp_id,matched_len, &rule_idx);
 
 	if (rt_info==NULL) {
 		LM_DBG("no matching for prefix \"%.*s\"\n",
@@ -109,8 +114,8 @@ static rt_info_t *match_number (dr_head_p partition, unsigned int grp_id,
 		const str *number, unsigned int *matched_len)
 {
 
-	return find_rule_by_prefix_unsafe(partition->pt, &(partition->noprefix),
-			*number, grp_id, matched_len);
+	return find_rule_by_prefix_unsafe(partition->pt, NULL,
+			&(partition->noprefix), *number, grp_id, matched_len);
 }
 
 static dr_head_p create_dr_head(void)
@@ -34,6 +34,7 @@
 #include "../../mem/rpm_mem.h"
 #include "../../time_rec.h"
 #include "../../socket_info.h"
+#include "../../rw_locking.h"
 
 #include "dr_load.h"
 #include "routing.h"
@@ -42,6 +43,8 @@
 #include "dr_db_def.h"
 
 
+extern int dr_compact_prefix_tree;
+
 #define check_val2( _col, _val, _type1, _type2, _not_null, _is_empty_str) \
 	do{\
 		if ((_val)->type!=_type1 && (_val)->type!=_type2) { \
@@ -107,7 +110,14 @@ static int add_rule(rt_data_t *rdata, char *grplst, str *prefix,
 		}
 		n++;
 		/* add rule -> has prefix? */
-		if (prefix->len) {
+		if (prefix->len && rdata->cpt) {
+			/* rule update, after the tree was compacted */
+			if ( add_prefix_compact(rdata->cpt, &rdata->pt, prefix, rule,
+					(unsigned int)t, malloc_f, free_f)!=0 ) {
+				LM_ERR("failed to add prefix route\n");
+				goto error;
+			}
+		} else if (prefix->len) {
 			/* add the routing rule */
 			if ( add_prefix(rdata->pt, prefix, rule, (unsigned int)t,
 					malloc_f, free_f)!=0 ) {
@@ -247,6 +257,100 @@ void dr_update_head_cache(struct head_db *head)
 #define STR_VALS_ATTRS_DRR_COL    5
 #define STR_VALS_SORT_ALG_DRR_COL 6
 
+#define DRR_COLS_NO 10
+
+static inline void set_rule_columns(db_key_t *columns)
+{
+	columns[0] = &rule_id_drr_col;
+	columns[1] = &group_drr_col;
+	columns[2] = &prefix_drr_col;
+	columns[3] = &time_drr_col;
+	columns[4] = &priority_drr_col;
+	columns[5] = &routeid_drr_col;
+	columns[6] = &dstlist_drr_col;
+	columns[7] = &sort_alg_drr_col;
+	columns[8] = &sort_profile_drr_col;
+	columns[9] = &attrs_drr_col;
+}
+
+/* reads the columns of a dr_rules row; returns 1 if the rule is to be
+ * skipped, -1 on error */
+static int get_rule_row_vals(db_row_t *row, int *int_vals, char **str_vals,
+		str *prefix, tmrec_expr **time_rec, char *id_buf)
+{
+	/* RULE_ID column */
+	check_val( rule_id_drr_col, ROW_VALUES(row), DB_INT, 1, 0);
+	int_vals[INT_VALS_RULE_ID_DRR_COL] = VAL_INT (ROW_VALUES(row));
+	/* GROUP column */
+	check_val( group_drr_col, ROW_VALUES(row)+1, DB_STRING, 1, 1);
+	str_vals[STR_VALS_GROUP_DRR_COL] =
+		(char*)VAL_STRING(ROW_VALUES(row)+1);
+	/* PREFIX column - it may be null or empty */
+	check_val( prefix_drr_col, ROW_VALUES(row)+2, DB_STRING, 0, 0);
+	if ((ROW_VALUES(row)+2)->nul || VAL_STRING(ROW_VALUES(row)+2)==0){
+		prefix->s = NULL;
+		prefix->len = 0;
+	} else {
+		str_vals[STR_VALS_PREFIX_DRR_COL] =
+			(char*)VAL_STRING(ROW_VALUES(row)+2);
+		prefix->s = str_vals[STR_VALS_PREFIX_DRR_COL];
+		prefix->len = strlen(str_vals[STR_VALS_PREFIX_DRR_COL]);
+	}
+	/* TIME column */
+	check_val( time_drr_col, ROW_VALUES(row)+3, DB_STRING, 0, 0);
+	/* PRIORITY column */
+	check_val2( priority_drr_col, ROW_VALUES(row)+4, DB_INT, DB_BIGINT, 1, 0);
+	int_vals[INT_VALS_PRIORITY_DRR_COL] = VAL_INT(ROW_VALUES(row)+4);
+	/* ROUTE_ID column */
+	check_val( routeid_drr_col, ROW_VALUES(row)+5, DB_STRING, 0, 0);
+	/* DSTLIST column */
+	check_val( dstlist_drr_col, ROW_VALUES(row)+6, DB_STRING, 1, 1);
+	str_vals[STR_VALS_DSTLIST_DRR_COL] =
+		(char*)VAL_STRING(ROW_VALUES(row)+6);
+	/* SORT_ALG column */
+	if( VAL_TYPE(ROW_VALUES(row)+7) == DB_INT ) {
+		check_val(sort_alg_drr_col, ROW_VALUES(row)+7, DB_INT, 1, 0);
+		str_vals[STR_VALS_SORT_ALG_DRR_COL] = int2bstr((unsigned long)
+				VAL_INT(ROW_VALUES(row)+7), id_buf, &int_vals[0]);
+	} else {
+		check_val(sort_alg_drr_col, ROW_VALUES(row)+7, DB_STRING, 1, 0);
+		str_vals[STR_VALS_SORT_ALG_DRR_COL] = (char*)VAL_STRING(
+				ROW_VALUES(row)+7);
+	}
+	/* SORT_PROFILE column */
+	check_val(sort_profile_drr_col, ROW_VALUES(row)+8, DB_INT, 0, 0);
+	int_vals[INT_VALS_QR_PROFILE_DRR_COL] = VAL_INT(ROW_VALUES(row)+8);
+	/* ATTRS column */
+	check_val( attrs_drr_col, ROW_VALUES(row)+9, DB_STRING, 0, 0);
+	str_vals[STR_VALS_ATTRS_DRR_COL] =
+		(char*)VAL_STRING(ROW_VALUES(row)+9);
+	/* parse the time definition */
+	if ( VAL_NULL(ROW_VALUES(row)+3) ||
+	((str_vals[STR_VALS_TIME_DRR_COL]=
+		(char*)VAL_STRING(ROW_VALUES(row)+3))==NULL ) ||
+	*(str_vals[STR_VALS_TIME_DRR_COL]) == 0)
+		*time_rec = NULL;
+	else if ((*time_rec = tmrec_expr_parse(
+	              str_vals[STR_VALS_TIME_DRR_COL], SHM_ALLOC))==0) {
+		LM_ERR("bad time definition <%s> for rule id %d -> skipping\n",
+			str_vals[STR_VALS_TIME_DRR_COL],
+			int_vals[INT_VALS_RULE_ID_DRR_COL]);
+		return 1;
+	}
+	/* set the script route ID */
+	if ( VAL_NULL(ROW_VALUES(row)+5) ||
+	((str_vals[STR_VALS_ROUTEID_DRR_COL]=
+		(char*)VAL_STRING(ROW_VALUES(row)+5))==NULL ) ||
+	str_vals[STR_VALS_ROUTEID_DRR_COL][0]==0 ) {
+		str_vals[STR_VALS_ROUTEID_DRR_COL] = NULL;
+	}
+
+	return 0;
+error:
+	return -1;
+}
+
+
 /* loads routing info for given partition; if partition_name is NULL
  * loads all partitions
  */
@@ -268,7 +372,7 @@ rt_data_t* dr_load_routing_info(struct head_db *current_partition,
 	rt_info_t *ri;
 	rt_data_t *rdata;
 	tmrec_expr *time_rec;
-	int i,n;
+	int i,n,ret;
 	int no_rows = 10;
 	int db_cols;
 	struct socket_info *sock;
@@ -561,19 +665,10 @@ rt_data_t* dr_load_routing_info(struct head_db *current_partition,
 		goto error;
 	}
 
-	columns[0] = &rule_id_drr_col;
-	columns[1] = &group_drr_col;
-	columns[2] = &prefix_drr_col;
-	columns[3] = &time_drr_col;
-	columns[4] = &priority_drr_col;
-	columns[5] = &routeid_drr_col;
-	columns[6] = &dstlist_drr_col;
-	columns[7] = &sort_alg_drr_col;
-	columns[8] = &sort_profile_drr_col;
-	columns[9] = &attrs_drr_col;
+	set_rule_columns(columns);
 
 	if (DB_CAPABILITY(*dr_dbf, DB_CAP_FETCH)) {
-		if ( dr_dbf->query( db_hdl, 0, 0, 0, columns, 0, 10, 0, 0) < 0) {
+		if ( dr_dbf->query( db_hdl, 0, 0, 0, columns, 0, DRR_COLS_NO, 0, 0) < 0) {
 			LM_ERR("DB query failed\n");
 			goto error;
 		}
@@ -584,7 +679,8 @@ rt_data_t* dr_load_routing_info(struct head_db *current_partition,
 			goto error;
 		}
 	} else {
-		if ( dr_dbf->query( db_hdl, 0, 0, 0, columns, 0, 10, 0, &res) < 0) {
+		if ( dr_dbf->query( db_hdl, 0, 0, 0, columns, 0, DRR_COLS_NO, 0,
+		&res) < 0) {
 			LM_ERR("DB query failed\n");
 			goto error;
 		}
@@ -601,72 +697,12 @@ rt_data_t* dr_load_routing_info(struct head_db *current_partition,
 	do {
 		for(i=0; i < RES_ROW_N(res); i++) {
 			row = RES_ROWS(res) + i;
-			/* RULE_ID column */
-			check_val( rule_id_drr_col, ROW_VALUES(row), DB_INT, 1, 0);
-			int_vals[INT_VALS_RULE_ID_DRR_COL] = VAL_INT (ROW_VALUES(row));
-			/* GROUP column */
-			check_val( group_drr_col, ROW_VALUES(row)+1, DB_STRING, 1, 1);
-			str_vals[STR_VALS_GROUP_DRR_COL] =
-				(char*)VAL_STRING(ROW_VALUES(row)+1);
-			/* PREFIX column - it may be null or empty */
-			check_val( prefix_drr_col, ROW_VALUES(row)+2, DB_STRING, 0, 0);
-			if ((ROW_VALUES(row)+2)->nul || VAL_STRING(ROW_VALUES(row)+2)==0){
-				tmp.s = NULL;
-				tmp.len = 0;
-			} else {
-				str_vals[STR_VALS_PREFIX_DRR_COL] =
-					(char*)VAL_STRING(ROW_VALUES(row)+2);
-				tmp.s = str_vals[STR_VALS_PREFIX_DRR_COL];
-				tmp.len = strlen(str_vals[STR_VALS_PREFIX_DRR_COL]);
-			}
-			/* TIME column */
-			check_val( time_drr_col, ROW_VALUES(row)+3, DB_STRING, 0, 0);
-			/* PRIORITY column */
-			check_val2( priority_drr_col, ROW_VALUES(row)+4, DB_INT, DB_BIGINT, 1, 0);
-			int_vals[INT_VALS_PRIORITY_DRR_COL] = VAL_INT(ROW_VALUES(row)+4);
-			/* ROUTE_ID column */
-			check_val( routeid_drr_col, ROW_VALUES(row)+5, DB_STRING, 0, 0);
-			/* DSTLIST column */
-			check_val( dstlist_drr_col, ROW_VALUES(row)+6, DB_STRING, 1, 1);
-			str_vals[STR_VALS_DSTLIST_DRR_COL] =
-				(char*)VAL_STRING(ROW_VALUES(row)+6);
-			/* SORT_ALG column */
-			if( VAL_TYPE(ROW_VALUES(row)+7) == DB_INT ) {
-				check_val(sort_alg_drr_col, ROW_VALUES(row)+7, DB_INT, 1, 0);
-				str_vals[STR_VALS_SORT_ALG_DRR_COL] = int2bstr((unsigned long)
-						VAL_INT(ROW_VALUES(row)+7), id_buf, &int_vals[0]);
-			} else {
-				check_val(sort_alg_drr_col, ROW_VALUES(row)+7, DB_STRING, 1, 0);
-				str_vals[STR_VALS_SORT_ALG_DRR_COL] = (char*)VAL_STRING(
-						ROW_VALUES(row)+7);
-			}
-			/* SORT_PROFILE column */
-			check_val(sort_profile_drr_col, ROW_VALUES(row)+8, DB_INT, 0, 0);
-			int_vals[INT_VALS_QR_PROFILE_DRR_COL] = VAL_INT(ROW_VALUES(row)+8);
-			/* ATTRS column */
-			check_val( attrs_drr_col, ROW_VALUES(row)+9, DB_STRING, 0, 0);
-			str_vals[STR_VALS_ATTRS_DRR_COL] =
-				(char*)VAL_STRING(ROW_VALUES(row)+9);
-			/* parse the time definition */
-			if ( VAL_NULL(ROW_VALUES(row)+3) ||
-			((str_vals[STR_VALS_TIME_DRR_COL]=
-				(char*)VAL_STRING(ROW_VALUES(row)+3))==NULL ) ||
-			*(str_vals[STR_VALS_TIME_DRR_COL]) == 0)
-				time_rec = NULL;
-			else if ((time_rec = tmrec_expr_parse(
-			              str_vals[STR_VALS_TIME_DRR_COL], SHM_ALLOC))==0) {
-				LM_ERR("bad time definition <%s> for rule id %d -> skipping\n",
-					str_vals[STR_VALS_TIME_DRR_COL],
-					int_vals[INT_VALS_RULE_ID_DRR_COL]);
+			ret = get_rule_row_vals(row, int_vals, str_vals, &tmp, &time_rec,
+				id_buf);
+			if (ret < 0)
+				goto error;
+			else if (ret > 0)
 				continue;
-			}
-			/* set the script route ID */
-			if ( VAL_NULL(ROW_VALUES(row)+5) ||
-			((str_vals[STR_VALS_ROUTEID_DRR_COL]=
-				(char*)VAL_STRING(ROW_VALUES(row)+5))==NULL ) ||
-			str_vals[STR_VALS_ROUTEID_DRR_COL][0]==0 ) {
-				str_vals[STR_VALS_ROUTEID_DRR_COL] = NULL;
-			}
 			/* build the routing rule */
 			if ((ri = build_rt_info( int_vals[INT_VALS_RULE_ID_DRR_COL],
 							int_vals[INT_VALS_PRIORITY_DRR_COL], time_rec,
@@ -709,6 +745,23 @@ rt_data_t* dr_load_routing_info(struct head_db *current_partition,
 
 	LM_DBG("%d total records loaded from table %.*s\n", n,
 			drr_table->len, drr_table->s);
+
+	if (dr_compact_prefix_tree) {
+		rdata->cpt = compact_prefix_tree(rdata->pt, current_partition->malloc,
+			current_partition->free);
+		if (rdata->cpt)
+			rdata->pt = NULL;
+		else
+			LM_WARN("failed to compact the prefix tree, using it as it is\n");
+	}
+
+	/* on the final trees, the compacting moves the routing groups */
+	if (index_rules(rdata->rules_idx, rdata->pt, rdata->cpt, &rdata->noprefix,
+	current_partition->malloc) < 0) {
+		LM_ERR("failed to index the rules\n");
+		goto error;
+	}
+
 	return rdata;
 error:
 	if (res)
@@ -718,3 +771,178 @@ error:
 	rdata = NULL;
 	return 0;
 }
+
+
+struct rule_update {
+	unsigned int id;
+	db_res_t *res;
+	/* the values of the row, if the rule is still in the DB */
+	int found;
+	int int_vals[5];
+	char *str_vals[7];
+	str prefix;
+	tmrec_expr *time_rec;
+	char id_buf[INT2STR_MAX_LEN];
+};
+
+static int cmp_rule_update(const void *a, const void *b)
+{
+	unsigned int ida = ((struct rule_update *)a)->id;
+	unsigned int idb = ((struct rule_update *)b)->id;
+
+	return ida < idb ? -1 : (ida > idb);
+}
+
+/* re-reads the given rules from the DB and updates them in the routing
+ * data of the partition, in place: the DB queries are done without any
+ * lock, while the old versions of the rules are replaced by the new ones
+ * under the write lock, so the readers see either all the changes or none
+ */
+int dr_update_rules(struct head_db *part, unsigned int *ids, int ids_no)
+{
+	db_func_t *dr_dbf = &part->db_funcs;
+	db_con_t* db_hdl = *part->db_con;
+	db_key_t columns[DRR_COLS_NO];
+	db_key_t key = &rule_id_drr_col;
+	db_val_t val;
+	struct rule_update *upd;
+	unsigned int *uids = NULL;
+	rt_data_t *rdata;
+	rt_info_t *ri;
+	int i, n, ret = -1;
+
+	upd = pkg_malloc(ids_no * (sizeof *upd + sizeof *uids));
+	if (!upd) {
+		LM_ERR("no more pkg mem for %d rule updates\n", ids_no);
+		return -1;
+	}
+	memset(upd, 0, ids_no * sizeof *upd);
+	uids = (unsigned int *)(upd + ids_no);
+
+	for (i = 0; i < ids_no; i++)
+		upd[i].id = ids[i];
+	qsort(upd, ids_no, sizeof *upd, cmp_rule_update);
+
+	/* drop the duplicates */
+	for (n = 0, i = 0; i < ids_no; i++)
+		if (n == 0 || upd[i].id != upd[n - 1].id)
+			upd[n++] = upd[i];
+	ids_no = n;
+
+	if (dr_dbf->use_table( db_hdl, &part->drr_table) < 0) {
+		LM_ERR("cannot select table \"%.*s\"\n",
+			part->drr_table.len, part->drr_table.s);
+		goto end;
+	}
+
+	set_rule_columns(columns);
+	val.type = DB_INT;
+	val.nul = 0;
+
+	for (i = 0; i < ids_no; i++) {
+		uids[i] = upd[i].id;
+		val.val.int_val = upd[i].id;
+
+		if (dr_dbf->query( db_hdl, &key, 0, &val, columns, 1, DRR_COLS_NO, 0,
+		&upd[i].res) < 0) {
+			LM_ERR("DB query failed for rule id %u\n", upd[i].id);
+			goto end;
+		}
+
+		if (RES_ROW_N(upd[i].res) == 0) {
+			LM_DBG("rule id %u was deleted\n", upd[i].id);
+			continue;
+		}
+
+		if (RES_ROW_N(upd[i].res) > 1)
+			LM_WARN("multiple rules with id %u, using the first one\n",
+				upd[i].id);
+
+		ret = get_rule_row_vals(RES_ROWS(upd[i].res), upd[i].int_vals,
+			upd[i].str_vals, &upd[i].prefix, &upd[i].time_rec, upd[i].id_buf);
+		if (ret < 0)
+			goto end;
+		if (ret > 0) {
+			/* skipped by a full reload as well, so only drop its old
+			 * version */
+			LM_WARN("rule id %u cannot be loaded, removing it\n", upd[i].id);
+			ret = -1;
+			continue;
+		}
+		ret = -1;
+
+		/* the quality-based routing data is only built by a full reload */
+		if (dr_get_sort_alg(upd[i].str_vals[STR_VALS_SORT_ALG_DRR_COL][0])
+		== QR_BASED_SORT) {
+			LM_ERR("rule id %u uses quality-based sorting, a full reload "
+				"is needed\n", upd[i].id);
+			goto end;
+		}
+
+		upd[i].found = 1;
+	}
+
+	lock_start_write( part->ref_lock );
+
+	rdata = part->rdata;
+	if (!rdata) {
+		lock_stop_write( part->ref_lock );
+		LM_ERR("no routing data loaded for partition %.*s\n",
+			part->partition.len, part->partition.s);
+		goto end;
+	}
+
+	n = del_rules_by_id(rdata->rules_idx, uids, ids_no, part->free);
+	LM_DBG("removed %d links of the old rules\n", n);
+
+	for (n = 0, i = 0; i < ids_no; i++) {
+		if (!upd[i].found)
+			continue;
+
+		if ((ri = build_rt_info( upd[i].int_vals[INT_VALS_RULE_ID_DRR_COL],
+						upd[i].int_vals[INT_VALS_PRIORITY_DRR_COL],
+						upd[i].time_rec,
+						upd[i].str_vals[STR_VALS_ROUTEID_DRR_COL],
+						upd[i].str_vals[STR_VALS_DSTLIST_DRR_COL],
+						upd[i].str_vals[STR_VALS_SORT_ALG_DRR_COL],
+						upd[i].int_vals[INT_VALS_QR_PROFILE_DRR_COL],
+						upd[i].str_vals[STR_VALS_ATTRS_DRR_COL], rdata,
+						part->malloc, part->free))== 0 ) {
+			LM_ERR("failed to add routing info for rule id %u -> "
+					"skipping\n", upd[i].id);
+			continue;
+		}
+		/* now owned by the rule */
+		upd[i].time_rec = NULL;
+
+		if (add_rule(rdata, upd[i].str_vals[STR_VALS_GROUP_DRR_COL],
+		&upd[i].prefix, ri, part->malloc, part->free)!=0) {
+			LM_ERR("failed to add rule id %u -> skipping\n", upd[i].id);
+			free_rt_info(ri, part->free);
+			continue;
+		}
+		if (index_rule_prefix(rdata->rules_idx, rdata->pt, rdata->cpt,
+		&rdata->noprefix, &upd[i].prefix, upd[i].id, part->malloc) < 0)
+			LM_ERR("failed to index rule id %u, its next update needs a "
+				"full reload\n", upd[i].id);
+		n++;
+	}
+
+	time(&part->time_last_update);
+
+	lock_stop_write( part->ref_lock );
+
+	LM_INFO("%d rule ids updated, %d of them currently loaded, in partition "
+		"%.*s\n", ids_no, n, part->partition.len, part->partition.s);
+	ret = 0;
+
+end:
+	for (i = 0; i < ids_no; i++) {
+		if (upd[i].time_rec)
+			tmrec_expr_free(upd[i].time_rec);
+		if (upd[i].res)
+			dr_dbf->free_result(db_hdl, upd[i].res);
+	}
+	pkg_free(upd);
+	return ret;
+}
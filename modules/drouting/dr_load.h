@@ -31,5 +31,6 @@
 void dr_update_head_cache(struct head_db *head);
 rt_data_t* dr_load_routing_info(struct head_db *current_partition,
                                 int persistent_state);
+int dr_update_rules(struct head_db *part, unsigned int *ids, int ids_no);
 
 #endif
@@ -148,6 +148,8 @@ static int populate_carrier_attrs;
 int tree_size = 0;
 int inode = 0;
 int unode = 0;
+/* keep the loaded prefixes in a compact tree */
+int dr_compact_prefix_tree = 1;
 static str attrs_empty = str_init("");
 
 /* configuration loader from db specific stuff */
@@ -332,6 +334,11 @@ mi_response_t *mi_dr_enable_probing(const mi_params_t *params,
 mi_response_t *mi_dr_enable_probing_1(const mi_params_t *params,
 								struct mi_handler *async_hdl);
 
+mi_response_t *mi_dr_update_rules(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+mi_response_t *mi_dr_update_rules_1(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+
 /*0-> disabled, 1 ->enabled*/
 unsigned int *dr_enable_probing_state=0;
 
@@ -483,6 +490,7 @@ static param_export_t params[] = {
 	{"cluster_sharing_tag",STR_PARAM, &dr_cluster_shtag       },
 	{"enable_restart_persistency",INT_PARAM, &dr_rpm_enable   },
 	{"extra_prefix_chars", STR_PARAM, &extra_prefix_chars     },
+	{"compact_prefix_tree",INT_PARAM, &dr_compact_prefix_tree },
 	{0, 0, 0}
 };
 
@@ -508,6 +516,9 @@ static param_export_t params[] = {
 #define HLP6 "Params: [ enable ] ; Enables probing of gateways if parameter "\
 	"value greater than 0. Disables probing of gateways if parameter"\
 "value is 0. With no parameter, returns current probing status"
+#define HLP7 "Params: [partition] rule_ids ; Re-reads only the given rules "\
+	"from the DB and applies the changes (added, modified or deleted rules) "\
+"to the loaded routing data, without a full reload."
 
 static mi_export_t mi_cmds[] = {
 	{ "dr_reload", HLP1, 0, 0, {
@@ -550,6 +561,11 @@ static mi_export_t mi_cmds[] = {
 		{mi_dr_enable_probing_1, {"status", 0}},
 		{EMPTY_MI_RECIPE}}
 	},
+	{ "dr_update_rules", HLP7, MI_NAMED_PARAMS_ONLY, 0, {
+		{mi_dr_update_rules, {"rule_ids", 0}},
+		{mi_dr_update_rules_1, {"partition_name", "rule_ids", 0}},
+		{EMPTY_MI_RECIPE}}
+	},
 	{EMPTY_MI_EXPORT}
 };
 
@@ -3030,8 +3046,13 @@ search_again:
 	}
 
 	/* search a prefix */
-	rt_info = get_prefix(current_partition->rdata->pt, &username,
-			(unsigned int)grp,&prefix_len, &rule_idx);
+	if (current_partition->rdata->cpt)
+		rt_info = get_prefix_compact(current_partition->rdata->cpt,
+				current_partition->rdata->pt, &username,
+				(unsigned int)grp,&prefix_len, &rule_idx);
+	else
+		rt_info = get_prefix(current_partition->rdata->pt, &username,
+				(unsigned int)grp,&prefix_len, &rule_idx);
 
 	if (flags & DR_PARAM_STRICT_LEN) {
 		if (rt_info==NULL || prefix_len!=username.len)
@@ -4097,7 +4118,7 @@ static int dr_match(struct sip_msg* msg, int *grp, long flags, str *number,
 
 	lock_start_read( part->ref_lock );
 
-	rule = find_rule_by_prefix_unsafe(part->rdata->pt,
+	rule = find_rule_by_prefix_unsafe(part->rdata->pt, part->rdata->cpt,
 			&part->rdata->noprefix, *number, *grp, &matched_len);
 	if (rule == NULL){
 		lock_stop_read( part->ref_lock );
@@ -4833,7 +4854,8 @@ mi_response_t *mi_dr_number_routing(const mi_params_t *params,
 	lock_start_read( partition->ref_lock );
 
 	route = find_rule_by_prefix_unsafe(partition->rdata->pt,
-			&partition->rdata->noprefix, number, grp_id, &matched_len);
+			partition->rdata->cpt, &partition->rdata->noprefix, number,
+			grp_id, &matched_len);
 	if (route == NULL){
 		lock_stop_read( partition->ref_lock );
 		return init_mi_result_string(MI_SSTR("No match"));
@@ -5068,3 +5090,62 @@ mi_response_t *mi_dr_reload_status_1(const mi_params_t *params,
 
 	return resp;
 }
+
+
+static mi_response_t *mi_dr_update_part_rules(const mi_params_t *params,
+													struct head_db *part)
+{
+	mi_item_t *ids_arr;
+	unsigned int *ids;
+	int i, ids_no, id;
+
+	if (get_mi_array_param(params, "rule_ids", &ids_arr, &ids_no) < 0)
+		return init_mi_param_error();
+
+	if (ids_no == 0)
+		return init_mi_result_ok();
+
+	ids = pkg_malloc(ids_no * sizeof *ids);
+	if (!ids)
+		return init_mi_error(500, MI_SSTR("Internal error"));
+
+	for (i = 0; i < ids_no; i++) {
+		if (get_mi_arr_param_int(ids_arr, i, &id) < 0 || id < 0) {
+			pkg_free(ids);
+			return init_mi_param_error();
+		}
+		ids[i] = id;
+	}
+
+	if (dr_update_rules(part, ids, ids_no) < 0) {
+		pkg_free(ids);
+		return init_mi_error(500, MI_SSTR("Failed to update the rules"));
+	}
+
+	pkg_free(ids);
+	return init_mi_result_ok();
+}
+
+mi_response_t *mi_dr_update_rules(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	if (use_partitions)
+		return init_mi_error_extra(400,
+			MI_SSTR("Missing parameter: 'partition_name'"),
+			MI_SSTR("'partition_name' is required when 'use_partitions' is set"));
+
+	return mi_dr_update_part_rules(params, head_db_start);
+}
+
+mi_response_t *mi_dr_update_rules_1(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	struct head_db *part;
+	mi_response_t *resp;
+
+	resp = mi_dr_get_partition(params, &part);
+	if (resp)
+		return resp;
+
+	return mi_dr_update_part_rules(params, part);
+}
@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "../../str.h"
 #include "../../mem/shm_mem.h"
@@ -81,20 +82,17 @@ int init_prefix_tree( char *extra_prefix_chars )
 
 static inline rt_info_t*
 internal_check_rt(
-		ptree_node_t *ptn,
+		rg_entry_t *rg,
+		int rg_pos,
 		unsigned int rgid,
 		unsigned int *rgidx
 		)
 {
 	int i,j;
-	int rg_pos=0;
-	rg_entry_t* rg=NULL;
 	rt_info_wrp_t* rtlw=NULL;
 
-	if((NULL==ptn) || (NULL==ptn->rg))
+	if(NULL==rg)
 		goto err_exit;
-	rg_pos = ptn->rg_pos;
-	rg=ptn->rg;
 	for(i=0;(i<rg_pos) && (rg[i].rgid!=rgid);i++);
 	if(i<rg_pos) {
 		LM_DBG("found rgid %d (rule list %p)\n",
@@ -126,7 +124,10 @@ check_rt(
 	)
 {
 	unsigned int rgidx = 0;
-	return internal_check_rt( ptn, rgid, &rgidx);
+
+	if (NULL==ptn)
+		return NULL;
+	return internal_check_rt( ptn->rg, ptn->rg_pos, rgid, &rgidx);
 }
 
 
@@ -178,7 +179,8 @@ get_prefix(
 		idx = IDX_OF_CHAR(*tmp);
 		if(NULL != ptree->ptnode[idx].rg) {
 			/* real node; check the constraints on the routing info*/
-			if( NULL != (rt = internal_check_rt( &(ptree->ptnode[idx]), rgid, rgidx)))
+			if( NULL != (rt = internal_check_rt( ptree->ptnode[idx].rg,
+			ptree->ptnode[idx].rg_pos, rgid, rgidx)))
 				break;
 		}
 		tmp--;
@@ -191,6 +193,94 @@ err_exit:
 	return NULL;
 }
 
+
+rt_info_t*
+get_prefix_compact(
+	ptree_compact_t *ctree,
+	ptree_t *overlay,
+	str* prefix,
+	unsigned int rgid,
+	unsigned int *matched_len,
+	unsigned int *rgidx
+	)
+{
+	ptree_cnode_t *n, *kid, *end;
+	unsigned char *label;
+	unsigned int len, olen, i;
+	rt_info_t *rt;
+	char c;
+
+	if(NULL == ctree || NULL == prefix || NULL == prefix->s || prefix->len<=0)
+		return NULL;
+
+	/* go the tree down, as long as the labels match the prefix string */
+	n = ctree->nodes;
+	len = 0;
+	while (len < prefix->len && n->kids_no) {
+		c = prefix->s[len];
+		if( !IS_VALID_PREFIX_CHAR(c) ) {
+			/* unknown character in the prefix string */
+			return NULL;
+		}
+		for (kid = ctree->nodes + n->kids, end = kid + n->kids_no;
+				kid < end && kid->c < IDX_OF_CHAR(c); kid++);
+		if (kid == end || kid->c != IDX_OF_CHAR(c))
+			break;
+
+		label = ctree->labels + kid->label;
+		for (i = 1; i < kid->label_len && len + i < prefix->len; i++) {
+			c = prefix->s[len + i];
+			if( !IS_VALID_PREFIX_CHAR(c) )
+				return NULL;
+			if (label[i - 1] != IDX_OF_CHAR(c))
+				break;
+		}
+		if (i < kid->label_len)
+			break;
+
+		n = kid;
+		len += kid->label_len;
+	}
+
+	/* same for the overlay tree; olen is the length of the prefix string
+	 * ending in the current slot */
+	olen = 0;
+	while (overlay && olen < prefix->len) {
+		c = prefix->s[olen];
+		if( !IS_VALID_PREFIX_CHAR(c) )
+			return NULL;
+		olen++;
+		if (olen == prefix->len || NULL == overlay->ptnode[IDX_OF_CHAR(c)].next)
+			break;
+		overlay = overlay->ptnode[IDX_OF_CHAR(c)].next;
+	}
+
+	/* go in the trees up to the root trying to match the prefix, from the
+	 * longest candidate to the shortest one (a prefix is in one tree only) */
+	while (n != ctree->nodes || (overlay && olen)) {
+		if (n != ctree->nodes && (!overlay || !olen || len >= olen)) {
+			if (n->rg && (rt = internal_check_rt(n->rg, n->rg_pos, rgid, rgidx))) {
+				if (matched_len) *matched_len = len;
+				return rt;
+			}
+			len -= n->label_len;
+			n = ctree->nodes + n->parent;
+		} else {
+			i = IDX_OF_CHAR(prefix->s[olen - 1]);
+			if (overlay->ptnode[i].rg && (rt = internal_check_rt(
+			overlay->ptnode[i].rg, overlay->ptnode[i].rg_pos, rgid, rgidx))) {
+				if (matched_len) *matched_len = olen;
+				return rt;
+			}
+			olen--;
+			overlay = overlay->bp;
+		}
+	}
+
+	if (matched_len) *matched_len = 0;
+	return NULL;
+}
+
 pgw_t*
 get_gw_by_internal_id(
 		map_t gw_tree,
@@ -330,6 +420,476 @@ exit:
 	return 0;
 }
 
+
+/* the slots of a node holding routing info or leading to more prefixes */
+#define PTREE_SLOT_USED(_pn) ((_pn)->rg || (_pn)->next)
+
+/* follows the chain of single-child slots, starting from @pn, as long as
+ * they hold no routing info; the chars of the chain are written into
+ * @label (if any) and counted into @len */
+static ptree_node_t *ptree_chain_end(ptree_node_t *pn, unsigned char *label,
+		unsigned int *len)
+{
+	ptree_t *t;
+	int i, k = 0, n;
+
+	while (!pn->rg && pn->next) {
+		t = pn->next;
+		for (n = 0, i = 0; i < ptree_children && n < 2; i++)
+			if (PTREE_SLOT_USED(&t->ptnode[i])) {
+				n++;
+				k = i;
+			}
+		if (n != 1)
+			break;
+
+		if (label)
+			label[*len] = k;
+		(*len)++;
+		pn = &t->ptnode[k];
+	}
+
+	return pn;
+}
+
+static void ptree_count(ptree_t *t, unsigned int *tnodes,
+		unsigned int *cnodes, unsigned long *labels)
+{
+	ptree_node_t *pn;
+	unsigned int len;
+	int i;
+
+	(*tnodes)++;
+	for (i = 0; i < ptree_children; i++) {
+		if (!PTREE_SLOT_USED(&t->ptnode[i]))
+			continue;
+
+		/* the chain itself still counts as tree nodes, for the stats */
+		len = 0;
+		pn = ptree_chain_end(&t->ptnode[i], NULL, &len);
+		(*tnodes) += len;
+		(*cnodes)++;
+		*labels += len;
+		if (pn->next)
+			ptree_count(pn->next, tnodes, cnodes, labels);
+	}
+}
+
+static void ptree_fill_compact(ptree_compact_t *ct, unsigned int parent,
+		ptree_t *t, unsigned int *next_node, unsigned int *next_label)
+{
+	ptree_cnode_t *cn;
+	ptree_node_t *pn;
+	unsigned int len, idx;
+	int i;
+
+	/* reserve the kids first, so they are kept together */
+	for (cn = &ct->nodes[parent], i = 0; i < ptree_children; i++)
+		if (PTREE_SLOT_USED(&t->ptnode[i]))
+			cn->kids_no++;
+	cn->kids = *next_node;
+	*next_node += cn->kids_no;
+
+	for (idx = cn->kids, i = 0; i < ptree_children; i++) {
+		if (!PTREE_SLOT_USED(&t->ptnode[i]))
+			continue;
+
+		cn = &ct->nodes[idx];
+		cn->c = i;
+		cn->parent = parent;
+		cn->label = *next_label;
+
+		len = 0;
+		pn = ptree_chain_end(&t->ptnode[i], ct->labels + cn->label, &len);
+		cn->label_len = len + 1;
+		*next_label += len;
+
+		cn->rg = pn->rg;
+		cn->rg_len = pn->rg_len;
+		cn->rg_pos = pn->rg_pos;
+
+		if (pn->next)
+			ptree_fill_compact(ct, idx, pn->next, next_node, next_label);
+		idx++;
+	}
+}
+
+/* releases the tree nodes, but not the routing info */
+static void ptree_free_nodes(ptree_t *t, osips_free_f free_f)
+{
+	int i;
+
+	for (i = 0; i < ptree_children; i++)
+		if (t->ptnode[i].next)
+			ptree_free_nodes(t->ptnode[i].next, free_f);
+
+	func_free(free_f, t);
+}
+
+ptree_compact_t*
+compact_prefix_tree(
+		ptree_t *t,
+		osips_malloc_f malloc_f,
+		osips_free_f free_f
+		)
+{
+	ptree_compact_t *ct;
+	unsigned int tnodes = 0, cnodes = 1, next_node = 1, next_label = 0;
+	unsigned long labels = 0, size;
+
+	if (NULL == t)
+		return NULL;
+
+	ptree_count(t, &tnodes, &cnodes, &labels);
+
+	size = sizeof(ptree_compact_t) + cnodes * sizeof(ptree_cnode_t) + labels;
+	if (size > UINT_MAX) {
+		LM_ERR("prefix tree too large to compact (%u nodes)\n", tnodes);
+		return NULL;
+	}
+
+	ct = (ptree_compact_t*)func_malloc(malloc_f, size);
+	if (NULL == ct) {
+		LM_ERR("no more memory for the compact prefix tree (%lu bytes)\n",
+			size);
+		return NULL;
+	}
+	memset(ct, 0, size);
+	ct->nodes_no = cnodes;
+	ct->size = size;
+	ct->nodes = (ptree_cnode_t*)(ct + 1);
+	ct->labels = (unsigned char*)(ct->nodes + cnodes);
+
+	ptree_fill_compact(ct, 0, t, &next_node, &next_label);
+
+	LM_INFO("prefix tree compacted from %u nodes (%lu bytes) to %u nodes "
+		"(%u bytes)\n", tnodes, (unsigned long)tnodes * (sizeof(ptree_t) +
+		ptree_children * sizeof(ptree_node_t)), cnodes, ct->size);
+
+	ptree_free_nodes(t, free_f);
+
+	return ct;
+}
+
+int
+del_compact_tree(
+		ptree_compact_t *ct,
+		osips_free_f free_f
+		)
+{
+	unsigned int i, j;
+
+	if (NULL == ct)
+		return 0;
+
+	for (i = 0; i < ct->nodes_no; i++) {
+		if (NULL == ct->nodes[i].rg)
+			continue;
+
+		for (j = 0; j < ct->nodes[i].rg_pos; j++)
+			if (ct->nodes[i].rg[j].rtlw != NULL)
+				del_rt_list(ct->nodes[i].rg[j].rtlw, free_f);
+		func_free(free_f, ct->nodes[i].rg);
+	}
+
+	func_free(free_f, ct);
+	return 0;
+}
+
+/* the node of the exact prefix in the compact tree, if any; -1 on a bad
+ * prefix char */
+static int cnode_of_prefix(ptree_compact_t *ct, str *prefix,
+		ptree_cnode_t **node)
+{
+	ptree_cnode_t *n, *kid, *end;
+	unsigned char *label;
+	unsigned int len = 0, i;
+
+	n = ct->nodes;
+	while (len < prefix->len) {
+		if( !IS_VALID_PREFIX_CHAR(prefix->s[len]) ) {
+			LM_ERR("%c is not valid char in the prefix\n", prefix->s[len]);
+			return -1;
+		}
+		for (kid = ct->nodes + n->kids, end = kid + n->kids_no;
+				kid < end && kid->c != IDX_OF_CHAR(prefix->s[len]); kid++);
+		if (kid == end || len + kid->label_len > prefix->len)
+			break;
+
+		label = ct->labels + kid->label;
+		for (i = 1; i < kid->label_len; i++)
+			if (!IS_VALID_PREFIX_CHAR(prefix->s[len + i]) ||
+			label[i - 1] != IDX_OF_CHAR(prefix->s[len + i]))
+				break;
+		if (i < kid->label_len)
+			break;
+
+		n = kid;
+		len += kid->label_len;
+	}
+
+	*node = len < prefix->len ? NULL : n;
+	return 0;
+}
+
+/* the node of the exact prefix in the tree, if any */
+static ptree_node_t *ptnode_of_prefix(ptree_t *t, str *prefix)
+{
+	unsigned int i;
+
+	for (i = 0; t && i < prefix->len; i++) {
+		if( !IS_VALID_PREFIX_CHAR(prefix->s[i]) )
+			return NULL;
+		if (i == prefix->len - 1)
+			return &t->ptnode[IDX_OF_CHAR(prefix->s[i])];
+		t = t->ptnode[IDX_OF_CHAR(prefix->s[i])].next;
+	}
+
+	return NULL;
+}
+
+int
+add_prefix_compact(
+		ptree_compact_t *ct,
+		ptree_t **overlay,
+		str *prefix,
+		rt_info_t *r,
+		unsigned int rg,
+		osips_malloc_f malloc_f,
+		osips_free_f free_f
+		)
+{
+	ptree_cnode_t *n;
+	ptree_node_t pn;
+
+	if (cnode_of_prefix(ct, prefix, &n) < 0)
+		return -1;
+
+	if (NULL == n) {
+		/* no such node, the compact tree cannot grow */
+		if (NULL == *overlay)
+			INIT_PTREE_NODE(malloc_f, NULL, *overlay);
+		return add_prefix(*overlay, prefix, r, rg, malloc_f, free_f);
+	}
+
+	pn.rg = n->rg;
+	pn.rg_len = n->rg_len;
+	pn.rg_pos = n->rg_pos;
+	pn.next = NULL;
+	if (add_rt_info(&pn, r, rg, malloc_f, free_f) < 0) {
+		LM_ERR("adding rt info doesn't work\n");
+		return -1;
+	}
+	n->rg = pn.rg;
+	n->rg_len = pn.rg_len;
+	n->rg_pos = pn.rg_pos;
+
+	return 0;
+
+err_exit:
+	LM_ERR("no more memory for the overlay prefix tree\n");
+	return -1;
+}
+
+static inline str rule_id_key(unsigned int *id)
+{
+	str key = {(char *)id, sizeof *id};
+
+	return key;
+}
+
+/* records that rule @id is linked in the @rg routing groups */
+static int add_rule_link(map_t index, unsigned int id, rg_entry_t **rg,
+		unsigned int *rg_pos, osips_malloc_f malloc_f)
+{
+	rt_link_t **links, *l;
+
+	links = (rt_link_t **)map_get(index, rule_id_key(&id));
+	if (!links) {
+		LM_ERR("no more memory for the rules index\n");
+		return -1;
+	}
+
+	/* a rule in several groups of the same prefix */
+	for (l = *links; l; l = l->next)
+		if (l->rg == rg)
+			return 0;
+
+	l = func_malloc(malloc_f, sizeof *l);
+	if (!l) {
+		LM_ERR("no more memory for the rules index\n");
+		return -1;
+	}
+	l->rg = rg;
+	l->rg_pos = rg_pos;
+	l->next = *links;
+	*links = l;
+
+	return 0;
+}
+
+static int index_rg_rules(map_t index, rg_entry_t **rg,
+		unsigned int *rg_pos, osips_malloc_f malloc_f)
+{
+	rt_info_wrp_t *rtlw;
+	unsigned int i;
+
+	if (NULL == *rg)
+		return 0;
+
+	for (i = 0; i < *rg_pos; i++)
+		for (rtlw = (*rg)[i].rtlw; rtlw; rtlw = rtlw->next)
+			if (add_rule_link(index, rtlw->rtl->id, rg, rg_pos, malloc_f) < 0)
+				return -1;
+
+	return 0;
+}
+
+static int index_ptree_rules(map_t index, ptree_t *t,
+		osips_malloc_f malloc_f)
+{
+	int i;
+
+	for (i = 0; i < ptree_children; i++) {
+		if (index_rg_rules(index, &t->ptnode[i].rg, &t->ptnode[i].rg_pos,
+				malloc_f) < 0)
+			return -1;
+		if (t->ptnode[i].next &&
+				index_ptree_rules(index, t->ptnode[i].next, malloc_f) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+index_rules(
+		map_t index,
+		ptree_t *pt,
+		ptree_compact_t *ct,
+		ptree_node_t *noprefix,
+		osips_malloc_f malloc_f
+		)
+{
+	unsigned int i;
+
+	if (pt && index_ptree_rules(index, pt, malloc_f) < 0)
+		return -1;
+
+	if (ct)
+		for (i = 0; i < ct->nodes_no; i++)
+			if (index_rg_rules(index, &ct->nodes[i].rg, &ct->nodes[i].rg_pos,
+					malloc_f) < 0)
+				return -1;
+
+	return index_rg_rules(index, &noprefix->rg, &noprefix->rg_pos,
+		malloc_f);
+}
+
+int
+index_rule_prefix(
+		map_t index,
+		ptree_t *pt,
+		ptree_compact_t *ct,
+		ptree_node_t *noprefix,
+		str *prefix,
+		unsigned int id,
+		osips_malloc_f malloc_f
+		)
+{
+	ptree_cnode_t *cn = NULL;
+	ptree_node_t *pn;
+
+	if (!prefix->len)
+		return add_rule_link(index, id, &noprefix->rg, &noprefix->rg_pos,
+			malloc_f);
+
+	if (ct && cnode_of_prefix(ct, prefix, &cn) == 0 && cn)
+		return add_rule_link(index, id, &cn->rg, &cn->rg_pos, malloc_f);
+
+	pn = ptnode_of_prefix(pt, prefix);
+	if (!pn) {
+		LM_BUG("no node for prefix %.*s of rule %u\n",
+			prefix->len, prefix->s, id);
+		return -1;
+	}
+
+	return add_rule_link(index, id, &pn->rg, &pn->rg_pos, malloc_f);
+}
+
+/* unlinks the rules with the given id from a routing groups array,
+ * dropping the groups left with no rules */
+static int rg_del_rule(rg_entry_t **rg, unsigned int *rg_pos,
+		unsigned int id, osips_free_f free_f)
+{
+	rt_info_wrp_t **prev, *rtlw;
+	unsigned int i, j;
+	int n = 0;
+
+	if (NULL == *rg)
+		return 0;
+
+	for (i = 0, j = 0; i < *rg_pos; i++) {
+		for (prev = &(*rg)[i].rtlw; (rtlw = *prev); ) {
+			if (rtlw->rtl->id != id) {
+				prev = &rtlw->next;
+				continue;
+			}
+
+			*prev = rtlw->next;
+			if ( (--rtlw->rtl->ref_cnt)==0)
+				free_rt_info(rtlw->rtl, free_f);
+			func_free(free_f, rtlw);
+			n++;
+		}
+
+		if ((*rg)[i].rtlw)
+			(*rg)[j++] = (*rg)[i];
+	}
+
+	if (j != *rg_pos) {
+		memset(*rg + j, 0, (*rg_pos - j) * sizeof(rg_entry_t));
+		*rg_pos = j;
+	}
+
+	return n;
+}
+
+void
+del_rule_links(
+		rt_link_t *l,
+		osips_free_f free_f
+		)
+{
+	rt_link_t *next;
+
+	for (; l; l = next) {
+		next = l->next;
+		func_free(free_f, l);
+	}
+}
+
+int
+del_rules_by_id(
+		map_t index,
+		unsigned int *ids,
+		int ids_no,
+		osips_free_f free_f
+		)
+{
+	rt_link_t *links, *l;
+	int i, n = 0;
+
+	for (i = 0; i < ids_no; i++) {
+		links = map_remove(index, rule_id_key(&ids[i]));
+		for (l = links; l; l = l->next)
+			n += rg_del_rule(l->rg, l->rg_pos, ids[i], free_f);
+		del_rule_links(links, free_f);
+	}
+
+	return n;
+}
+
 void
 del_rt_list(
 		rt_info_wrp_t *rwl,
@@ -167,6 +167,42 @@ typedef struct ptree_ {
 	ptree_node_t *ptnode;
 } ptree_t;
 
+/* node of the compact (read-only) prefix tree; the chains of nodes with a
+ * single child and no routing info are merged into a single node */
+typedef struct ptree_cnode_ {
+	/* routing groups of the prefix, NULL for branching-only nodes */
+	rg_entry_t *rg;
+	unsigned int rg_len;
+	unsigned int rg_pos;
+	/* index of the parent node */
+	unsigned int parent;
+	/* index of the first kid; the kids are contiguous, sorted by char */
+	unsigned int kids;
+	/* offset of the label chars (except the first one) in the labels */
+	unsigned int label;
+	unsigned short label_len;
+	unsigned char kids_no;
+	/* first char of the label (as index) */
+	unsigned char c;
+} ptree_cnode_t;
+
+/* the routing groups of a prefix node a rule is linked in, kept by
+ * rule id for the rule updates */
+typedef struct rt_link_ {
+	rg_entry_t **rg;
+	unsigned int *rg_pos;
+	struct rt_link_ *next;
+} rt_link_t;
+
+/* compact prefix tree, kept as a single memory block */
+typedef struct ptree_compact_ {
+	unsigned int nodes_no;
+	unsigned int size;
+	/* nodes[0] is the root (the empty prefix) */
+	ptree_cnode_t *nodes;
+	unsigned char *labels;
+} ptree_compact_t;
+
 
 
 int
@@ -187,6 +223,72 @@ del_tree(
 	osips_free_f
 	);
 
+/* builds the compact version of the tree, which takes over all its
+ * routing info; on success, the original tree is released */
+ptree_compact_t*
+compact_prefix_tree(
+	ptree_t *,
+	osips_malloc_f,
+	osips_free_f
+	);
+
+int
+del_compact_tree(
+	ptree_compact_t *,
+	osips_free_f
+	);
+
+/* adds a rule to the prefix node of the compact tree or, if there is no
+ * such node, into the overlay tree (created on demand) */
+int
+add_prefix_compact(
+	ptree_compact_t *,
+	ptree_t **,
+	str*,
+	rt_info_t *,
+	unsigned int,
+	osips_malloc_f,
+	osips_free_f
+	);
+
+/* indexes all the rules of the trees and of the prefixless list by id */
+int
+index_rules(
+	map_t,
+	ptree_t *,
+	ptree_compact_t *,
+	ptree_node_t *,
+	osips_malloc_f
+	);
+
+/* adds to the index the node of @prefix, where the rule was just added */
+int
+index_rule_prefix(
+	map_t,
+	ptree_t *,
+	ptree_compact_t *,
+	ptree_node_t *,
+	str *,
+	unsigned int,
+	osips_malloc_f
+	);
+
+/* unlinks the rules with the given ids from the nodes they are indexed
+ * at and drops them from the index; returns the number of removed links */
+int
+del_rules_by_id(
+	map_t,
+	unsigned int *,
+	int,
+	osips_free_f
+	);
+
+void
+del_rule_links(
+	rt_link_t *,
+	osips_free_f
+	);
+
 int
 add_prefix(
 	ptree_t*,
@@ -207,6 +309,18 @@ get_prefix(
 	unsigned int *matched_len
 	);
 
+/* looks up both the compact tree and the tree of the prefixes added to
+ * it after its creation (if any) */
+rt_info_t*
+get_prefix_compact(
+	ptree_compact_t *ctree,
+	ptree_t *overlay,
+	str* prefix,
+	unsigned int rgid,
+	unsigned int *rgidx,
+	unsigned int *matched_len
+	);
+
 int
 add_rt_info(
 	ptree_node_t*,
@@ -62,11 +62,15 @@ build_rt_data(struct head_db *part)
 
 	rdata->pgw_tree = map_create(flags);
 	rdata->carriers_tree = map_create(flags);
+	rdata->rules_idx = map_create(flags);
 
-	if (rdata->pgw_tree == NULL || rdata->carriers_tree == NULL) {
+	if (rdata->pgw_tree == NULL || rdata->carriers_tree == NULL ||
+	rdata->rules_idx == NULL) {
 		LM_ERR("Initializing avl failed!\n");
 		if (rdata->pgw_tree)
 			map_destroy(rdata->pgw_tree, 0);
+		if (rdata->carriers_tree)
+			map_destroy(rdata->carriers_tree, 0);
 		goto err_exit;
 
 	}
@@ -712,6 +716,16 @@ void destroy_pcr_rpm_w(void *pcr_p)
 	if (pcr->pgwl) rpm_free(pcr->pgwl);
 	rpm_free(pcr);
 }
+static void del_rule_links_shm_w(void *links)
+{
+	del_rule_links(links, shm_free_func);
+}
+
+static void del_rule_links_rpm_w(void *links)
+{
+	del_rule_links(links, rpm_free_func);
+}
+
 static void shm_free_w(void *p)
 {
 	shm_free(p);
@@ -756,6 +770,8 @@ free_rt_data(
 		/* del prefix tree */
 		del_tree(rt_data->pt, free_f);
 		rt_data->pt = 0 ;
+		del_compact_tree(rt_data->cpt, free_f);
+		rt_data->cpt = 0 ;
 		/* del prefixless rules */
 		if(NULL!=rt_data->noprefix.rg) {
 			for(j=0;j<rt_data->noprefix.rg_pos;j++) {
@@ -770,6 +786,12 @@ free_rt_data(
 		/* del carriers */
 		del_carriers_list(rt_data->carriers_tree);
 		rt_data->carriers_tree=0;
+		/* del the rules index */
+		if (rt_data->rules_idx)
+			map_destroy(rt_data->rules_idx,
+				(rt_data->rules_idx->flags & AVLMAP_PERSISTENT?
+					del_rule_links_rpm_w:del_rule_links_shm_w));
+		rt_data->rules_idx=0;
 		/* del top level */
 		func_free(free_f, rt_data);
 	}
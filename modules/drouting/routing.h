@@ -55,6 +55,12 @@ typedef struct rt_data_ {
 	ptree_node_t noprefix;
 	/* tree with routing prefixes */
 	ptree_t *pt;
+	/* compact tree with the routing prefixes, built once the loading is
+	 * done; it replaces the "pt" tree, which afterwards only holds the
+	 * new prefixes added by the rule updates */
+	ptree_compact_t *cpt;
+	/* where the rules are linked, by rule id (see dr_update_rules) */
+	map_t rules_idx;
 }rt_data_t;
 
 typedef struct _dr_group {
@@ -122,7 +122,7 @@ int reload_address_table(struct pm_part_struct *part_struct)
 	db_val_t* val;
 
 	struct address_list **new_hash_table;
-	struct subnet *new_subnet_table;
+	struct subnet_table *new_subnet_table;
 	int i, mask, proto, group, port, id;
 	struct ip_addr *ip_addr;
 	struct net *subnet;
@@ -325,6 +325,12 @@ int reload_address_table(struct pm_part_struct *part_struct)
 		}
 	}
 
+	/* build the lookup trees before making the new table visible */
+	if (subnet_table_index(new_subnet_table) != 0) {
+		LM_ERR("failed to index the subnet table\n");
+		goto error;
+	}
+
 	part_struct->perm_dbf.free_result(part_struct->db_handle, res);
 
 	*part_struct->hash_table = new_hash_table;
@@ -334,6 +340,9 @@ int reload_address_table(struct pm_part_struct *part_struct)
 	return 1;
 error:
 	part_struct->perm_dbf.free_result(part_struct->db_handle, res);
+	/* drop whatever was loaded into the unused tables */
+	empty_hash(new_hash_table);
+	empty_subnet_table(new_subnet_table);
 	return -1;
 }
 
@@ -407,7 +416,8 @@ int init_address_part(struct pm_partition *partition)
     part_struct->subnet_table_2 = new_subnet_table();
     if (!part_struct->subnet_table_2) goto error;
 
-	part_struct->subnet_table = (struct subnet **)shm_malloc(sizeof(struct subnet *));
+	part_struct->subnet_table = (struct subnet_table **)shm_malloc(
+		sizeof(struct subnet_table *));
 	if (!part_struct->subnet_table) goto error;
 
 	*part_struct->subnet_table = part_struct->subnet_table_1;
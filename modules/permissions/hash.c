@@ -326,93 +326,338 @@ void empty_hash(struct address_list** table) {
 /*
  * Create and initialize a subnet table
  */
-struct subnet* new_subnet_table(void)
+struct subnet_table* new_subnet_table(void)
 {
-    struct subnet* ptr;
+	struct subnet_table* ptr;
 
-    /* subnet record [PERM_MAX_SUBNETS] contains in its grp field
-       the number of subnet records in the subnet table */
-    ptr = (struct subnet *)shm_malloc
-	(sizeof(struct subnet) * (PERM_MAX_SUBNETS + 1));
-
-    if (!ptr) {
+	ptr = (struct subnet_table *)shm_malloc(sizeof(struct subnet_table));
+	if (!ptr) {
 		LM_ERR("no shm memory for subnet table\n");
 		return 0;
-    }
+	}
 
-    ptr[PERM_MAX_SUBNETS].grp = 0;
-    return ptr;
+	memset(ptr, 0, sizeof(struct subnet_table));
+	return ptr;
 }
 
 
 /*
- * Add <grp, subnet, mask, port> into subnet table so that table is
- * kept in increasing ordered according to grp.
+ * Add <grp, subnet, mask, port> into subnet table; the ordering according
+ * to grp is done by subnet_table_index(), once all subnets are loaded
  */
-int subnet_table_insert(struct subnet* table, unsigned int grp,
+int subnet_table_insert(struct subnet_table* table, unsigned int grp,
 			struct net *subnet,
 			unsigned int port, int proto, str* pattern, str *info)
 {
-    int i;
-    unsigned int count;
-
-    count = table[PERM_MAX_SUBNETS].grp;
-
-    if (count == PERM_MAX_SUBNETS) {
-		LM_CRIT("subnet table is full\n");
-		return 0;
-    }
-
-    i = count - 1;
+	struct subnet *s;
+	unsigned int size;
+
+	if (table->count == table->size) {
+		size = table->size ? 2 * table->size : 32;
+		s = (struct subnet *)shm_realloc(table->subnets,
+			size * sizeof(struct subnet));
+		if (!s) {
+			LM_ERR("no shm memory to grow the subnet table to %u\n", size);
+			return -1;
+		}
+		table->subnets = s;
+		table->size = size;
+	}
 
-    while (i >= 0 && table[i].grp > grp) {
-		table[i + 1] = table[i];
-		i--;
-    }
+	s = &table->subnets[table->count];
+	memset(s, 0, sizeof(struct subnet));
 
-    table[i + 1].grp = grp;
-    table[i + 1].port = port;
-	table[i + 1].proto = proto;
+	s->grp = grp;
+	s->port = port;
+	s->proto = proto;
 
 	if (subnet) {
-		table[i + 1].subnet = (struct net*) shm_malloc(sizeof(struct net));
-		if (!table[i + 1].subnet) {
+		s->subnet = (struct net*) shm_malloc(sizeof(struct net));
+		if (!s->subnet) {
 			LM_ERR("cannot allocate shm memory for table subnet\n");
 			return -1;
 		}
-		memcpy(table[i + 1].subnet, subnet, sizeof(struct net));
+		memcpy(s->subnet, subnet, sizeof(struct net));
 	}
-	else
-		table[i + 1].subnet = NULL;
 
 	if (info->len) {
-		table[i + 1].info = (char*) shm_malloc(info->len + 1);
-		if (!table[i + 1].info) {
+		s->info = (char*) shm_malloc(info->len + 1);
+		if (!s->info) {
 			LM_ERR("cannot allocate shm memory for table info\n");
-			return -1;
+			goto error;
 		}
-		memcpy(table[i + 1].info, info->s, info->len);
-		table[i + 1].info[info->len] = 0;
+		memcpy(s->info, info->s, info->len);
+		s->info[info->len] = 0;
 	}
-	else
-		table[i + 1].info = NULL;
 
 	if (pattern->len) {
-		table[i + 1].pattern = (char*) shm_malloc(pattern->len + 1);
-		if (!table[i + 1].pattern) {
+		s->pattern = (char*) shm_malloc(pattern->len + 1);
+		if (!s->pattern) {
 			LM_ERR("cannot allocate shm memory for table pattern\n");
+			goto error;
+		}
+		memcpy(s->pattern, pattern->s, pattern->len);
+		s->pattern[ pattern->len ] = 0;
+	}
+
+	table->count++;
+
+	return 1;
+error:
+	if (s->subnet)
+		shm_free(s->subnet);
+	if (s->info)
+		shm_free(s->info);
+	return -1;
+}
+
+
+#define ip_bit(_ip, _n) (((_ip)->u.addr[(_n) / 8] >> (7 - (_n) % 8)) & 1)
+
+/* number of leading bits (at most @max) that @a and @b have in common */
+static inline unsigned int ip_common_bits(struct ip_addr *a, struct ip_addr *b,
+															unsigned int max)
+{
+	unsigned int i, bits;
+	unsigned char x;
+
+	for (i = 0; i * 8 < max; i++) {
+		x = a->u.addr[i] ^ b->u.addr[i];
+		if (x) {
+			bits = i * 8 + __builtin_clz((unsigned int)x) - 24;
+			return bits < max ? bits : max;
+		}
+	}
+
+	return max;
+}
+
+static inline unsigned int mask_bitlen(struct ip_addr *mask)
+{
+	unsigned int i, bits = 0;
+
+	for (i = 0; i < mask->len && mask->u.addr[i] == 0xff; i++)
+		bits += 8;
+	if (i < mask->len)
+		bits += __builtin_clz(~(unsigned int)mask->u.addr[i] << 24);
+
+	return bits;
+}
+
+static struct subnet_node *new_subnet_node(struct ip_addr *prefix,
+															unsigned int bitlen)
+{
+	struct subnet_node *node;
+
+	node = (struct subnet_node *)shm_malloc(sizeof(struct subnet_node));
+	if (!node) {
+		LM_ERR("no shm memory for subnet tree node\n");
+		return NULL;
+	}
+
+	memset(node, 0, sizeof(struct subnet_node));
+	node->prefix = *prefix;
+	node->bitlen = bitlen;
+
+	return node;
+}
+
+static int subnet_node_add(struct subnet_node *node, unsigned int idx)
+{
+	unsigned int *p;
+
+	p = (unsigned int *)shm_realloc(node->idx,
+		(node->idx_no + 1) * sizeof(unsigned int));
+	if (!p) {
+		LM_ERR("no shm memory for subnet tree node entries\n");
+		return -1;
+	}
+
+	p[node->idx_no++] = idx;
+	node->idx = p;
+
+	return 0;
+}
+
+/* adds the subnet @idx, of network @prefix/@bitlen, into the tree */
+static int subnet_tree_insert(struct subnet_node **slot,
+			struct ip_addr *prefix, unsigned int bitlen, unsigned int idx)
+{
+	struct subnet_node *node, *parent;
+	unsigned int common;
+
+	for (;;) {
+		node = *slot;
+		if (!node) {
+			node = new_subnet_node(prefix, bitlen);
+			if (!node)
+				return -1;
+			*slot = node;
+			return subnet_node_add(node, idx);
+		}
+
+		common = ip_common_bits(&node->prefix, prefix,
+			node->bitlen < bitlen ? node->bitlen : bitlen);
+
+		if (common == node->bitlen) {
+			if (bitlen == node->bitlen)
+				return subnet_node_add(node, idx);
+
+			slot = &node->kids[ip_bit(prefix, node->bitlen)];
+			continue;
+		}
+
+		/* the networks diverge earlier => split the path */
+		parent = new_subnet_node(prefix, common);
+		if (!parent)
 			return -1;
+		parent->kids[ip_bit(&node->prefix, common)] = node;
+		*slot = parent;
+
+		if (common == bitlen)
+			return subnet_node_add(parent, idx);
+
+		slot = &parent->kids[ip_bit(prefix, common)];
+	}
+}
+
+static void free_subnet_tree(struct subnet_node *node)
+{
+	if (!node)
+		return;
+
+	free_subnet_tree(node->kids[0]);
+	free_subnet_tree(node->kids[1]);
+
+	if (node->idx)
+		shm_free(node->idx);
+	shm_free(node);
+}
+
+/* collects the tree nodes holding subnets which include @ip, from the
+ * widest to the narrowest network; returns their number */
+static int subnet_tree_path(struct subnet_table *table, struct ip_addr *ip,
+										struct subnet_node **path)
+{
+	struct subnet_node *node;
+	int n = 0;
+
+	node = table->tree[ip->af == AF_INET6];
+
+	while (node) {
+		if (ip->len * 8 < node->bitlen ||
+		ip_common_bits(&node->prefix, ip, node->bitlen) < node->bitlen)
+			break;
+
+		if (node->idx_no)
+			path[n++] = node;
+
+		if (node->bitlen == ip->len * 8)
+			break;
+
+		node = node->kids[ip_bit(ip, node->bitlen)];
+	}
+
+	return n;
+}
+
+/* returns the next subnet (in table order) from the collected @path */
+static inline int subnet_path_next(struct subnet_node **path, int n,
+															unsigned int *pos)
+{
+	int i, best = -1;
+
+	for (i = 0; i < n; i++) {
+		if (pos[i] == path[i]->idx_no)
+			continue;
+		if (best < 0 || path[i]->idx[pos[i]] < path[best]->idx[pos[best]])
+			best = i;
+	}
+
+	if (best < 0)
+		return -1;
+
+	return path[best]->idx[pos[best]++];
+}
+
+#define SUBNET_MAX_PATH (128 + 1)
+
+static void merge_subnets(struct subnet *dst, struct subnet *src,
+									unsigned int lo, unsigned int mid, unsigned int hi)
+{
+	unsigned int i = lo, j = mid, k = lo;
+
+	while (i < mid && j < hi)
+		dst[k++] = (src[j].grp < src[i].grp) ? src[j++] : src[i++];
+	while (i < mid)
+		dst[k++] = src[i++];
+	while (j < hi)
+		dst[k++] = src[j++];
+}
+
+
+/*
+ * Orders the subnets according to grp (keeping the load order within the
+ * same group) and builds the radix trees used for the lookups
+ */
+int subnet_table_index(struct subnet_table* table)
+{
+	struct subnet *buf, *src, *dst, *tmp;
+	unsigned int width, lo, i, af;
+
+	if (table->count > 1) {
+		buf = (struct subnet *)shm_malloc(table->count * sizeof(struct subnet));
+		if (!buf) {
+			LM_ERR("no shm memory to sort %u subnets\n", table->count);
+			return -1;
+		}
+
+		/* bottom-up merge sort, as it is stable */
+		src = table->subnets;
+		dst = buf;
+		for (width = 1; width < table->count; width *= 2) {
+			for (lo = 0; lo < table->count; lo += 2 * width)
+				merge_subnets(dst, src, lo,
+					lo + width < table->count ? lo + width : table->count,
+					lo + 2 * width < table->count ? lo + 2 * width : table->count);
+			tmp = src; src = dst; dst = tmp;
 		}
-		memcpy(table[i + 1].pattern, pattern->s, pattern->len);
-		table[i + 1].pattern[ pattern->len ] = 0;
+
+		if (src != table->subnets)
+			memcpy(table->subnets, src, table->count * sizeof(struct subnet));
+		shm_free(buf);
 	}
-	else
-		table[i + 1].pattern = NULL;
 
+	for (i = 0; i < table->count; i++) {
+		if (!table->subnets[i].subnet)
+			continue;
 
-    table[PERM_MAX_SUBNETS].grp = count + 1;
+		af = (table->subnets[i].subnet->ip.af == AF_INET6);
+		if (subnet_tree_insert(&table->tree[af], &table->subnets[i].subnet->ip,
+		mask_bitlen(&table->subnets[i].subnet->mask), i) != 0) {
+			LM_ERR("failed to index subnet %u\n", i);
+			return -1;
+		}
+	}
 
-    return 1;
+	return 0;
+}
+
+
+/* checks if there is any subnet in the @grp group */
+static int subnet_group_exists(struct subnet_table* table, unsigned int grp)
+{
+	unsigned int lo = 0, hi = table->count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (table->subnets[mid].grp < grp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < table->count && table->subnets[lo].grp == grp;
 }
 
 
@@ -420,93 +665,69 @@ int subnet_table_insert(struct subnet* table, unsigned int grp,
  * Check if an entry exists in subnet table that matches given group, ip_addr,
  * and port.  Port 0 in subnet table matches any port.
  */
-int match_subnet_table(struct sip_msg *msg, struct subnet* table,
+int match_subnet_table(struct sip_msg *msg, struct subnet_table* table,
 			unsigned int grp, struct ip_addr *ip, unsigned int port, int proto,
 			char *pattern, pv_spec_t *info)
 {
-        unsigned int count, i;
+	struct subnet_node *path[SUBNET_MAX_PATH];
+	unsigned int pos[SUBNET_MAX_PATH];
+	struct subnet *s;
 	pv_value_t pvt;
-	int match_res, found_group = 0;
+	int n, i;
 
-	count = table[PERM_MAX_SUBNETS].grp;
-
-	if (count == 0) {
+	if (table->count == 0) {
 		LM_DBG("subnet table is empty\n");
 		return -2;
 	}
 
-	if (grp != GROUP_ANY) {
-		for (i = 0; i < count; i++) {
-			if (table[i].grp == grp) {
-				found_group = 1;
-				break;
-			} else if (table[i].grp > grp) {
-				break;
-			}
-		}
-
-		if (!found_group) {
-			LM_DBG("specified group %u does not exist in hash table\n", grp);
-			return -2;
-		}
+	if (grp != GROUP_ANY && !subnet_group_exists(table, grp)) {
+		LM_DBG("specified group %u does not exist in hash table\n", grp);
+		return -2;
 	}
 
-	i = 0;
-	do {
-		if ((table[i].grp == grp || table[i].grp == GROUP_ANY
+	n = subnet_tree_path(table, ip, path);
+	memset(pos, 0, n * sizeof *pos);
+
+	/* the including subnets, in table order */
+	while ((i = subnet_path_next(path, n, pos)) >= 0) {
+		s = &table->subnets[i];
+
+		if ((s->grp == grp || s->grp == GROUP_ANY
 				|| grp == GROUP_ANY) &&
-			(table[i].port == port || table[i].port == PORT_ANY
+			(s->port == port || s->port == PORT_ANY
 				|| port == PORT_ANY) &&
-			(table[i].proto == proto || table[i].proto == PROTO_NONE
+			(s->proto == proto || s->proto == PROTO_NONE
 			 	|| proto == PROTO_NONE))
 			{
-
-				match_res = matchnet(ip, table[i].subnet);
-
-				if (match_res != 1) {
-					i++;
+				if (s->pattern && pattern &&
+				fnmatch(s->pattern, pattern, FNM_PERIOD))
 					continue;
-				}
-
-				if (table[i].pattern && pattern) {
-					match_res = fnmatch(table[i].pattern, pattern, FNM_PERIOD);
-
-					if (match_res) {
-						i++;
-						continue;
-					}
-				}
 
 				if (info) {
 					pvt.flags = PV_VAL_STR;
-					pvt.rs.s = table[i].info;
-					pvt.rs.len = table[i].info ? strlen(table[i].info) : 0;
+					pvt.rs.s = s->info;
+					pvt.rs.len = s->info ? strlen(s->info) : 0;
 
 					if (pv_set_value(msg, info, (int)EQ_T, &pvt) < 0) {
 						LM_ERR("setting of avp failed\n");
 						return -1;
-	    			}
+					}
 				}
 
 				LM_DBG("match found in the subnet table\n");
 				return 1;
 			}
-
-		if (table[i].grp > grp && grp != GROUP_ANY)
-			break;
-		i++;
-
-	} while (i < count);
+	}
 
 	LM_DBG("no match in the subnet table\n");
-    return -1;
+	return -1;
 }
 
 
 /*
  * Print subnets stored in subnet table
  */
-int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
+int subnet_table_mi_print(struct subnet_table* table, mi_item_t *part_item,
 		struct pm_part_struct *pm)
 {
     unsigned int count, i;
@@ -515,7 +736,7 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
 	static char ip_buff[IP_ADDR_MAX_STR_SIZE];
 	mi_item_t *dests_arr, *dest_item;
 
-	count = table[PERM_MAX_SUBNETS].grp;
+	count = table->count;
 
 	dests_arr = add_mi_array(part_item, MI_SSTR("Destinations"));
 	if (!dests_arr)
@@ -526,19 +747,19 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
 		if (!dest_item)
 			return -1;
 
-		ip = ip_addr2a(&table[i].subnet->ip);
+		ip = ip_addr2a(&table->subnets[i].subnet->ip);
 		if (!ip) {
 			LM_ERR("cannot print ip address\n");
 			continue;
 		}
 		strcpy(ip_buff, ip);
-		mask = ip_addr2a(&table[i].subnet->mask);
+		mask = ip_addr2a(&table->subnets[i].subnet->mask);
 		if (!mask) {
 			LM_ERR("cannot print mask address\n");
 			continue;
 		}
 
-		if (add_mi_number(dest_item, MI_SSTR("grp"), table[i].grp) < 0)
+		if (add_mi_number(dest_item, MI_SSTR("grp"), table->subnets[i].grp) < 0)
 			return -1;
 
 		if (add_mi_string(dest_item, MI_SSTR("ip"), ip_buff, strlen(ip_buff)) < 0)
@@ -547,14 +768,14 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
 		if (add_mi_string(dest_item, MI_SSTR("mask"), mask, strlen(mask)) < 0)
 			return -1;
 
-		if (add_mi_number(dest_item, MI_SSTR("port"), table[i].port) < 0)
+		if (add_mi_number(dest_item, MI_SSTR("port"), table->subnets[i].port) < 0)
 			return -1;
 
-		if (table[i].proto == PROTO_NONE) {
+		if (table->subnets[i].proto == PROTO_NONE) {
 			p = "any";
 			len = 3;
 		} else {
-			p = proto2str(table[i].proto, prbuf);
+			p = proto2str(table->subnets[i].proto, prbuf);
 			len = p - prbuf;
 			p = prbuf;
 		}
@@ -562,13 +783,13 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
 			return -1;
 
 		if (add_mi_string(dest_item, MI_SSTR("pattern"),
-			table[i].pattern,
-		    table[i].pattern ? strlen(table[i].pattern) : 0) < 0)
+			table->subnets[i].pattern,
+		    table->subnets[i].pattern ? strlen(table->subnets[i].pattern) : 0) < 0)
 		    return -1;
 
 		if (add_mi_string(dest_item, MI_SSTR("context_info"),
-			table[i].info,
-		    table[i].info ? strlen(table[i].info) : 0) < 0)
+			table->subnets[i].info,
+		    table->subnets[i].info ? strlen(table->subnets[i].info) : 0) < 0)
 		    return -1;
     }
 
@@ -581,24 +802,19 @@ int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
  * and port.  Port 0 in subnet table matches any port.  Return group of
  * first match or -1 if no match is found.
  */
-int find_group_in_subnet_table(struct subnet* table,
+int find_group_in_subnet_table(struct subnet_table* table,
 		                   struct ip_addr *ip, unsigned int port)
 {
-	unsigned int count, i, match_res;
+	struct subnet_node *path[SUBNET_MAX_PATH];
+	unsigned int pos[SUBNET_MAX_PATH];
+	int n, i;
 
-	count = table[PERM_MAX_SUBNETS].grp;
+	n = subnet_tree_path(table, ip, path);
+	memset(pos, 0, n * sizeof *pos);
 
-	i = 0;
-	while (i < count) {
-		if	(table[i].port == port || table[i].port == 0) {
-			match_res = matchnet(ip, table[i].subnet);
-
-			if (match_res == 1)
-		        return table[i].grp;
-
-		}
-	    i++;
-	}
+	while ((i = subnet_path_next(path, n, pos)) >= 0)
+		if (table->subnets[i].port == port || table->subnets[i].port == 0)
+			return table->subnets[i].grp;
 
 	return -1;
 }
@@ -607,39 +823,40 @@ int find_group_in_subnet_table(struct subnet* table,
 /*
  * Empty contents of subnet table
  */
-void empty_subnet_table(struct subnet *table)
+void empty_subnet_table(struct subnet_table *table)
 {
-	int count, i;
+	unsigned int i;
 
 	if (!table)
 		return;
 
-	count = table[PERM_MAX_SUBNETS].grp;
-
-	for (i = 0; i < count; i++) {
-		if (table[i].info)
-			shm_free(table[i].info);
-		if (table[i].pattern)
-			shm_free(table[i].pattern);
-		if (table[i].subnet)
-			shm_free(table[i].subnet);
+	for (i = 0; i < table->count; i++) {
+		if (table->subnets[i].info)
+			shm_free(table->subnets[i].info);
+		if (table->subnets[i].pattern)
+			shm_free(table->subnets[i].pattern);
+		if (table->subnets[i].subnet)
+			shm_free(table->subnets[i].subnet);
 	}
 
-	table[PERM_MAX_SUBNETS].grp = 0;
+	free_subnet_tree(table->tree[0]);
+	free_subnet_tree(table->tree[1]);
+	table->tree[0] = table->tree[1] = NULL;
+
+	if (table->subnets)
+		shm_free(table->subnets);
+	table->subnets = NULL;
+	table->count = table->size = 0;
 }
 
 
 /*
  * Release memory allocated for a subnet table
  */
-void free_subnet_table(struct subnet* table)
+void free_subnet_table(struct subnet_table* table)
 {
 	empty_subnet_table(table);
 
 	if (table)
 	    shm_free(table);
 }
-
-
-
-
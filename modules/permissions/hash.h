@@ -102,13 +102,11 @@ int find_group_in_hash_table(struct address_list** table,
 
 
 
-#define PERM_MAX_SUBNETS 128
-
 /*
  * Structure used to store a subnet
  */
 struct subnet {
-	unsigned int grp;        /* address group, subnet count in last record */
+	unsigned int grp;        /* address group */
 	struct net *subnet;		 /* IP subnet + mask */
 	int proto;                  /* Protocol -- UDP, TCP, TLS, or SCTP */
 	char *pattern;              /* Pattern matching From header field */
@@ -116,18 +114,41 @@ struct subnet {
 	char *info;				 /* extra information */
 };
 
+/*
+ * Node of the (path-compressed) radix tree indexing the subnets by their
+ * network address; a node holds the subnets having exactly its prefix
+ */
+struct subnet_node {
+	struct ip_addr prefix;      /* first "bitlen" bits are relevant */
+	unsigned int bitlen;
+	unsigned int *idx;          /* subnets of the node, in table order */
+	unsigned int idx_no;
+	struct subnet_node *kids[2];
+};
+
+/*
+ * Subnet table: the subnets ordered by group, plus a radix tree per
+ * address family, built once all the subnets are loaded
+ */
+struct subnet_table {
+	struct subnet *subnets;
+	unsigned int count;
+	unsigned int size;
+	struct subnet_node *tree[2];   /* IPv4, IPv6 */
+};
+
 
 /*
  * Create a subnet table
  */
-struct subnet* new_subnet_table(void);
+struct subnet_table* new_subnet_table(void);
 
 
 /*
  * Check if an entry exists in subnet table that matches given group, ip_addr,
  * and port.  Port 0 in subnet table matches any port.
  */
-int match_subnet_table(struct sip_msg *msg, struct subnet* table,
+int match_subnet_table(struct sip_msg *msg, struct subnet_table* table,
 		unsigned int group, struct ip_addr *ip, unsigned int port, int proto,
 		char *pattern, pv_spec_t* info);
 
@@ -137,36 +158,42 @@ int match_subnet_table(struct sip_msg *msg, struct subnet* table,
  * and port.  Port 0 in subnet table matches any port.  Returns group of
  * the first match or -1 if no match is found.
  */
-int find_group_in_subnet_table(struct subnet* table,
+int find_group_in_subnet_table(struct subnet_table* table,
 		struct ip_addr *ip, unsigned int port);
 
 /*
  * Empty contents of subnet table
  */
-void empty_subnet_table(struct subnet *table);
+void empty_subnet_table(struct subnet_table *table);
 
 
 /*
  * Release memory allocated for a subnet table
  */
-void free_subnet_table(struct subnet* table);
+void free_subnet_table(struct subnet_table* table);
 
 
 
 /*
- * Add <grp, subnet, mask, port> into subnet table so that table is
- * kept ordered according to subnet, port, grp.
+ * Add <grp, subnet, mask, port> into subnet table; the table must be
+ * indexed with subnet_table_index() once all the subnets are added
  */
-int subnet_table_insert(struct subnet* table, unsigned int grp,
+int subnet_table_insert(struct subnet_table* table, unsigned int grp,
 		struct net *subnet, unsigned int port, int proto,
 		str* pattern, str *info);
 
 
+/*
+ * Orders the subnets according to grp and builds their radix trees
+ */
+int subnet_table_index(struct subnet_table* table);
+
+
 /*
  * Print subnets stored in subnet table
  */
 /*void subnet_table_print(struct subnet* table, FILE* reply_file);*/
-int subnet_table_mi_print(struct subnet* table, mi_item_t *part_item,
+int subnet_table_mi_print(struct subnet_table* table, mi_item_t *part_item,
 		struct pm_part_struct *pm);
 
 
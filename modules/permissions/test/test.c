@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <tap.h>
+
+#include "../../../dprint.h"
+#include "../../../ip_addr.h"
+#include "../../../mem/mem.h"
+#include "../../../mem/shm_mem.h"
+
+#include "../hash.h"
+
+#define SUBNET_BENCH_PREFIXES  100000
+#define SUBNET_BENCH_LOOKUPS   100000
+#define SUBNET_BENCH_SCANS     200
+
+static void rand_ip(struct ip_addr *ip, int af, int dense)
+{
+	int i;
+
+	memset(ip, 0, sizeof *ip);
+	ip->af = af;
+	ip->len = (af == AF_INET) ? 4 : 16;
+
+	/* dense addresses are close, so their networks overlap a lot */
+	for (i = 0; i < ip->len; i++)
+		ip->u.addr[i] = (dense && i < 2) ? rand() % 4 : rand();
+}
+
+static int add_rand_subnet(struct subnet_table *t, int af, int dense,
+													int min_bitlen, int i)
+{
+	struct ip_addr ip;
+	struct net *net;
+	char buf[16];
+	str info, pattern = {NULL, 0};
+	int ret;
+
+	rand_ip(&ip, af, dense);
+	net = mk_net_bitlen(&ip, min_bitlen +
+		rand() % ((af == AF_INET ? 32 : 128) - min_bitlen + 1));
+	if (!net)
+		return -1;
+
+	info.s = buf;
+	info.len = sprintf(buf, "%d", i);
+
+	ret = subnet_table_insert(t, rand() % 4, net, rand() % 3,
+		(rand() % 2) ? PROTO_NONE : PROTO_UDP, &pattern, &info);
+	pkg_free(net);
+
+	return ret;
+}
+
+/* the linear scans the subnet table used to do */
+static int scan_group(struct subnet_table *t, struct ip_addr *ip,
+		unsigned int port)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->count; i++)
+		if ((t->subnets[i].port == port || t->subnets[i].port == 0) &&
+				matchnet(ip, t->subnets[i].subnet) == 1)
+			return t->subnets[i].grp;
+
+	return -1;
+}
+
+static int scan_match(struct subnet_table *t, unsigned int grp,
+		struct ip_addr *ip, unsigned int port, int proto)
+{
+	unsigned int i;
+	int found = 0;
+
+	for (i = 0; i < t->count; i++)
+		if (t->subnets[i].grp == grp)
+			found = 1;
+
+	if (grp != GROUP_ANY && !found)
+		return -2;
+
+	for (i = 0; i < t->count; i++)
+		if ((t->subnets[i].grp == grp || t->subnets[i].grp == GROUP_ANY ||
+				grp == GROUP_ANY) &&
+			(t->subnets[i].port == port || t->subnets[i].port == PORT_ANY ||
+				port == PORT_ANY) &&
+			(t->subnets[i].proto == proto ||
+				t->subnets[i].proto == PROTO_NONE || proto == PROTO_NONE) &&
+			matchnet(ip, t->subnets[i].subnet) == 1)
+			return 1;
+
+	return -1;
+}
+
+static void test_subnet_table(void)
+{
+	struct subnet_table *t;
+	struct ip_addr ip;
+	unsigned int i;
+	int af, ordered, bad_grp, bad_match;
+
+	t = new_subnet_table();
+	ok(t != NULL, "subnet-1");
+	if (!t)
+		return;
+
+	for (i = 0; i < 2000; i++)
+		if (add_rand_subnet(t, i % 3 ? AF_INET : AF_INET6, 1, 0, i) != 1)
+			break;
+	ok(i == 2000 && t->count == 2000, "subnet-2");
+	ok(subnet_table_index(t) == 0, "subnet-3");
+
+	/* ordered by group, in load order within a group */
+	for (ordered = 1, i = 1; i < t->count; i++)
+		if (t->subnets[i].grp < t->subnets[i - 1].grp ||
+				(t->subnets[i].grp == t->subnets[i - 1].grp &&
+				atoi(t->subnets[i].info) < atoi(t->subnets[i - 1].info)))
+			ordered = 0;
+	ok(ordered, "subnet-4");
+
+	for (bad_grp = bad_match = 0, i = 0; i < 20000; i++) {
+		af = i % 3 ? AF_INET : AF_INET6;
+		rand_ip(&ip, af, 1);
+
+		if (find_group_in_subnet_table(t, &ip, i % 3) !=
+				scan_group(t, &ip, i % 3))
+			bad_grp++;
+
+		if (match_subnet_table(NULL, t, i % 5, &ip, i % 3,
+				(i % 2) ? PROTO_UDP : PROTO_TCP, NULL, NULL) !=
+				scan_match(t, i % 5, &ip, i % 3,
+				(i % 2) ? PROTO_UDP : PROTO_TCP))
+			bad_match++;
+	}
+	ok(bad_grp == 0, "subnet-5");
+	ok(bad_match == 0, "subnet-6");
+
+	empty_subnet_table(t);
+	ok(t->count == 0 && !t->tree[0] && !t->tree[1], "subnet-7");
+	rand_ip(&ip, AF_INET, 1);
+	ok(match_subnet_table(NULL, t, GROUP_ANY, &ip, 0, PROTO_NONE, NULL,
+		NULL) == -2, "subnet-8");
+
+	free_subnet_table(t);
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *stop)
+{
+	return (stop->tv_sec - start->tv_sec) * 1e9 +
+		(stop->tv_nsec - start->tv_nsec);
+}
+
+static void bench_subnet_table(void)
+{
+	struct subnet_table *t;
+	struct ip_addr *ips;
+	struct timespec start, stop;
+	volatile int r;
+	double load, tree, scan;
+	int i;
+
+	t = new_subnet_table();
+	ips = shm_malloc(SUBNET_BENCH_LOOKUPS * sizeof *ips);
+	if (!t || !ips) {
+		diag("oom, skipping the subnet table benchmark");
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	/* spread, mostly narrow networks, as in a typical ACL */
+	for (i = 0; i < SUBNET_BENCH_PREFIXES; i++)
+		if (add_rand_subnet(t, AF_INET, 0, 16, i) != 1) {
+			diag("oom, skipping the subnet table benchmark");
+			goto out;
+		}
+	if (subnet_table_index(t) != 0) {
+		diag("failed to index, skipping the subnet table benchmark");
+		goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	load = elapsed_ns(&start, &stop) / 1e6;
+
+	for (i = 0; i < SUBNET_BENCH_LOOKUPS; i++)
+		rand_ip(&ips[i], AF_INET, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SUBNET_BENCH_LOOKUPS; i++)
+		r = find_group_in_subnet_table(t, &ips[i], 0);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	tree = elapsed_ns(&start, &stop) / SUBNET_BENCH_LOOKUPS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SUBNET_BENCH_SCANS; i++)
+		r = scan_group(t, &ips[i], 0);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	scan = elapsed_ns(&start, &stop) / SUBNET_BENCH_SCANS;
+	(void)r;
+
+	diag("%d subnets: loaded in %.1f ms, %.1f ns/lookup indexed, "
+		"%.1f ns/lookup scanned", SUBNET_BENCH_PREFIXES, load, tree, scan);
+
+out:
+	if (ips)
+		shm_free(ips);
+	if (t)
+		free_subnet_table(t);
+}
+
+
+void mod_tests(void)
+{
+	test_subnet_table();
+	bench_subnet_table();
+}
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <string.h>
+
+#include "../../dprint.h"
+#include "../../mem/shm_mem.h"
+#include "../../timer.h"
+#include "ip_tree.h"
+#include "ip_bucket.h"
+
+
+int bucket_hash_size = 16;
+int bucket_ipv4_prefix = 32;
+int bucket_ipv6_prefix = 128;
+
+extern int timeout;
+extern int pike_log_level;
+
+static struct pike_buckets *buckets;
+
+
+int init_ip_buckets(int max_reqs, int time_unit)
+{
+	unsigned int size, i;
+
+	if (max_reqs <= 0 || max_reqs > PIKE_MAX_DENSITY) {
+		LM_ERR("reqs_density_per_unit must be between 1 and %d with the "
+			"bucket engine\n", PIKE_MAX_DENSITY);
+		return -1;
+	}
+
+	if (bucket_hash_size < 4 || bucket_hash_size > 28) {
+		LM_ERR("bad bucket_hash_size %d (4 - 28)\n", bucket_hash_size);
+		return -1;
+	}
+
+	if (bucket_ipv4_prefix < 1 || bucket_ipv4_prefix > 32 ||
+			bucket_ipv6_prefix < 1 || bucket_ipv6_prefix > 128) {
+		LM_ERR("bad bucket_ipv4_prefix / bucket_ipv6_prefix\n");
+		return -1;
+	}
+
+	size = 1U << bucket_hash_size;
+	buckets = shm_malloc(sizeof *buckets + size * sizeof *buckets->entries);
+	if (!buckets) {
+		LM_ERR("no more shm memory for %u buckets\n", size);
+		return -1;
+	}
+	memset(buckets, 0, sizeof *buckets + size * sizeof *buckets->entries);
+
+	buckets->size = size;
+	buckets->sketch_width = size / PIKE_SKETCH_ROWS;
+	buckets->cap = max_reqs * PIKE_TOKEN;
+	buckets->rate = (unsigned long long)max_reqs * PIKE_TOKEN /
+		(time_unit * 1000);
+	if (buckets->rate == 0)
+		buckets->rate = 1;
+
+	buckets->sketch = shm_malloc(size * sizeof *buckets->sketch);
+	if (!buckets->sketch) {
+		LM_ERR("no more shm memory for the sketch\n");
+		shm_free(buckets);
+		buckets = NULL;
+		return -1;
+	}
+
+	/* all the buckets start full */
+	for (i = 0; i < size; i++) {
+		buckets->entries[i].state = buckets->cap;
+		buckets->sketch[i] = buckets->cap;
+	}
+
+	LM_INFO("%u buckets, %u sketch cells\n", size, size);
+	return 0;
+}
+
+
+void destroy_ip_buckets(void)
+{
+	if (!buckets)
+		return;
+
+	shm_free(buckets->sketch);
+	shm_free(buckets);
+	buckets = NULL;
+}
+
+
+/* FNV-1a over the (masked) IP; the family is part of the hash as well */
+static unsigned long long ip_tag(const unsigned char *ip, int len)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL ^ len;
+	int i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ ip[i]) * 0x100000001b3ULL;
+
+	return h && h != PIKE_TAG_CLEANING ? h : 1;
+}
+
+
+static int mask_ip(struct ip_addr *ip, unsigned char *buf)
+{
+	int prefix = ip->af == AF_INET ? bucket_ipv4_prefix : bucket_ipv6_prefix;
+	int i;
+
+	memcpy(buf, ip->u.addr, ip->len);
+	for (i = prefix / 8; i < ip->len; i++)
+		buf[i] = (i == prefix / 8) ? buf[i] & (0xff00 >> (prefix % 8)) : 0;
+
+	return ip->len;
+}
+
+
+/* the ms clock of the buckets (wraps every ~49 days, handled) */
+static inline unsigned int bucket_now(void)
+{
+	return (unsigned int)(get_uticks() / 1000);
+}
+
+
+/*
+ * Takes a token from a bucket, refilling it first; returns the RED_NODE /
+ * NEWRED_NODE flags, plus NO_UPDATE if the bucket was red and is not anymore
+ */
+static int bucket_take(unsigned long long *state, unsigned int now)
+{
+	unsigned long long old, new, tokens;
+	unsigned int last, red;
+	int ret;
+
+	old = __atomic_load_n(state, __ATOMIC_RELAXED);
+	do {
+		last = old >> 32;
+		red = old & PIKE_BUCKET_RED;
+		tokens = (old & (PIKE_BUCKET_RED - 1)) +
+			(unsigned long long)(now - last) * buckets->rate;
+		if (tokens > buckets->cap)
+			tokens = buckets->cap;
+
+		/* a red bucket keeps being drained by the flood; it is released
+		 * only once the IP slowed down enough for it to refill halfway */
+		ret = 0;
+		if (red && tokens >= buckets->cap / 2) {
+			red = 0;
+			ret = NO_UPDATE;
+		}
+
+		if (red) {
+			ret = RED_NODE;
+			tokens = tokens > PIKE_TOKEN ? tokens - PIKE_TOKEN : 0;
+		} else if (tokens >= PIKE_TOKEN) {
+			tokens -= PIKE_TOKEN;
+		} else {
+			ret = RED_NODE|NEWRED_NODE;
+			red = PIKE_BUCKET_RED;
+		}
+
+		new = ((unsigned long long)now << 32) | red | tokens;
+	} while (!__atomic_compare_exchange_n(state, &old, new, 1,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return ret;
+}
+
+
+static struct pike_bucket *get_bucket(unsigned long long tag,
+		unsigned char *ip, int len)
+{
+	struct pike_bucket *e, *free = NULL;
+	unsigned long long t;
+	unsigned int pos, i;
+
+	pos = (unsigned int)(tag >> 32) & (buckets->size - 1);
+
+	for (i = 0; i < PIKE_BUCKET_PROBES; i++) {
+		e = &buckets->entries[(pos + i) & (buckets->size - 1)];
+		t = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+		if (t == tag)
+			return e;
+		if (!t && !free)
+			free = e;
+	}
+
+	if (!free)
+		return NULL;
+
+	/* a free entry always holds a full bucket, see the timer */
+	t = 0;
+	if (!__atomic_compare_exchange_n(&free->tag, &t, tag, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return t == tag ? free : NULL;
+
+	memcpy(free->ip, ip, len);
+	free->ip_len = len;
+	return free;
+}
+
+
+int mark_bucket(struct ip_addr *ip)
+{
+	struct pike_bucket *e;
+	unsigned char buf[16];
+	unsigned long long tag;
+	unsigned int now = bucket_now();
+	int len, row, flags, ret;
+
+	len = mask_ip(ip, buf);
+	tag = ip_tag(buf, len);
+
+	e = get_bucket(tag, buf, len);
+	if (e) {
+		e->last_hit = get_ticks();
+		ret = bucket_take(&e->state, now);
+		if (ret & NO_UPDATE)
+			LM_GEN1(pike_log_level, "PIKE - UNBLOCKing ip %s\n",
+				ip_addr2a(ip));
+
+		return ret & (RED_NODE|NEWRED_NODE);
+	}
+
+	/* no room left around its position, fall back to the sketch: the IP
+	 * is only flooding if all its cells are empty */
+	for (ret = RED_NODE, row = 0; row < PIKE_SKETCH_ROWS; row++) {
+		flags = bucket_take(&buckets->sketch[row * buckets->sketch_width +
+			((tag * (2 * row + 1)) >> 32 & (buckets->sketch_width - 1))],
+			now);
+		if (!(flags & RED_NODE))
+			ret = 0;
+		else if (ret)
+			ret |= flags & NEWRED_NODE;
+	}
+
+	return ret;
+}
+
+
+/*
+ * Frees the buckets unused for remove_latency seconds; each run checks a
+ * share of the hash, so that all of it is checked every remove_latency
+ */
+void bucket_clean_routine(unsigned int ticks, void *param)
+{
+	struct pike_bucket *e;
+	unsigned long long tag;
+	unsigned int n, i;
+
+	n = buckets->size / timeout + 1;
+
+	for (i = 0; i < n; i++) {
+		e = &buckets->entries[buckets->clean_pos];
+		buckets->clean_pos = (buckets->clean_pos + 1) & (buckets->size - 1);
+
+		tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+		if (!tag || tag == PIKE_TAG_CLEANING ||
+				ticks - e->last_hit < timeout)
+			continue;
+
+		/* claim the entry first, so that no IP may take it (or find it)
+		 * while its bucket is being refilled; skip it if it changed */
+		if (!__atomic_compare_exchange_n(&e->tag, &tag, PIKE_TAG_CLEANING, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+
+		if (__atomic_exchange_n(&e->state, buckets->cap, __ATOMIC_RELAXED) &
+				PIKE_BUCKET_RED)
+			LM_GEN1(pike_log_level, "PIKE - UNBLOCKing expired ip, "
+				"bucket=%p\n", e);
+
+		__atomic_store_n(&e->tag, 0, __ATOMIC_RELEASE);
+	}
+}
+
+
+int bucket_list_red(mi_item_t *ips_arr)
+{
+	struct ip_addr ip;
+	struct pike_bucket *e;
+	unsigned long long tag;
+	unsigned int i;
+
+	for (i = 0; i < buckets->size; i++) {
+		e = &buckets->entries[i];
+		tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+		if (!tag || tag == PIKE_TAG_CLEANING ||
+				!(__atomic_load_n(&e->state, __ATOMIC_RELAXED) &
+				PIKE_BUCKET_RED))
+			continue;
+
+		memset(&ip, 0, sizeof ip);
+		ip.af = e->ip_len == 4 ? AF_INET : AF_INET6;
+		ip.len = e->ip_len;
+		memcpy(ip.u.addr, e->ip, e->ip_len);
+
+		if (add_mi_string_fmt(ips_arr, 0, 0, "%s", ip_addr2a(&ip)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* returns 1 if unblocked, 0 if not blocked, -1 if not found */
+int bucket_unblock(struct ip_addr *ip)
+{
+	struct pike_bucket *e;
+	unsigned char buf[16];
+	unsigned long long tag;
+	unsigned int pos, i;
+	int len;
+
+	len = mask_ip(ip, buf);
+	tag = ip_tag(buf, len);
+	pos = (unsigned int)(tag >> 32) & (buckets->size - 1);
+
+	for (i = 0; i < PIKE_BUCKET_PROBES; i++) {
+		e = &buckets->entries[(pos + i) & (buckets->size - 1)];
+		if (__atomic_load_n(&e->tag, __ATOMIC_ACQUIRE) != tag)
+			continue;
+
+		if (!(__atomic_exchange_n(&e->state, buckets->cap, __ATOMIC_RELAXED) &
+				PIKE_BUCKET_RED))
+			return 0;
+
+		LM_GEN1(pike_log_level, "PIKE - UNBLOCKing ip %s, bucket=%p\n",
+			ip_addr2a(ip), e);
+		return 1;
+	}
+
+	return -1;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * The "bucket" pike engine: a fixed-size, open-addressed hash of per-IP
+ * token buckets, updated with atomic operations only. Each bucket holds up
+ * to reqs_density_per_unit requests and is refilled at the same rate per
+ * sampling_time_unit, so the requests are counted without any lock or
+ * tree walk. The IPs which do not find a free bucket (the hash is full
+ * around their position) share the buckets of a count-min sketch instead.
+ */
+
+#ifndef _IP_BUCKET_H
+#define _IP_BUCKET_H
+
+#include "../../ip_addr.h"
+#include "../../mi/mi.h"
+
+/* consecutive hash entries an IP may be stored into */
+#define PIKE_BUCKET_PROBES  8
+
+/* rows of the fallback count-min sketch */
+#define PIKE_SKETCH_ROWS    4
+
+/* a request costs this many units of a bucket */
+#define PIKE_TOKEN          (1U << 16)
+
+/* the bucket state packs the time of its last refill (ms, upper 32 bits),
+ * its tokens and whether it was detected as flooding */
+#define PIKE_BUCKET_RED     (1U << 31)
+#define PIKE_MAX_DENSITY    ((PIKE_BUCKET_RED - 1) / PIKE_TOKEN)
+
+/* the tag of an entry being freed by the timer, never the one of an IP */
+#define PIKE_TAG_CLEANING   (~0ULL)
+
+struct pike_bucket {
+	unsigned long long tag;        /* hash of the IP (never 0), 0 if free */
+	unsigned long long state;
+	unsigned int last_hit;         /* ticks */
+	unsigned char ip_len;
+	unsigned char ip[16];
+};
+
+struct pike_buckets {
+	unsigned int size;             /* power of 2 */
+	unsigned int sketch_width;     /* power of 2 */
+	unsigned int cap;              /* full bucket */
+	unsigned int rate;             /* refill, per ms */
+	unsigned int clean_pos;        /* next entry checked by the timer */
+	unsigned long long *sketch;    /* PIKE_SKETCH_ROWS * sketch_width */
+	struct pike_bucket entries[0];
+};
+
+extern int bucket_hash_size;
+extern int bucket_ipv4_prefix;
+extern int bucket_ipv6_prefix;
+
+int init_ip_buckets(int max_reqs, int time_unit);
+void destroy_ip_buckets(void);
+
+/* counts a request from @ip; returns the RED_NODE / NEWRED_NODE flags */
+int mark_bucket(struct ip_addr *ip);
+
+void bucket_clean_routine(unsigned int ticks, void *param);
+
+int bucket_list_red(mi_item_t *ips_arr);
+int bucket_unblock(struct ip_addr *ip);
+
+#endif
@@ -46,6 +46,7 @@
 #include "../../timer.h"
 #include "../../locking.h"
 #include "ip_tree.h"
+#include "ip_bucket.h"
 #include "timer.h"
 #include "pike_mi.h"
 #include "pike_funcs.h"
@@ -65,6 +66,8 @@ static int max_reqs  = 30;
 static char *pike_route_s = NULL;
 int timeout   = 120;
 int pike_log_level = L_WARN;
+static char *engine_s = "tree";
+int pike_use_buckets = 0;
 
 /* global variables */
 gen_lock_t*             timer_lock=0;
@@ -86,6 +89,10 @@ static param_export_t params[]={
 	{"remove_latency",        INT_PARAM,  &timeout},
 	{"pike_log_level",        INT_PARAM,  &pike_log_level},
 	{"check_route",           STR_PARAM,  &pike_route_s},
+	{"engine",                STR_PARAM,  &engine_s},
+	{"bucket_hash_size",      INT_PARAM,  &bucket_hash_size},
+	{"bucket_ipv4_prefix",    INT_PARAM,  &bucket_ipv4_prefix},
+	{"bucket_ipv6_prefix",    INT_PARAM,  &bucket_ipv6_prefix},
 	{0,0,0}
 };
 
@@ -141,6 +148,24 @@ static int pike_init(void)
 		LM_NOTICE("Forcing remove_latency to %ds\n", timeout);
 	}
 
+	if (!strcasecmp(engine_s, "bucket")) {
+		pike_use_buckets = 1;
+	} else if (strcasecmp(engine_s, "tree")) {
+		LM_ERR("unknown engine <%s> (tree, bucket)\n", engine_s);
+		return -1;
+	}
+
+	if (pike_use_buckets) {
+		if (init_ip_buckets(max_reqs, time_unit) != 0) {
+			LM_ERR("failed to create the IP buckets\n");
+			return -1;
+		}
+
+		register_timer("pike-clean", bucket_clean_routine, 0, 1,
+			TIMER_FLAG_DELAY_ON_DELAY);
+		goto register_cbs;
+	}
+
 	/* alloc the timer lock */
 	timer_lock=lock_alloc();
 	if (timer_lock==0) {
@@ -173,6 +198,7 @@ static int pike_init(void)
 	register_timer( "pike-swap", swap_routine , 0, time_unit,
 		TIMER_FLAG_DELAY_ON_DELAY );
 
+register_cbs:
 	if (pike_route_s && *pike_route_s) {
 		rt = get_script_route_ID_by_name(pike_route_s,sroutes->request,RT_NO);
 		if (rt<1) {
@@ -193,8 +219,9 @@ static int pike_init(void)
 	return 0;
 error3:
 	destroy_ip_tree();
+	destroy_ip_buckets();
 error2:
-	lock_destroy(timer_lock);
+	if (timer_lock) lock_destroy(timer_lock);
 error1:
 	if (timer_lock) lock_dealloc(timer_lock);
 	timer_lock = 0;
@@ -221,6 +248,7 @@ static int pike_exit(void)
 
 	/* destroy the IP tree */
 	destroy_ip_tree();
+	destroy_ip_buckets();
 
 	return 0;
 }
@@ -46,6 +46,7 @@
 #include "../../route.h"
 #include "../../script_cb.h"
 #include "ip_tree.h"
+#include "ip_bucket.h"
 #include "pike_funcs.h"
 #include "timer.h"
 
@@ -59,6 +60,7 @@ extern int               pike_log_level;
 extern int               pike_start_level;
 extern int               pike_stop_level;
 extern event_id_t        pike_event_id;
+extern int               pike_use_buckets;
 
 static inline void pike_raise_event(char *ip)
 {
@@ -112,6 +114,10 @@ int pike_check_req(struct sip_msg *msg)
 	ip = &(msg->rcv.src_ip);
 #endif
 
+	if (pike_use_buckets) {
+		flags = mark_bucket(ip);
+		goto check_red;
+	}
 
 	/* first lock the proper tree branch and mark the IP with one more hit*/
 	lock_tree_branch( ip->u.addr[0] );
@@ -183,10 +189,11 @@ int pike_check_req(struct sip_msg *msg)
 	unlock_tree_branch( ip->u.addr[0] );
 	/*print_tree( 0 );*/ /* debug */
 
+check_red:
 	if (flags&RED_NODE) {
 		if (flags&NEWRED_NODE) {
 			LM_GEN1( pike_log_level,
-				"PIKE - BLOCKing ip %s, node=%p\n",ip_addr2a(ip),node);
+				"PIKE - BLOCKing ip %s\n",ip_addr2a(ip));
 			pike_raise_event(ip_addr2a(ip));
 			return -2;
 		}
@@ -29,6 +29,7 @@
 #include "../../resolve.h"
 
 #include "ip_tree.h"
+#include "ip_bucket.h"
 #include "pike_mi.h"
 
 #define IPv6_LEN 16
@@ -38,6 +39,7 @@
 
 static struct 		 ip_node *ip_stack[MAX_IP_LEN];
 extern int    		 pike_log_level;
+extern int    		 pike_use_buckets;
 
 
 static inline int print_ip_stack( int level, mi_item_t *ips_arr)
@@ -114,6 +116,17 @@ mi_response_t *mi_pike_rm(const mi_params_t *params,
     if (ip==0)
 	return init_mi_error(500, MI_SSTR("Bad IP"));
 
+    if (pike_use_buckets) {
+	switch (bucket_unblock(ip)) {
+	case 1:
+	    return init_mi_result_ok();
+	case 0:
+	    return init_mi_error(400, MI_SSTR("IP not blocked"));
+	default:
+	    return init_mi_error(404, MI_SSTR("Match not found"));
+	}
+    }
+
     node = 0;
     byte_pos = 0;
 
@@ -177,6 +190,12 @@ mi_response_t *mi_pike_list(const mi_params_t *params,
 	if (!ips_arr)
 		goto error;
 
+	if (pike_use_buckets) {
+		if (bucket_list_red(ips_arr) < 0)
+			goto error;
+		return resp;
+	}
+
 	for( i=0 ; i<MAX_IP_BRANCHES ; i++ ) {
 
 		if (get_tree_branch(i)==0)
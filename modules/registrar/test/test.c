@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdio.h>
+#include <time.h>
 #include <tap.h>
 
 #include "../../../dprint.h"
@@ -30,6 +32,12 @@
 #include "../reg_mod.h"
 #include "../lookup.h"
 
+/* fits the default shm size; raise it up to 1M - 10M, along with the
+ * shm size (-m), in order to profile large setups */
+#define AOR_BENCH_RECORDS  20000
+#define AOR_BENCH_LOOKUPS  1000000
+
+#define EXP_TEST_RECORDS   2000
 
 static void fill_ucontact_info(ucontact_info_t *ci)
 {
@@ -148,8 +156,191 @@ static void test_purr(void)
 }
 
 
+static double elapsed_ns(struct timespec *start, struct timespec *stop)
+{
+	return (stop->tv_sec - start->tv_sec) * 1e9 +
+		(stop->tv_nsec - start->tv_nsec);
+}
+
+static void bench_aor_index(void)
+{
+	udomain_t *d;
+	urecord_t *r;
+	ucontact_t *c;
+	ucontact_info_t ci;
+	struct timespec start, stop;
+	char buf[32];
+	str aor = {buf, 0};
+	str ct = str_init("sip:bench@127.0.0.1");
+	double save, lookup;
+	int i, bad;
+
+	if (ul.register_udomain("location", &d) != 0) {
+		diag("no 'location' udomain, skipping the AoR benchmark");
+		return;
+	}
+
+	/* the in-memory part of a save(): new AoR + its Contact */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < AOR_BENCH_RECORDS; i++) {
+		aor.len = sprintf(buf, "bench-%d", i);
+		fill_ucontact_info(&ci);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.insert_urecord(d, &aor, &r, 0) != 0 ||
+				ul.insert_ucontact(r, &ct, &ci, &c, 0) != 0) {
+			ul.unlock_udomain(d, &aor);
+			diag("oom, skipping the AoR benchmark");
+			goto out;
+		}
+		ul.unlock_udomain(d, &aor);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	save = elapsed_ns(&start, &stop) / AOR_BENCH_RECORDS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (bad = 0, i = 0; i < AOR_BENCH_LOOKUPS; i++) {
+		aor.len = sprintf(buf, "bench-%d", (i * 7919) % AOR_BENCH_RECORDS);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.get_urecord(d, &aor, &r) != 0 || !str_match(&r->aor, &aor))
+			bad++;
+		ul.unlock_udomain(d, &aor);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	lookup = elapsed_ns(&start, &stop) / AOR_BENCH_LOOKUPS;
+
+	ok(bad == 0, "aor-1");
+
+	aor.len = sprintf(buf, "bench-%d", AOR_BENCH_RECORDS);
+	ok(ul.get_urecord(d, &aor, &r) == 1, "aor-2");
+
+	diag("%d AoRs: %.1f ns/save, %.1f ns/lookup", AOR_BENCH_RECORDS,
+		save, lookup);
+
+out:
+	for (i = 0; i < AOR_BENCH_RECORDS; i++) {
+		aor.len = sprintf(buf, "bench-%d", i);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.get_urecord(d, &aor, &r) == 0)
+			ul.delete_urecord(d, &aor, r, 0);
+		ul.unlock_udomain(d, &aor);
+	}
+
+	ok(ul.get_urecord(d, _str("bench-0"), &r) == 1, "aor-3");
+}
+
+
+/* checks the heap order of the expiry index of each slot */
+static int check_expiry_index(udomain_t *d, int *indexed)
+{
+	hslot_t *s;
+	unsigned int pos;
+	int i, bad = 0;
+
+	for (*indexed = 0, i = 0; i < d->size; i++) {
+		s = &d->table[i];
+
+		ul.lock_ulslot(d, i);
+		for (pos = 0; pos < s->exp_used; pos++)
+			if (s->exp[pos]->exp_pos != pos || s->exp[pos]->expires == 0 ||
+					(pos > 0 && s->exp[(pos - 1) / 2]->expires >
+					s->exp[pos]->expires))
+				bad++;
+		*indexed += s->exp_used;
+		ul.unlock_ulslot(d, i);
+	}
+
+	return bad;
+}
+
+static void test_expiry_index(void)
+{
+	udomain_t *d;
+	urecord_t *r;
+	ucontact_t *c;
+	ucontact_info_t ci;
+	char buf[32], cbuf[48];
+	str aor = {buf, 0}, ct = {cbuf, 0};
+	int i, j, base, indexed, expiring = 0;
+
+	if (ul.register_udomain("location", &d) != 0) {
+		diag("no 'location' udomain, skipping the expiry index tests");
+		return;
+	}
+
+	check_expiry_index(d, &base);
+
+	for (i = 0; i < EXP_TEST_RECORDS; i++) {
+		aor.len = sprintf(buf, "exp-%d", i);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.insert_urecord(d, &aor, &r, 0) != 0) {
+			ul.unlock_udomain(d, &aor);
+			break;
+		}
+
+		for (j = 0; j <= i % 3; j++) {
+			ct.len = sprintf(cbuf, "sip:exp-%d@127.0.0.%d", i, j + 1);
+			fill_ucontact_info(&ci);
+
+			/* some permanent contacts, which are never indexed */
+			if ((i + j) % 10 == 0)
+				ci.expires = 0;
+			else
+				ci.expires += rand() % 3600;
+
+			if (ul.insert_ucontact(r, &ct, &ci, &c, 0) != 0)
+				break;
+			if (ci.expires)
+				expiring++;
+		}
+		ul.unlock_udomain(d, &aor);
+	}
+
+	ok(check_expiry_index(d, &indexed) == 0 &&
+		indexed - base == expiring, "expiry-1");
+
+	/* re-registrations (some turning permanent) and de-registrations */
+	for (i = 0; i < EXP_TEST_RECORDS; i++) {
+		aor.len = sprintf(buf, "exp-%d", i);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.get_urecord(d, &aor, &r) == 0 && (c = r->contacts)) {
+			if (i % 4 == 0) {
+				expiring -= c->expires != 0;
+				ul.delete_ucontact(r, c, 0);
+			} else {
+				fill_ucontact_info(&ci);
+				ci.expires = i % 7 ? ci.expires - rand() % 60 : 0;
+				expiring += (ci.expires != 0) - (c->expires != 0);
+				ul.update_ucontact(r, c, &ci, 0);
+			}
+		}
+		ul.unlock_udomain(d, &aor);
+	}
+
+	ok(check_expiry_index(d, &indexed) == 0 &&
+		indexed - base == expiring, "expiry-2");
+
+	for (i = 0; i < EXP_TEST_RECORDS; i++) {
+		aor.len = sprintf(buf, "exp-%d", i);
+
+		ul.lock_udomain(d, &aor);
+		if (ul.get_urecord(d, &aor, &r) == 0)
+			ul.delete_urecord(d, &aor, r, 0);
+		ul.unlock_udomain(d, &aor);
+	}
+
+	ok(check_expiry_index(d, &indexed) == 0 && indexed == base, "expiry-3");
+}
+
+
 void mod_tests(void)
 {
 	test_lookup();
 	test_purr();
+	bench_aor_index();
+	test_expiry_index();
 }
@@ -38,6 +38,7 @@
  */
 
 #include <stdlib.h>
+#include <sched.h>
 
 
 #include "../../mem/shm_mem.h"
@@ -65,6 +66,7 @@ static enum kill_reason kr;
 static struct s_table*  tm_table;
 
 int syn_branch = 1;
+int tm_hash_rw_locks = 0;
 
 
 void reset_kr(void)
@@ -83,15 +85,64 @@ enum kill_reason get_kr(void) {
 }
 
 
+/* the mutex of the entry serializes the writers (and, by default, the
+ * readers too); with "hash_rw_locks", lookups only announce themselves in
+ * the "readers" counter and the writer waits for them to leave the entry */
 void lock_hash(int i)
 {
-	lock(&tm_table->entrys[i].mutex);
+	struct entry *e = &tm_table->entrys[i];
+
+	lock(&e->mutex);
+
+	if (tm_hash_rw_locks) {
+		__atomic_store_n(&e->writer, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&e->readers, __ATOMIC_SEQ_CST))
+			sched_yield();
+	}
 }
 
 
 void unlock_hash(int i)
 {
-	unlock(&tm_table->entrys[i].mutex);
+	struct entry *e = &tm_table->entrys[i];
+
+	if (tm_hash_rw_locks)
+		__atomic_store_n(&e->writer, 0, __ATOMIC_RELEASE);
+
+	unlock(&e->mutex);
+}
+
+
+void lock_hash_read(int i)
+{
+	struct entry *e = &tm_table->entrys[i];
+
+	if (!tm_hash_rw_locks) {
+		lock(&e->mutex);
+		return;
+	}
+
+	for (;;) {
+		__atomic_add_fetch(&e->readers, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&e->writer, __ATOMIC_SEQ_CST))
+			return;
+
+		/* back off, writers have priority */
+		__atomic_sub_fetch(&e->readers, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&e->writer, __ATOMIC_ACQUIRE))
+			sched_yield();
+	}
+}
+
+
+void unlock_hash_read(int i)
+{
+	if (!tm_hash_rw_locks) {
+		unlock(&tm_table->entrys[i].mutex);
+		return;
+	}
+
+	__atomic_sub_fetch(&tm_table->entrys[i].readers, 1, __ATOMIC_RELEASE);
 }
 
 
@@ -62,8 +62,15 @@ struct retr_buf;
 #define LOCK_HASH(_h) lock_hash((_h))
 #define UNLOCK_HASH(_h) unlock_hash((_h))
 
+/* shared (lookup only) access to a hash entry; the same as LOCK_HASH(),
+ * unless "hash_rw_locks" is enabled */
+#define LOCK_HASH_READ(_h) lock_hash_read((_h))
+#define UNLOCK_HASH_READ(_h) unlock_hash_read((_h))
+
 void lock_hash(int i);
 void unlock_hash(int i);
+void lock_hash_read(int i);
+void unlock_hash_read(int i);
 
 
 #define NO_CANCEL       ( (char*) 0 )
@@ -318,6 +325,10 @@ typedef struct entry
 	unsigned int    next_label;
 	/* sync mutex */
 	ser_lock_t      mutex;
+	/* readers currently walking the entry and writer (mutex holder)
+	 * waiting for them - only used with "hash_rw_locks" */
+	int             readers;
+	int             writer;
 	unsigned long acc_entries;
 	unsigned long cur_entries;
 }entry_type;
@@ -364,6 +375,7 @@ struct s_table
 
 
 extern int syn_branch;
+extern int tm_hash_rw_locks;
 extern int fr_timeout;
 extern int fr_inv_timeout;
 extern int tm_timer_shift;
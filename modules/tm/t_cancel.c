@@ -28,6 +28,7 @@
 #include "t_funcs.h"
 #include "../../dprint.h"
 #include "../../ut.h"
+#include "../../net/proto_udp/proto_udp.h"
 #include "t_reply.h"
 #include "t_fwd.h"
 #include "t_cancel.h"
@@ -88,6 +89,7 @@ void cancel_branch( struct cell *t, int branch )
 	char *cancel;
 	unsigned int len;
 	struct retr_buf *crb, *irb;
+	int ret;
 
 	crb=&t->uac[branch].local_cancel;
 	irb=&t->uac[branch].request;
@@ -123,7 +125,11 @@ void cancel_branch( struct cell *t, int branch )
 	LM_DBG("sending cancel...\n");
 	if (t->uac[branch].br_flags & tcp_no_new_conn_bflag)
 		tcp_no_new_conn = 1;
-	if (SEND_BUFFER( crb )==0) {
+	/* the result is not used, so the CANCEL may wait in a send batch */
+	udp_send_batch_defer(1);
+	ret = SEND_BUFFER( crb );
+	udp_send_batch_defer(0);
+	if (ret==0) {
 		if ( has_tran_tmcbs( t, TMCB_MSG_SENT_OUT) ) {
 			set_extra_tmcb_params( &crb->buffer, &crb->dst);
 			run_trans_callbacks( TMCB_MSG_SENT_OUT,
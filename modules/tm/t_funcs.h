@@ -106,9 +106,12 @@ int send_pr_buffer( struct retr_buf *rb, void *buf, int len, void* ctx);
 	SEND_PR_CONTEXTS_BUFFER( (_rb) , (_rb)->buffer.s, (_rb)->buffer.len, ctx)
 
 
+/* the ref_count is changed atomically, as with "hash_rw_locks" the cells
+ * are also referenced by lookups holding their entry only for reading */
 #define UNREF_UNSAFE(_T_cell) do { \
-	((_T_cell)->ref_count--);\
-	LM_DBG("UNREF_UNSAFE: [%p] after is %d\n",_T_cell, (_T_cell)->ref_count);\
+	unsigned int __rc = \
+		__atomic_sub_fetch(&(_T_cell)->ref_count, 1, __ATOMIC_ACQ_REL);\
+	LM_DBG("UNREF_UNSAFE: [%p] after is %d\n",_T_cell, __rc);\
 	}while(0)
 
 #define REF(_T_cell) do{ \
@@ -116,16 +119,25 @@ int send_pr_buffer( struct retr_buf *rb, void *buf, int len, void* ctx);
 	REF_UNSAFE(_T_cell); \
 	UNLOCK_HASH( (_T_cell)->hash_index ); }while(0)
 
+/* with "hash_rw_locks", dropping a reference needs no lock: a cell can
+ * only be deleted under the write lock, after being unlinked, so its
+ * ref_count may only decrease by then */
 #define UNREF(_T_cell) do{ \
-	LOCK_HASH( (_T_cell)->hash_index ); \
-	UNREF_UNSAFE(_T_cell); \
-	UNLOCK_HASH( (_T_cell)->hash_index ); }while(0)
+	if (tm_hash_rw_locks) { \
+		UNREF_UNSAFE(_T_cell); \
+	} else { \
+		LOCK_HASH( (_T_cell)->hash_index ); \
+		UNREF_UNSAFE(_T_cell); \
+		UNLOCK_HASH( (_T_cell)->hash_index ); \
+	} }while(0)
 #define REF_UNSAFE(_T_cell) do {\
-	((_T_cell)->ref_count++);\
-	LM_DBG("REF_UNSAFE:[%p] after is %d\n",_T_cell, (_T_cell)->ref_count);\
+	unsigned int __rc = \
+		__atomic_add_fetch(&(_T_cell)->ref_count, 1, __ATOMIC_RELAXED);\
+	LM_DBG("REF_UNSAFE:[%p] after is %d\n",_T_cell, __rc);\
 	}while(0)
 #define INIT_REF_UNSAFE(_T_cell) ((_T_cell)->ref_count=1)
-#define IS_REFFED_UNSAFE(_T_cell) ((_T_cell)->ref_count!=0)
+#define IS_REFFED_UNSAFE(_T_cell) \
+	(__atomic_load_n(&(_T_cell)->ref_count, __ATOMIC_ACQUIRE)!=0)
 
 #define unset_timeout(timeout) ((timeout) = 0)
 #define is_timeout_set(timeout) ((timeout) != 0)
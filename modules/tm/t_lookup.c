@@ -387,7 +387,8 @@ static int matching_3261( struct sip_msg *p_msg, struct cell **trans,
  *      positive - transaction found
  */
 
-int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked )
+static int _t_lookup_request( struct sip_msg* p_msg, int leave_new_locked,
+																int shared)
 {
 	struct cell         *p_cell;
 	unsigned int       isACK;
@@ -395,6 +396,11 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked )
 	struct via_param *branch;
 	int match_status;
 
+#define LOCK_LOOKUP(_h) \
+	do { if (shared) LOCK_HASH_READ(_h); else LOCK_HASH(_h); } while (0)
+#define UNLOCK_LOOKUP(_h) \
+	do { if (shared) UNLOCK_HASH_READ(_h); else UNLOCK_HASH(_h); } while (0)
+
 	isACK = p_msg->REQ_METHOD==METHOD_ACK;
 
 	if (isACK) {
@@ -433,7 +439,7 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked )
 	if (branch && branch->value.s && branch->value.len>MCOOKIE_LEN
 			&& memcmp(branch->value.s,MCOOKIE,MCOOKIE_LEN)==0) {
 		/* huhuhu! the cookie is there -- let's proceed fast */
-		LOCK_HASH(p_msg->hash_index);
+		LOCK_LOOKUP(p_msg->hash_index);
 		match_status=matching_3261(p_msg,&p_cell,
 				/* skip transactions with different method; otherwise CANCEL
 				 * would match the previous INVITE trans.  */
@@ -451,7 +457,7 @@ int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked )
 	LM_DBG("proceeding to pre-RFC3261 transaction matching\n");
 
 	/* lock the whole entry*/
-	LOCK_HASH(p_msg->hash_index);
+	LOCK_LOOKUP(p_msg->hash_index);
 
 	/* all the transactions from the entry are compared */
 	for ( p_cell = get_tm_table()->entrys[p_msg->hash_index].first_cell;
@@ -533,14 +539,14 @@ notfound:
 	set_t(0);
 	e2eack_T = NULL;
 	if (!leave_new_locked || isACK) {
-		UNLOCK_HASH(p_msg->hash_index);
+		UNLOCK_LOOKUP(p_msg->hash_index);
 	}
 	LM_DBG("no transaction found\n");
 	return -1;
 
 e2e_ack:
 	REF_UNSAFE( p_cell );
-	UNLOCK_HASH(p_msg->hash_index);
+	UNLOCK_LOOKUP(p_msg->hash_index);
 	e2eack_T = p_cell;
 	set_t(0);
 	LM_DBG("e2e proxy ACK found\n");
@@ -550,11 +556,35 @@ found:
 	set_t(p_cell);
 	REF_UNSAFE( T );
 	set_kr(REQ_EXIST);
-	UNLOCK_HASH( p_msg->hash_index );
+	UNLOCK_LOOKUP( p_msg->hash_index );
 	LM_DBG("transaction found (T=%p)\n",T);
 	if (has_tran_tmcbs( T, TMCB_MSG_MATCHED_IN) )
 		run_trans_callbacks( TMCB_MSG_MATCHED_IN, T, p_msg, 0,0);
 	return 1;
+
+#undef LOCK_LOOKUP
+#undef UNLOCK_LOOKUP
+}
+
+
+int t_lookup_request( struct sip_msg* p_msg , int leave_new_locked )
+{
+	int ret;
+
+	if (!tm_hash_rw_locks)
+		return _t_lookup_request(p_msg, leave_new_locked, 0);
+
+	if (!leave_new_locked)
+		return _t_lookup_request(p_msg, 0, 1);
+
+	/* most of the hits (retransmissions) are solved under the read lock;
+	 * a miss is checked again under the write lock, which is then kept
+	 * for inserting the new transaction */
+	ret = _t_lookup_request(p_msg, 0, 1);
+	if (ret != -1 || p_msg->REQ_METHOD==METHOD_ACK)
+		return ret;
+
+	return _t_lookup_request(p_msg, 1, 0);
 }
 
 
@@ -594,7 +624,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 	if (branch && branch->value.s && branch->value.len>MCOOKIE_LEN
 			&& memcmp(branch->value.s,MCOOKIE,MCOOKIE_LEN)==0) {
 		/* huhuhu! the cookie is there -- let's proceed fast */
-		LOCK_HASH(hash_index);
+		LOCK_HASH_READ(hash_index);
 		ret=matching_3261(p_msg, &p_cell,
 				/* we are seeking the original transaction --
 				 * skip CANCEL transactions during search
@@ -605,7 +635,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 
 	/* no cookies --proceed to old-fashioned pre-3261 t-matching */
 
-	LOCK_HASH(hash_index);
+	LOCK_HASH_READ(hash_index);
 
 	/* all the transactions from the entry are compared */
 	for (p_cell=get_tm_table()->entrys[hash_index].first_cell;
@@ -670,7 +700,7 @@ struct cell* t_lookupOriginalT(  struct sip_msg* p_msg )
 notfound:
 	/* no transaction found */
 	LM_DBG("no CANCEL matching found! \n" );
-	UNLOCK_HASH(hash_index);
+	UNLOCK_HASH_READ(hash_index);
 	cancelled_T = NULL;
 	LM_DBG("t_lookupOriginalT completed\n");
 	return 0;
@@ -679,7 +709,7 @@ found:
 	LM_DBG("canceled transaction found (%p)! \n",p_cell );
 	cancelled_T = p_cell;
 	REF_UNSAFE( p_cell );
-	UNLOCK_HASH(hash_index);
+	UNLOCK_HASH_READ(hash_index);
 	/* run callback */
 	run_trans_callbacks( TMCB_TRANS_CANCELLED, cancelled_T, p_msg, 0,0);
 	LM_DBG("t_lookupOriginalT completed\n");
@@ -784,7 +814,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 
 	/* search the hash table list at entry 'hash_index'; lock the
 	   entry first */
-	LOCK_HASH(hash_index);
+	LOCK_HASH_READ(hash_index);
 
 	for (p_cell = get_tm_table()->entrys[hash_index].first_cell; p_cell;
 		p_cell=p_cell->next_cell) {
@@ -820,7 +850,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 		set_t(p_cell);
 		*p_branch = branch_id;
 		REF_UNSAFE( T );
-		UNLOCK_HASH(hash_index);
+		UNLOCK_HASH_READ(hash_index);
 		LM_DBG("reply matched (T=%p)!\n",T);
 		/* if this is a 200 for INVITE, we will wish to store to-tags to be
 		 * able to distinguish retransmissions later and not to call
@@ -844,7 +874,7 @@ int t_reply_matching( struct sip_msg *p_msg , int *p_branch )
 	} /* for cycle */
 
 	/* nothing found */
-	UNLOCK_HASH(hash_index);
+	UNLOCK_HASH_READ(hash_index);
 	LM_DBG("no matching transaction exists\n");
 
 nomatch2:
@@ -1197,7 +1227,7 @@ int t_lookup_ident(struct cell ** trans, unsigned int hash_index,
 		return -1;
 	}
 
-	LOCK_HASH(hash_index);
+	LOCK_HASH_READ(hash_index);
 
 	/* all the transactions from the entry are compared */
 	for ( p_cell = get_tm_table()->entrys[hash_index].first_cell;
@@ -1205,7 +1235,7 @@ int t_lookup_ident(struct cell ** trans, unsigned int hash_index,
 	{
 		if(p_cell->label == label){
 			REF_UNSAFE(p_cell);
-			UNLOCK_HASH(hash_index);
+			UNLOCK_HASH_READ(hash_index);
 			set_t(p_cell);
 			*trans=p_cell;
 			LM_DBG("transaction found\n");
@@ -1213,7 +1243,7 @@ int t_lookup_ident(struct cell ** trans, unsigned int hash_index,
 		}
 	}
 
-	UNLOCK_HASH(hash_index);
+	UNLOCK_HASH_READ(hash_index);
 	set_t(0);
 	*trans=p_cell;
 
@@ -1280,7 +1310,7 @@ int t_lookup_callid(struct cell ** trans, str callid, str cseq) {
 	LM_DBG("created comparable cseq header field: >%.*s<\n",
 			(int)(endpos - cseq_header), cseq_header);
 
-	LOCK_HASH(hash_index);
+	LOCK_HASH_READ(hash_index);
 
 	/* all the transactions from the entry are compared */
 	p_cell = get_tm_table()->entrys[hash_index].first_cell;
@@ -1295,7 +1325,7 @@ int t_lookup_callid(struct cell ** trans, str callid, str cseq) {
 				p_cell->callid.len,p_cell->callid.s, p_cell->cseq_n.len,
 				p_cell->cseq_n.s);
 			REF_UNSAFE(p_cell);
-			UNLOCK_HASH(hash_index);
+			UNLOCK_HASH_READ(hash_index);
 			set_t(p_cell);
 			*trans=p_cell;
 			LM_DBG("transaction found.\n");
@@ -1306,7 +1336,7 @@ int t_lookup_callid(struct cell ** trans, str callid, str cseq) {
 			p_cell->cseq_n.len, p_cell->cseq_n.s);
 	}
 
-	UNLOCK_HASH(hash_index);
+	UNLOCK_HASH_READ(hash_index);
 	LM_DBG("transaction not found.\n");
 
 	return -1;
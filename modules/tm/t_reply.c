@@ -79,6 +79,7 @@
 #include "../../usr_avp.h"
 #include "../../receive.h"
 #include "../../msg_callbacks.h"
+#include "../../net/proto_udp/proto_udp.h"
 
 #include "h_table.h"
 #include "t_hooks.h"
@@ -1057,7 +1058,7 @@ discard:
 int t_retransmit_reply( struct cell *t )
 {
 	static char b[BUF_SIZE];
-	int len;
+	int len, ret;
 	str cb_s;
 
 	/* we need to lock the transaction as messages from
@@ -1088,7 +1089,11 @@ int t_retransmit_reply( struct cell *t )
 	if (t->uas.request && t->uas.request->flags & tcp_no_new_conn_rplflag)
 		tcp_no_new_conn = 1;
 
-	if (SEND_PR_BUFFER( & t->uas.response, b, len )==0) {
+	/* a reply may wait in a send batch */
+	udp_send_batch_defer(1);
+	ret = SEND_PR_BUFFER( & t->uas.response, b, len );
+	udp_send_batch_defer(0);
+	if (ret==0) {
 		/* success */
 		LM_DBG("buf=%p: %.9s..., shmem=%p: %.9s\n",b, b,
 			t->uas.response.buffer.s, t->uas.response.buffer.s );
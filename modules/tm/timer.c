@@ -34,13 +34,15 @@
   for high performance using some techniques of which timer users
   need to be aware.
 
-	One technique is "fixed-timer-length". We maintain separate
-	timer lists, all of them include elements of the same time
-	to fire. That allows *appending* new events to the list as
-	opposed to inserting them by time, which is costly due to
-	searching time spent in a mutex. The performance benefit is
-	noticeable. The limitation is you need a new timer list for
-	each new timer length.
+	One technique is the "timing wheel". Each timer list is a
+	hierarchy of wheels: the first one has a slot for each tick
+	(or TM_UTIMER_INTERVAL, for the retransmission lists), each
+	of the upper ones a slot for a whole turn of the wheel below.
+	Adding or removing a timer is just (un)linking it from the
+	slot of its expiry time, whatever the number of timers or their
+	lengths are; the timer process only visits the slots passed
+	by, moving the timers of an upper slot one level down once
+	the wheel below completes a turn.
 
 	Another technique is the timer process slices off expired elements
 	from the list in a mutex, but executes the timer after the mutex
@@ -108,6 +110,7 @@
 #include "../../parser/parser_f.h"
 #include "../../ut.h"
 #include "../../context.h"
+#include "../../net/proto_udp/proto_udp.h"
 #include "t_funcs.h"
 #include "t_reply.h"
 #include "t_cancel.h"
@@ -272,6 +275,7 @@ inline static void retransmission_handler( struct timer_link *retr_tl )
 {
 	struct retr_buf* r_buf ;
 	enum lists id;
+	int ret;
 
 	r_buf = get_retr_timer_payload(retr_tl);
 #ifdef EXTRA_DEBUG
@@ -289,7 +293,11 @@ inline static void retransmission_handler( struct timer_link *retr_tl )
 			LM_DBG("retransmission_handler : request resending"
 				" (t=%p, %.9s ... )\n", r_buf->my_T, r_buf->buffer.s);
 			set_t(r_buf->my_T);
-			if (SEND_BUFFER( r_buf )==0) {
+			/* nothing to do on failure, it may wait in the batch */
+			udp_send_batch_defer(1);
+			ret = SEND_BUFFER( r_buf );
+			udp_send_batch_defer(0);
+			if (ret==0) {
 				if ( has_tran_tmcbs( r_buf->my_T, TMCB_MSG_SENT_OUT) ) {
 					set_extra_tmcb_params( &r_buf->buffer, &r_buf->dst);
 					run_trans_callbacks( TMCB_MSG_SENT_OUT, r_buf->my_T,
@@ -499,28 +507,31 @@ struct timer_table *get_timertable(void)
 
 void unlink_timer_lists(void)
 {
-	struct timer_link  *tl, *end, *tmp;
+	struct timer_link  *tl, *tmp;
+	struct timer *dl;
 	enum lists i;
-	unsigned int set;
+	unsigned int set, slot;
 
 	if (timertable==0)
 		return; /* nothing to do */
 
 	for ( set=0 ; set<timer_sets ; set++) {
-		/* remember the DELETE LIST */
-		tl = timertable[set].timers[DELETE_LIST].first_tl.next_tl;
-		end = & timertable[set].timers[DELETE_LIST].last_tl;
-		/* unlink the timer lists */
-		for( i=0; i<NR_OF_TIMER_LISTS ; i++ )
-			reset_timer_list( set, i );
 		LM_DBG("emptying DELETE list for set %d\n",set);
-		/* deletes all cells from DELETE_LIST list 
+		/* deletes all cells from DELETE_LIST list
 		   (they are no more accessible from entries) */
-		while (tl!=end) {
-			tmp=tl->next_tl;
-			free_cell( get_dele_timer_payload(tl) );
-			tl=tmp;
+		dl = &timertable[set].timers[DELETE_LIST];
+		for ( slot=0 ; slot<TM_WHEEL_SLOTS ; slot++ ) {
+			tl = dl->slots[slot];
+			dl->slots[slot] = NULL;
+			while (tl) {
+				tmp=tl->next_tl;
+				free_cell( get_dele_timer_payload(tl) );
+				tl=tmp;
+			}
 		}
+		/* unlink the timer lists */
+		for( i=0; i<NR_OF_TIMER_LISTS ; i++ )
+			reset_timer_list( set, i );
 	}
 
 }
@@ -634,13 +645,17 @@ void free_timer_table(void)
 
 void reset_timer_list(unsigned int set, enum lists list_id)
 {
-	timertable[set].timers[list_id].first_tl.next_tl =
-		&(timertable[set].timers[list_id].last_tl );
-	timertable[set].timers[list_id].last_tl.prev_tl =
-		&(timertable[set].timers[list_id].first_tl );
-	timertable[set].timers[list_id].first_tl.prev_tl =
-		timertable[set].timers[list_id].last_tl.next_tl = NULL;
-	timertable[set].timers[list_id].last_tl.time_out = -1;
+	struct timer *list = &timertable[set].timers[list_id];
+
+	memset( list->slots, 0, sizeof list->slots );
+	list->nr = 0;
+	if (timer_id2type[list_id]==UTIME_TYPE) {
+		list->unit = TM_UTIMER_INTERVAL;
+		list->clk = get_uticks() / list->unit;
+	} else {
+		list->unit = 1;
+		list->clk = get_ticks();
+	}
 }
 
 
@@ -657,14 +672,12 @@ void print_timer_list(unsigned int set, enum lists list_id)
 {
 	struct timer* timer_list=&(timertable[set].timers[ list_id ]);
 	struct timer_link *tl ;
+	unsigned int slot;
 
-	tl = timer_list->first_tl.next_tl;
-	while (tl!=& timer_list->last_tl)
-	{
-		LM_DBG("[%d]: %p, next=%p \n",
-			list_id, tl, tl->next_tl);
-		tl = tl->next_tl;
-	}
+	for ( slot=0 ; slot<TM_WHEEL_SLOTS ; slot++ )
+		for ( tl=timer_list->slots[slot] ; tl ; tl=tl->next_tl )
+			LM_DBG("[%d]: slot %u, %p, next=%p \n",
+				list_id, slot, tl, tl->next_tl);
 }
 
 
@@ -673,71 +686,98 @@ void print_timer_list(unsigned int set, enum lists list_id)
 static void check_timer_list( struct timer* timer_list, char *txt)
 {
 	struct timer_link *tl ;
-	struct timer_link *tl1 ;
+	unsigned int slot, n = 0;
 
-	if (list_id<0 || list_id>=NR_OF_TIMER_LISTS) {
+	if (timer_list->id<0 || timer_list->id>=NR_OF_TIMER_LISTS) {
 			LM_CRIT("TM TIMER list [%d] bug [%s]\n",timer_list->id, txt);
 			abort();
 	}
 
-	tl = timer_list->last_tl.prev_tl;
-	while (tl!=&timer_list->first_tl) {
-		if (tl->prev_tl==0) {
-			LM_CRIT("TM TIMER list [%d] prev_tl==0 [%s]\n",timer_list->id, txt);
-			abort();
+	for ( slot=0 ; slot<TM_WHEEL_SLOTS ; slot++ ) {
+		for ( tl=timer_list->slots[slot] ; tl ; tl=tl->next_tl, n++ ) {
+			if (tl->slot!=slot || tl->timer_list!=timer_list) {
+				LM_CRIT("TM TIMER list [%d] corrupted - bad slot [%s]\n",
+					timer_list->id, txt);
+				abort();
+			}
+			if ((tl->prev_tl==0) != (tl==timer_list->slots[slot]) ||
+			(tl->prev_tl && tl->prev_tl->next_tl!=tl)) {
+				LM_CRIT("TM TIMER list [%d] corrupted - bad links [%s]\n",
+					timer_list->id, txt);
+				abort();
+			}
 		}
-		tl = tl->prev_tl;
 	}
 
-	tl = timer_list->first_tl.next_tl;
-	while (tl!=&timer_list->last_tl) {
-		if (tl->next_tl==0) {
-			LM_CRIT("TM TIMER list [%d] next_tl==0 [%s]\n",timer_list->id, txt);
-			abort();
-		}
-		tl = tl->next_tl;
+	if (n!=timer_list->nr) {
+		LM_CRIT("TM TIMER list [%d] corrupted - %u linked, %u counted [%s]\n",
+			timer_list->id, n, timer_list->nr, txt);
+		abort();
 	}
+}
+#endif
 
-	tl = timer_list->first_tl.next_tl;
-	while (tl!=&timer_list->last_tl) {
-		if (tl->ld_tl==0) {
-			LM_CRIT("TM TIMER list [%d] corrupted - ld=0 [%s]\n",
-				timer_list->id, txt);
-			abort();
-		}
-		if (tl->ld_tl->ld_tl!=tl) {
-			LM_CRIT("TM TIMER list [%d] corrupted - ld cycle broken [%s]\n",
-				timer_list->id, txt);
-			abort();
-		}
 
-		if (tl->ld_tl!=tl) {
-			tl1 = tl->next_tl;
-			while(tl1!=tl->ld_tl) {
-				if (tl1->ld_tl) {
-					LM_CRIT("TM TIMER list [%d] corrupted - ld!=0 inside "
-						"cycle [%s]\n", timer_list->id, txt);
-					abort();
-				}
-				tl1 = tl1->next_tl;
-			}
-		}
+/* finds the wheel slot for expiring at the "expires" unit; timers further
+ * away than the top level can hold are parked in its last slot and moved
+ * back as the wheel turns */
+static unsigned int wheel_slot( struct timer *timer_list, utime_t expires )
+{
+	utime_t delta;
+	unsigned int lvl, shift;
+
+	if (expires < timer_list->clk)
+		expires = timer_list->clk;
+	delta = expires - timer_list->clk;
+
+	if (delta < TM_WHEEL_L0_SIZE)
+		return expires & (TM_WHEEL_L0_SIZE-1);
 
-		tl = tl->ld_tl->next_tl;
+	for ( lvl=1, shift=TM_WHEEL_L0_BITS ; ; lvl++, shift+=TM_WHEEL_LN_BITS ) {
+		if (delta < ((utime_t)1 << (shift+TM_WHEEL_LN_BITS)))
+			break;
+		if (lvl==TM_WHEEL_LEVELS-1) {
+			expires = timer_list->clk +
+				((utime_t)1 << (shift+TM_WHEEL_LN_BITS)) - 1;
+			break;
+		}
 	}
+
+	return TM_WHEEL_L0_SIZE + (lvl-1)*TM_WHEEL_LN_SIZE +
+		((expires >> shift) & (TM_WHEEL_LN_SIZE-1));
+}
+
+
+static inline void link_timer_unsafe( struct timer *timer_list,
+													struct timer_link *tl )
+{
+	unsigned int slot;
+
+	slot = wheel_slot( timer_list, tl->time_out / timer_list->unit );
+
+	tl->slot = slot;
+	tl->prev_tl = NULL;
+	tl->next_tl = timer_list->slots[slot];
+	if (tl->next_tl)
+		tl->next_tl->prev_tl = tl;
+	timer_list->slots[slot] = tl;
+}
+
+
+static inline void unlink_timer_unsafe( struct timer *timer_list,
+													struct timer_link *tl )
+{
+	if (tl->prev_tl)
+		tl->prev_tl->next_tl = tl->next_tl;
+	else
+		timer_list->slots[tl->slot] = tl->next_tl;
+	if (tl->next_tl)
+		tl->next_tl->prev_tl = tl->prev_tl;
 }
-#endif
 
 
 static void remove_timer_unsafe(  struct timer_link* tl )
 {
-#ifdef EXTRA_DEBUG
-	if (tl && is_in_timer_list2(tl) &&
-		tl->timer_list->last_tl.prev_tl==0) {
-		LM_CRIT("Oh no, zero link in trailing timer element\n");
-		abort();
-	};
-#endif
 	if (is_in_timer_list2( tl )) {
 #ifdef EXTRA_DEBUG
 		LM_DBG("unlinking timer: tl=%p, timeout=%lld, group=%d\n",
@@ -746,23 +786,13 @@ static void remove_timer_unsafe(  struct timer_link* tl )
 #ifdef TM_TIMER_DEBUG
 		check_timer_list( tl->timer_list, "before remove" );
 #endif
-		if (tl->ld_tl && tl->ld_tl!=tl) {
-			if (tl->time_out==tl->prev_tl->time_out) {
-				tl->prev_tl->ld_tl = tl->ld_tl;
-				tl->ld_tl->ld_tl = tl->prev_tl;
-			} else {
-				tl->next_tl->ld_tl = tl->ld_tl;
-				tl->ld_tl->ld_tl = tl->next_tl;
-			}
-		}
-		tl->prev_tl->next_tl = tl->next_tl;
-		tl->next_tl->prev_tl = tl->prev_tl;
+		unlink_timer_unsafe( tl->timer_list, tl );
+		tl->timer_list->nr--;
 #ifdef TM_TIMER_DEBUG
 		check_timer_list( tl->timer_list, "after remove" );
 #endif
 		tl->next_tl = 0;
 		tl->prev_tl = 0;
-		tl->ld_tl = 0;
 		tl->timer_list = NULL;
 	}
 }
@@ -770,10 +800,8 @@ static void remove_timer_unsafe(  struct timer_link* tl )
 
 /* put a new linker into a timer_list */
 static void insert_timer_unsafe( struct timer *timer_list,
-									struct timer_link *tl, utime_t time_out )
+						struct timer_link *tl, utime_t time_out, utime_t now )
 {
-	struct timer_link* ptr;
-
 	tl->time_out = time_out;
 	tl->timer_list = timer_list;
 	tl->deleted = 0;
@@ -781,25 +809,13 @@ static void insert_timer_unsafe( struct timer *timer_list,
 #ifdef TM_TIMER_DEBUG
 	check_timer_list( timer_list, "before insert" );
 #endif
-	ptr = timer_list->last_tl.prev_tl;
-	for( ; ptr != &timer_list->first_tl ; ptr = ptr->ld_tl->prev_tl) {
-		if ( ptr->time_out<=time_out )
-			break;
-	}
-
-	/* insert "tl" after "ptr" */
-	tl->prev_tl = ptr;
-	tl->next_tl = ptr->next_tl;
-	tl->prev_tl->next_tl = tl;
-	tl->next_tl->prev_tl = tl;
+	/* an empty wheel is not turned by the timer routine,
+	 * so it may be behind */
+	if (timer_list->nr==0 && timer_list->clk < now / timer_list->unit)
+		timer_list->clk = now / timer_list->unit;
 
-	if (tl->time_out==ptr->time_out) {
-		tl->ld_tl = ptr->ld_tl;
-		ptr->ld_tl = 0;
-		tl->ld_tl->ld_tl = tl;
-	} else {
-		tl->ld_tl = tl;
-	}
+	link_timer_unsafe( timer_list, tl );
+	timer_list->nr++;
 #ifdef TM_TIMER_DEBUG
 	check_timer_list( timer_list, "after insert" );
 #endif
@@ -809,18 +825,40 @@ static void insert_timer_unsafe( struct timer *timer_list,
 }
 
 
+/* moves the timers of the current slot of each upper level (as long as
+ * the level below wrapped) one level down */
+static void cascade_timers_unsafe( struct timer *timer_list )
+{
+	struct timer_link *tl, *tmp;
+	unsigned int lvl, shift, idx, slot;
+
+	for ( lvl=1, shift=TM_WHEEL_L0_BITS ; lvl<TM_WHEEL_LEVELS ;
+	lvl++, shift+=TM_WHEEL_LN_BITS ) {
+		idx = (timer_list->clk >> shift) & (TM_WHEEL_LN_SIZE-1);
+		slot = TM_WHEEL_L0_SIZE + (lvl-1)*TM_WHEEL_LN_SIZE + idx;
+
+		tl = timer_list->slots[slot];
+		timer_list->slots[slot] = NULL;
+		for ( ; tl ; tl=tmp ) {
+			tmp = tl->next_tl;
+			link_timer_unsafe( timer_list, tl );
+		}
+
+		if (idx)
+			break;
+	}
+}
+
 
 /* detach items passed by the time from timer list */
 static struct timer_link  *check_and_split_time_list( struct timer *timer_list,
 		utime_t time )
 {
-	struct timer_link *tl , *end, *ret;
-
+	struct timer_link *tl, *tmp, *ret, **last;
+	utime_t target;
 
 	/* quick check whether it is worth entering the lock */
-	if (timer_list->first_tl.next_tl==&timer_list->last_tl
-			|| ( /* timer_list->first_tl.next_tl
-				&& */ timer_list->first_tl.next_tl->time_out > time) )
+	if (timer_list->nr==0)
 		return NULL;
 
 	/* the entire timer list is locked now -- no one else can manipulate it */
@@ -829,45 +867,48 @@ static struct timer_link  *check_and_split_time_list( struct timer *timer_list,
 #ifdef TM_TIMER_DEBUG
 	check_timer_list( timer_list, "before split" );
 #endif
-	end = &timer_list->last_tl;
-	tl = timer_list->first_tl.next_tl;
-	while( tl!=end && tl->time_out <= time)
-		tl=tl->ld_tl->next_tl;
-
-	/* nothing to delete found */
-	if (tl->prev_tl==&(timer_list->first_tl)) {
-		ret = NULL;
-	} else { /* we did find timers to be fired! */
-		/* the detached list begins with current beginning */
-		ret = timer_list->first_tl.next_tl;
-		/* and we mark the end of the split list */
-		tl->prev_tl->next_tl = NULL;
-		/* the shortened list starts from where we suspended */
-		timer_list->first_tl.next_tl = tl;
-		tl->prev_tl = & timer_list->first_tl;
-
-		for( tl=ret ; tl ; tl=tl->next_tl )
+	ret = NULL;
+	last = &ret;
+	target = time / timer_list->unit;
+
+	/* all the timers in the slots passed by are expired; the slot of the
+	 * current unit may still hold some which are not */
+	while (timer_list->nr) {
+		for ( tl=timer_list->slots[timer_list->clk & (TM_WHEEL_L0_SIZE-1)] ;
+		tl ; tl=tmp ) {
+			tmp = tl->next_tl;
+			if (tl->time_out > time)
+				continue;
+
+			unlink_timer_unsafe( timer_list, tl );
+			timer_list->nr--;
 			tl->timer_list = DETACHED_LIST;
+			tl->next_tl = NULL;
+			*last = tl;
+			last = &tl->next_tl;
+		}
+
+		if (timer_list->clk >= target)
+			break;
+
+		timer_list->clk++;
+		if ((timer_list->clk & (TM_WHEEL_L0_SIZE-1))==0)
+			cascade_timers_unsafe( timer_list );
 	}
+
+	/* nothing left to wait for */
+	if (timer_list->nr==0 && timer_list->clk < target)
+		timer_list->clk = target;
+
 #ifdef TM_TIMER_DEBUG
 	check_timer_list( timer_list, "after split" );
 #endif
 
-#ifdef EXTRA_DEBUG
-	if (timer_list->last_tl.prev_tl==0) {
-		LM_CRIT("Oh no, zero link in trailing timer element\n");
-		abort();
-	};
-#endif
-
 	/* give the list lock away */
 	unlock(timer_list->mutex);
 
 	return ret;
 }
-
-
-
 /* stop timer
  * WARNING: a reset'ed timer will be lost forever
  *  (successive set_timer won't work unless you're lucky
@@ -901,7 +942,7 @@ void reset_timer( struct timer_link* tl )
 void set_timer( struct timer_link *new_tl, enum lists list_id,
 												utime_t* ext_timeout )
 {
-	utime_t timeout;
+	utime_t timeout, now;
 	struct timer* list;
 
 	if (list_id>=NR_OF_TIMER_LISTS) {
@@ -934,8 +975,8 @@ void set_timer( struct timer_link *new_tl, enum lists list_id,
 	/* make sure I'm not already on a list */
 	remove_timer_unsafe( new_tl );
 
-	insert_timer_unsafe( list, new_tl, timeout +
-			((timer_id2type[list_id]==UTIME_TYPE)?get_uticks():get_ticks()));
+	now = (timer_id2type[list_id]==UTIME_TYPE)?get_uticks():get_ticks();
+	insert_timer_unsafe( list, new_tl, timeout + now, now );
 end:
 	unlock(list->mutex);
 }
@@ -952,7 +993,7 @@ end:
 int set_1timer( struct timer_link *new_tl, enum lists list_id,
 												utime_t* ext_timeout )
 {
-	utime_t timeout;
+	utime_t timeout, now;
 	struct timer* list;
 	int ret = -1;
 
@@ -975,8 +1016,8 @@ int set_1timer( struct timer_link *new_tl, enum lists list_id,
 
 	lock(list->mutex);
 	if (!new_tl->time_out) {
-		insert_timer_unsafe( list, new_tl, timeout +
-			((timer_id2type[list_id]==UTIME_TYPE)?get_uticks():get_ticks()));
+		now = (timer_id2type[list_id]==UTIME_TYPE)?get_uticks():get_ticks();
+		insert_timer_unsafe( list, new_tl, timeout + now, now );
 		ret = 0;
 	}
 	unlock(list->mutex);
@@ -1060,8 +1101,11 @@ static void unlink_timers( struct cell *t )
 		(_tl)->next_tl = (_tl)->prev_tl = 0;\
 		LM_DBG("timer routine:%d,tl=%p next=%p, timeout=%lld\n",\
 			id,(_tl),tmp_tl,(_tl)->time_out);\
-		if ( !(_tl)->deleted ) \
+		if ( !(_tl)->deleted ) {\
+			if ((_tl)->time_out + lag < now)\
+				lag = now - (_tl)->time_out;\
 			(_handler)( _tl );\
+		}\
 		(_tl) = tmp_tl;\
 	}
 
@@ -1072,6 +1116,10 @@ void timer_routine(unsigned int ticks , void *set)
 {
 	struct timer_link *tl, *tmp_tl;
 	int                id;
+	utime_t            now = ticks, lag = 0;
+
+	/* coalesce the CANCELs and the retransmissions of this tick */
+	udp_send_batch_start();
 
 	lock_start_write( timertable[(long)set].ex_lock );
 
@@ -1095,7 +1143,10 @@ void timer_routine(unsigned int ticks , void *set)
 				break;
 		}
 	}
+	timertable[(long)set].lag[0] = lag * 1000;
 	lock_stop_write( timertable[(long)set].ex_lock );
+
+	udp_send_batch_flush();
 }
 
 
@@ -1104,6 +1155,9 @@ void utimer_routine(utime_t uticks , void *set)
 {
 	struct timer_link *tl, *tmp_tl;
 	int                id;
+	utime_t            now = uticks, lag = 0;
+
+	udp_send_batch_start();
 
 	lock_start_write( timertable[(long)set].ex_lock );
 
@@ -1123,6 +1177,25 @@ void utimer_routine(utime_t uticks , void *set)
 				break;
 		}
 	}
+	timertable[(long)set].lag[1] = lag / 1000;
 	lock_stop_write( timertable[(long)set].ex_lock );
+
+	udp_send_batch_flush();
 }
 
+
+
+unsigned long tm_get_timer_lag(void *unused)
+{
+	unsigned long lag = 0;
+	unsigned int set;
+
+	for ( set=0 ; set<timer_sets ; set++ ) {
+		if (timertable[set].lag[0] > lag)
+			lag = timertable[set].lag[0];
+		if (timertable[set].lag[1] > lag)
+			lag = timertable[set].lag[1];
+	}
+
+	return lag;
+}
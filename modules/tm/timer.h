@@ -49,15 +49,30 @@ enum lists
 };
 
 
+/* resolution of the retransmission timers (run by the tm utimer), usec */
+#define TM_UTIMER_INTERVAL  (100*1000)
+
+/* the timer lists are hierarchical timing wheels: a level-0 wheel with a
+ * slot for each tick (or TM_UTIMER_INTERVAL) and a few coarser levels,
+ * each slot spanning a full turn of the level below */
+#define TM_WHEEL_LEVELS     4
+#define TM_WHEEL_L0_BITS    8
+#define TM_WHEEL_LN_BITS    6
+#define TM_WHEEL_L0_SIZE    (1<<TM_WHEEL_L0_BITS)
+#define TM_WHEEL_LN_SIZE    (1<<TM_WHEEL_LN_BITS)
+#define TM_WHEEL_SLOTS \
+	(TM_WHEEL_L0_SIZE + (TM_WHEEL_LEVELS-1)*TM_WHEEL_LN_SIZE)
+
+
 /* all you need to put a cell in a timer list
    links to neighbors and timer value */
 typedef struct timer_link
 {
 	struct timer_link     *next_tl;
 	struct timer_link     *prev_tl;
-	struct timer_link     *ld_tl;
 	volatile utime_t      time_out;
 	struct timer          *timer_list;
+	unsigned short        slot;
 	unsigned short        deleted;
 	unsigned short        set;
 #ifdef EXTRA_DEBUG
@@ -66,11 +81,17 @@ typedef struct timer_link
 }timer_link_type ;
 
 
-/* timer list: includes head, tail and protection semaphore */
+/* timer list: a timing wheel and its protection semaphore */
 typedef struct  timer
 {
-	struct timer_link  first_tl;
-	struct timer_link  last_tl;
+	/* unordered, NULL terminated lists of timers, one per slot */
+	struct timer_link  *slots[TM_WHEEL_SLOTS];
+	/* wheel position (in "unit"s) - the level-0 slot being expired */
+	utime_t            clk;
+	/* ticks or uticks covered by a level-0 slot */
+	unsigned int       unit;
+	/* number of timers in the wheel */
+	unsigned int       nr;
 	ser_lock_t*        mutex;
 	enum lists         id;
 } timer_type;
@@ -82,6 +103,8 @@ struct timer_table
 	rw_lock_t      *ex_lock;
 	/* table of timer lists */
 	struct timer   timers[ NR_OF_TIMER_LISTS ];
+	/* max delay of the timers fired during the last run, in ms */
+	unsigned int   lag[2];
 };
 
 
@@ -116,4 +139,7 @@ void utimer_routine( utime_t, void*);
 
 struct timer_table *get_timertable();
 
+/* stat function - the worst timer lag over all the timer sets, in ms */
+unsigned long tm_get_timer_lag(void *unused);
+
 #endif
@@ -291,6 +291,8 @@ static param_export_t params[]={
 		&pass_provisional_replies },
 	{ "syn_branch",               INT_PARAM,
 		&syn_branch },
+	{ "hash_rw_locks",            INT_PARAM,
+		&tm_hash_rw_locks },
 	{ "onreply_avp_mode",         INT_PARAM,
 		&onreply_avp_mode },
 	{ "disable_6xx_block",        INT_PARAM,
@@ -312,17 +314,20 @@ static param_export_t params[]={
 
 
 static stat_export_t mod_stats[] = {
-	{"received_replies" ,    0,              &tm_rcv_rpls    },
-	{"relayed_replies" ,     0,              &tm_rld_rpls    },
-	{"local_replies" ,       0,              &tm_loc_rpls    },
-	{"UAS_transactions" ,    0,              &tm_uas_trans   },
-	{"UAC_transactions" ,    0,              &tm_uac_trans   },
-	{"2xx_transactions" ,    0,              &tm_trans_2xx   },
-	{"3xx_transactions" ,    0,              &tm_trans_3xx   },
-	{"4xx_transactions" ,    0,              &tm_trans_4xx   },
-	{"5xx_transactions" ,    0,              &tm_trans_5xx   },
-	{"6xx_transactions" ,    0,              &tm_trans_6xx   },
-	{"inuse_transactions" ,  STAT_NO_RESET,  &tm_trans_inuse },
+	{"received_replies" ,    STAT_PER_PROC,  &tm_rcv_rpls    },
+	{"relayed_replies" ,     STAT_PER_PROC,  &tm_rld_rpls    },
+	{"local_replies" ,       STAT_PER_PROC,  &tm_loc_rpls    },
+	{"UAS_transactions" ,    STAT_PER_PROC,  &tm_uas_trans   },
+	{"UAC_transactions" ,    STAT_PER_PROC,  &tm_uac_trans   },
+	{"2xx_transactions" ,    STAT_PER_PROC,  &tm_trans_2xx   },
+	{"3xx_transactions" ,    STAT_PER_PROC,  &tm_trans_3xx   },
+	{"4xx_transactions" ,    STAT_PER_PROC,  &tm_trans_4xx   },
+	{"5xx_transactions" ,    STAT_PER_PROC,  &tm_trans_5xx   },
+	{"6xx_transactions" ,    STAT_PER_PROC,  &tm_trans_6xx   },
+	{"inuse_transactions" ,  STAT_NO_RESET|STAT_PER_PROC,
+		&tm_trans_inuse },
+	{"timer_lag" ,           STAT_IS_FUNC,
+		(stat_var**)tm_get_timer_lag },
 	{0,0,0}
 };
 
@@ -808,7 +813,7 @@ static int mod_init(void)
 			return -1;
 		}
 		if (register_utimer( "tm-utimer", utimer_routine,
-		(void*)(long)set, 100*1000, TIMER_FLAG_DELAY_ON_DELAY)<0) {
+		(void*)(long)set, TM_UTIMER_INTERVAL, TIMER_FLAG_DELAY_ON_DELAY)<0) {
 			LM_ERR("failed to register utimer for set %d\n",set);
 			return -1;
 		}
@@ -1066,6 +1066,16 @@ unsigned long get_number_of_users(void* foo)
  *		* clean up any in-memory expired contacts or empty records
  */
 int _synchronize_all_udomains(void)
+{
+	return _synchronize_udomains(0, 1);
+}
+
+
+/*! \brief
+ * Same as _synchronize_all_udomains(), but only for the @step'th of the
+ * @steps equal parts of the hash table of each domain
+ */
+int _synchronize_udomains(int step, int steps)
 {
 	int res = 0;
 	dlist_t* ptr;
@@ -1073,11 +1083,13 @@ int _synchronize_all_udomains(void)
 	get_act_time(); /* Get and save actual time */
 
 	if (cluster_mode == CM_SQL_ONLY) {
-		for( ptr=root ; ptr ; ptr=ptr->next)
-			res |= db_timer_udomain(ptr->d);
+		if (step == 0)
+			for( ptr=root ; ptr ; ptr=ptr->next)
+				res |= db_timer_udomain(ptr->d);
 	} else if (have_mem_storage()) {
 		for( ptr=root ; ptr ; ptr=ptr->next)
-			res |= mem_timer_udomain(ptr->d);
+			res |= mem_timer_udomain(ptr->d, ptr->d->size * step / steps,
+				ptr->d->size * (step + 1) / steps);
 	} /* TODO: add a form of cleanup here, or implement cache API TTLs */
 
 	return res;
@@ -1240,6 +1252,9 @@ int delete_ucontact_from_coords(udomain_t *d, ucontact_coords ct_coords,
 		}
 
 		mem_delete_ucontact(r, c);
+		release_empty_urecord(d, r);
+	} else if (r->slot) {
+		slot_exp_update(r->slot, c);
 	}
 
 	_unlock_ulslot(d, contact_id);
@@ -75,6 +75,12 @@ void free_all_udomains(void);
 int _synchronize_all_udomains(void);
 
 
+/*! \brief
+ * Called from timer, runs the @step'th of @steps parts of each domain
+ */
+int _synchronize_udomains(int step, int steps);
+
+
 /*! \brief
  * Get contacts to all registered users
  */
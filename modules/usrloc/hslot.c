@@ -27,7 +27,9 @@
 
 
 
+#include "../../mem/shm_mem.h"
 #include "hslot.h"
+#include "ul_mod.h"
 
 int ul_locks_no=4;
 gen_lock_set_t* ul_locks=0;
@@ -106,6 +108,12 @@ int init_slot(struct udomain* _d, hslot_t* _s, int n)
 {
 	_s->records = map_create( AVLMAP_SHARED | AVLMAP_NO_DUPLICATE);
 	_s->next_label = 0;
+	_s->idx = NULL;
+	_s->idx_bits = 0;
+	_s->idx_used = 0;
+	_s->exp = NULL;
+	_s->exp_size = 0;
+	_s->exp_used = 0;
 
 	if( _s->records == NULL )
 		return -1;
@@ -134,6 +142,80 @@ void deinit_slot(hslot_t* _s)
 {
 	map_destroy(_s->records , free_value_urecord);
 	_s->d = 0;
+
+	if (_s->idx) {
+		shm_free(_s->idx);
+		_s->idx = NULL;
+	}
+	_s->idx_bits = 0;
+	_s->idx_used = 0;
+
+	if (_s->exp) {
+		shm_free(_s->exp);
+		_s->exp = NULL;
+	}
+	_s->exp_size = 0;
+	_s->exp_used = 0;
+}
+
+
+/*
+ * All the AoRs of a slot share the low bits of their hash, so the index
+ * position is taken from the top bits of a multiplicative hash
+ */
+#define idx_pos(_hash, _bits) \
+	(((_hash) * 2654435761U) >> (32 - (_bits)))
+
+#define idx_next(_pos, _bits) \
+	(((_pos) + 1) & ((1U << (_bits)) - 1))
+
+static inline int aor_match(struct urecord* _r, const str* _aor)
+{
+	return _r->aor.len == _aor->len &&
+		memcmp(_r->aor.s, _aor->s, _aor->len) == 0;
+}
+
+
+static void idx_put(slot_idx_entry_t* idx, unsigned int bits,
+											unsigned int hash, struct urecord* _r)
+{
+	unsigned int pos;
+
+	for (pos = idx_pos(hash, bits); idx[pos].r; pos = idx_next(pos, bits))
+		if (idx[pos].hash == hash && aor_match(idx[pos].r, &_r->aor))
+			break;
+
+	idx[pos].hash = hash;
+	idx[pos].r = _r;
+}
+
+
+/*
+ * Rebuild the index of a slot with 2^bits entries
+ */
+static int idx_resize(hslot_t* _s, unsigned int bits)
+{
+	slot_idx_entry_t *idx;
+	unsigned int i;
+
+	idx = shm_malloc((1U << bits) * sizeof *idx);
+	if (!idx) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(idx, 0, (1U << bits) * sizeof *idx);
+
+	if (_s->idx) {
+		for (i = 0; i < (1U << _s->idx_bits); i++)
+			if (_s->idx[i].r)
+				idx_put(idx, bits, _s->idx[i].hash, _s->idx[i].r);
+
+		shm_free(_s->idx);
+	}
+
+	_s->idx = idx;
+	_s->idx_bits = bits;
+	return 0;
 }
 
 
@@ -145,6 +227,12 @@ int slot_add(hslot_t* _s, struct urecord* _r)
 
 	void ** dest;
 
+	/* keep the index at most 3/4 full */
+	if (!_s->idx || (_s->idx_used + 1) * 4 > (3U << _s->idx_bits)) {
+		if (idx_resize(_s, _s->idx ? _s->idx_bits + 1 : SLOT_IDX_MIN_BITS)<0)
+			return -1;
+	}
+
 	dest = map_get( _s->records, _r->aor );
 
 	if( dest == NULL )
@@ -153,6 +241,10 @@ int slot_add(hslot_t* _s, struct urecord* _r)
 		return -1;
 	}
 
+	/* a record replacing another one for the same AoR takes its entry */
+	if (!*dest)
+		_s->idx_used++;
+	idx_put(_s->idx, _s->idx_bits, _r->aorhash, _r);
 
 	*dest = _r;
 
@@ -167,7 +259,177 @@ int slot_add(hslot_t* _s, struct urecord* _r)
  */
 void slot_rem(hslot_t* _s, struct urecord* _r)
 {
+	unsigned int pos, next, home, bits = _s->idx_bits;
+
+	struct ucontact *c;
 
 	map_remove( _s->records, _r->aor );
 	_r->slot = 0;
+
+	/* the contacts are freed together with the record */
+	for (c = _r->contacts; c; c = c->next)
+		slot_exp_rem(_s, c);
+
+	if (!_s->idx)
+		return;
+
+	for (pos = idx_pos(_r->aorhash, bits); _s->idx[pos].r != _r;
+			pos = idx_next(pos, bits))
+		if (!_s->idx[pos].r)
+			return;
+
+	/* backward-shift deletion: move up the following entries of the
+	 * cluster which may not be reached anymore past the freed one */
+	for (next = idx_next(pos, bits); _s->idx[next].r;
+			next = idx_next(next, bits)) {
+		home = idx_pos(_s->idx[next].hash, bits);
+		if (((next - home) & ((1U << bits) - 1)) >=
+				((next - pos) & ((1U << bits) - 1))) {
+			_s->idx[pos] = _s->idx[next];
+			pos = next;
+		}
+	}
+
+	_s->idx[pos].r = NULL;
+	_s->idx_used--;
+
+	/* shrink the index back when mostly empty */
+	if (bits > SLOT_IDX_MIN_BITS && _s->idx_used * 8 < (1U << bits))
+		idx_resize(_s, bits - 1);
+}
+
+
+/*! \brief
+ * Find the record of an AoR, given its core_hash()
+ */
+struct urecord* slot_find(hslot_t* _s, unsigned int _hash, const str* _aor)
+{
+	unsigned int pos, bits = _s->idx_bits;
+
+	if (!_s->idx)
+		return NULL;
+
+	for (pos = idx_pos(_hash, bits); _s->idx[pos].r;
+			pos = idx_next(pos, bits))
+		if (_s->idx[pos].hash == _hash && aor_match(_s->idx[pos].r, _aor))
+			return _s->idx[pos].r;
+
+	return NULL;
+}
+
+
+/*
+ * Expiry index: a binary min-heap over the ->expires of the contacts, each
+ * contact keeping its own position in order to be removed or moved
+ */
+#define exp_parent(_pos) (((_pos) - 1) / 2)
+
+static inline void exp_set(hslot_t* _s, unsigned int pos, struct ucontact* _c)
+{
+	_s->exp[pos] = _c;
+	_c->exp_pos = pos;
+}
+
+static void exp_sift_up(hslot_t* _s, unsigned int pos)
+{
+	struct ucontact *c = _s->exp[pos];
+
+	while (pos > 0 && _s->exp[exp_parent(pos)]->expires > c->expires) {
+		exp_set(_s, pos, _s->exp[exp_parent(pos)]);
+		pos = exp_parent(pos);
+	}
+
+	exp_set(_s, pos, c);
+}
+
+static void exp_sift_down(hslot_t* _s, unsigned int pos)
+{
+	struct ucontact *c = _s->exp[pos];
+	unsigned int child;
+
+	while ((child = 2 * pos + 1) < _s->exp_used) {
+		if (child + 1 < _s->exp_used &&
+				_s->exp[child + 1]->expires < _s->exp[child]->expires)
+			child++;
+
+		if (_s->exp[child]->expires >= c->expires)
+			break;
+
+		exp_set(_s, pos, _s->exp[child]);
+		pos = child;
+	}
+
+	exp_set(_s, pos, c);
+}
+
+static int exp_resize(hslot_t* _s, unsigned int size)
+{
+	struct ucontact **exp;
+
+	exp = shm_realloc(_s->exp, size * sizeof *exp);
+	if (!exp) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+
+	_s->exp = exp;
+	_s->exp_size = size;
+	return 0;
+}
+
+
+int slot_exp_add(hslot_t* _s, struct ucontact* _c)
+{
+	/* permanent contacts never expire */
+	if (!have_expiry_index() || _c->expires == 0)
+		return 0;
+
+	if (_s->exp_used == _s->exp_size && exp_resize(_s,
+			_s->exp_size ? _s->exp_size * 2 : SLOT_EXP_MIN_SIZE) < 0)
+		return -1;
+
+	_s->exp[_s->exp_used] = _c;
+	exp_sift_up(_s, _s->exp_used++);
+	return 0;
+}
+
+
+void slot_exp_rem(hslot_t* _s, struct ucontact* _c)
+{
+	unsigned int pos = _c->exp_pos;
+
+	if (_c->exp_pos < 0)
+		return;
+
+	_c->exp_pos = -1;
+
+	/* the last contact takes the freed position */
+	if (pos != --_s->exp_used) {
+		_s->exp[pos] = _s->exp[_s->exp_used];
+		if (pos > 0 && _s->exp[exp_parent(pos)]->expires >
+				_s->exp[pos]->expires)
+			exp_sift_up(_s, pos);
+		else
+			exp_sift_down(_s, pos);
+	}
+
+	/* shrink the index back when mostly empty */
+	if (_s->exp_size > SLOT_EXP_MIN_SIZE && _s->exp_used * 8 < _s->exp_size)
+		exp_resize(_s, _s->exp_size / 2);
+}
+
+
+int slot_exp_update(hslot_t* _s, struct ucontact* _c)
+{
+	if (_c->exp_pos < 0)
+		return slot_exp_add(_s, _c);
+
+	if (_c->expires == 0) {
+		slot_exp_rem(_s, _c);
+		return 0;
+	}
+
+	exp_sift_up(_s, _c->exp_pos);
+	exp_sift_down(_s, _c->exp_pos);
+	return 0;
 }
@@ -38,6 +38,18 @@
 
 struct udomain;
 struct urecord;
+struct ucontact;
+
+/* the AoR index of a slot starts with this many entries (power of 2) */
+#define SLOT_IDX_MIN_BITS  4
+
+/* the expiry index of a slot starts with this many entries */
+#define SLOT_EXP_MIN_SIZE  16
+
+typedef struct slot_idx_entry {
+	unsigned int hash;          /*!< core_hash() of the AoR */
+	struct urecord *r;          /*!< NULL if the entry is free */
+} slot_idx_entry_t;
 
 
 typedef struct hslot {
@@ -45,6 +57,18 @@ typedef struct hslot {
 	map_t records;
 	unsigned int next_label;
 
+	/* open-addressed (linear probing) index over the records, so AoR
+	 * lookups only touch the urecords whose full hash matches */
+	slot_idx_entry_t *idx;
+	unsigned int idx_bits;      /*!< the index has 2^idx_bits entries */
+	unsigned int idx_used;      /*!< number of used entries */
+
+	/* min-heap of the expiring contacts of the slot (by ->expires), so the
+	 * timer only has to visit the ones which actually expired */
+	struct ucontact **exp;
+	unsigned int exp_size;
+	unsigned int exp_used;
+
 	struct udomain* d;      /*!< Domain we belong to */
 #ifdef GEN_LOCK_T_PREFERED
 	gen_lock_t *lock;       /*!< Lock for hash entry - fastlock */
@@ -76,6 +100,36 @@ int slot_add(hslot_t* _s, struct urecord* _r);
  */
 void slot_rem(hslot_t* _s, struct urecord* _r);
 
+
+/*! \brief
+ * Find the record of an AoR, given its core_hash()
+ */
+struct urecord* slot_find(hslot_t* _s, unsigned int _hash, const str* _aor);
+
+
+/*! \brief
+ * Add a contact to the expiry index of the slot (if it ever expires)
+ */
+int slot_exp_add(hslot_t* _s, struct ucontact* _c);
+
+
+/*! \brief
+ * Remove a contact from the expiry index of the slot
+ */
+void slot_exp_rem(hslot_t* _s, struct ucontact* _c);
+
+
+/*! \brief
+ * Re-position a contact in the expiry index, after its ->expires changed
+ */
+int slot_exp_update(hslot_t* _s, struct ucontact* _c);
+
+
+/*! \brief
+ * The contact of the slot which expires first, if any
+ */
+#define slot_exp_first(_s) ((_s)->exp_used ? (_s)->exp[0] : NULL)
+
 int ul_init_locks();
 void ul_unlock_locks();
 void ul_destroy_locks();
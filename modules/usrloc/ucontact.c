@@ -195,6 +195,8 @@ new_ucontact(str* _dom, str* _aor, str* _contact, ucontact_info_t* _ci)
 	if (c->refresh_time)
 		start_refresh_timer(c);
 
+	c->exp_pos = -1;
+
 	return c;
 
 mem_error:
@@ -513,29 +515,18 @@ int st_flush_ucontact(ucontact_t* _c)
 
 /* ============== Database related functions ================ */
 
+/* position of the K/V store column within the DB row of a contact */
+#define UL_KV_STORE_COL 16
+
 /*! \brief
- * Insert contact into the database
+ * Fill in the columns of the DB row of a contact; the K/V store column
+ * (UL_KV_STORE_COL) must be released with store_free_buffer()
+ * \return the number of columns, the contact_id being the first one
  */
-int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
+static int ucontact2dbrow(ucontact_t* _c, db_key_t* keys, db_val_t* vals)
 {
 	int nr_vals = UL_COLS - 1;
-	int start = 0;
-
-	static db_ps_t myI_ps = NULL;
-	static db_ps_t myR_ps = NULL;
 	char* dom;
-	db_key_t keys[UL_COLS];
-	db_val_t vals[UL_COLS];
-
-	if (_c->flags & FL_MEM) {
-		return 0;
-	}
-
-	/* in CM_SQL_ONLY, we let the SQL engine auto-generate the ucontact_id */
-	if (cluster_mode == CM_SQL_ONLY) {
-		start++;
-		nr_vals--;
-	}
 
 	keys[0] = &contactid_col;
 	keys[1] = &user_col;
@@ -557,7 +548,7 @@ int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
 	keys[17] = &attr_col;
 	keys[UL_COLS - 1] = &domain_col; /* "domain" always stays last */
 
-	memset(vals, 0, sizeof vals);
+	memset(vals, 0, UL_COLS * sizeof *vals);
 
 	vals[0].type = DB_BIGINT;
 	vals[0].val.bigint_val = _c->contact_id;
@@ -670,6 +661,35 @@ int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
 		nr_vals++;
 	}
 
+	return nr_vals;
+}
+
+
+/*! \brief
+ * Insert contact into the database
+ */
+int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
+{
+	int nr_vals;
+	int start = 0;
+
+	static db_ps_t myI_ps = NULL;
+	static db_ps_t myR_ps = NULL;
+	db_key_t keys[UL_COLS];
+	db_val_t vals[UL_COLS];
+
+	if (_c->flags & FL_MEM) {
+		return 0;
+	}
+
+	nr_vals = ucontact2dbrow(_c, keys, vals);
+
+	/* in CM_SQL_ONLY, we let the SQL engine auto-generate the ucontact_id */
+	if (cluster_mode == CM_SQL_ONLY) {
+		start++;
+		nr_vals--;
+	}
+
 	if (ul_dbf.use_table(ul_dbh, _c->domain) < 0) {
 		LM_ERR("sql use_table failed\n");
 		goto out_err;
@@ -697,10 +717,10 @@ int db_insert_ucontact(ucontact_t* _c,query_list_t **ins_list, int update)
 		}
 	}
 
-	store_free_buffer(&vals[16].val.str_val);
+	store_free_buffer(&vals[UL_KV_STORE_COL].val.str_val);
 	return 0;
 out_err:
-	store_free_buffer(&vals[16].val.str_val);
+	store_free_buffer(&vals[UL_KV_STORE_COL].val.str_val);
 	return -1;
 }
 
@@ -902,6 +922,129 @@ int db_multiple_ucontact_delete(str *domain, db_key_t *keys,
 }
 
 
+/*
+ * Write-back batch of contact rows (timer only), written with multi-row
+ * upserts; the strings of each row are copied, as some of them only live
+ * in static buffers (flags, K/V store)
+ */
+static db_key_t wb_keys[UL_COLS];
+static db_val_t *wb_vals;          /* flush_batch_size packed rows */
+static char **wb_bufs;             /* the string copies of each row */
+static ucontact_t **wb_cts;
+static cstate_t *wb_states;        /* states to restore if the write fails */
+static int wb_rows, wb_cols;
+static str *wb_domain;
+
+static int wb_alloc(void)
+{
+	char *p;
+
+	p = pkg_malloc(ul_flush_batch * (UL_COLS * sizeof *wb_vals +
+		sizeof *wb_bufs + sizeof *wb_cts + sizeof *wb_states));
+	if (!p) {
+		LM_ERR("oom\n");
+		return -1;
+	}
+
+	wb_vals = (db_val_t *)p;
+	wb_bufs = (char **)(wb_vals + ul_flush_batch * UL_COLS);
+	wb_cts = (ucontact_t **)(wb_bufs + ul_flush_batch);
+	wb_states = (cstate_t *)(wb_cts + ul_flush_batch);
+
+	return 0;
+}
+
+
+int db_batch_ucontact(ucontact_t* _c, cstate_t old_state)
+{
+	db_val_t vals[UL_COLS];
+	str kv_store;
+	char *p;
+	int i, cols, len;
+
+	if (_c->flags & FL_MEM)
+		return 0;
+
+	if (!wb_vals && wb_alloc() < 0)
+		return -1;
+
+	/* a batch only targets the table of a single domain */
+	if (wb_rows && wb_domain != _c->domain && db_flush_ucontacts() < 0)
+		LM_ERR("failed to flush the contacts of %.*s\n",
+			wb_domain->len, wb_domain->s);
+
+	cols = ucontact2dbrow(_c, wb_keys, vals);
+	kv_store = vals[UL_KV_STORE_COL].val.str_val;
+
+	for (len = 0, i = 0; i < cols; i++)
+		if (VAL_TYPE(vals + i) == DB_STR && !VAL_NULL(vals + i))
+			len += VAL_STR(vals + i).len;
+
+	p = NULL;
+	if (len && !(p = pkg_malloc(len))) {
+		LM_ERR("oom\n");
+		store_free_buffer(&kv_store);
+		return -1;
+	}
+
+	wb_bufs[wb_rows] = p;
+	for (i = 0; i < cols; i++)
+		if (VAL_TYPE(vals + i) == DB_STR && !VAL_NULL(vals + i)) {
+			memcpy(p, VAL_STR(vals + i).s, VAL_STR(vals + i).len);
+			VAL_STR(vals + i).s = p;
+			p += VAL_STR(vals + i).len;
+		}
+
+	store_free_buffer(&kv_store);
+
+	memcpy(wb_vals + wb_rows * cols, vals, cols * sizeof *vals);
+	wb_cts[wb_rows] = _c;
+	wb_states[wb_rows] = old_state;
+	wb_domain = _c->domain;
+	wb_cols = cols;
+
+	if (++wb_rows == ul_flush_batch)
+		return db_flush_ucontacts();
+
+	return 0;
+}
+
+
+int db_flush_ucontacts(void)
+{
+	int i, stmts;
+
+	if (!wb_rows)
+		return 0;
+
+	if (ul_dbf.use_table(ul_dbh, wb_domain) < 0) {
+		LM_ERR("sql use_table failed\n");
+		stmts = -1;
+	} else {
+		CON_RESET_CURR_PS(ul_dbh);
+		stmts = ul_dbf.insert_update_multi(ul_dbh, wb_keys, wb_vals, wb_cols,
+			wb_rows);
+	}
+
+	if (stmts < 0) {
+		LM_ERR("failed to write %d contacts to the database\n", wb_rows);
+		/* retry them on the next timer run */
+		for (i = 0; i < wb_rows; i++)
+			wb_cts[i]->state = wb_states[i];
+	} else {
+		update_stat(ul_flush_rows, wb_rows);
+		update_stat(ul_flush_stmts, stmts);
+	}
+
+	for (i = 0; i < wb_rows; i++)
+		if (wb_bufs[i])
+			pkg_free(wb_bufs[i]);
+	wb_rows = 0;
+
+	return stmts < 0 ? -1 : 0;
+}
+
+
 static inline void unlink_contact(struct urecord* _r, ucontact_t* _c)
 {
 	if (_c->prev) {
@@ -977,6 +1120,9 @@ int update_ucontact(struct urecord* _r, ucontact_t* _c, ucontact_info_t* _ci,
 		return -1;
 	}
 
+	if (_r->slot && slot_exp_update(_r->slot, _c) < 0)
+		LM_ERR("failed to re-index the expiry of the contact\n");
+
 	if (is_replicated && _c->kv_storage)
 		restore_urecord_kv_store(_r, _c);
 
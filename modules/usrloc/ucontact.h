@@ -138,6 +138,9 @@ typedef struct ucontact {
 	int refresh_time;         /*!< UNIX timestamp: the next refresh event >*/
 	struct list_head refresh_list;
 
+	int exp_pos;            /*!< Position in the expiry index of the slot,
+	                             -1 if not indexed */
+
 	struct ucontact* next;  /*!< Next contact in the linked list */
 	struct ucontact* prev;  /*!< Previous contact in the linked list */
 } ucontact_t;
@@ -292,6 +295,21 @@ int db_multiple_ucontact_delete(str *domain, db_key_t *keys,
 										db_val_t *vals, int clen);
 
 
+/*! \brief
+ * Queue the insert/update of a contact into the write-back batch, which
+ * is written to the database once full (requires "flush_batch_size");
+ * @old_state is restored if the write fails
+ */
+int db_batch_ucontact(ucontact_t* _c, cstate_t old_state);
+
+
+/*! \brief
+ * Write the contacts of the write-back batch to the database; must be
+ * called before releasing the lock of their slot
+ */
+int db_flush_ucontacts(void);
+
+
 /* ====== Module interface ====== */
 
 struct urecord;
@@ -31,6 +31,7 @@
 #include "../../ut.h"
 #include "../../hash_func.h"
 #include "../../cachedb/cachedb.h"
+#include "../../lib/container.h"
 
 #include "ul_mod.h"            /* usrloc module parameters */
 #include "ul_evi.h"
@@ -419,7 +420,7 @@ static inline ucontact_info_t* dbrow2info(db_val_t *vals, str *contact)
 }
 
 
-int preload_udomain(db_con_t* _c, udomain_t* _d)
+int preload_udomain(db_con_t* _c, udomain_t* _d, int chunk, int chunks_no)
 {
 	/* no use to try prepared statements here as this query is performed
 	   once at startup -bogdan */
@@ -428,12 +429,17 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 	ucontact_info_t *ci;
 	db_row_t *row;
 	db_key_t columns[UL_COLS];
+	db_key_t keys[2];
+	db_op_t ops[2];
+	db_val_t vals[2];
 	db_res_t* res = NULL;
 	str user, contact;
 	char* domain;
 	int i;
 	int n;
 	int ret;
+	int keys_no = 0;
+	int loaded = 0;
 	int no_rows = 10;
 	unsigned short aorhash, clabel;
 	unsigned int   rlabel;
@@ -466,6 +472,31 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 	columns[17] = &attr_col;
 	columns[UL_COLS - 1] = &domain_col; /* "domain" always stays last */
 
+	/* the contacts of an AoR share the aorhash bits of their contact_id,
+	 * so each chunk is a range of aorhashes; the first and last chunks are
+	 * left open, in order to also pick up any out-of-range (broken) ids */
+	if (chunks_no > 1) {
+		if (chunk > 0) {
+			keys[keys_no] = &contactid_col;
+			ops[keys_no] = OP_GEQ;
+			VAL_TYPE(vals + keys_no) = DB_BIGINT;
+			VAL_NULL(vals + keys_no) = 0;
+			VAL_BIGINT(vals + keys_no) =
+				(long long)UL_PRELOAD_CHUNK_START(chunk, chunks_no);
+			keys_no++;
+		}
+
+		if (chunk < chunks_no - 1) {
+			keys[keys_no] = &contactid_col;
+			ops[keys_no] = OP_LT;
+			VAL_TYPE(vals + keys_no) = DB_BIGINT;
+			VAL_NULL(vals + keys_no) = 0;
+			VAL_BIGINT(vals + keys_no) =
+				(long long)UL_PRELOAD_CHUNK_START(chunk + 1, chunks_no);
+			keys_no++;
+		}
+	}
+
 	if (ul_dbf.use_table(_c, _d->name) < 0) {
 		LM_ERR("sql use_table failed\n");
 		return -1;
@@ -476,7 +507,7 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 #endif
 
 	if (DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
-		if (ul_dbf.query(_c, 0, 0, 0, columns, 0,
+		if (ul_dbf.query(_c, keys, ops, vals, columns, keys_no,
 		                 use_domain ? UL_COLS : UL_COLS - 1, 0, 0) < 0) {
 			LM_ERR("db_query (1) failed\n");
 			return -1;
@@ -489,7 +520,7 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 			return -1;
 		}
 	} else {
-		if (ul_dbf.query(_c, 0, 0, 0, columns, 0,
+		if (ul_dbf.query(_c, keys, ops, vals, columns, keys_no,
 		                 use_domain ? UL_COLS : UL_COLS - 1, 0, &res) < 0) {
 			LM_ERR("db_query failed\n");
 			return -1;
@@ -682,6 +713,7 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 			}
 
 			unlock_udomain(_d, &user);
+			loaded++;
 		}
 
 		if (DB_CAPABILITY(ul_dbf, DB_CAP_FETCH)) {
@@ -707,24 +739,32 @@ int preload_udomain(db_con_t* _c, udomain_t* _d)
 				" enable 'regen_broken_contactid' module parameter.\n");
 	}
 
-	/* for each not populated slot with record label
-	 * populate it*/
-	for (sl=0; sl < _d->size; sl++) {
-		if (_d->table[sl].next_label == 0)
-			_d->table[sl].next_label = rand();
-	}
-
 #ifdef EXTRA_DEBUG
 	LM_NOTICE("load end time [%d]\n", (int)time(NULL));
 #endif
 
-	return 0;
+	return loaded;
 error:
 	ul_dbf.free_result(_c, res);
 	return -1;
 }
 
 
+void preload_udomain_labels(udomain_t* _d)
+{
+	int sl;
+
+	/* for each not populated slot with record label
+	 * populate it*/
+	for (sl=0; sl < _d->size; sl++) {
+		lock_ulslot(_d, sl);
+		if (_d->table[sl].next_label == 0)
+			_d->table[sl].next_label = rand();
+		unlock_ulslot(_d, sl);
+	}
+}
+
+
 /*! \brief
  * loads from DB all contacts for an AOR
  */
@@ -1135,15 +1175,77 @@ void mem_delete_urecord(udomain_t* _d, struct urecord* _r)
 }
 
 
-int mem_timer_udomain(udomain_t* _d)
+/*
+ * Drop a record left without contacts by the timer
+ */
+static void timer_delete_urecord(udomain_t* _d, struct urecord* _r)
+{
+	if (exists_ulcb_type(UL_AOR_EXPIRE))
+		run_ul_callbacks(UL_AOR_EXPIRE, _r);
+
+	if (location_cluster) {
+		if (cluster_mode == CM_FEDERATION_CACHEDB &&
+		    cdb_update_urecord_metadata(&_r->aor, 1) != 0)
+			LM_ERR("failed to delete metadata, aor: %.*s\n",
+			       _r->aor.len, _r->aor.s);
+	}
+
+	mem_delete_urecord(_d, _r);
+}
+
+
+/*
+ * Drop a record emptied outside of the timer, which only goes through the
+ * expiry index and would no longer see it
+ */
+void release_empty_urecord(udomain_t* _d, struct urecord* _r)
+{
+	if (!have_expiry_index() || !_r->slot)
+		return;
+
+	if (_r->no_clear_ref <= 0 && _r->contacts == NULL)
+		timer_delete_urecord(_d, _r);
+}
+
+
+/*
+ * Expire the contacts of a slot, going only through its expiry index
+ */
+static void exp_timer_slot(udomain_t* _d, hslot_t* _s)
+{
+	struct urecord* r;
+	ucontact_t* c;
+
+	while ((c = slot_exp_first(_s)) && c->expires <= act_time) {
+		r = container_of(c->aor, struct urecord, aor);
+
+		timer_expire_ucontact(r, c);
+
+		if (r->no_clear_ref <= 0 && r->contacts == NULL)
+			timer_delete_urecord(_d, r);
+	}
+}
+
+
+int mem_timer_udomain(udomain_t* _d, int from, int to)
 {
 	struct urecord* ptr;
 	void ** dest;
 	int i,ret=0,flush=0;
 	map_iterator_t it,prev;
 
+	if (have_expiry_index()) {
+		for (i = from; i < to; i++) {
+			lock_ulslot(_d, i);
+			exp_timer_slot(_d, &_d->table[i]);
+			unlock_ulslot(_d, i);
+		}
+
+		return 0;
+	}
+
 	cid_len = 0;
-	for(i=0; i<_d->size; i++)
+	for(i=from; i<to; i++)
 	{
 		lock_ulslot(_d, i);
 
@@ -1154,6 +1256,7 @@ int mem_timer_udomain(udomain_t* _d)
 
 			dest = iterator_val(&it);
 			if( dest == NULL ) {
+				db_flush_ucontacts();
 				unlock_ulslot(_d, i);
 				return -1;
 			}
@@ -1165,6 +1268,7 @@ int mem_timer_udomain(udomain_t* _d)
 
 			if ((ret =timer_urecord(ptr,&_d->ins_list)) < 0) {
 				LM_ERR("timer_urecord failed\n");
+				db_flush_ucontacts();
 				unlock_ulslot(_d, i);
 				return -1;
 			}
@@ -1175,21 +1279,15 @@ int mem_timer_udomain(udomain_t* _d)
 			/* Remove the entire record if it is empty */
 			if (ptr->no_clear_ref <= 0 && ptr->contacts == NULL)
 			{
-				if (exists_ulcb_type(UL_AOR_EXPIRE))
-					run_ul_callbacks(UL_AOR_EXPIRE, ptr);
-
-				if (location_cluster) {
-					if (cluster_mode == CM_FEDERATION_CACHEDB &&
-					    cdb_update_urecord_metadata(&ptr->aor, 1) != 0)
-						LM_ERR("failed to delete metadata, aor: %.*s\n",
-						       ptr->aor.len, ptr->aor.s);
-				}
-
 				iterator_delete(&prev);
-				mem_delete_urecord(_d, ptr);
+				timer_delete_urecord(_d, ptr);
 			}
 		}
 
+		/* the batched contacts must still be valid if the write fails */
+		if (ul_flush_batch && db_flush_ucontacts() < 0)
+			LM_ERR("failed to flush contacts to DB\n");
+
 		unlock_ulslot(_d, i);
 	}
 
@@ -1389,13 +1487,11 @@ int insert_urecord(udomain_t* _d, str* _aor, struct urecord** _r,
 static inline urecord_t *find_mem_urecord(udomain_t *_d, const str *_aor)
 {
 	unsigned int sl, aorhash;
-	urecord_t **r;
 
 	aorhash = core_hash(_aor, 0, 0);
 	sl = aorhash & (_d->size - 1);
 
-	r = (urecord_t **)map_find(_d->table[sl].records, *_aor);
-	return r ? *r : NULL;
+	return slot_find(&_d->table[sl], aorhash, _aor);
 }
 
 /*! \brief
@@ -82,10 +82,22 @@ int new_udomain(str* _n, int _s, udomain_t** _d);
 void free_udomain(udomain_t* _d);
 
 
+/* first contact_id of the given startup load chunk */
+#define UL_PRELOAD_CHUNK_START(_chunk, _chunks_no) \
+	((uint64_t)(((_chunk) * 65536) / (_chunks_no)) << 46)
+
+/*! \brief
+ * Load data from a database: all of it if chunks_no <= 1, otherwise only
+ * the contacts of the @chunk'th range of AoR hashes
+ * \return the number of loaded contacts or -1 on error
+ */
+int preload_udomain(db_con_t* _c, udomain_t* _d, int chunk, int chunks_no);
+
+
 /*! \brief
- * Load data from a database
+ * Seed the record labels of the slots left empty after the load
  */
-int preload_udomain(db_con_t* _c, udomain_t* _d);
+void preload_udomain_labels(udomain_t* _d);
 
 
 /*! \brief
@@ -101,9 +113,9 @@ int db_timer_udomain(udomain_t* _d);
 
 
 /*! \brief
- * Timer handler for given domain
+ * Timer handler for the [from, to) slots of the given domain
  */
-int mem_timer_udomain(udomain_t* _d);
+int mem_timer_udomain(udomain_t* _d, int from, int to);
 
 /*! \brief
  * Insert record into domain
@@ -117,6 +129,12 @@ int mem_insert_urecord(udomain_t* _d, str* _aor, struct urecord** _r);
 void mem_delete_urecord(udomain_t* _d, struct urecord* _r);
 
 
+/*! \brief
+ * Drop a record left without contacts when only the expiry index is timed
+ */
+void release_empty_urecord(udomain_t* _d, struct urecord* _r);
+
+
 /*! \brief
  * Locks the domain hash entrie corresponding to AOR
  */
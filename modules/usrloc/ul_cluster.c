@@ -766,6 +766,8 @@ static int receive_ucontact_delete(bin_packet_t *packet)
 		goto error;
 	}
 
+	release_empty_urecord(domain, record);
+
 	unlock_udomain(domain, &aor);
 
 	return 0;
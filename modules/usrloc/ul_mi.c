@@ -756,3 +756,60 @@ mi_response_t *mi_usrloc_cl_sync(const mi_params_t *params,
 	else
 		return init_mi_result_ok();
 }
+
+
+/*! \brief
+ * Progress of the startup SQL load
+ */
+mi_response_t *mi_usrloc_preload_status(const mi_params_t *params,
+								struct mi_handler *async_hdl)
+{
+	static str st_done = str_init("done");
+	static str st_loading = str_init("loading");
+	static str st_pending = str_init("pending");
+	mi_response_t *resp;
+	mi_item_t *resp_obj;
+	str *state;
+	time_t end;
+	int done;
+
+	resp = init_mi_result_object(&resp_obj);
+	if (!resp)
+		return 0;
+
+	if (!ul_preload) {
+		if (add_mi_string(resp_obj, MI_SSTR("State"), MI_SSTR("disabled")) < 0)
+			goto error;
+		return resp;
+	}
+
+	done = ul_preload->done;
+	end = done ? ul_preload->end : time(NULL);
+	state = done ? &st_done : (ul_preload->start ? &st_loading : &st_pending);
+
+	if (add_mi_string(resp_obj, MI_SSTR("State"), state->s, state->len) < 0)
+		goto error;
+
+	if (add_mi_number(resp_obj, MI_SSTR("Workers"), ul_preload_workers) < 0)
+		goto error;
+
+	if (add_mi_number(resp_obj, MI_SSTR("Chunks"), ul_preload->chunks_no) < 0)
+		goto error;
+
+	if (add_mi_number(resp_obj, MI_SSTR("Chunks_done"),
+	        ul_preload->chunks_done) < 0)
+		goto error;
+
+	if (add_mi_number(resp_obj, MI_SSTR("Contacts"),
+	        ul_preload->contacts) < 0)
+		goto error;
+
+	if (add_mi_number(resp_obj, MI_SSTR("Duration"),
+	        ul_preload->start ? end - ul_preload->start : 0) < 0)
+		goto error;
+
+	return resp;
+error:
+	free_mi_response(resp);
+	return 0;
+}
@@ -40,6 +40,7 @@
 #define MI_USRLOC_SHOW_CONTACT "ul_show_contact"
 #define MI_USRLOC_SYNC         "ul_sync"
 #define MI_USRLOC_CL_SYNC      "ul_cluster_sync"
+#define MI_USRLOC_PRELOAD_STATUS "ul_preload_status"
 
 extern rw_lock_t *sync_lock;
 
@@ -71,4 +72,7 @@ mi_response_t *mi_usrloc_sync_2(const mi_params_t *params,
 mi_response_t *mi_usrloc_cl_sync(const mi_params_t *params,
 								struct mi_handler *async_hdl);
 
+mi_response_t *mi_usrloc_preload_status(const mi_params_t *params,
+								struct mi_handler *async_hdl);
+
 #endif
@@ -49,6 +49,8 @@
 #include "../../globals.h"   /* is_main */
 #include "../../ut.h"        /* str_init */
 #include "../../ipc.h"
+#include "../../script_cb.h"
+#include "../../mem/shm_mem.h"
 
 #include "ul_mod.h"
 #include "dlist.h"           /* register_udomain */
@@ -90,6 +92,7 @@ int ul_init_globals(void);
 int ul_check_config(void);
 int ul_check_db(void);
 int ul_deprec_shp(modparam_t _, void *modparam);
+static unsigned long get_flush_rows_per_stmt(void *_);
 
 //static int add_replication_dest(modparam_t type, void *val);
 
@@ -154,6 +157,17 @@ int desc_time_order = 0;   /*!< By default do not enable timestamp ordering */
 
 int ul_hash_size = 9;
 
+/* startup SQL load */
+int ul_preload_workers = 1;
+int ul_preload_drop_requests = 0;
+struct ul_preload_status *ul_preload;
+
+/* write-back contact flushing */
+int ul_flush_batch = 0;
+stat_var *ul_flush_rows;
+stat_var *ul_flush_stmts;
+stat_var *ul_flush_duration;
+
 /* flag */
 unsigned int nat_bflag = (unsigned int)-1;
 static char *nat_bflag_str = 0;
@@ -241,6 +255,10 @@ static param_export_t params[] = {
 	{ "skip_replicated_db_ops", INT_PARAM, &skip_replicated_db_ops   },
 	{ "max_contact_delete", INT_PARAM, &max_contact_delete },
 	{ "regen_broken_contactid", INT_PARAM, &cid_regen},
+	{ "preload_workers",    INT_PARAM, &ul_preload_workers },
+	{ "preload_drop_requests", INT_PARAM, &ul_preload_drop_requests },
+	{ "flush_batch_size",   INT_PARAM, &ul_flush_batch },
+	{ "flush_spread",       INT_PARAM, &ul_flush_spread },
 
 	{0, 0, 0}
 };
@@ -248,6 +266,11 @@ static param_export_t params[] = {
 
 static stat_export_t mod_stats[] = {
 	{"registered_users" ,  STAT_IS_FUNC, (stat_var**)get_number_of_users  },
+	{"flush_rows",         STAT_NO_RESET, &ul_flush_rows                 },
+	{"flush_statements",   STAT_NO_RESET, &ul_flush_stmts                },
+	{"flush_rows_per_statement", STAT_IS_FUNC,
+		(stat_var**)get_flush_rows_per_stmt                                  },
+	{"flush_duration",     STAT_NO_RESET, &ul_flush_duration             },
 	{0,0,0}
 };
 
@@ -287,6 +310,10 @@ static mi_export_t mi_cmds[] = {
 		{mi_usrloc_cl_sync, {0}},
 		{EMPTY_MI_RECIPE}}
 	},
+	{ MI_USRLOC_PRELOAD_STATUS, 0, 0, 0, {
+		{mi_usrloc_preload_status, {0}},
+		{EMPTY_MI_RECIPE}}
+	},
 	{EMPTY_MI_EXPORT}
 };
 
@@ -404,19 +431,73 @@ static int mod_init(void)
 }
 
 
+/*! \brief
+ * Loads chunks of contacts from the DB, for as long as there are chunks
+ * not picked up yet by any of the preload workers
+ */
 static void ul_rpc_data_load(int sender_id, void *unsused)
 {
 	dlist_t* ptr;
+	unsigned long contacts;
+	int chunk, done, rc;
+
+	for (;;) {
+		lock_get(&ul_preload->lock);
+		if (ul_preload->next_chunk == 0)
+			ul_preload->start = time(NULL);
+		chunk = ul_preload->next_chunk < ul_preload->chunks_no ?
+			ul_preload->next_chunk++ : -1;
+		lock_release(&ul_preload->lock);
+
+		if (chunk < 0)
+			return;
+
+		LM_DBG("loading chunk %d/%d\n", chunk + 1, ul_preload->chunks_no);
+
+		for (contacts = 0, ptr = root; ptr; ptr = ptr->next) {
+			rc = preload_udomain(ul_dbh, ptr->d, chunk, ul_preload->chunks_no);
+			if (rc < 0) {
+				LM_ERR("failed to preload domain '%.*s'\n",
+					ptr->name.len, ZSW(ptr->name.s));
+				/* continue with the other ul domains */;
+			} else {
+				contacts += rc;
+			}
+		}
 
-	for( ptr=root ; ptr ; ptr=ptr->next) {
-		if (preload_udomain(ul_dbh, ptr->d) < 0) {
-			LM_ERR("failed to preload domain '%.*s'\n",
-				ptr->name.len, ZSW(ptr->name.s));
-			/* continue with the other ul domains */;
+		lock_get(&ul_preload->lock);
+		ul_preload->contacts += contacts;
+		done = (++ul_preload->chunks_done == ul_preload->chunks_no);
+		lock_release(&ul_preload->lock);
+
+		if (done) {
+			for (ptr = root; ptr; ptr = ptr->next)
+				preload_udomain_labels(ptr->d);
+
+			ul_preload->end = time(NULL);
+			ul_preload->done = 1;
+
+			LM_INFO("loaded %lu contacts in %ld s, using %d worker(s)\n",
+				ul_preload->contacts, (long)(ul_preload->end -
+				ul_preload->start), ul_preload_workers);
 		}
 	}
 }
 
+
+/*! \brief
+ * Drops the SIP requests received before the contacts are loaded, so
+ * they are not answered based on an incomplete location table
+ */
+static int ul_preload_gate(struct sip_msg *msg, void *param)
+{
+	if (ul_preload->done)
+		return SCB_RUN_ALL;
+
+	LM_DBG("contacts still loading, dropping request\n");
+	return SCB_DROP_MSG;
+}
+
 int init_cachedb(void)
 {
 	if (!cdbf.init) {
@@ -453,8 +534,9 @@ static int child_init(int _rank)
 		LM_ERR("child(%d): failed to connect to database\n", _rank);
 		return -1;
 	}
-	/* _rank==1 is used even when fork is disabled */
-	if (_rank==1 && rr_persist == RRP_LOAD_FROM_SQL) {
+	/* _rank==1 is used even when fork is disabled, so the load still
+	 * completes if there are fewer workers than "preload_workers" */
+	if (_rank <= ul_preload_workers && rr_persist == RRP_LOAD_FROM_SQL) {
 		/* if cache is used, populate domains from DB */
 		if (ipc_send_rpc( process_no, ul_rpc_data_load, NULL)<0) {
 			LM_ERR("failed to fire RPC for data load\n");
@@ -928,8 +1010,44 @@ int ul_check_db(void)
 				VAL_NULL(cid_vals + i) = 0;
 				cid_keys[i] = &contactid_col;
 			}
+
+			if (ul_preload_workers < 1)
+				ul_preload_workers = 1;
+
+			ul_preload = shm_malloc(sizeof *ul_preload);
+			if (!ul_preload) {
+				LM_ERR("oom\n");
+				return -1;
+			}
+			memset(ul_preload, 0, sizeof *ul_preload);
+			lock_init(&ul_preload->lock);
+			ul_preload->chunks_no = ul_preload_workers == 1 ? 1 :
+				ul_preload_workers * UL_PRELOAD_CHUNKS_PER_WORKER;
+
+			if (ul_preload_drop_requests && register_script_cb(
+			        ul_preload_gate, PRE_SCRIPT_CB|REQ_TYPE_CB, 0) < 0) {
+				LM_ERR("failed to register the preload script callback\n");
+				return -1;
+			}
+		}
+
+		if (ul_flush_batch > 0 && !DB_CAPABILITY(ul_dbf,
+		        DB_CAP_MULTIPLE_INSERT_UPDATE)) {
+			LM_WARN("the database module cannot write multiple rows at "
+			        "once, ignoring 'flush_batch_size'\n");
+			ul_flush_batch = 0;
+		} else if (ul_flush_batch < 0) {
+			ul_flush_batch = 0;
 		}
 	}
 
 	return 0;
 }
+
+
+static unsigned long get_flush_rows_per_stmt(void *_)
+{
+	unsigned long stmts = get_stat_val(ul_flush_stmts);
+
+	return stmts ? get_stat_val(ul_flush_rows) / stmts : 0;
+}
@@ -32,9 +32,13 @@
 #define UL_MOD_H
 
 
+#include <time.h>
+
 #include "../../db/db.h"
 #include "../../str.h"
+#include "../../locking.h"
 #include "../../cachedb/cachedb.h"
+#include "../../statistics.h"
 
 #include "usrloc.h"
 
@@ -83,6 +87,13 @@ static inline int have_mem_storage(void)
 	       cluster_mode == CM_FULL_SHARING;
 }
 
+/* without SQL write-back, the timer only has to visit the expired contacts,
+ * which are kept in an expiry index */
+static inline int have_expiry_index(void)
+{
+	return have_mem_storage() && rr_persist != RRP_LOAD_FROM_SQL;
+}
+
 static inline int tags_in_use(void)
 {
 	return pinging_mode == PMD_OWNERSHIP;
@@ -138,4 +149,29 @@ extern cachedb_con *cdbc;
 
 extern int matching_mode;
 
+/* the startup SQL load is split into this many chunks for each worker */
+#define UL_PRELOAD_CHUNKS_PER_WORKER 4
+
+/* progress of the startup SQL load, shared by all processes */
+struct ul_preload_status {
+	gen_lock_t lock;
+	int chunks_no;        /* key-range chunks of each domain */
+	int next_chunk;       /* next chunk to be picked up by a worker */
+	int chunks_done;
+	unsigned long contacts;
+	time_t start;
+	time_t end;
+	int done;
+};
+
+extern struct ul_preload_status *ul_preload;
+extern int ul_preload_workers;
+extern int ul_preload_drop_requests;
+
+/* write-back contact flushing */
+extern int ul_flush_batch;
+extern stat_var *ul_flush_rows;
+extern stat_var *ul_flush_stmts;
+extern stat_var *ul_flush_duration;
+
 #endif /* UL_MOD_H */
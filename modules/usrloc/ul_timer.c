@@ -19,6 +19,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <sys/time.h>
+
 #include "../../locking.h"
 #include "../../lib/list.h"
 
@@ -26,9 +28,12 @@
 #include "ul_evi.h"
 #include "ul_mi.h"
 #include "dlist.h"
+#include "ul_mod.h"
 
 int timer_interval = 60;              /*!< Timer interval in seconds */
 int ct_refresh_timer;
+int ul_flush_spread;                  /*!< Spread the timer work over
+                                           each second of the interval */
 
 static struct list_head *pending_refreshes;
 static gen_lock_t *ul_refresh_lock;
@@ -39,7 +44,8 @@ static void synchronize_all_udomains(unsigned int ticks, void* param);
 int ul_init_timers(void)
 {
 	/* cache -> DB timer */
-	if (register_timer("ul-timer", synchronize_all_udomains, 0, timer_interval,
+	if (register_timer("ul-timer", synchronize_all_udomains, 0,
+	                   ul_flush_spread ? 1 : timer_interval,
 	                   TIMER_FLAG_DELAY_ON_DELAY) < 0) {
 		LM_ERR("oom\n");
 		return -1;
@@ -72,17 +78,39 @@ int ul_init_timers(void)
 
 
 /*! \brief
- * Timer handler
+ * Timer handler; with "flush_spread", each run only goes through the next
+ * 1/timer_interval of the hash table of each domain
  */
 static void synchronize_all_udomains(unsigned int ticks, void* param)
 {
+	static int step;
+	static unsigned long cycle_ms;
+	struct timeval start, stop;
+	int steps = (ul_flush_spread && timer_interval > 1) ? timer_interval : 1;
+	long ms;
+
+	gettimeofday(&start, NULL);
+
 	if (sync_lock)
 		lock_start_read(sync_lock);
-	if (_synchronize_all_udomains() != 0) {
+	if (_synchronize_udomains(step, steps) != 0) {
 		LM_ERR("synchronizing cache failed\n");
 	}
 	if (sync_lock)
 		lock_stop_read(sync_lock);
+
+	gettimeofday(&stop, NULL);
+	cycle_ms += (stop.tv_sec - start.tv_sec) * 1000 +
+		(stop.tv_usec - start.tv_usec) / 1000;
+
+	if (++step < steps)
+		return;
+
+	/* a full pass over all contacts is done, publish its duration */
+	ms = cycle_ms - get_stat_val(ul_flush_duration);
+	update_stat(ul_flush_duration, ms);
+	step = 0;
+	cycle_ms = 0;
 }
 
 
@@ -28,6 +28,7 @@
 
 extern int timer_interval;
 extern int ct_refresh_timer;
+extern int ul_flush_spread;
 
 int ul_init_timers(void);
 void start_refresh_timer(ucontact_t *ct);
@@ -153,6 +153,13 @@ ucontact_t* mem_insert_ucontact(urecord_t* _r, str* _c, ucontact_info_t* _ci)
 		return 0;
 	}
 
+	if (_r->slot && slot_exp_add(_r->slot, c) < 0) {
+		LM_ERR("failed to index the expiry of the new contact\n");
+		stop_refresh_timer(c);
+		free_ucontact(c);
+		return 0;
+	}
+
 	if_update_stat( _r->slot, _r->slot->d->contacts, 1);
 
 	if (c->kv_storage)
@@ -200,6 +207,9 @@ void mem_remove_ucontact(urecord_t* _r, ucontact_t* _c)
 
 	stop_refresh_timer(_c);
 
+	if (_r->slot)
+		slot_exp_rem(_r->slot, _c);
+
 	if (_c->prev) {
 		_c->prev->next = _c->next;
 		if (_c->next) {
@@ -236,6 +246,24 @@ void mem_delete_ucontact(urecord_t* _r, ucontact_t* _c)
 }
 
 
+/*! \brief
+ * Expire a contact of a memory-only record
+ */
+void timer_expire_ucontact(urecord_t* _r, ucontact_t* _c)
+{
+	/* run callbacks for EXPIRE event */
+	if (exists_ulcb_type(UL_CONTACT_EXPIRE))
+		run_ul_callbacks( UL_CONTACT_EXPIRE, _c);
+
+	LM_DBG("Binding '%.*s','%.*s' has expired\n",
+		_c->aor->len, ZSW(_c->aor->s),
+		_c->c.len, ZSW(_c->c.s));
+
+	mem_delete_ucontact(_r, _c);
+	update_stat( _r->slot->d->expires, 1);
+}
+
+
 /*! \brief
  * This timer routine is used when
  * 'rr_persist' is set to RRP_NONE
@@ -248,19 +276,10 @@ static inline int nodb_timer(urecord_t* _r)
 
 	while(ptr) {
 		if (!VALID_CONTACT(ptr, act_time)) {
-			/* run callbacks for EXPIRE event */
-			if (exists_ulcb_type(UL_CONTACT_EXPIRE))
-				run_ul_callbacks( UL_CONTACT_EXPIRE, ptr);
-
-			LM_DBG("Binding '%.*s','%.*s' has expired\n",
-				ptr->aor->len, ZSW(ptr->aor->s),
-				ptr->c.len, ZSW(ptr->c.s));
-
 			t = ptr;
 			ptr = ptr->next;
 
-			mem_delete_ucontact(_r, t);
-			update_stat( _r->slot->d->expires, 1);
+			timer_expire_ucontact(_r, t);
 		} else {
 			ptr = ptr->next;
 		}
@@ -312,7 +331,7 @@ static inline int ALLOW_UNUSED wt_timer(urecord_t* _r)
 /*! \brief
  * Write-back timer
  */
-static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
+static inline int wb_timer(urecord_t* _r,query_list_t **ins_list, int batch)
 {
 	ucontact_t* ptr, *t;
 	cstate_t old_state;
@@ -372,6 +391,14 @@ static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 				break;
 
 			case 1: /* insert */
+				if (batch) {
+					if (db_batch_ucontact(ptr, old_state) < 0) {
+						LM_ERR("batching contact for database failed\n");
+						ptr->state = old_state;
+					}
+					break;
+				}
+
 				if (db_insert_ucontact(ptr,ins_list,0) < 0) {
 					LM_ERR("inserting contact into database failed\n");
 					ptr->state = old_state;
@@ -381,6 +408,14 @@ static inline int wb_timer(urecord_t* _r,query_list_t **ins_list)
 				break;
 
 			case 2: /* update */
+				if (batch) {
+					if (db_batch_ucontact(ptr, old_state) < 0) {
+						LM_ERR("batching contact for database failed\n");
+						ptr->state = old_state;
+					}
+					break;
+				}
+
 				if (db_update_ucontact(ptr) < 0) {
 					LM_ERR("updating contact in db failed\n");
 					ptr->state = old_state;
@@ -406,7 +441,7 @@ static inline int db_only_timer(urecord_t* _r) {
 		return -1;
 	}
 
-	if (wb_timer(_r, 0) < 0) {
+	if (wb_timer(_r, 0, 0) < 0) {
 		LM_ERR("failed to sync with db\n");
 		return -1;
 	}
@@ -437,7 +472,7 @@ int timer_urecord(urecord_t* _r,query_list_t **ins_list)
 	case RRP_LOAD_FROM_SQL:
 		/* use also the write_back timer routine to handle the failed
 		 * realtime inserts/updates */
-		return wb_timer(_r, ins_list); /* wt_timer(_r); */
+		return wb_timer(_r, ins_list, ul_flush_batch); /* wt_timer(_r); */
 	default:
 		return 0; /* Makes gcc happy */
 	}
@@ -928,6 +963,9 @@ int delete_ucontact(urecord_t* _r, struct ucontact* _c, char is_replicated)
 			if (db_only_timer(_r) < 0)
 				LM_ERR("failed to sync with db\n");
 		}
+	} else if (_r->slot) {
+		/* the timer will remove it, sooner */
+		slot_exp_update(_r->slot, _c);
 	}
 
 	return 0;
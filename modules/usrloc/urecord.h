@@ -95,6 +95,12 @@ void mem_remove_ucontact(urecord_t* _r, ucontact_t* _c);
 void mem_delete_ucontact(urecord_t* _r, ucontact_t* _c);
 
 
+/*
+ * Expire a contact of a memory-only record (timer)
+ */
+void timer_expire_ucontact(urecord_t* _r, ucontact_t* _c);
+
+
 /*
  * Timer handler
  */
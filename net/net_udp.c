@@ -24,7 +24,10 @@
  *  2015-02-09  first version (bogdan)
  */
 
-
+#ifdef __OS_linux
+#define _GNU_SOURCE /* we need this for sched_setaffinity() */
+#include <sched.h>
+#endif
 #include <unistd.h>
 
 #include "../ipc.h"
@@ -179,6 +182,14 @@ int udp_init_listener(struct socket_info *si, int status_flags)
 		LM_ERR("setsockopt: %s\n", strerror(errno));
 		goto error;
 	}
+#ifdef SO_REUSEPORT
+	/* sharded listener - each UDP worker will bind its own socket */
+	if (is_reuse_port(si) && setsockopt(si->socket, SOL_SOCKET, SO_REUSEPORT,
+					(void*)&optval, sizeof(optval)) ==-1){
+		LM_ERR("setsockopt(SO_REUSEPORT): %s\n", strerror(errno));
+		goto error;
+	}
+#endif
 	/* tos */
 	optval=tos;
 	if (setsockopt(si->socket, IPPROTO_IP, IP_TOS, (void*)&optval,
@@ -308,6 +319,45 @@ inline static int handle_io(struct fd_map* fm, int idx,int event_type)
 }
 
 
+/* Called in the UDP worker @rank (0 based) of a listener, right after fork.
+ * For a sharded (reuse_port) listener, all the workers except the first one
+ * replace the shared socket (in their private copy of the listener) with
+ * their own SO_REUSEPORT socket, opened by trans_init_all_listeners(), so
+ * both reading and sending are done via the private socket. The first worker
+ * keeps reading the shared socket, which also belongs to the group. */
+static int udp_init_worker_socket(struct socket_info *si, int rank)
+{
+#ifdef __OS_linux
+	cpu_set_t cpus;
+	int ncpus;
+
+	if (si->flags & SI_PIN_WORKERS) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpus > 0) {
+			CPU_ZERO(&cpus);
+			CPU_SET(rank % ncpus, &cpus);
+			if (sched_setaffinity(0, sizeof cpus, &cpus) < 0)
+				LM_WARN("failed to pin UDP worker %d of <%.*s> to CPU %d: "
+					"%s\n", rank, si->sock_str.len, si->sock_str.s,
+					rank % ncpus, strerror(errno));
+			else
+				LM_DBG("UDP worker %d of <%.*s> pinned to CPU %d\n",
+					rank, si->sock_str.len, si->sock_str.s, rank % ncpus);
+		}
+	}
+#endif
+
+	if (!si->worker_sockets || rank == 0)
+		return 0;
+
+	si->socket = si->worker_sockets[rank];
+
+	LM_DBG("UDP worker %d of <%.*s> uses private socket %d\n",
+		rank, si->sock_str.len, si->sock_str.s, si->socket);
+	return 0;
+}
+
+
 int udp_proc_reactor_init( struct socket_info *si )
 {
 
@@ -463,7 +513,8 @@ int udp_start_processes(int *chd_rank, int *startup_done)
 					bind_address=si; /* shortcut */
 					/* we first need to init the reactor to be able to add fd
 					 * into it in child_init routines */
-					if (udp_proc_reactor_init(si) < 0 ||
+					if (udp_init_worker_socket(si, i) < 0 ||
+							udp_proc_reactor_init(si) < 0 ||
 							init_child(*chd_rank) < 0) {
 						report_failure_status();
 						if (*chd_rank == 1 && startup_done)
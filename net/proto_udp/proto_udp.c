@@ -24,6 +24,7 @@
  *  2015-02-11  first version (bogdan)
  */
 
+#define _GNU_SOURCE /* we need this for recvmmsg() and sendmmsg() */
 #include <errno.h>
 #include <unistd.h>
 #include <netinet/tcp.h>
@@ -34,6 +35,8 @@
 #include "../../timer.h"
 #include "../../socket_info.h"
 #include "../../receive.h"
+#include "../../statistics.h"
+#include "../../ut.h"
 #include "../api_proto.h"
 #include "../api_proto_net.h"
 #include "../net_udp.h"
@@ -47,11 +50,65 @@ static int proto_udp_send(struct socket_info* send_sock,
 		char* buf, unsigned int len, union sockaddr_union* to, int id);
 
 static int udp_read_req(struct socket_info *src, int* bytes_read);
+static int udp_add_listener_batch(modparam_t type, void *val);
+static unsigned long udp_batch_avg_fill(void *foo);
 
 static callback_list* cb_list = NULL;
 
 static int udp_port = SIP_PORT;
 
+/* how many datagrams to pull per read event via recvmmsg();
+ * 0 or 1 means the classic one-datagram-per-recvfrom() mode */
+static int udp_recv_batch = 0;
+
+/* upper limit of the batch size - each slot costs a BUF_SIZE pkg buffer */
+#define UDP_MAX_RECV_BATCH  64
+#define UDP_MAX_SEND_BATCH  1024
+
+/* per-listener batch size, as set via the "listener_recv_batch" modparam */
+struct udp_batch_sock {
+	str sock_name;
+	struct socket_info *si;
+	int size;
+	/* receiving ring, lazily allocated in the worker reading the socket */
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	union sockaddr_union *from;
+	char *bufs;
+	struct udp_batch_sock *next;
+};
+
+static struct udp_batch_sock *udp_batch_socks = NULL;
+
+/* how many outgoing datagrams may be coalesced into one sendmmsg() call;
+ * 0 or 1 means each datagram is sent right away via sendto() */
+static int udp_send_batch = 0;
+
+/* bytes available for holding the copies of the queued datagrams */
+#define UDP_SEND_QUEUE_BYTES  (256*1024)
+
+/* per-process queue of the outgoing datagrams, filled in only while a
+ * batch window (see udp_send_batch_start()) is open and only with the
+ * datagrams whose sending result is not needed (see udp_send_batch_defer()) */
+struct udp_send_queue {
+	int depth;
+	int defer;
+	int used;
+	unsigned int bytes;
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	union sockaddr_union *to;
+	int *fds;
+	char *buf;
+};
+
+static struct udp_send_queue udp_sq;
+
+static stat_var *rcv_batches = NULL;
+static stat_var *rcv_batch_msgs = NULL;
+static stat_var *snd_batches = NULL;
+static stat_var *snd_batch_msgs = NULL;
+
 
 static cmd_export_t cmds[] = {
 	{"proto_init", (cmd_function)proto_udp_init, {{0,0,0}}, 0},
@@ -60,10 +117,24 @@ static cmd_export_t cmds[] = {
 
 
 static param_export_t params[] = {
-	{ "udp_port",    INT_PARAM,   &udp_port   },
+	{ "udp_port",            INT_PARAM,   &udp_port   },
+	{ "recv_batch_size",     INT_PARAM,   &udp_recv_batch },
+	{ "listener_recv_batch", STR_PARAM|USE_FUNC_PARAM,
+		(void*)udp_add_listener_batch },
+	{ "send_batch_size",     INT_PARAM,   &udp_send_batch },
 	{0, 0, 0}
 };
 
+static stat_export_t mod_stats[] = {
+	{"udp_rcv_batches",       0,             &rcv_batches    },
+	{"udp_rcv_batch_msgs",    0,             &rcv_batch_msgs },
+	{"udp_rcv_batch_avg_fill",STAT_IS_FUNC,
+		(stat_var**)udp_batch_avg_fill },
+	{"udp_snd_batches",       0,             &snd_batches    },
+	{"udp_snd_batch_msgs",    0,             &snd_batch_msgs },
+	{0,0,0}
+};
+
 
 struct module_exports proto_udp_exports = {
 	PROTO_PREFIX "udp",  /* module name*/
@@ -75,7 +146,7 @@ struct module_exports proto_udp_exports = {
 	cmds,       /* exported functions */
 	0,          /* exported async functions */
 	params,     /* module parameters */
-	0,          /* exported statistics */
+	mod_stats,  /* exported statistics */
 	0,          /* exported MI functions */
 	0,          /* exported pseudo-variables */
 	0,			/* exported transformations */
@@ -92,10 +163,91 @@ struct module_exports proto_udp_exports = {
 static int mod_init(void)
 {
 	LM_INFO("initializing UDP-plain protocol\n");
+
+	if (udp_recv_batch<0 || udp_recv_batch>UDP_MAX_RECV_BATCH) {
+		LM_ERR("invalid recv_batch_size %d, accepted range is 0..%d\n",
+			udp_recv_batch, UDP_MAX_RECV_BATCH);
+		return -1;
+	}
+	if (udp_send_batch<0 || udp_send_batch>UDP_MAX_SEND_BATCH) {
+		LM_ERR("invalid send_batch_size %d, accepted range is 0..%d\n",
+			udp_send_batch, UDP_MAX_SEND_BATCH);
+		return -1;
+	}
+#ifndef __OS_linux
+	if (udp_recv_batch>1 || udp_batch_socks) {
+		LM_WARN("batched UDP receiving is not supported on this OS, "
+			"falling back to one datagram per read\n");
+		udp_recv_batch = 0;
+	}
+	if (udp_send_batch>1) {
+		LM_WARN("batched UDP sending is not supported on this OS, "
+			"falling back to one datagram per send\n");
+		udp_send_batch = 0;
+	}
+#endif
+
 	return 0;
 }
 
 
+/* format of the param is "socket=batch_size", e.g. "udp:1.2.3.4:5060=32";
+ * the socket may be given also as its tag */
+static int udp_add_listener_batch(modparam_t type, void *val)
+{
+	struct udp_batch_sock *bs;
+	str s, num;
+	char *p;
+	unsigned int size;
+
+	s.s = (char*)val;
+	s.len = strlen(s.s);
+
+	p = q_memrchr(s.s, '=', s.len);
+	if (!p) {
+		LM_ERR("missing '=' in listener batch definition <%s>\n", s.s);
+		return -1;
+	}
+
+	num.s = p + 1;
+	num.len = s.s + s.len - num.s;
+	s.len = p - s.s;
+	trim(&s);
+	trim(&num);
+
+	if (s.len==0 || str2int(&num, &size)<0 || size>UDP_MAX_RECV_BATCH) {
+		LM_ERR("invalid listener batch definition <%s>, the batch size "
+			"must be in the 0..%d range\n", (char*)val, UDP_MAX_RECV_BATCH);
+		return -1;
+	}
+
+	bs = pkg_malloc(sizeof *bs + s.len);
+	if (!bs) {
+		LM_ERR("out of pkg memory\n");
+		return -1;
+	}
+	memset(bs, 0, sizeof *bs);
+
+	bs->sock_name.s = (char*)(bs + 1);
+	bs->sock_name.len = s.len;
+	memcpy(bs->sock_name.s, s.s, s.len);
+	bs->size = size;
+
+	bs->next = udp_batch_socks;
+	udp_batch_socks = bs;
+
+	return 0;
+}
+
+
+static unsigned long udp_batch_avg_fill(void *foo)
+{
+	unsigned long batches = get_stat_val(rcv_batches);
+
+	return batches ? get_stat_val(rcv_batch_msgs) / batches : 0;
+}
+
+
 static int proto_udp_init(struct proto_info *pi)
 {
 	pi->id					= PROTO_UDP;
@@ -114,21 +266,184 @@ static int proto_udp_init(struct proto_info *pi)
 
 static int proto_udp_init_listener(struct socket_info *si)
 {
+	struct udp_batch_sock *bs;
+
+	/* bind the per-listener batch sizes to the actual sockets; the list
+	 * is inherited by all the UDP workers forked later on */
+	for (bs = udp_batch_socks; bs; bs = bs->next)
+		if (!bs->si && (str_match(&bs->sock_name, &si->sock_str) ||
+		(si->tag_sock_str.len && str_match(&bs->sock_name,&si->tag_sock_str))))
+			bs->si = si;
+
 	/* we do not do anything particular to UDP plain here, so
 	 * transparently use the generic listener init from net UDP layer */
 	return udp_init_listener(si, O_NONBLOCK);
 }
 
 
+/* pushes one received datagram (already 0-terminated) to the upper layers */
+static inline void udp_handle_datagram(struct socket_info *si,
+					char *buf, int len, struct receive_info *ri)
+{
+	callback_list* p;
+	str msg;
+
+	ri->bind_address = si;
+	ri->dst_port = si->port_no;
+	ri->dst_ip = si->address;
+	ri->proto = si->proto;
+	ri->proto_reserved1 = ri->proto_reserved2 = 0;
+
+	su2ip_addr(&ri->src_ip, &ri->src_su);
+	ri->src_port=su_getport(&ri->src_su);
+
+	msg.s = buf;
+	msg.len = len;
+
+	/* run callbacks if looks like non-SIP message*/
+	if( !isalpha(msg.s[0]) ){    /* not-SIP related */
+		for(p = cb_list; p; p = p->next){
+			if(p->b == msg.s[1]){
+				if (p->func(si->socket, ri, &msg, p->param)==0){
+					/* buffer consumed by callback */
+					break;
+				}
+			}
+		}
+		if (p) return;
+	}
+
+	if (ri->src_port==0){
+		LM_INFO("dropping 0 port packet from %s\n", ip_addr2a(&ri->src_ip));
+		return;
+	}
+
+	receive_msg( msg.s, msg.len, ri, NULL, 0);
+}
+
+
+#ifdef __OS_linux
+/* returns the batch definition to be used for reading from the socket,
+ * or NULL if the socket is to be read one datagram at a time */
+static struct udp_batch_sock* udp_get_batch_sock(struct socket_info *si)
+{
+	static struct udp_batch_sock *last = NULL;
+	struct udp_batch_sock *bs;
+	int i;
+
+	if (last && last->si==si)
+		return last;
+
+	for (bs = udp_batch_socks; bs; bs = bs->next)
+		if (bs->si==si)
+			break;
+
+	if (!bs) {
+		if (udp_recv_batch<=1)
+			return NULL;
+
+		/* use the global batch size for this listener */
+		bs = pkg_malloc(sizeof *bs);
+		if (!bs) {
+			LM_ERR("out of pkg memory\n");
+			return NULL;
+		}
+		memset(bs, 0, sizeof *bs);
+		bs->si = si;
+		bs->size = udp_recv_batch;
+		bs->next = udp_batch_socks;
+		udp_batch_socks = bs;
+	}
+
+	if (bs->size<=1)
+		goto done;
+
+	if (!bs->msgs) {
+		bs->msgs = pkg_malloc(bs->size * (sizeof *bs->msgs +
+			sizeof *bs->iov + sizeof *bs->from + BUF_SIZE+1));
+		if (!bs->msgs) {
+			LM_ERR("no more pkg memory for a %d slots receiving ring, "
+				"reading one datagram at a time\n", bs->size);
+			bs->size = 0;
+			goto done;
+		}
+		bs->iov = (struct iovec*)(bs->msgs + bs->size);
+		bs->from = (union sockaddr_union*)(bs->iov + bs->size);
+		bs->bufs = (char*)(bs->from + bs->size);
+
+		memset(bs->msgs, 0, bs->size * sizeof *bs->msgs);
+		for (i = 0; i < bs->size; i++) {
+			bs->iov[i].iov_base = bs->bufs + i*(BUF_SIZE+1);
+			bs->iov[i].iov_len = BUF_SIZE;
+			bs->msgs[i].msg_hdr.msg_iov = &bs->iov[i];
+			bs->msgs[i].msg_hdr.msg_iovlen = 1;
+			bs->msgs[i].msg_hdr.msg_name = &bs->from[i].s;
+		}
+	}
+
+done:
+	last = bs;
+	return bs->size>1 ? bs : NULL;
+}
+
+
+/* drains up to bs->size datagrams with a single syscall */
+static int udp_read_batch(struct socket_info *si, struct udp_batch_sock *bs)
+{
+	struct receive_info ri;
+	unsigned int fromlen;
+	char *buf;
+	int i, n, len;
+
+	fromlen = sockaddru_len(si->su);
+	for (i = 0; i < bs->size; i++)
+		bs->msgs[i].msg_hdr.msg_namelen = fromlen;
+
+	n = recvmmsg(si->socket, bs->msgs, bs->size, MSG_DONTWAIT, NULL);
+	if (n==-1){
+		if (errno==EAGAIN)
+			return 0;
+		if ((errno==EINTR)||(errno==EWOULDBLOCK)|| (errno==ECONNREFUSED))
+			return -1;
+		LM_ERR("recvmmsg:[%d] %s\n", errno, strerror(errno));
+		return -2;
+	}
+
+	update_stat(rcv_batches, 1);
+	update_stat(rcv_batch_msgs, n);
+
+	for (i = 0; i < n; i++) {
+		len = bs->msgs[i].msg_len;
+		if (len<MIN_UDP_PACKET) {
+			LM_DBG("probing packet received len = %d\n", len);
+			continue;
+		}
+
+		buf = bs->iov[i].iov_base;
+		/* we must 0-term the messages, receive_msg expects it */
+		buf[len]=0;
+
+		memcpy(&ri.src_su, &bs->from[i], sizeof ri.src_su);
+		udp_handle_datagram(si, buf, len, &ri);
+	}
+
+	return 0;
+}
+#endif
+
+
 static int udp_read_req(struct socket_info *si, int* bytes_read)
 {
 	struct receive_info ri;
 	int len;
 	static char buf [BUF_SIZE+1];
-	char *tmp;
 	unsigned int fromlen;
-	callback_list* p;
-	str msg;
+#ifdef __OS_linux
+	struct udp_batch_sock *bs;
+
+	if ((bs = udp_get_batch_sock(si))!=NULL)
+		return udp_read_batch(si, bs);
+#endif
 
 	fromlen=sockaddru_len(si->su);
 	/* coverity[overrun-buffer-arg: FALSE] - union has 28 bytes, CID #200029 */
@@ -150,41 +465,140 @@ static int udp_read_req(struct socket_info *si, int* bytes_read)
 	/* we must 0-term the messages, receive_msg expects it */
 	buf[len]=0; /* no need to save the previous char */
 
-	ri.bind_address = si;
-	ri.dst_port = si->port_no;
-	ri.dst_ip = si->address;
-	ri.proto = si->proto;
-	ri.proto_reserved1 = ri.proto_reserved2 = 0;
+	udp_handle_datagram(si, buf, len, &ri);
 
-	su2ip_addr(&ri.src_ip, &ri.src_su);
-	ri.src_port=su_getport(&ri.src_su);
+	return 0;
+}
 
-	msg.s = buf;
-	msg.len = len;
 
-	/* run callbacks if looks like non-SIP message*/
-	if( !isalpha(msg.s[0]) ){    /* not-SIP related */
-		for(p = cb_list; p; p = p->next){
-			if(p->b == msg.s[1]){
-				if (p->func(bind_address->socket, &ri, &msg, p->param)==0){
-					/* buffer consumed by callback */
-					break;
-				}
+#ifdef __OS_linux
+/* sends out all the queued datagrams; datagrams going out via the same
+ * socket are pushed with a single sendmmsg() call */
+static void udp_send_queue_flush(void)
+{
+	int i, j, n;
+
+	for (i = 0; i < udp_sq.used; i = j) {
+		for (j = i + 1; j < udp_sq.used && udp_sq.fds[j]==udp_sq.fds[i]; j++);
+
+		while (i < j) {
+			n = sendmmsg(udp_sq.fds[i], &udp_sq.msgs[i], j - i, 0);
+			if (n==-1) {
+				if (errno==EINTR || errno==EAGAIN)
+					continue;
+				/* the error refers to the first datagram, skip it */
+				LM_ERR("sendmmsg(sock,%p,%d,0,%s:%hu): %s(%d)\n",
+					udp_sq.iov[i].iov_base, (int)udp_sq.iov[i].iov_len,
+					inet_ntoa(udp_sq.to[i].sin.sin_addr),
+					ntohs(udp_sq.to[i].sin.sin_port), strerror(errno), errno);
+				n = 1;
+			} else {
+				update_stat(snd_batches, 1);
+				update_stat(snd_batch_msgs, n);
 			}
+			i += n;
 		}
-		if (p) return 0;
 	}
 
-	if (ri.src_port==0){
-		tmp=ip_addr2a(&ri.src_ip);
-		LM_INFO("dropping 0 port packet from %s\n", tmp);
+	udp_sq.used = 0;
+	udp_sq.bytes = 0;
+}
+
+
+/* queues a copy of the datagram for a later sendmmsg();
+ * returns 0 if the datagram is to be sent right away */
+static int udp_send_queue_add(struct socket_info *source,
+					char *buf, unsigned int len, union sockaddr_union *to)
+{
+	struct mmsghdr *m;
+	int i;
+
+	if (len > UDP_SEND_QUEUE_BYTES)
 		return 0;
+
+	if (!udp_sq.msgs) {
+		udp_sq.msgs = pkg_malloc(udp_send_batch * (sizeof *udp_sq.msgs +
+			sizeof *udp_sq.iov + sizeof *udp_sq.to + sizeof *udp_sq.fds)
+			+ UDP_SEND_QUEUE_BYTES);
+		if (!udp_sq.msgs) {
+			LM_ERR("no more pkg memory for the send queue, sending "
+				"one datagram at a time\n");
+			udp_send_batch = 0;
+			return 0;
+		}
+		udp_sq.iov = (struct iovec*)(udp_sq.msgs + udp_send_batch);
+		udp_sq.to = (union sockaddr_union*)(udp_sq.iov + udp_send_batch);
+		udp_sq.fds = (int*)(udp_sq.to + udp_send_batch);
+		udp_sq.buf = (char*)(udp_sq.fds + udp_send_batch);
+
+		memset(udp_sq.msgs, 0, udp_send_batch * sizeof *udp_sq.msgs);
+		for (i = 0; i < udp_send_batch; i++) {
+			udp_sq.msgs[i].msg_hdr.msg_iov = &udp_sq.iov[i];
+			udp_sq.msgs[i].msg_hdr.msg_iovlen = 1;
+			udp_sq.msgs[i].msg_hdr.msg_name = &udp_sq.to[i].s;
+		}
 	}
 
-	/* receive_msg must free buf too!*/
-	receive_msg( msg.s, msg.len, &ri, NULL, 0);
+	if (udp_sq.used==udp_send_batch ||
+	udp_sq.bytes + len > UDP_SEND_QUEUE_BYTES)
+		udp_send_queue_flush();
 
-	return 0;
+	i = udp_sq.used++;
+	m = &udp_sq.msgs[i];
+
+	udp_sq.iov[i].iov_base = udp_sq.buf + udp_sq.bytes;
+	udp_sq.iov[i].iov_len = len;
+	memcpy(udp_sq.iov[i].iov_base, buf, len);
+	udp_sq.bytes += len;
+
+	memcpy(&udp_sq.to[i], to, sizeof *to);
+	m->msg_hdr.msg_namelen = sockaddru_len(*to);
+	udp_sq.fds[i] = source->socket;
+
+	return 1;
+}
+#endif
+
+
+/*! \brief
+ * Opens a batching window for the outgoing UDP datagrams of the current
+ * process: until the matching udp_send_batch_flush(), the datagrams are
+ * queued and later pushed out with as few sendmmsg() calls as possible.
+ * Windows may be nested, only the outermost flush sends out the datagrams.
+ * Only the datagrams sent under udp_send_batch_defer() are queued.
+ */
+void udp_send_batch_start(void)
+{
+	if (udp_send_batch>1)
+		udp_sq.depth++;
+}
+
+
+/*! \brief
+ * Marks the datagrams sent from now on (until turned off again) as not
+ * needing a send result, like the retransmissions, so they may be queued
+ * if a batching window is open. Their send errors are only logged at flush
+ * time, the sender seeing them as successful.
+ */
+void udp_send_batch_defer(int on)
+{
+	udp_sq.defer = on;
+}
+
+
+/*! \brief
+ * Closes a batching window opened via udp_send_batch_start()
+ */
+void udp_send_batch_flush(void)
+{
+	if (udp_sq.depth==0)
+		return;
+
+	if (--udp_sq.depth==0 && udp_sq.used) {
+#ifdef __OS_linux
+		udp_send_queue_flush();
+#endif
+	}
 }
 
 
@@ -202,6 +616,12 @@ static int proto_udp_send(struct socket_info* source,
 {
 	int n, tolen;
 
+#ifdef __OS_linux
+	if (udp_sq.depth && udp_sq.defer &&
+	udp_send_queue_add(source, buf, len, to))
+		return len;
+#endif
+
 	tolen=sockaddru_len(*to);
 again:
 	n=sendto(source->socket, buf, len, 0, &to->s, tolen);
@@ -38,5 +38,10 @@ typedef struct cb_list{
 
 int register_udprecv_cb(udp_rcv_cb_f* func, void* param, char a, char b);
 
+/* batching of the outgoing UDP datagrams (see "send_batch_size") */
+void udp_send_batch_start(void);
+void udp_send_batch_defer(int on);
+void udp_send_batch_flush(void);
+
 
 #endif
@@ -224,6 +224,39 @@ error:
 }
 
 
+/* opens the SO_REUSEPORT socket of each UDP worker of a sharded listener,
+ * all in the same group as the (already opened) shared socket. This must be
+ * done here, by the main process, as the workers are forked only after the
+ * privileges are dropped */
+static int trans_init_worker_sockets(struct proto_info *pi,
+													struct socket_info *si)
+{
+	int shared_fd, i;
+
+	si->worker_sockets = pkg_malloc(si->workers * sizeof *si->worker_sockets);
+	if (!si->worker_sockets) {
+		LM_ERR("no more pkg mem\n");
+		return -1;
+	}
+
+	shared_fd = si->socket;
+	si->worker_sockets[0] = shared_fd;
+
+	for (i = 1; i < si->workers; i++) {
+		if (pi->tran.init_listener(si) < 0) {
+			LM_ERR("failed to bind the socket of UDP worker %d on <%.*s>\n",
+				i, si->sock_str.len, si->sock_str.s);
+			si->socket = shared_fd;
+			return -1;
+		}
+		si->worker_sockets[i] = si->socket;
+	}
+
+	si->socket = shared_fd;
+	return 0;
+}
+
+
 int trans_init_all_listeners(void)
 {
 	struct socket_info *si;
@@ -238,6 +271,9 @@ int trans_init_all_listeners(void)
 						protos[i].name );
 					return -1;
 				}
+				if (is_reuse_port(si) && si->workers > 1 &&
+				trans_init_worker_sockets(&protos[i], si) < 0)
+					return -1;
 				/* set first IPv4 and IPv6 listeners for this proto */
 				if ((si->address.af==AF_INET) &&
 				(!protos[i].sendipv4 || (protos[i].sendipv4->flags&SI_IS_LO)))
@@ -0,0 +1,335 @@
+/*
+ * Lazily built lookup index over the parsed headers of a SIP message
+ *
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The index is created on the first lookup and, on each following lookup,
+ * it is extended with the headers parsed (appended to msg->headers) in the
+ * meantime, so there is no cost for the messages which are never searched.
+ * Every header is chained both with the other headers of the same type and
+ * with the other headers having the same (case-insensitive) name, so the
+ * first/last header of a type or name is found in O(1), and the N-th one
+ * by walking only the headers of that type or name.
+ *
+ * The index lives in pkg memory, so it is never built for the messages
+ * cloned in shm (FL_SHM_CLONE) - the lookups fall back to walking the list.
+ */
+
+#include "../mem/mem.h"
+#include "../hash_func.h"
+#include "msg_parser.h"
+
+#define HDR_IDX_BUCKETS   16
+#define HDR_IDX_MIN_SIZE  32
+
+struct hdr_idx_node {
+	struct hdr_field *hf;
+	int next_type;  /* next node with the same type */
+	int next_name;  /* next node with the same name */
+};
+
+struct hdr_idx_chain {
+	int first;
+	int last;
+	int count;
+};
+
+struct hdr_idx_name {
+	unsigned int hash;
+	struct hdr_idx_chain chain;
+	int next;       /* next name in the same bucket */
+};
+
+struct hdr_index {
+	struct hdr_field *headers;  /* the list the index was built for */
+	struct hdr_field *last;     /* last indexed header */
+	int size;
+	int nodes_no;
+	int names_no;
+	struct hdr_idx_chain types[HDR_EOH_T];
+	int buckets[HDR_IDX_BUCKETS];
+	struct hdr_idx_node *nodes;
+	struct hdr_idx_name *names;
+};
+
+
+static inline int hdr_idx_name_match(struct hdr_index *idx,
+				struct hdr_idx_name *n, unsigned int hash, char *s, unsigned int len)
+{
+	struct hdr_field *hf = idx->nodes[n->chain.first].hf;
+
+	return n->hash==hash && hf->name.len==len &&
+		strncasecmp(hf->name.s, s, len)==0;
+}
+
+
+static struct hdr_idx_name *hdr_idx_find_name(struct hdr_index *idx,
+								unsigned int hash, char *s, unsigned int len)
+{
+	int i;
+
+	for (i = idx->buckets[hash & (HDR_IDX_BUCKETS-1)]; i >= 0;
+	i = idx->names[i].next)
+		if (hdr_idx_name_match(idx, &idx->names[i], hash, s, len))
+			return &idx->names[i];
+
+	return NULL;
+}
+
+
+static inline void hdr_idx_chain_add(struct hdr_idx_chain *c, int node,
+										int *prev_link)
+{
+	if (c->count++ == 0)
+		c->first = node;
+	else
+		*prev_link = node;
+	c->last = node;
+}
+
+
+static void hdr_idx_add(struct hdr_index *idx, struct hdr_field *hf)
+{
+	struct hdr_idx_node *node;
+	struct hdr_idx_name *name;
+	unsigned int hash;
+	int i, b;
+
+	i = idx->nodes_no++;
+	node = &idx->nodes[i];
+	node->hf = hf;
+	node->next_type = node->next_name = -1;
+
+	if (hf->type >= 0 && hf->type < HDR_EOH_T)
+		hdr_idx_chain_add(&idx->types[hf->type], i,
+			&idx->nodes[idx->types[hf->type].last].next_type);
+
+	hash = core_case_hash(&hf->name, NULL, 0);
+	name = hdr_idx_find_name(idx, hash, hf->name.s, hf->name.len);
+	if (!name) {
+		b = hash & (HDR_IDX_BUCKETS-1);
+		name = &idx->names[idx->names_no];
+		name->hash = hash;
+		name->chain.count = name->chain.last = 0;
+		name->next = idx->buckets[b];
+		idx->buckets[b] = idx->names_no++;
+	}
+	hdr_idx_chain_add(&name->chain, i,
+		&idx->nodes[name->chain.last].next_name);
+}
+
+
+/* returns the index of the message, up to date with msg->headers,
+ * or NULL if no index may be used for this message */
+static struct hdr_index *get_hdr_index(struct sip_msg *msg)
+{
+	struct hdr_index *idx = msg->hdr_idx;
+	struct hdr_field *hf, *start;
+	int n, size;
+
+	if (msg->msg_flags & FL_SHM_CLONE)
+		return NULL;
+
+	/* the header list was rebuilt in the meantime */
+	if (idx && idx->headers != msg->headers) {
+		free_hdr_index(msg);
+		idx = NULL;
+	}
+
+	start = idx ? (idx->last ? idx->last->next : msg->headers) : msg->headers;
+	if (!start)
+		return idx;
+
+	for (n = 0, hf = start; hf; hf = hf->next)
+		n++;
+
+	if (!idx || idx->nodes_no + n > idx->size) {
+		size = idx ? idx->nodes_no + n : n;
+		size = size < HDR_IDX_MIN_SIZE ? HDR_IDX_MIN_SIZE : 2 * size;
+
+		idx = pkg_realloc(idx, sizeof *idx +
+			size * (sizeof *idx->nodes + sizeof *idx->names));
+		if (!idx) {
+			LM_ERR("no more pkg memory for the headers index\n");
+			free_hdr_index(msg);
+			return NULL;
+		}
+
+		if (!msg->hdr_idx) {
+			memset(idx, 0, sizeof *idx);
+			memset(idx->buckets, -1, sizeof idx->buckets);
+			idx->headers = msg->headers;
+		} else if (idx->names_no) {
+			/* the names follow the nodes in the same block */
+			memmove((struct hdr_idx_node *)(idx + 1) + size,
+				(struct hdr_idx_node *)(idx + 1) + idx->size,
+				idx->names_no * sizeof *idx->names);
+		}
+
+		idx->size = size;
+		idx->nodes = (struct hdr_idx_node *)(idx + 1);
+		idx->names = (struct hdr_idx_name *)(idx->nodes + size);
+		msg->hdr_idx = idx;
+	}
+
+	for (hf = start; hf; hf = hf->next) {
+		hdr_idx_add(idx, hf);
+		idx->last = hf;
+	}
+
+	return idx;
+}
+
+
+void free_hdr_index(struct sip_msg *msg)
+{
+	if (msg->hdr_idx) {
+		pkg_free(msg->hdr_idx);
+		msg->hdr_idx = NULL;
+	}
+}
+
+
+/* N-th node of the chain; negative indexes count from the end */
+static inline struct hdr_field *hdr_idx_nth(struct hdr_index *idx,
+								struct hdr_idx_chain *c, int n, int by_type)
+{
+	int i;
+
+	if (n < 0)
+		n += c->count;
+	if (n < 0 || n >= c->count)
+		return NULL;
+	if (n == c->count - 1)
+		return idx->nodes[c->last].hf;
+
+	for (i = c->first; n > 0; n--)
+		i = by_type ? idx->nodes[i].next_type : idx->nodes[i].next_name;
+
+	return idx->nodes[i].hf;
+}
+
+
+struct hdr_field *get_hdr_by_type_idx(struct sip_msg *msg,
+											hdr_types_t type, int n)
+{
+	struct hdr_index *idx;
+	struct hdr_field *hf;
+	int cnt;
+
+	if (type < 0 || type >= HDR_EOH_T)
+		return NULL;
+
+	if ((idx = get_hdr_index(msg)) != NULL)
+		return hdr_idx_nth(idx, &idx->types[type], n, 1);
+
+	/* no index available, walk the list */
+	if (n < 0) {
+		for (cnt = 0, hf = msg->headers; hf; hf = hf->next)
+			if (hf->type == type)
+				cnt++;
+		n += cnt;
+		if (n < 0)
+			return NULL;
+	}
+	for (hf = msg->headers; hf; hf = hf->next)
+		if (hf->type == type && n-- == 0)
+			return hf;
+
+	return NULL;
+}
+
+
+struct hdr_field *get_hdr_by_name_idx(struct sip_msg *msg,
+										char *s, unsigned int len, int n)
+{
+	struct hdr_index *idx;
+	struct hdr_idx_name *name;
+	struct hdr_field *hf;
+	str sname;
+	int cnt;
+
+	if ((idx = get_hdr_index(msg)) != NULL) {
+		sname.s = s;
+		sname.len = len;
+		name = hdr_idx_find_name(idx, core_case_hash(&sname, NULL, 0), s, len);
+		return name ? hdr_idx_nth(idx, &name->chain, n, 0) : NULL;
+	}
+
+	/* no index available, walk the list */
+	if (n < 0) {
+		for (cnt = 0, hf = msg->headers; hf; hf = hf->next)
+			if (len==hf->name.len && strncasecmp(hf->name.s, s, len)==0)
+				cnt++;
+		n += cnt;
+		if (n < 0)
+			return NULL;
+	}
+	for (hf = msg->headers; hf; hf = hf->next)
+		if (len==hf->name.len && strncasecmp(hf->name.s, s, len)==0
+		&& n-- == 0)
+			return hf;
+
+	return NULL;
+}
+
+
+int get_hdr_count_by_type(struct sip_msg *msg, hdr_types_t type)
+{
+	struct hdr_index *idx;
+	struct hdr_field *hf;
+	int cnt;
+
+	if (type < 0 || type >= HDR_EOH_T)
+		return 0;
+
+	if ((idx = get_hdr_index(msg)) != NULL)
+		return idx->types[type].count;
+
+	for (cnt = 0, hf = msg->headers; hf; hf = hf->next)
+		if (hf->type == type)
+			cnt++;
+
+	return cnt;
+}
+
+
+int get_hdr_count_by_name(struct sip_msg *msg, char *s, unsigned int len)
+{
+	struct hdr_index *idx;
+	struct hdr_idx_name *name;
+	struct hdr_field *hf;
+	str sname;
+	int cnt;
+
+	if ((idx = get_hdr_index(msg)) != NULL) {
+		sname.s = s;
+		sname.len = len;
+		name = hdr_idx_find_name(idx, core_case_hash(&sname, NULL, 0), s, len);
+		return name ? name->chain.count : 0;
+	}
+
+	for (cnt = 0, hf = msg->headers; hf; hf = hf->next)
+		if (len==hf->name.len && strncasecmp(hf->name.s, s, len)==0)
+			cnt++;
+
+	return cnt;
+}
@@ -0,0 +1,208 @@
+/*
+ * Vectorized scanning primitives for the SIP header parser
+ *
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The SSE2 / AVX2 kernels are compiled via the "target" function attribute,
+ * so no special compiler flags are required, and are picked at runtime,
+ * based on the CPU features. All the kernels load only whole 16/32 bytes
+ * blocks which are entirely inside the [p, end) buffer - the remaining
+ * tail is always handled by the scalar code, so we never read past @end.
+ */
+
+#include "../dprint.h"
+#include "hdr_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HDR_SCAN_X86
+#include <immintrin.h>
+#endif
+
+static char *scan_lf_resolve(char *p, char *end);
+static char *scan_name_resolve(char *p, char *end);
+
+hdr_scan_f hdr_scan_lf = scan_lf_resolve;
+hdr_scan_f hdr_scan_name = scan_name_resolve;
+
+
+static char *scan_lf_scalar(char *p, char *end)
+{
+	for (; p < end; p++)
+		if (*p == '\n')
+			return p;
+	return NULL;
+}
+
+static char *scan_name_scalar(char *p, char *end)
+{
+	for (; p < end; p++)
+		if (*p == ':' || *p == ' ' || *p == '\t')
+			return p;
+	return end;
+}
+
+
+#ifdef HDR_SCAN_X86
+__attribute__((target("sse2")))
+static char *scan_lf_sse2(char *p, char *end)
+{
+	const __m128i lf = _mm_set1_epi8('\n');
+	__m128i v;
+	int m;
+
+	for (; end - p >= 16; p += 16) {
+		v = _mm_loadu_si128((const __m128i *)p);
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+		if (m)
+			return p + __builtin_ctz(m);
+	}
+
+	return scan_lf_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static char *scan_name_sse2(char *p, char *end)
+{
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	__m128i v;
+	int m;
+
+	for (; end - p >= 16; p += 16) {
+		v = _mm_loadu_si128((const __m128i *)p);
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, colon),
+			_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab))));
+		if (m)
+			return p + __builtin_ctz(m);
+	}
+
+	return scan_name_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static char *scan_lf_avx2(char *p, char *end)
+{
+	const __m256i lf = _mm256_set1_epi8('\n');
+	__m256i v;
+	unsigned int m;
+
+	for (; end - p >= 32; p += 32) {
+		v = _mm256_loadu_si256((const __m256i *)p);
+		m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf));
+		if (m)
+			return p + __builtin_ctz(m);
+	}
+
+	return scan_lf_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static char *scan_name_avx2(char *p, char *end)
+{
+	const __m256i colon = _mm256_set1_epi8(':');
+	const __m256i sp = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	__m256i v;
+	unsigned int m;
+
+	for (; end - p >= 32; p += 32) {
+		v = _mm256_loadu_si256((const __m256i *)p);
+		m = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, colon), _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab))));
+		if (m)
+			return p + __builtin_ctz(m);
+	}
+
+	return scan_name_sse2(p, end);
+}
+#endif /* HDR_SCAN_X86 */
+
+
+enum hdr_scan_impl hdr_scan_init(enum hdr_scan_impl impl)
+{
+#ifdef HDR_SCAN_X86
+	__builtin_cpu_init();
+
+	if (impl == HDR_SCAN_AUTO)
+		impl = __builtin_cpu_supports("avx2") ? HDR_SCAN_AVX2 :
+			(__builtin_cpu_supports("sse2") ? HDR_SCAN_SSE2 : HDR_SCAN_SCALAR);
+	else if (impl == HDR_SCAN_AVX2 && !__builtin_cpu_supports("avx2"))
+		impl = HDR_SCAN_SSE2;
+
+	if (impl == HDR_SCAN_SSE2 && !__builtin_cpu_supports("sse2"))
+		impl = HDR_SCAN_SCALAR;
+
+	switch (impl) {
+	case HDR_SCAN_AVX2:
+		hdr_scan_lf = scan_lf_avx2;
+		hdr_scan_name = scan_name_avx2;
+		break;
+	case HDR_SCAN_SSE2:
+		hdr_scan_lf = scan_lf_sse2;
+		hdr_scan_name = scan_name_sse2;
+		break;
+	default:
+		impl = HDR_SCAN_SCALAR;
+		hdr_scan_lf = scan_lf_scalar;
+		hdr_scan_name = scan_name_scalar;
+	}
+#else
+	impl = HDR_SCAN_SCALAR;
+	hdr_scan_lf = scan_lf_scalar;
+	hdr_scan_name = scan_name_scalar;
+#endif
+
+	LM_DBG("using the %s header scanning kernels\n", hdr_scan_impl_name(impl));
+	return impl;
+}
+
+
+const char *hdr_scan_impl_name(enum hdr_scan_impl impl)
+{
+	switch (impl) {
+	case HDR_SCAN_AUTO:
+		return "auto";
+	case HDR_SCAN_SCALAR:
+		return "scalar";
+	case HDR_SCAN_SSE2:
+		return "SSE2";
+	case HDR_SCAN_AVX2:
+		return "AVX2";
+	}
+
+	return "unknown";
+}
+
+
+static char *scan_lf_resolve(char *p, char *end)
+{
+	hdr_scan_init(HDR_SCAN_AUTO);
+	return hdr_scan_lf(p, end);
+}
+
+static char *scan_name_resolve(char *p, char *end)
+{
+	hdr_scan_init(HDR_SCAN_AUTO);
+	return hdr_scan_name(p, end);
+}
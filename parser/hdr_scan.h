@@ -0,0 +1,57 @@
+/*
+ * Vectorized scanning primitives for the SIP header parser
+ *
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef HDR_SCAN_H
+#define HDR_SCAN_H
+
+enum hdr_scan_impl {
+	HDR_SCAN_AUTO,    /* best one supported by the running CPU */
+	HDR_SCAN_SCALAR,
+	HDR_SCAN_SSE2,
+	HDR_SCAN_AVX2,
+};
+
+typedef char* (*hdr_scan_f)(char *p, char *end);
+
+/*
+ * Returns the first '\n' within [p, end), or NULL if none.
+ * Used to find the end of the header fields which are not parsed in place.
+ */
+extern hdr_scan_f hdr_scan_lf;
+
+/*
+ * Returns the first ':', ' ' or '\t' within [p, end), or @end if none.
+ * Used to find the end of the unknown header names.
+ */
+extern hdr_scan_f hdr_scan_name;
+
+/*
+ * Selects the scanning kernels. The kernels are resolved on first use to
+ * HDR_SCAN_AUTO, so this is only needed for forcing an implementation
+ * (e.g. for benchmarking). Returns the selected implementation, which may
+ * differ from the requested one if the CPU does not support it.
+ */
+enum hdr_scan_impl hdr_scan_init(enum hdr_scan_impl impl);
+
+const char *hdr_scan_impl_name(enum hdr_scan_impl impl);
+
+#endif /* HDR_SCAN_H */
@@ -46,12 +46,14 @@
 #include "../dprint.h"
 #include "../data_lump_rpl.h"
 #include "../mem/mem.h"
+#include "../mem/msg_arena.h"
 #include "../error.h"
 #include "../globals.h"
 #include "../core_stats.h"
 #include "../errinfo.h"
 #include "../dset.h"
 #include "parse_hname2.h"
+#include "hdr_scan.h"
 #include "parse_uri.h"
 #include "parse_content.h"
 #include "../msg_callbacks.h"
@@ -107,7 +109,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 			/* keep number of vias parsed -- we want to report it in
 			   replies for diagnostic purposes */
 			via_cnt++;
-			vb=pkg_malloc(sizeof(struct via_body));
+			vb=msg_arena_malloc(sizeof(struct via_body));
 			if (vb==0){
 				LM_ERR("out of pkg memory\n");
 				goto error;
@@ -129,7 +131,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 			hdr->body.len=tmp-hdr->body.s;
 			break;
 		case HDR_CSEQ_T:
-			cseq_b=pkg_malloc(sizeof(struct cseq_body));
+			cseq_b=msg_arena_malloc(sizeof(struct cseq_body));
 			if (cseq_b==0){
 				LM_ERR("out of pkg memory\n");
 				goto error;
@@ -139,7 +141,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 			tmp=parse_cseq(tmp, end, cseq_b);
 			if (cseq_b->error==PARSE_ERROR){
 				LM_ERR("bad cseq\n");
-				pkg_free(cseq_b);
+				msg_arena_free(cseq_b);
 				set_err_info(OSER_EC_PARSER, OSER_EL_MEDIUM,
 					"error parsing CSeq`");
 				set_err_reply(400, "bad CSeq header");
@@ -153,7 +155,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 					cseq_b->method.len, cseq_b->method.s);
 			break;
 		case HDR_TO_T:
-			to_b=pkg_malloc(sizeof(struct to_body));
+			to_b=msg_arena_malloc(sizeof(struct to_body));
 			if (to_b==0){
 				LM_ERR("out of pkg memory\n");
 				goto error;
@@ -163,7 +165,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 			tmp=parse_to(tmp, end,to_b);
 			if (to_b->error==PARSE_ERROR){
 				LM_ERR("bad to header\n");
-				pkg_free(to_b);
+				msg_arena_free(to_b);
 				set_err_info(OSER_EC_PARSER, OSER_EL_MEDIUM,
 					"error parsing To header");
 				set_err_reply(400, "bad header");
@@ -235,7 +237,7 @@ char* get_hdr_field(char* buf, char* end, struct hdr_field* hdr)
 			/* find end of header */
 			/* find lf */
 			do{
-				match=q_memchr(tmp, '\n', end-tmp);
+				match=hdr_scan_lf(tmp, end);
 				if (match){
 					match++;
 				}else {
@@ -291,6 +293,7 @@ int parse_headers(struct sip_msg* msg, hdr_flags_t flags, int next)
 	char* rest;
 	char* end;
 	hdr_flags_t orig_flag;
+	int arena;
 
 #define link_sibling_hdr(_hook, _hdr) \
 	do{ \
@@ -310,9 +313,12 @@ int parse_headers(struct sip_msg* msg, hdr_flags_t flags, int next)
 	}else
 		orig_flag=0;
 
+	/* everything parsed here dies along with the message */
+	arena = msg_arena_enter(msg);
+
 	LM_DBG("flags=%llx\n", (unsigned long long)flags);
 	while( tmp<end && (flags & msg->parsed_flag) != flags){
-		hf=pkg_malloc(sizeof(struct hdr_field));
+		hf=msg_arena_malloc(sizeof(struct hdr_field));
 		if (hf==0){
 			ser_error=E_OUT_OF_MEM;
 			LM_ERR("pkg memory allocation failed\n");
@@ -328,7 +334,7 @@ int parse_headers(struct sip_msg* msg, hdr_flags_t flags, int next)
 			case HDR_EOH_T:
 				msg->eoh=tmp; /* or rest?*/
 				msg->parsed_flag|=HDR_EOH_F;
-				pkg_free(hf);
+				msg_arena_free(hf);
 				goto skip;
 			case HDR_OTHER_T: /*do nothing*/
 				break;
@@ -539,12 +545,14 @@ int parse_headers(struct sip_msg* msg, hdr_flags_t flags, int next)
 	}
 skip:
 	msg->unparsed=tmp;
+	msg_arena_leave(arena);
 	return 0;
 
 error:
 	ser_error=E_BAD_REQ;
-	if (hf) pkg_free(hf);
+	if (hf) msg_arena_free(hf);
 	if (next) msg->parsed_flag |= orig_flag;
+	msg_arena_leave(arena);
 	return -1;
 }
 
@@ -823,6 +831,7 @@ void free_sip_msg(struct sip_msg* msg)
 {
 	if (msg->msg_cb)
 		msg_callback_process(msg, MSG_DESTROY, NULL);
+	free_hdr_index(msg);
 	if (msg->new_uri.s)
 		pkg_free(msg->new_uri.s);
 	if (msg->set_global_address.s)
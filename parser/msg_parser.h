@@ -333,6 +333,9 @@ struct sip_msg {
 	str set_global_port;
 
 	struct msg_callback *msg_cb;
+
+	/* lookup index over the parsed headers, built on demand */
+	struct hdr_index *hdr_idx;
 };
 
 
@@ -462,6 +465,20 @@ inline static int get_callid(struct sip_msg* _m, str* _cid)
 }
 
 
+/*
+ * Lookups through the already parsed headers (no parsing done), by type or
+ * by (case-insensitive) name. The N-th header is returned, where a negative
+ * N counts from the end (-1 is the last one). They use an index built on
+ * demand over msg->headers (see parser/hdr_index.c).
+ */
+struct hdr_field *get_hdr_by_type_idx(struct sip_msg *msg,
+		hdr_types_t type, int n);
+struct hdr_field *get_hdr_by_name_idx(struct sip_msg *msg,
+		char *s, unsigned int len, int n);
+int get_hdr_count_by_type(struct sip_msg *msg, hdr_types_t type);
+int get_hdr_count_by_name(struct sip_msg *msg, char *s, unsigned int len);
+void free_hdr_index(struct sip_msg *msg);
+
 /*
  * Search through already parsed headers (no parsing done) a non-standard
  * header - all known headers are skipped!
@@ -471,13 +488,7 @@ inline static int get_callid(struct sip_msg* _m, str* _cid)
 inline static struct hdr_field *get_header_by_name( struct sip_msg *msg,
 													char *s, unsigned int len)
 {
-	struct hdr_field *hdr;
-
-	for( hdr=msg->headers ; hdr ; hdr=hdr->next ) {
-		if(len==hdr->name.len && strncasecmp(hdr->name.s,s,len)==0)
-			return hdr;
-	}
-	return NULL;
+	return get_hdr_by_name_idx(msg, s, len, 0);
 }
 
 
@@ -30,6 +30,7 @@
 
 #include "parse_hname2.h"
 #include "keys.h"
+#include "hdr_scan.h"
 #include "../ut.h"  /* q_memchr */
 
 #define LOWER_BYTE(b) ((b) | 0x20)
@@ -237,10 +238,11 @@ char* parse_hname2(char* begin, char* end, struct hdr_field* hdr)
  other:
 	/* Unknown header type */
 	hdr->type = HDR_OTHER_T;
-	/* if overflow during the "switch-case" parsing, the "while" will
-	 * exit and we will fall in the "error" section */
-	while ( p < end ) {
-		switch (*p) {
+	/* if overflow during the "switch-case" parsing, the scan will
+	 * return end and we will fall in the "error" section */
+	if (p < end) {
+		p = hdr_scan_name(p, end);
+		switch (p < end ? *p : 0) {
 			case ':' :
 				hdr->name.len = p - hdr->name.s;
 				return (p + 1);
@@ -252,7 +254,6 @@ char* parse_hname2(char* begin, char* end, struct hdr_field* hdr)
 					goto error;
 				return (p+1);
 		}
-		p++;
 	}
 
  error:
@@ -34,6 +34,7 @@
 #include "parse_uri.h"
 #include "../ut.h"
 #include "../mem/mem.h"
+#include "../mem/msg_arena.h"
 #include "../errinfo.h"
 
 
@@ -71,7 +72,7 @@ void free_to_params(struct to_body* tb)
 	struct to_param *foo;
 	while (tp){
 		foo = tp->next;
-		pkg_free(tp);
+		msg_arena_free(tp);
 		tp=foo;
 	}
 
@@ -84,7 +85,7 @@ void free_to(struct to_body* tb)
 	if (tb) {
 		free_to( tb->next );
 		free_to_params(tb);
-		pkg_free(tb);
+		msg_arena_free(tb);
 	}
 }
 
@@ -284,7 +285,7 @@ static inline char* parse_to_param(char *buffer, char *end,
 						add_param(param,to_b);
 					case E_PARA_VALUE:
 						param = (struct to_param*)
-							pkg_malloc(sizeof(struct to_param));
+							msg_arena_malloc(sizeof(struct to_param));
 						if (!param){
 							LM_ERR("out of pkg memory\n" );
 							goto error;
@@ -464,7 +465,7 @@ endofheader:
 				goto parse_error;
 			add_param(param, to_b);
 		} else {
-			pkg_free(param);
+			msg_arena_free(param);
 		}
 	}
 	*returned_status=saved_status;
@@ -474,7 +475,7 @@ parse_error:
 	LM_ERR("unexpected char [%c] in status %d: <<%.*s>> .\n",
 		*tmp,status, (int)(tmp-buffer), ZSW(buffer));
 error:
-	if (param) pkg_free(param);
+	if (param) msg_arena_free(param);
 	free_to_params(to_b);
 	to_b->error=PARSE_ERROR;
 	*returned_status = status;
@@ -614,7 +615,7 @@ static inline char* _parse_to(char* buffer, char *end, struct to_body *to_b,
 						if (multi==0)
 							goto parse_error;
 						to_b->next = (struct to_body*)
-							pkg_malloc(sizeof(struct to_body));
+							msg_arena_malloc(sizeof(struct to_body));
 						if (to_b->next==NULL) {
 							LM_ERR("failed to allocate new TO body\n");
 							goto error;
@@ -729,7 +730,7 @@ static inline char* _parse_to(char* buffer, char *end, struct to_body *to_b,
 						if (to_b->error!=PARSE_ERROR && multi && *tmp==',') {
 							/* continue with a new body instance */
 							to_b->next = (struct to_body*)
-								pkg_malloc(sizeof(struct to_body));
+								msg_arena_malloc(sizeof(struct to_body));
 							if (to_b->next==NULL) {
 								LM_ERR("failed to allocate new TO body\n");
 								goto error;
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <tap.h>
+
+#include "../../str.h"
+#include "../../ut.h"
+#include "../../trim.h"
+
+#include "../msg_parser.h"
+
+static str test_msg = str_init(
+	"INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP p1.example.com;branch=z9hG4bK1\r\n"
+	"X-Tag: one\r\n"
+	"Via: SIP/2.0/UDP p2.example.com;branch=z9hG4bK2\r\n"
+	"To: Bob <sip:bob@biloxi.example.com>\r\n"
+	"x-tag: two\r\n"
+	"From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+	"v: SIP/2.0/UDP p3.example.com;branch=z9hG4bK3\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"X-TAG: three\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n");
+
+static int body_is(struct hdr_field *hf, const char *s)
+{
+	if (!hf)
+		return 0;
+
+	trim(&hf->body);
+	return str_match(&hf->body, _str(s));
+}
+
+void test_hdr_index(void)
+{
+	struct sip_msg msg;
+	struct hdr_field *hf;
+
+	memset(&msg, 0, sizeof msg);
+	msg.buf = test_msg.s;
+	msg.len = test_msg.len;
+
+	/* parse only up to the To header, so the index must catch up later */
+	ok(parse_headers(&msg, HDR_TO_F, 0) == 0, "hidx-1");
+	ok(get_hdr_count_by_type(&msg, HDR_VIA_T) == 2, "hidx-2");
+	ok(get_hdr_count_by_name(&msg, "x-tag", 5) == 1, "hidx-3");
+
+	ok(parse_headers(&msg, HDR_EOH_F, 0) == 0, "hidx-4");
+	ok(get_hdr_count_by_type(&msg, HDR_VIA_T) == 3, "hidx-5");
+	ok(get_hdr_count_by_name(&msg, "X-Tag", 5) == 3, "hidx-6");
+	ok(get_hdr_count_by_name(&msg, "Via", 3) == 2, "hidx-7");
+	ok(get_hdr_count_by_name(&msg, "X-None", 6) == 0, "hidx-8");
+
+	hf = get_hdr_by_type_idx(&msg, HDR_VIA_T, 0);
+	ok(hf && hf == msg.h_via1, "hidx-9");
+	hf = get_hdr_by_type_idx(&msg, HDR_VIA_T, 2);
+	ok(hf && hf->name.len == 1, "hidx-10");
+	ok(get_hdr_by_type_idx(&msg, HDR_VIA_T, -1) == hf, "hidx-11");
+	ok(get_hdr_by_type_idx(&msg, HDR_VIA_T, 3) == NULL, "hidx-12");
+	ok(get_hdr_by_type_idx(&msg, HDR_VIA_T, -4) == NULL, "hidx-13");
+
+	ok(body_is(get_hdr_by_name_idx(&msg, "x-tag", 5, 0), "one"), "hidx-14");
+	ok(body_is(get_hdr_by_name_idx(&msg, "X-TAG", 5, 1), "two"), "hidx-15");
+	ok(body_is(get_hdr_by_name_idx(&msg, "X-Tag", 5, -1), "three"), "hidx-16");
+	ok(body_is(get_hdr_by_name_idx(&msg, "X-Tag", 5, -3), "one"), "hidx-17");
+	ok(get_hdr_by_name_idx(&msg, "X-Tag", 5, 3) == NULL, "hidx-18");
+	ok(body_is(get_header_by_name(&msg, "x-TAG", 5), "one"), "hidx-19");
+	ok(get_header_by_name(&msg, "X-Ta", 4) == NULL, "hidx-20");
+
+	free_sip_msg(&msg);
+	ok(msg.hdr_idx == NULL, "hidx-21");
+}
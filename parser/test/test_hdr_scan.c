@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <time.h>
+#include <tap.h>
+
+#include "../../str.h"
+#include "../../ut.h"
+
+#include "../msg_parser.h"
+#include "../hdr_scan.h"
+
+#include "test_oob.h"
+
+#define HDR_SCAN_BENCH_LOOPS 20000
+
+static const str corpus[] = {
+	str_init(
+	"INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds\r\n"
+	"Via: SIP/2.0/UDP 10.0.0.10:5060;received=192.0.2.101;branch=z9hG4bKnashds8\r\n"
+	"Max-Forwards: 70\r\n"
+	"To: Bob <sip:bob@biloxi.example.com>\r\n"
+	"From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Contact: <sip:alice@pc33.atlanta.example.com>\r\n"
+	"Record-Route: <sip:p1.example.com;lr>\r\n"
+	"Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE\r\n"
+	"Supported: replaces, timer, 100rel\r\n"
+	"Session-Expires: 1800;refresher=uac\r\n"
+	"P-Asserted-Identity: \"Alice\" <sip:+15551234567@atlanta.example.com>\r\n"
+	"X-Account-Code: 0123456789abcdef0123456789abcdef\r\n"
+	"X-Billing-Correlation-Identifier: 7a1f8e2c-5b6d-4e3a-9f0b-1c2d3e4f5a6b\r\n"
+	"User-Agent: Example SoftPhone 4.2.1 (Linux x86_64)\r\n"
+	"Content-Type: application/sdp\r\n"
+	"Content-Length: 142\r\n"
+	"\r\n"
+	"v=0\r\n"
+	"o=alice 2890844526 2890844526 IN IP4 pc33.atlanta.example.com\r\n"
+	"s=-\r\n"
+	"c=IN IP4 192.0.2.101\r\n"
+	"t=0 0\r\n"
+	"m=audio 49172 RTP/AVP 0\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"),
+	str_init(
+	"REGISTER sip:registrar.biloxi.example.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP bobspc.biloxi.example.com:5060;branch=z9hG4bKnashds7\r\n"
+	"Max-Forwards: 70\r\n"
+	"To: Bob <sip:bob@biloxi.example.com>\r\n"
+	"From: Bob <sip:bob@biloxi.example.com>;tag=456248\r\n"
+	"Call-ID: 843817637684230@998sdasdh09\r\n"
+	"CSeq: 1826 REGISTER\r\n"
+	"Contact: <sip:bob@192.0.2.4;transport=udp>;expires=3600;"
+		"+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-000A95A0E128>\"\r\n"
+	"Authorization: Digest username=\"bob\", realm=\"biloxi.example.com\",\r\n"
+	"  nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+		"uri=\"sip:registrar.biloxi.example.com\",\r\n"
+	"  response=\"6629fae49393a05397450978507c4ef1\", algorithm=MD5\r\n"
+	"Path: <sip:edge1.biloxi.example.com;lr>\r\n"
+	"Supported: path, outbound, gruu\r\n"
+	"User-Agent: Example Deskphone/1.0\r\n"
+	"Expires: 3600\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n"),
+	str_init(
+	"SIP/2.0 200 OK\r\n"
+	"Via: SIP/2.0/UDP server10.biloxi.example.com;branch=z9hG4bK4b43c2ff8.1"
+		";received=192.0.2.3\r\n"
+	"Via: SIP/2.0/UDP bigbox3.site3.atlanta.example.com;branch=z9hG4bK77ef4c2312983.1"
+		";received=192.0.2.2\r\n"
+	"Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds"
+		";received=192.0.2.1\r\n"
+	"Record-Route: <sip:server10.biloxi.example.com;lr>, "
+		"<sip:bigbox3.site3.atlanta.example.com;lr>\r\n"
+	"To: Bob <sip:bob@biloxi.example.com>;tag=a6c85cf\r\n"
+	"From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Contact: <sip:bob@192.0.2.4>\r\n"
+	"Server: Example Gateway 2.0\r\n"
+	"X-Trace-Id: 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n"),
+	STR_NULL
+};
+
+static char *ref_scan_lf(char *p, char *end)
+{
+	for (; p < end; p++)
+		if (*p == '\n')
+			return p;
+	return NULL;
+}
+
+static char *ref_scan_name(char *p, char *end)
+{
+	for (; p < end; p++)
+		if (*p == ':' || *p == ' ' || *p == '\t')
+			return p;
+	return end;
+}
+
+static void test_hdr_scan_oob(const str *tstr, enum oob_position where,
+		void *farg)
+{
+	hdr_scan_lf(tstr->s, tstr->s + tstr->len);
+	hdr_scan_name(tstr->s, tstr->s + tstr->len);
+	ok(1, OOB_CHECK_OK_MSG("hdr_scan", tstr, where));
+}
+
+static int count_headers(const str *m)
+{
+	struct sip_msg msg;
+	struct hdr_field *hf;
+	int n = -1;
+
+	memset(&msg, 0, sizeof msg);
+	msg.buf = m->s;
+	msg.len = m->len;
+
+	if (parse_msg(msg.buf, msg.len, &msg) == 0) {
+		for (n = 0, hf = msg.headers; hf; hf = hf->next)
+			n++;
+	}
+
+	free_sip_msg(&msg);
+	return n;
+}
+
+/* average parsing time of the corpus messages, in ns/msg */
+static double bench_parse(void)
+{
+	struct timespec start, stop;
+	int i, j, msgs = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < HDR_SCAN_BENCH_LOOPS; i++)
+		for (j = 0; corpus[j].s; j++, msgs++)
+			count_headers(&corpus[j]);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	return ((stop.tv_sec - start.tv_sec) * 1e9 +
+		(stop.tv_nsec - start.tv_nsec)) / msgs;
+}
+
+void test_hdr_scan(void)
+{
+	static const enum hdr_scan_impl impls[] =
+		{HDR_SCAN_SCALAR, HDR_SCAN_SSE2, HDR_SCAN_AVX2};
+	static const str oob_set[] = {
+		str_init("Via"),
+		str_init("X-Some-Rather-Long-Header-Name-Without-Colon"),
+		str_init("X-Long-Header-Name-Ending-In-A-Colon-Here-And-Now:"),
+		str_init("some header body which is longer than 32 bytes, no LF"),
+		str_init("some header body which is longer than 32 bytes + LF\n"),
+		STR_NULL
+	};
+	enum hdr_scan_impl impl;
+	int hdrs[3], i, j, k, bad_lf, bad_name;
+	char *p, *end;
+	double ns;
+
+	for (j = 0; corpus[j].s; j++)
+		hdrs[j] = count_headers(&corpus[j]);
+
+	for (i = 0; i < sizeof impls / sizeof *impls; i++) {
+		impl = hdr_scan_init(impls[i]);
+		if (impl != impls[i]) {
+			diag("%s header scanning not supported by the CPU, skipping",
+				hdr_scan_impl_name(impls[i]));
+			continue;
+		}
+
+		/* check the kernels against the naive scans from every offset */
+		for (j = 0; corpus[j].s; j++) {
+			end = corpus[j].s + corpus[j].len;
+			for (bad_lf = bad_name = 0, k = 0; k < corpus[j].len; k++) {
+				p = corpus[j].s + k;
+				if (hdr_scan_lf(p, end) != ref_scan_lf(p, end))
+					bad_lf++;
+				if (hdr_scan_name(p, end) != ref_scan_name(p, end))
+					bad_name++;
+			}
+
+			ok(bad_lf == 0, "hdr_scan_lf(%s) on msg #%d",
+				hdr_scan_impl_name(impl), j);
+			ok(bad_name == 0, "hdr_scan_name(%s) on msg #%d",
+				hdr_scan_impl_name(impl), j);
+			ok(count_headers(&corpus[j]) == hdrs[j],
+				"parse_msg(%s) on msg #%d: %d hdrs",
+				hdr_scan_impl_name(impl), j, hdrs[j]);
+		}
+
+		for (j = 0; oob_set[j].s; j++)
+			test_oob(&oob_set[j], test_hdr_scan_oob, NULL);
+
+		ns = bench_parse();
+		diag("header parsing with %s scanning: %.1f ns/msg",
+			hdr_scan_impl_name(impl), ns);
+	}
+
+	hdr_scan_init(HDR_SCAN_AUTO);
+}
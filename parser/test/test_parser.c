@@ -26,6 +26,8 @@
 #include "test_parse_fcaps.h"
 #include "test_parser.h"
 #include "test_parse_authenticate_body.h"
+#include "test_hdr_scan.h"
+#include "test_hdr_index.h"
 
 void test_parse_uri(void)
 {
@@ -116,4 +118,6 @@ void test_parser(void)
 	test_parse_fcaps();
 	test_parse_uri();
 	test_parse_authenticate_body();
+	test_hdr_scan();
+	test_hdr_index();
 }
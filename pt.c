@@ -89,6 +89,12 @@ int init_multi_proc_support(void)
 		pt[i].ipc_sync_pipe[0] = pt[i].ipc_sync_pipe[1] = -1;
 	}
 
+	/* one slot per process for the per-process statistics */
+	if (init_stat_shards( counted_max_processes ) != 0) {
+		LM_ERR("failed to allocate the per-process statistics\n");
+		return -1;
+	}
+
 	/* create the load-related stats (initially marked as hidden */
 	/* until the proc starts) */
 	if (register_processes_load_stats( counted_max_processes ) != 0) {
@@ -277,6 +283,7 @@ int internal_fork(char *proc_desc, unsigned int flags,
 		pt[new_idx].ipc_pipe[1]=pt[new_idx].ipc_pipe_holder[1];
 		pt[new_idx].ipc_sync_pipe[0]=pt[new_idx].ipc_sync_pipe_holder[0];
 		pt[new_idx].ipc_sync_pipe[1]=pt[new_idx].ipc_sync_pipe_holder[1];
+		ipc_reset_queue(new_idx);
 	}
 
 	pt[new_idx].pid = 0;
@@ -310,6 +317,7 @@ int internal_fork(char *proc_desc, unsigned int flags,
 		#endif
 		/* each children need a unique seed */
 		seed_child(seed);
+		shm_cache_enable();
 		init_log_level();
 
 		/* set attributes */
@@ -408,6 +416,9 @@ void dynamic_process_final_exit(void)
 	/* if a TCP proc by chance, reset the tcp-related data */
 	tcp_reset_worker_slot();
 
+	/* give back the shm chunks cached by this process */
+	shm_cache_flush();
+
 	/* mark myself as DYNAMIC (just in case) to have an err-less terminatio */
 	pt[process_no].flags |= OSS_PROC_SELFEXIT;
 	LM_INFO("doing self termination\n");
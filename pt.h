@@ -48,13 +48,17 @@ struct process_table {
 	/* various flags describing properties of this process */
 	unsigned int flags;
 
-	/* pipe used by the process to receive designated jobs (used by IPC)
+	/* pipe (or eventfd) used by the process to get notified about its
+	 * designated jobs (used by IPC)
 	 * [1] for writting into by other process,
 	 * [0] to listen on by this process */
 	int ipc_pipe[2];
 	/* same as above, but the holder used when the corresponding process
 	 * does not exist */
 	int ipc_pipe_holder[2];
+	/* shm queue holding the IPC jobs for this process; the ipc_pipe
+	 * only acts as a doorbell, rang when the process is idle */
+	struct ipc_queue *ipc_queue;
 
 	/* pipe used by the process to receive a synchronoys job
 	 * this pipe should only be used by a process to synchronously receive a
@@ -2427,27 +2427,18 @@ static int pv_get_hdr_prolog(struct sip_msg *msg,  pv_param_t *param, pv_value_t
 static int pv_get_hdrcnt(struct sip_msg *msg,  pv_param_t *param, pv_value_t *res)
 {
 	pv_value_t tv;
-	struct hdr_field *hf;
 	unsigned int n;
 	int ret;
 
 	if ( (ret=pv_get_hdr_prolog(msg,  param, res, &tv)) <= 0 )
 	    	return ret;
 
-	n = 0;
 	if (tv.flags==0) {
 		/* it is a known header -> use type to find it */
-		for (hf=msg->headers; hf; hf=hf->next) {
-			if (tv.ri==hf->type)
-			        ++n;
-		}
+		n = get_hdr_count_by_type(msg, tv.ri);
 	} else {
 		/* it is an un-known header -> use name to find it */
-		for (hf=msg->headers; hf; hf=hf->next) {
-			if (hf->type==HDR_OTHER_T && hf->name.len==tv.rs.len
-			&& strncasecmp(hf->name.s, tv.rs.s, hf->name.len)==0)
-				++n;
-		}
+		n = get_hdr_count_by_name(msg, tv.rs.s, tv.rs.len);
 	}
 	return pv_get_uintval(msg, param, res, n);
 }
@@ -2458,29 +2449,18 @@ static int pv_get_hdr(struct sip_msg *msg,  pv_param_t *param, pv_value_t *res)
 	int idxf;
 	pv_value_t tv;
 	struct hdr_field *hf;
-	struct hdr_field *hf0;
 	char *p;
-	int n;
 	int ret;
 
+#define get_nth_hdr(_n) \
+	(tv.flags==0 ? get_hdr_by_type_idx(msg, tv.ri, _n) : \
+		get_hdr_by_name_idx(msg, tv.rs.s, tv.rs.len, _n))
+
 	if ( (ret=pv_get_hdr_prolog(msg,  param, res, &tv)) <= 0 )
 	    	return ret;
 
-	if (tv.flags==0) {
-		/* it is a known header -> use type to find it */
-		for (hf=msg->headers; hf; hf=hf->next) {
-			if (tv.ri==hf->type)
-				break;
-		}
-	} else {
-		/* it is an un-known header -> use name to find it */
-		for (hf=msg->headers; hf; hf=hf->next) {
-			if (hf->type==HDR_OTHER_T && hf->name.len==tv.rs.len
-			&& strncasecmp(hf->name.s, tv.rs.s, hf->name.len)==0)
-				break;
-		}
-	}
-
+	/* known headers are found by type, the un-known ones by name */
+	hf = get_nth_hdr(0);
 	if(hf==NULL)
 		return pv_get_null(msg, param, res);
 	/* get the index */
@@ -2519,7 +2499,7 @@ static int pv_get_hdr(struct sip_msg *msg,  pv_param_t *param, pv_value_t *res)
 			}
 			memcpy(p, hf->body.s, hf->body.len);
 			p += hf->body.len;
-			/* next hf */
+			/* next hf - a single pass, even with no index */
 			if (tv.flags==0) {
 				/* it is a known header -> use type to find it */
 				for (hf=hf->next ; hf; hf=hf->next) {
@@ -2541,74 +2521,17 @@ static int pv_get_hdr(struct sip_msg *msg,  pv_param_t *param, pv_value_t *res)
 		return 0;
 	}
 
-	/* we have a numeric index */
-	hf0 = 0;
-	if(idx<0)
+	/* we have a numeric index (negative ones count from the end) */
+	hf = get_nth_hdr(idx);
+	if(hf!=NULL)
 	{
-		n = 1;
-		/* count headers */
-		if (tv.flags==0 ) {
-			/* it is a known header -> use type to find it */
-			for (hf0=hf->next; hf0; hf0=hf0->next) {
-				if (tv.ri==hf0->type)
-					n++;
-			}
-		} else {
-			/* it is an un-known header -> use name to find it */
-			for (hf0=hf->next; hf0; hf0=hf0->next) {
-				if (hf0->type==HDR_OTHER_T && hf0->name.len==tv.rs.len
-				&& strncasecmp(hf0->name.s, tv.rs.s, hf0->name.len)==0)
-					n++;
-			}
-		}
-
-		idx = -idx;
-		if(idx>n)
-		{
-			LM_DBG("index out of range\n");
-			return pv_get_null(msg, param, res);
-		}
-		idx = n - idx;
-		if(idx==0)
-		{
-			res->rs  = hf->body;
-			return 0;
-		}
-	}
-	n=0;
-	while(n<idx)
-	{
-		if (tv.flags==0) {
-			/* it is a known header -> use type to find it */
-			for (hf0=hf->next; hf0; hf0=hf0->next) {
-				if (tv.ri==hf0->type) {
-					n++;
-					if(n==idx) break;
-				}
-			}
-		} else {
-			/* it is an un-known header -> use name to find it */
-			for (hf0=hf->next; hf0; hf0=hf0->next) {
-				if (hf0->type==HDR_OTHER_T && hf0->name.len==tv.rs.len
-				&& strncasecmp(hf0->name.s, tv.rs.s, hf0->name.len)==0) {
-					n++;
-					if(n==idx) break;
-				}
-			}
-		}
-		if(hf0==NULL)
-			break;
-	}
-
-	if(hf0!=0)
-	{
-		res->rs  = hf0->body;
+		res->rs  = hf->body;
 		return 0;
 	}
 
 	LM_DBG("index out of range\n");
 	return pv_get_null(msg, param, res);
-
+#undef get_nth_hdr
 }
 
 static int pv_get_hdr_name(struct sip_msg *msg,  pv_param_t *param, pv_value_t *res)
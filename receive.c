@@ -53,6 +53,7 @@
 #include "forward.h"
 #include "action.h"
 #include "mem/mem.h"
+#include "mem/msg_arena.h"
 #include "ip_addr.h"
 #include "script_cb.h"
 #include "dset.h"
@@ -142,6 +143,10 @@ int receive_msg(char* buf, unsigned int len, struct receive_info* rcv_info,
 	msg->msg_flags=msg_flags;
 	msg->ruri_q = Q_UNSPECIFIED;
 
+	/* request-scoped parser data and lumps are carved from the msg arena;
+	 * if already in use (nested processing), simply stick to pkg */
+	msg_arena_bind(msg);
+
 	if (parse_msg(in_buff.s,len, msg)!=0){
 		tmp=ip_addr2a(&(rcv_info->src_ip));
 		LM_ERR("Unable to parse msg received from [%s:%d]\n",
@@ -290,6 +295,7 @@ end:
 	reset_avps();
 	LM_DBG("cleaning up\n");
 	free_sip_msg(msg);
+	msg_arena_release(msg);
 	pkg_free(msg);
 	if (in_buff.s != buf)
 		pkg_free(in_buff.s);
@@ -297,6 +303,7 @@ end:
 parse_error:
 	exec_parse_err_cb(msg);
 	free_sip_msg(msg);
+	msg_arena_release(msg);
 	pkg_free(msg);
 error:
 	if (in_buff.s != buf)
@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "route.h"
+#include "route_optimize.h"
+#include "hash_func.h"
+#include "dprint.h"
+#include "mem/mem.h"
+
+int script_optimize = 1;
+
+static int folded_exprs, indexed_switches;
+
+
+#define is_int_const(_e) \
+	((_e) && (_e)->type==ELEM_T && (_e)->left.type==NUMBERV_O)
+
+#define is_str_const(_e) \
+	((_e) && (_e)->type==ELEM_T && (_e)->left.type==STRINGV_O)
+
+#define is_bool_const(_e) \
+	((_e) && (_e)->type==ELEM_T && (_e)->left.type==NUMBER_O)
+
+
+/* turns @e into a boolean constant, as "if (1)" does */
+static void set_bool_const(struct expr *e, int v)
+{
+	e->type = ELEM_T;
+	e->op = NO_OP;
+	e->left.type = NUMBER_O;
+	e->left.v.data = NULL;
+	e->right.type = NUMBER_ST;
+	e->right.v.data = NULL;
+	e->right.v.n = !!v;
+}
+
+/* replaces @e with its child @c, dropping the @other one */
+static void replace_expr(struct expr *e, struct expr *c, struct expr *other)
+{
+	*e = *c;
+	pkg_free(c);
+	free_expr(other);
+}
+
+/* folds an arithmetic / string operation on two constants; the children of
+ * @e are already optimized */
+static void fold_value_expr(struct expr *e)
+{
+	struct expr *l = e->left.v.expr;
+	struct expr *r = (e->right.type==EXPR_ST) ? e->right.v.expr : NULL;
+	int lv, rv, ival;
+	char *s;
+
+	if (is_int_const(l) && e->op==BNOT_OP) {
+		ival = ~l->left.v.n;
+		goto int_done;
+	}
+
+	if (is_str_const(l) && is_str_const(r) && e->op==PLUS_OP) {
+		if (l->left.v.s.len + r->left.v.s.len == 0)
+			return;
+
+		s = pkg_malloc(l->left.v.s.len + r->left.v.s.len + 1);
+		if (!s) {
+			LM_ERR("oom, leaving the expression unfolded\n");
+			return;
+		}
+
+		memcpy(s, l->left.v.s.s, l->left.v.s.len);
+		memcpy(s + l->left.v.s.len, r->left.v.s.s, r->left.v.s.len);
+
+		e->left.v.s.s = s;
+		e->left.v.s.len = l->left.v.s.len + r->left.v.s.len;
+		s[e->left.v.s.len] = '\0';
+		e->left.type = STRINGV_O;
+		goto done;
+	}
+
+	if (!is_int_const(l) || !is_int_const(r))
+		return;
+
+	lv = l->left.v.n;
+	rv = r->left.v.n;
+
+	switch (e->op) {
+		case PLUS_OP:
+			ival = lv + rv;
+			break;
+		case MINUS_OP:
+			ival = lv - rv;
+			break;
+		case MULT_OP:
+			ival = lv * rv;
+			break;
+		case DIV_OP:
+			/* keep the runtime "divide by 0" error */
+			if (rv == 0)
+				return;
+			ival = lv / rv;
+			break;
+		case MODULO_OP:
+			if (rv == 0)
+				return;
+			ival = lv % rv;
+			break;
+		case BAND_OP:
+			ival = lv & rv;
+			break;
+		case BOR_OP:
+			ival = lv | rv;
+			break;
+		case BXOR_OP:
+			ival = lv ^ rv;
+			break;
+		case BLSHIFT_OP:
+			ival = lv << rv;
+			break;
+		case BRSHIFT_OP:
+			ival = lv >> rv;
+			break;
+		default:
+			return;
+	}
+
+int_done:
+	e->left.type = NUMBERV_O;
+	e->left.v.data = NULL;
+	e->left.v.n = ival;
+done:
+	e->op = VALUE_OP;
+	e->right.type = NOSUBTYPE;
+	e->right.v.data = NULL;
+	free_expr(l);
+	free_expr(r);
+	folded_exprs++;
+}
+
+/* folds the logical operators having a constant operand on the left side;
+ * constants on the right side are kept, as the left side may have effects */
+static void fold_logic_expr(struct expr *e)
+{
+	struct expr *l = e->left.v.expr;
+	struct expr *r = e->right.v.expr;
+
+	switch (e->op) {
+		case EVAL_OP:
+			/* parentheses are only needed by the parser */
+			replace_expr(e, l, NULL);
+			return;
+		case NOT_OP:
+			if (!is_bool_const(l))
+				return;
+			set_bool_const(e, !l->right.v.n);
+			free_expr(l);
+			break;
+		case AND_OP:
+			if (!is_bool_const(l))
+				return;
+			if (l->right.v.n) {
+				replace_expr(e, r, l);
+			} else {
+				set_bool_const(e, 0);
+				free_expr(l);
+				free_expr(r);
+			}
+			break;
+		case OR_OP:
+			if (!is_bool_const(l))
+				return;
+			if (l->right.v.n) {
+				set_bool_const(e, 1);
+				free_expr(l);
+				free_expr(r);
+			} else {
+				replace_expr(e, r, l);
+			}
+			break;
+		default:
+			return;
+	}
+
+	folded_exprs++;
+}
+
+
+void optimize_expr(struct expr *e)
+{
+	if (!e)
+		return;
+
+	if (e->type==EXP_T) {
+		optimize_expr(e->left.v.expr);
+		if (e->op==AND_OP || e->op==OR_OP)
+			optimize_expr(e->right.v.expr);
+
+		fold_logic_expr(e);
+	} else if (e->type==ELEM_T) {
+		if (e->left.type==ACTION_O)
+			optimize_actions((struct action*)e->right.v.data);
+
+		if (e->left.type==EXPR_O)
+			optimize_expr(e->left.v.expr);
+		if (e->right.type==EXPR_ST)
+			optimize_expr(e->right.v.expr);
+
+		if (e->left.type==EXPR_O)
+			fold_value_expr(e);
+	}
+}
+
+
+static int cmp_idx_num(const void *a, const void *b)
+{
+	const struct switch_idx_num *x = a, *y = b;
+
+	if (x->n != y->n)
+		return x->n < y->n ? -1 : 1;
+
+	/* equal values: the first case in the script wins */
+	return x->pos - y->pos;
+}
+
+struct switch_idx *build_switch_idx(struct action *cases)
+{
+	struct switch_idx *idx;
+	struct action *it;
+	int nums_no = 0, strs_no = 0, i;
+	unsigned int size, h;
+
+	for (it = cases; it; it = it->next) {
+		if ((unsigned char)it->type!=CASE_T)
+			continue;
+		if (it->elem[0].type==STR_ST)
+			strs_no++;
+		else
+			nums_no++;
+	}
+
+	if (nums_no + strs_no < SWITCH_IDX_MIN_CASES)
+		return NULL;
+
+	/* keep the string table at most half full */
+	for (size = 0; strs_no && size < 2 * strs_no; )
+		size = size ? size << 1 : 4;
+
+	idx = pkg_malloc(sizeof *idx + nums_no * sizeof *idx->nums +
+		size * sizeof *idx->strs);
+	if (!idx) {
+		LM_ERR("oom for a %d cases switch index\n", nums_no + strs_no);
+		return NULL;
+	}
+	memset(idx, 0, sizeof *idx + nums_no * sizeof *idx->nums +
+		size * sizeof *idx->strs);
+
+	idx->nums = (struct switch_idx_num *)(idx + 1);
+	idx->strs = (struct switch_idx_str *)(idx->nums + nums_no);
+	idx->strs_size = size;
+
+	for (i = 0, it = cases; it; it = it->next, i++) {
+		if ((unsigned char)it->type==DEFAULT_T) {
+			/* as the scan does, the last default wins */
+			idx->deflt = it;
+			continue;
+		}
+		if ((unsigned char)it->type!=CASE_T)
+			continue;
+
+		if (it->elem[0].type==STR_ST) {
+			h = core_case_hash(&it->elem[0].u.s, NULL, size);
+			for (; idx->strs[h].a; h = (h + 1) & (size - 1)) {
+				if (idx->strs[h].s.len==it->elem[0].u.s.len &&
+				strncasecmp(idx->strs[h].s.s, it->elem[0].u.s.s,
+				it->elem[0].u.s.len)==0)
+					break;
+			}
+			/* a duplicate case is never reached first */
+			if (idx->strs[h].a)
+				continue;
+
+			idx->strs[h].s = it->elem[0].u.s;
+			idx->strs[h].pos = i;
+			idx->strs[h].a = it;
+		} else {
+			idx->nums[idx->nums_no].n = it->elem[0].u.number;
+			idx->nums[idx->nums_no].pos = i;
+			idx->nums[idx->nums_no].a = it;
+			idx->nums_no++;
+		}
+	}
+
+	qsort(idx->nums, idx->nums_no, sizeof *idx->nums, cmp_idx_num);
+
+	return idx;
+}
+
+struct action *switch_idx_lookup(struct switch_idx *idx, pv_value_t *val)
+{
+	struct switch_idx_num *num = NULL;
+	struct switch_idx_str *st = NULL;
+	unsigned int h;
+	int lo, hi, mid;
+
+	if (val->flags & PV_VAL_INT) {
+		lo = 0;
+		hi = idx->nums_no - 1;
+		/* lowest position among the equal values */
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			if (idx->nums[mid].n < val->ri) {
+				lo = mid + 1;
+			} else {
+				if (idx->nums[mid].n == val->ri)
+					num = &idx->nums[mid];
+				hi = mid - 1;
+			}
+		}
+	}
+
+	if ((val->flags & PV_VAL_STR) && idx->strs_size) {
+		h = core_case_hash(&val->rs, NULL, idx->strs_size);
+		for (; idx->strs[h].a; h = (h + 1) & (idx->strs_size - 1)) {
+			if (idx->strs[h].s.len==val->rs.len &&
+			strncasecmp(idx->strs[h].s.s, val->rs.s, val->rs.len)==0) {
+				st = &idx->strs[h];
+				break;
+			}
+		}
+	}
+
+	if (num && st)
+		return num->pos < st->pos ? num->a : st->a;
+
+	return num ? num->a : (st ? st->a : NULL);
+}
+
+
+int optimize_actions(struct action *a)
+{
+	struct action *t;
+	int i;
+
+	for (t = a; t; t = t->next) {
+		for (i = 0; i < MAX_ACTION_ELEMS; i++) {
+			if (t->elem[i].type==EXPR_ST)
+				optimize_expr((struct expr*)t->elem[i].u.data);
+			else if (t->elem[i].type==ACTIONS_ST)
+				optimize_actions((struct action*)t->elem[i].u.data);
+		}
+
+		if ((unsigned char)t->type==SWITCH_T && t->elem[1].type==ACTIONS_ST
+		&& t->elem[2].type==NOSUBTYPE) {
+			t->elem[2].u.data = build_switch_idx(
+				(struct action*)t->elem[1].u.data);
+			if (t->elem[2].u.data) {
+				t->elem[2].type = SWITCH_IDX_ST;
+				indexed_switches++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+static int optimize_route_list(struct script_route *sr, int size, int start,
+																int stop_at_null)
+{
+	int i;
+
+	for (i = start; i < size; i++) {
+		if (!sr[i].a) {
+			if (stop_at_null)
+				break;
+			continue;
+		}
+
+		if (optimize_actions(sr[i].a) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int optimize_rls(void)
+{
+	int i;
+
+	if (!script_optimize)
+		return 0;
+
+	folded_exprs = indexed_switches = 0;
+
+	if (optimize_route_list(sroutes->request, RT_NO, 0, 0) < 0 ||
+	optimize_route_list(sroutes->onreply, ONREPLY_RT_NO, 0, 0) < 0 ||
+	optimize_route_list(sroutes->failure, FAILURE_RT_NO, 0, 0) < 0 ||
+	optimize_route_list(sroutes->branch, BRANCH_RT_NO, 0, 0) < 0 ||
+	optimize_route_list(&sroutes->error, 1, 0, 0) < 0 ||
+	optimize_route_list(&sroutes->local, 1, 0, 0) < 0 ||
+	optimize_route_list(&sroutes->startup, 1, 0, 0) < 0 ||
+	optimize_route_list(sroutes->event, EVENT_RT_NO, 1, 1) < 0)
+		return -1;
+
+	for (i = 0; i < TIMER_RT_NO && sroutes->timer[i].a; i++)
+		if (optimize_actions(sroutes->timer[i].a) < 0)
+			return -1;
+
+	LM_DBG("folded %d constant expressions, indexed %d switch statements\n",
+		folded_exprs, indexed_switches);
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Post-fixup optimization pass over the parsed routing script:
+ *  - constant sub-expressions (e.g. "$var(t) = 60 * 60 * 24;" or
+ *    "if (0 && ...)") are folded into a single value at startup;
+ *  - switch statements with enough cases get a lookup index, so the
+ *    matching case is found without comparing against each case in turn.
+ *
+ * The optimized tree is evaluated by the regular interpreter and keeps the
+ * same semantics (fall-through, case-insensitive string cases, default).
+ */
+
+#ifndef _ROUTE_OPTIMIZE_H
+#define _ROUTE_OPTIMIZE_H
+
+#include "route_struct.h"
+
+/* switch statements with fewer cases are simply scanned */
+#define SWITCH_IDX_MIN_CASES  4
+
+struct switch_idx_num {
+	long n;
+	int pos;
+	struct action *a;
+};
+
+struct switch_idx_str {
+	str s;
+	int pos;
+	struct action *a;
+};
+
+/* lookup index of a SWITCH_T, stored as its SWITCH_IDX_ST element; it is
+ * allocated as a single pkg chunk */
+struct switch_idx {
+	int nums_no;
+	struct switch_idx_num *nums;   /* sorted by value */
+	unsigned int strs_size;        /* power of 2, 0 if no string cases */
+	struct switch_idx_str *strs;   /* open addressing, case-insensitive */
+	struct action *deflt;
+};
+
+extern int script_optimize;
+
+/* optimizes all the routing tables; must be called after fix_rls()
+ * \return 0 if ok, <0 on error */
+int optimize_rls(void);
+
+/* optimizes the given action list, in place */
+int optimize_actions(struct action *a);
+
+/* optimizes the given expression, in place */
+void optimize_expr(struct expr *e);
+
+/* builds the lookup index for the cases of a switch statement;
+ * returns NULL if there are too few cases or on error */
+struct switch_idx *build_switch_idx(struct action *cases);
+
+/* returns the first case (in script order) matching @val, or NULL */
+struct action *switch_idx_lookup(struct switch_idx *idx, pv_value_t *val);
+
+#endif /* _ROUTE_OPTIMIZE_H */
@@ -139,7 +139,7 @@ struct action* append_action(struct action* a, struct action* b)
 }
 
 
-static void free_expr( struct expr *e)
+void free_expr( struct expr *e)
 {
 	if (e==NULL)
 		return;
@@ -186,7 +186,7 @@ static void free_action_elem( action_elem_t *e )
 		free_expr( (struct expr*)e->u.data );
 	else if (e->type==ACTIONS_ST)
 		free_action_list( (struct action*)e->u.data );
-	else if (e->type==SCRIPTVAR_ST)
+	else if (e->type==SCRIPTVAR_ST || e->type==SWITCH_IDX_ST)
 		pkg_free(e->u.data);
 	else if (e->type==SCRIPTVAR_ELEM_ST)
 		pv_elem_free_all(e->u.data);
@@ -72,7 +72,7 @@ enum {  ASSERT_T, DROP_T, LOG_T, ERROR_T, ROUTE_T, EXEC_T,
 enum { NOSUBTYPE=0, STRING_ST, NET_ST, NUMBER_ST, IP_ST, RE_ST, PROXY_ST,
 		EXPR_ST, ACTIONS_ST, CMD_ST, ACMD_ST, MODFIXUP_ST,
 		STR_ST, SOCKID_ST, SOCKETINFO_ST, SCRIPTVAR_ST, NULLV_ST,
-		BLACKLIST_ST, SCRIPTVAR_ELEM_ST};
+		BLACKLIST_ST, SCRIPTVAR_ELEM_ST, SWITCH_IDX_ST};
 
 struct expr;
 #include "pvar.h"
@@ -136,6 +136,7 @@ struct action* mk_action(int type, int n, action_elem_t *elem,
 		int line, char *file);
 struct action* append_action(struct action* a, struct action* b);
 void free_action_list( struct action *a);
+void free_expr( struct expr *e);
 
 
 void print_action(struct action* a);
@@ -169,6 +169,11 @@ static struct socket_info* new_sock_info( struct socket_id *sid)
 		if (sid->auto_scaling_profile)
 			LM_WARN("auto-scaling for non UDP-based <%.*s> listener not "
 				"supported -> ignoring...\n", si->name.len, si->name.s);
+		if (si->flags & (SI_REUSE_PORT|SI_PIN_WORKERS)) {
+			LM_WARN("reuse_port/pin_workers for non UDP-based <%.*s> listener"
+				" not supported -> ignoring...\n", si->name.len, si->name.s);
+			si->flags &= ~(SI_REUSE_PORT|SI_PIN_WORKERS);
+		}
 	} else {
 		if (sid->workers)
 			si->workers = sid->workers;
@@ -190,6 +195,25 @@ static struct socket_info* new_sock_info( struct socket_id *sid)
 				auto_scaling_enabled = 1;
 			}
 		}
+		if ((si->flags & SI_REUSE_PORT) && si->proto==PROTO_SCTP) {
+			LM_WARN("reuse_port for SCTP <%.*s> listener not supported "
+				"-> ignoring...\n", si->name.len, si->name.s);
+			si->flags &= ~SI_REUSE_PORT;
+		}
+#ifndef SO_REUSEPORT
+		if (si->flags & SI_REUSE_PORT) {
+			LM_WARN("SO_REUSEPORT not supported by the OS, <%.*s> listener "
+				"will not be sharded\n", si->name.len, si->name.s);
+			si->flags &= ~SI_REUSE_PORT;
+		}
+#endif
+		/* the sharded sockets are statically bound to the workers, so
+		 * the workers cannot come and go */
+		if ((si->flags & SI_REUSE_PORT) && si->s_profile) {
+			LM_WARN("auto-scaling for sharded (reuse_port) <%.*s> listener "
+				"not supported -> ignoring...\n", si->name.len, si->name.s);
+			si->s_profile = NULL;
+		}
 	}
 	return si;
 error:
@@ -213,6 +237,7 @@ static void free_sock_info(struct socket_info* si)
 		if(si->adv_port_str.s) pkg_free(si->adv_port_str.s);
 		if(si->adv_sock_str.s) pkg_free(si->adv_sock_str.s);
 		if(si->tag_sock_str.s) pkg_free(si->tag_sock_str.s);
+		if(si->worker_sockets) pkg_free(si->worker_sockets);
 	}
 }
 
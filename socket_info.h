@@ -57,6 +57,9 @@ struct socket_info {
 	unsigned short adv_port;    /* optimization for grep_sock_info() */
 	unsigned short workers;
 	struct scaling_profile *s_profile;
+	/* sharded (reuse_port) listener - the socket of each UDP worker, opened
+	 * before the privileges are dropped; the first one is the shared socket */
+	int *worker_sockets;
 
 	/* these are IP-level local/remote ports used during the last write op via
 	 * this sock (or a connection belonging to this sock). These values are 
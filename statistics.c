@@ -55,6 +55,9 @@
 static stats_collector *collector = NULL;
 static int stats_ready;
 
+/* number of per-process slots of the STAT_PER_PROC statistics */
+static int stat_shards_no;
+
 static mi_response_t *mi_get_stats(const mi_params_t *params,
 								struct mi_handler *async_hdl);
 static mi_response_t *w_mi_list_stats(const mi_params_t *params,
@@ -333,6 +336,8 @@ void destroy_stats_collector(void)
 				stat = stat->hnext;
 				if ((tmp_stat->flags&STAT_IS_FUNC)==0 && tmp_stat->u.val && !(tmp_stat->flags&STAT_NOT_ALLOCATED))
 					shm_free(tmp_stat->u.val);
+				if (tmp_stat->shards)
+					shm_free(tmp_stat->shards);
 				if ( (tmp_stat->flags&STAT_SHM_NAME) && tmp_stat->name.s)
 					shm_free(tmp_stat->name.s);
 				if (!(tmp_stat->flags&STAT_NOT_ALLOCATED))
@@ -344,6 +349,8 @@ void destroy_stats_collector(void)
 				stat = stat->hnext;
 				if ((tmp_stat->flags&STAT_IS_FUNC)==0 && tmp_stat->u.val && !(tmp_stat->flags&STAT_NOT_ALLOCATED))
 					shm_free(tmp_stat->u.val);
+				if (tmp_stat->shards)
+					shm_free(tmp_stat->shards);
 				if ( (tmp_stat->flags&STAT_SHM_NAME) && tmp_stat->name.s)
 					shm_free(tmp_stat->name.s);
 				if (!(tmp_stat->flags&STAT_NOT_ALLOCATED))
@@ -377,6 +384,72 @@ int stats_are_ready(void)
 
 /********************* Create/Register STATS functions ***********************/
 
+static int alloc_stat_shards(stat_var *stat, int unsafe)
+{
+#ifndef NO_ATOMIC_OPS
+	unsigned long size = (unsigned long)stat_shards_no * STAT_SHARD_SIZE;
+
+	stat->shards = unsafe ? shm_malloc_unsafe(size) : shm_malloc(size);
+	if (!stat->shards) {
+		LM_ERR("no more shm memory\n");
+		return -1;
+	}
+	memset(stat->shards, 0, size);
+#endif
+
+	return 0;
+}
+
+int init_stat_shards(int procs)
+{
+	stat_var *stat;
+	int i;
+
+	stat_shards_no = procs;
+
+	for (i = 0; i < STATS_HASH_SIZE; i++) {
+		for (stat = collector->hstats[i]; stat; stat = stat->hnext)
+			if ((stat->flags&STAT_PER_PROC) && !stat->shards &&
+					alloc_stat_shards(stat, 0) != 0)
+				return -1;
+		for (stat = collector->dy_hstats[i]; stat; stat = stat->hnext)
+			if ((stat->flags&STAT_PER_PROC) && !stat->shards &&
+					alloc_stat_shards(stat, 0) != 0)
+				return -1;
+	}
+
+	return 0;
+}
+
+#ifndef NO_ATOMIC_OPS
+unsigned long get_stat_shards_val(stat_var *stat)
+{
+	unsigned int val;
+	int i;
+
+	val = stat->u.val->counter;
+	if (stat->shards)
+		for (i = 0; i < stat_shards_no; i++)
+			val += ((stat_val *)((char *)stat->shards +
+				i * STAT_SHARD_SIZE))->counter;
+
+	return val;
+}
+
+/* a concurrent update of a slot may be lost, just like with any counter
+ * being reset while updated */
+void reset_stat_shards(stat_var *stat)
+{
+	int i;
+
+	atomic_set(stat->u.val, 0);
+	if (stat->shards)
+		for (i = 0; i < stat_shards_no; i++)
+			atomic_set((stat_val *)((char *)stat->shards +
+				i * STAT_SHARD_SIZE), 0);
+}
+#endif
+
 /**
  * Note: certain statistics (e.g. shm statistics) require different handling,
  * hence the <unsafe> parameter
@@ -427,6 +500,15 @@ static int __register_stat(str *module, str *name, stat_var **pvar,
 		atomic_set(stat->u.val,0);
 #endif
 		*pvar = stat;
+
+		if ((flags&STAT_PER_PROC) && stat_shards_no &&
+				alloc_stat_shards(stat, unsafe) != 0) {
+			if (unsafe)
+				shm_free_unsafe(stat->u.val);
+			else
+				shm_free(stat->u.val);
+			goto error1;
+		}
 	} else {
 		stat->u.f = (stat_function)(pvar);
 	}
@@ -480,6 +562,8 @@ do_register:
 
 					if ((flags&STAT_IS_FUNC)==0)
 						shm_free_unsafe(stat->u.val);
+					if (stat->shards)
+						shm_free_unsafe(stat->shards);
 
 					shm_free_unsafe(stat);
 				
@@ -489,6 +573,8 @@ do_register:
 
 					if ((flags&STAT_IS_FUNC)==0)
 						shm_free(stat->u.val);
+					if (stat->shards)
+						shm_free(stat->shards);
 
 					shm_free(stat);
 				}
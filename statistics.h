@@ -48,6 +48,11 @@
 #define STAT_IS_FUNC   (1<<3)
 #define STAT_NOT_ALLOCATED  (1<<4)
 #define STAT_HIDDEN    (1<<5)
+/* each process counts in its own slot, the slots are summed up on read */
+#define STAT_PER_PROC  (1<<6)
+
+/* distance between the per-process slots of a STAT_PER_PROC statistic */
+#define STAT_SHARD_SIZE  64
 
 #ifdef NO_ATOMIC_OPS
 typedef unsigned int stat_val;
@@ -68,6 +73,7 @@ typedef struct stat_var_{
 		stat_val *val;
 		stat_function f;
 	}u;
+	void *shards;     /* STAT_PER_PROC only, one slot for each process */
 	struct stat_var_ *hnext;
 	struct stat_var_ *lnext;
 } stat_var;
@@ -139,6 +145,13 @@ module_stats *get_stat_module( str *module);
 
 unsigned int get_stat_val( stat_var *var );
 
+/* allocates the per-process slots of the STAT_PER_PROC statistics, once
+ * the number of processes is known */
+int init_stat_shards(int procs);
+
+unsigned long get_stat_shards_val( stat_var *var );
+void reset_stat_shards( stat_var *var );
+
 /*! \brief
  * Returns the statistic associated with 'numerical_code' and 'is_a_reply'.
  * Specifically:
@@ -169,6 +182,7 @@ extern gen_lock_t *stat_lock;
 	#define add_stat_module(_module) 0
 	#define get_stat_module(_module) 0
 	#define get_stat_val( _var ) 0
+	#define init_stat_shards( _procs ) 0
 	#define get_stat_var_from_num_code( _n_code, _in_code) NULL
 	#define register_udp_load_stat( _a, _b, _c) 0
 	#define register_tcp_load_stat( _a)     0
@@ -206,23 +220,37 @@ extern gen_lock_t *stat_lock;
 		#define get_stat_val( _var ) ((unsigned long)\
 			((_var)->flags&STAT_IS_FUNC)?(_var)->u.f((_var)->context):*((_var)->u.val))
 	#else
+		extern int process_no;
+
+		/* the counter to update: the slot of the current process for the
+		 * STAT_PER_PROC statistics (shared one until they are allocated) */
+		#define stat_val_of( _var) \
+			(((_var)->flags&STAT_PER_PROC && (_var)->shards) ? \
+				(stat_val *)((char *)(_var)->shards + \
+					process_no * STAT_SHARD_SIZE) : (_var)->u.val)
+
 		#define update_stat( _var, _n) \
 			do { \
 				if ( !((_var)->flags&STAT_IS_FUNC) ) {\
 					if ((long)(_n) >= 0L) \
-						atomic_add( _n, (_var)->u.val);\
+						atomic_add( _n, stat_val_of(_var));\
 					else \
-						atomic_sub( -(_n), (_var)->u.val);\
+						atomic_sub( -(_n), stat_val_of(_var));\
 				}\
 			}while(0)
 		#define reset_stat( _var) \
 			do { \
 				if ( ((_var)->flags&(STAT_NO_RESET|STAT_IS_FUNC))==0 ) {\
-					atomic_set( (_var)->u.val, 0);\
+					if ((_var)->flags&STAT_PER_PROC) \
+						reset_stat_shards(_var);\
+					else \
+						atomic_set( (_var)->u.val, 0);\
 				}\
 			}while(0)
 		#define get_stat_val( _var ) ((unsigned long)\
-			((_var)->flags&STAT_IS_FUNC)?(_var)->u.f((_var)->context):(_var)->u.val->counter)
+			((_var)->flags&STAT_IS_FUNC)?(_var)->u.f((_var)->context):\
+			((_var)->flags&STAT_PER_PROC)?get_stat_shards_val(_var):\
+			(_var)->u.val->counter)
 	#endif /* NO_ATOMIC_OPS */
 
 	#define if_update_stat(_c, _var, _n) \
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2021 OpenSIPS Solutions
+ *
+ * This file is part of opensips, a free SIP server.
+ *
+ * opensips is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version
+ *
+ * opensips is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <tap.h>
+
+#include "../str.h"
+#include "../ut.h"
+#include "../route.h"
+#include "../route_optimize.h"
+
+#include "test_route.h"
+
+#define SWITCH_CASES       64
+#define SWITCH_BENCH_LOOPS 100000
+
+/* the same matching rules as the SWITCH_T interpreter */
+static struct action *scan_cases(struct action *cases, pv_value_t *val)
+{
+	struct action *it;
+
+	for (it = cases; it; it = it->next) {
+		if ((unsigned char)it->type != CASE_T)
+			continue;
+
+		if (it->elem[0].type == STR_ST) {
+			if (val->flags & PV_VAL_STR
+					&& val->rs.len == it->elem[0].u.s.len
+					&& strncasecmp(val->rs.s, it->elem[0].u.s.s,
+						val->rs.len) == 0)
+				return it;
+		} else if (val->flags & PV_VAL_INT
+				&& val->ri == it->elem[0].u.number) {
+			return it;
+		}
+	}
+
+	return NULL;
+}
+
+static struct action *mk_case(int i)
+{
+	action_elem_t elems[2];
+	char *s;
+
+	memset(elems, 0, sizeof elems);
+	elems[1].type = ACTIONS_ST;
+
+	/* alternate numeric and string cases, with a few duplicates */
+	if (i % 2) {
+		s = pkg_malloc(16);
+		sprintf(s, "Case-%d", i % 50);
+		elems[0].type = STR_ST;
+		elems[0].u.data = s;
+	} else {
+		elems[0].type = NUMBER_ST;
+		elems[0].u.number = i % 50;
+	}
+
+	return mk_action(CASE_T, 2, elems, 0, "test");
+}
+
+static double bench_lookup(struct switch_idx *idx, struct action *cases,
+															pv_value_t *vals)
+{
+	struct timespec start, stop;
+	volatile void *r;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SWITCH_BENCH_LOOPS; i++)
+		for (j = 0; j < SWITCH_CASES; j++)
+			r = idx ? switch_idx_lookup(idx, &vals[j]) :
+				scan_cases(cases, &vals[j]);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	(void)r;
+
+	return ((stop.tv_sec - start.tv_sec) * 1e9 +
+		(stop.tv_nsec - start.tv_nsec)) / (SWITCH_BENCH_LOOPS * SWITCH_CASES);
+}
+
+static void test_switch_idx(void)
+{
+	action_elem_t elems[1];
+	struct action *cases = NULL, *deflt;
+	struct switch_idx *idx;
+	pv_value_t vals[SWITCH_CASES];
+	char bufs[SWITCH_CASES][16];
+	int i, bad;
+
+	for (i = 0; i < SWITCH_IDX_MIN_CASES - 1; i++)
+		cases = append_action(cases, mk_case(i));
+	ok(build_switch_idx(cases) == NULL, "switch-1");
+
+	for (; i < SWITCH_CASES; i++)
+		cases = append_action(cases, mk_case(i));
+
+	memset(elems, 0, sizeof elems);
+	elems[0].type = ACTIONS_ST;
+	deflt = mk_action(DEFAULT_T, 1, elems, 0, "test");
+	cases = append_action(cases, deflt);
+
+	idx = build_switch_idx(cases);
+	ok(idx != NULL && idx->deflt == deflt, "switch-2");
+	if (!idx)
+		return;
+
+	/* ints, strings (in any case) and values carrying both */
+	memset(vals, 0, sizeof vals);
+	for (i = 0; i < SWITCH_CASES; i++) {
+		sprintf(bufs[i], i % 3 ? "case-%d" : "CASE-%d", i);
+		vals[i].rs.s = bufs[i];
+		vals[i].rs.len = strlen(bufs[i]);
+		vals[i].ri = SWITCH_CASES - i;
+		vals[i].flags = i % 4 == 0 ? PV_VAL_STR :
+			(i % 4 == 1 ? PV_VAL_INT|PV_TYPE_INT :
+			PV_VAL_STR|PV_VAL_INT|PV_TYPE_INT);
+	}
+
+	for (bad = 0, i = 0; i < SWITCH_CASES; i++)
+		if (switch_idx_lookup(idx, &vals[i]) != scan_cases(cases, &vals[i]))
+			bad++;
+	ok(bad == 0, "switch-3");
+
+	vals[0].flags = PV_VAL_INT|PV_TYPE_INT;
+	vals[0].ri = -1;
+	ok(switch_idx_lookup(idx, &vals[0]) == NULL, "switch-4");
+	vals[0].flags = PV_VAL_STR;
+	vals[0].rs.len = 0;
+	ok(switch_idx_lookup(idx, &vals[0]) == NULL, "switch-5");
+	vals[0].rs.len = strlen(bufs[0]);
+	vals[0].flags = PV_VAL_STR;
+
+	diag("switch with %d cases: %.1f ns/lookup scanned, %.1f ns/lookup "
+		"indexed", SWITCH_CASES, bench_lookup(NULL, cases, vals),
+		bench_lookup(idx, cases, vals));
+
+	pkg_free(idx);
+	free_action_list(cases);
+}
+
+
+static struct expr *mk_num(int n)
+{
+	return mk_elem(VALUE_OP, NUMBERV_O, (void *)(long)n, 0, 0);
+}
+
+static struct expr *mk_op(int op, struct expr *l, struct expr *r)
+{
+	return mk_elem(op, EXPR_O, l, r ? EXPR_ST : 0, r);
+}
+
+/* (7 + 3 * 5) << 2 ^ ~1 - 100 / 7 % 4 */
+static struct expr *mk_arith(void)
+{
+	return mk_op(MINUS_OP,
+		mk_op(BXOR_OP,
+			mk_op(BLSHIFT_OP,
+				mk_op(PLUS_OP, mk_num(7), mk_op(MULT_OP, mk_num(3), mk_num(5))),
+				mk_num(2)),
+			mk_op(BNOT_OP, mk_num(1), NULL)),
+		mk_op(MODULO_OP, mk_op(DIV_OP, mk_num(100), mk_num(7)), mk_num(4)));
+}
+
+static struct expr *mk_bool(int v)
+{
+	return mk_elem(NO_OP, NUMBER_O, 0, NUMBER_ST, (void *)(long)v);
+}
+
+static void test_fold_exprs(void)
+{
+	struct expr *e, *ref;
+	pv_value_t v1, v2;
+	int r1, r2;
+
+	ref = mk_arith();
+	e = mk_arith();
+	optimize_expr(e);
+	ok(e->type == ELEM_T && e->left.type == NUMBERV_O, "fold-1");
+
+	r1 = eval_expr(ref, NULL, &v1);
+	r2 = eval_expr(e, NULL, &v2);
+	ok(r1 == r2 && (v2.flags & PV_VAL_INT) && v1.ri == v2.ri, "fold-2");
+	free_expr(ref);
+	free_expr(e);
+
+	/* division by 0 stays a runtime error */
+	e = mk_op(DIV_OP, mk_num(1), mk_num(0));
+	optimize_expr(e);
+	ok(e->left.type == EXPR_O, "fold-3");
+	free_expr(e);
+
+	e = mk_op(PLUS_OP, mk_elem(VALUE_OP, STRINGV_O, "sip:", 0, 0),
+		mk_elem(VALUE_OP, STRINGV_O, "alice", 0, 0));
+	optimize_expr(e);
+	ok(e->left.type == STRINGV_O && str_match(&e->left.v.s,
+		_str("sip:alice")), "fold-4");
+	pkg_free(e->left.v.s.s);
+	free_expr(e);
+
+	/* !(0 && <anything>) || <anything> */
+	e = mk_exp(OR_OP, mk_exp(NOT_OP,
+		mk_exp(EVAL_OP, mk_exp(AND_OP, mk_bool(0), mk_bool(1)), NULL), NULL),
+		mk_bool(0));
+	optimize_expr(e);
+	ok(e->type == ELEM_T && e->left.type == NUMBER_O && e->right.v.n == 1,
+		"fold-5");
+	free_expr(e);
+
+	/* a non-constant left side is always evaluated */
+	e = mk_exp(AND_OP, mk_op(PLUS_OP, mk_elem(VALUE_OP, STRINGV_O, "", 0, 0),
+		mk_num(1)), mk_bool(1));
+	optimize_expr(e);
+	ok(e->type == EXP_T && e->op == AND_OP, "fold-6");
+	free_expr(e);
+
+	/* 1 && X  ->  X */
+	e = mk_exp(AND_OP, mk_bool(1), mk_op(PLUS_OP, mk_num(2), mk_num(2)));
+	optimize_expr(e);
+	r1 = eval_expr(e, NULL, &v1);
+	ok(e->type == ELEM_T && e->left.type == NUMBERV_O && r1 == 1 &&
+		v1.ri == 4, "fold-7");
+	free_expr(e);
+}
+
+void test_route_optimize(void)
+{
+	test_fold_exprs();
+	test_switch_idx();
+}
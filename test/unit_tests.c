@@ -26,6 +26,9 @@
 #include "../lib/test/test_csv.h"
 #include "../parser/test/test_parser.h"
 #include "../mem/test/test_malloc.h"
+#include "../mem/test/test_msg_arena.h"
+#include "../mem/test/test_shm_cache.h"
+#include "test_route.h"
 
 #include "../lib/list.h"
 #include "../globals.h"
@@ -60,6 +63,9 @@ int run_unit_tests(void)
 		//test_malloc();
 		test_lib_csv();
 		test_parser();
+		test_msg_arena();
+		test_shm_cache();
+		test_route_optimize();
 
 	/* module tests */
 	} else {
@@ -72,6 +72,9 @@ static unsigned short timer_id=0;
 static int            timer_pipe[2];
 static struct scaling_profile *s_profile=NULL;
 
+/* list with the accounting of all the timer labels */
+static struct os_timer_stats *timer_stats_list = NULL;
+
 int timer_fd_out = -1 ;
 char *timer_auto_scaling_profile = NULL;
 int timer_workers_no = 1;
@@ -189,10 +192,64 @@ static inline struct os_timer* new_os_timer(char *label, unsigned short flags,
 	t->expires=*jiffies+interval;
 	t->trigger_time = 0;
 	t->time = 0;
+	t->stats = NULL;
 	return t;
 }
 
 
+static unsigned long get_timer_lateness(void *ctx)
+{
+	return ((struct os_timer_stats *)ctx)->lateness;
+}
+
+
+/* attaches to each timer the accounting of its label; the statistics
+ * are registered here, once all the timers are known */
+static int register_timer_stats(struct os_timer *tlist)
+{
+	struct os_timer_stats *ts;
+	struct os_timer *t;
+	str label;
+	char *name;
+
+	for ( t=tlist ; t ; t=t->next ) {
+		for ( ts=timer_stats_list ; ts ; ts=ts->next )
+			if (strcmp(ts->label, t->label)==0)
+				break;
+
+		if (ts==NULL) {
+			ts = shm_malloc(sizeof *ts);
+			if (ts==NULL) {
+				LM_ERR("no more shm mem\n");
+				return -1;
+			}
+			memset(ts, 0, sizeof *ts);
+			ts->label = t->label;
+
+			init_str(&label, t->label);
+			if ( (name=build_stat_name(&label, "lateness"))==NULL ||
+			register_stat2("timers", name, (stat_var**)get_timer_lateness,
+			STAT_IS_FUNC|STAT_NO_RESET|STAT_SHM_NAME, ts, 0)!=0 ||
+			(name=build_stat_name(&label, "overruns"))==NULL ||
+			register_stat2("timers", name, &ts->overruns,
+			STAT_SHM_NAME, NULL, 0)!=0) {
+				LM_ERR("failed to register the stats of timer <%s>\n",
+					t->label);
+				shm_free(ts);
+				return -1;
+			}
+
+			ts->next = timer_stats_list;
+			timer_stats_list = ts;
+		}
+
+		t->stats = ts;
+	}
+
+	return 0;
+}
+
+
 /*register a periodic timer;
  * ret: <0 on error
  * Hint: if you need it in a module, register it from mod_init or it
@@ -335,6 +392,8 @@ static inline void timer_ticker(struct os_timer *tlist)
 			continue;
 
 		if (t->trigger_time) {
+			if (t->stats)
+				update_stat( t->stats->overruns, 1);
 			LM_WARN("timer task <%s> already scheduled %lld ms ago"
 				" (now %lld ms), %s\n", t->label, ((utime_t)*ijiffies/1000) -
 				(utime_t)(t->trigger_time/1000), ((utime_t)*ijiffies/1000),
@@ -386,6 +445,8 @@ static inline void utimer_ticker(struct os_timer *utlist)
 			continue;
 
 		if (t->trigger_time) {
+			if (t->stats)
+				update_stat( t->stats->overruns, 1);
 			LM_WARN("utimer task <%s> already scheduled %lld ms ago"
 				" (now %lld ms), %s\n", t->label, ((utime_t)*ijiffies/1000) -
 				(utime_t)(t->trigger_time/1000), ((utime_t)*ijiffies/1000),
@@ -608,6 +669,12 @@ int start_timer_processes(void)
 {
 	int id;
 
+	if (register_timer_stats(timer_list)!=0 ||
+	register_timer_stats(utimer_list)!=0) {
+		LM_CRIT("cannot register the timer statistics\n");
+		goto error;
+	}
+
 	/*
 	 * A change of the way timers were run. In the pre-1.5 times,
 	 * all timer processes had their own jiffies and just the first
@@ -851,6 +918,9 @@ void handle_timer_job(void)
 		return;
 	}
 
+	if (t->stats)
+		t->stats->lateness = (*ijiffies - t->trigger_time) / 1000;
+
 	/* run the handler */
 	if (t->flags&TIMER_FLAG_IS_UTIMER) {
 
@@ -38,6 +38,8 @@
 #ifndef timer_h
 #define timer_h
 
+#include "statistics.h"
+
 typedef unsigned long long utime_t;
 typedef long long stime_t;
 
@@ -56,6 +58,17 @@ typedef void (utimer_function)(utime_t uticks, void* param);
 /* synchronize if drift is greater than internal timer tick */
 #define TIMER_MAX_DRIFT_TICKS ITIMER_TICK
 
+/* per label accounting of the timer jobs, exported in the "timers"
+ * statistics group as "<label>-lateness" and "<label>-overruns" */
+struct os_timer_stats {
+	char *label;
+	/* delay between the triggering and the execution of the last job, ms */
+	unsigned int lateness;
+	/* triggerings which found the previous job still pending or running */
+	stat_var *overruns;
+	struct os_timer_stats *next;
+};
+
 struct os_timer{
 	/* unique ID in the list of timer handlers - not really used */
 	unsigned short id;
@@ -78,6 +91,8 @@ struct os_timer{
 	utime_t trigger_time;
 	/* UTICKs or TICKs of the triggering */
 	utime_t time;
+	/* accounting shared by all the handlers with the same label */
+	struct os_timer_stats *stats;
 	/* next element in the timer list */
 	struct os_timer* next;
 };
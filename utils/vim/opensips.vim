@@ -36,6 +36,7 @@ syn keyword osGlobalParam dns_retr_time dns_retr_no dns_servers_no maxbuffer
 syn keyword osGlobalParam dns_use_search_list shm_hash_split_percentage
 syn keyword osGlobalParam shm_secondary_hash_size mem_warming mem_warming_enabled
 syn keyword osGlobalParam mem_warming_pattern_file mem_warming_percentage
+syn keyword osGlobalParam shm_cache_size shm_cache_batch
 syn keyword osGlobalParam mem_log mem_dump execmsgthreshold execdnsthreshold
 syn keyword osGlobalParam dns_use_search_list shm_hash_split_percentage
 syn keyword osGlobalParam tcp_threshold tcpthreshold event_shm_threshold
@@ -49,6 +50,7 @@ syn keyword osGlobalParam open_files_limit mcast_loopback mcast_ttl tos
 syn keyword osGlobalParam max_while_loops disable_stateless_fwd db_default_url
 syn keyword osGlobalParam disable_503_translation import_file server_header
 syn keyword osGlobalParam tcp_max_msg_time abort_on_assert anycast
+syn keyword osGlobalParam reuse_port pin_workers
 
 " String constants
 syn match	osSpecial	contained 	display "\\\(x\x\+\|\o\{1,3}\|.\|$\)"